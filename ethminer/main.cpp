@@ -19,6 +19,7 @@
 
 #include <ethminer/buildinfo.h>
 #include <condition_variable>
+#include <fstream>
 
 #ifndef ENABLE_VIRTUAL_TERMINAL_PROCESSING
 #define ENABLE_VIRTUAL_TERMINAL_PROCESSING 0x0004
@@ -35,6 +36,7 @@
 #include <libethash-cpu/CPUMiner.h>
 #endif
 #include <libpoolprotocols/PoolManager.h>
+#include <libpoolprotocols/stratum/StratumParser.h>
 
 #if API_CORE
 #include <libapicore/ApiServer.h>
@@ -107,8 +109,10 @@ public:
     {
         if (!ec && g_running)
         {
-            string logLine =
-                PoolManager::p().isConnected() ? Farm::f().Telemetry().str() : "Not connected";
+            string logLine = "Not connected";
+            if (PoolManager::p().isConnected())
+                logLine = PoolManager::p().isProxy() ? PoolManager::p().getProxyStatus() :
+                                                       Farm::f().Telemetry().str();
             minelog << logLine;
 
 #if ETH_DBUS
@@ -252,6 +256,8 @@ public:
 
         app.add_option("--farm-recheck", m_PoolSettings.getWorkPollInterval, "", true)->check(CLI::Range(1, 99999));
 
+        app.add_option("--getwork-push", m_PoolSettings.getWorkPush, "", true);
+
         app.add_option("--farm-retries", m_PoolSettings.connectionMaxRetries, "", true)->check(CLI::Range(0, 99999));
 
         app.add_option("--retry-delay", m_PoolSettings.delayBeforeRetry, "", true)
@@ -278,12 +284,35 @@ public:
         app.add_option("--failover-timeout", m_PoolSettings.poolFailoverTimeout, "", true)
             ->check(CLI::Range(0, 999));
 
+        app.add_option("--failover-standby", m_PoolSettings.standbyConnections, "", true)
+            ->check(CLI::Range(0, 8));
+
+        app.add_option("--pool-split", m_PoolSettings.poolWeights, "")
+            ->check(CLI::Range(1, 1000));
+
+        app.add_option("--proxy-port", m_PoolSettings.proxyPort, "", true)
+            ->check(CLI::Range(1, 65535));
+
+        app.add_option("--proxy-address", m_PoolSettings.proxyAddress, "", true)
+            ->check([](const string& _addr) -> string {
+                boost::system::error_code ec;
+                boost::asio::ip::address::from_string(_addr, ec);
+                if (ec)
+                    throw CLI::ValidationError("--proxy-address", "Invalid Ip Address");
+                return string("");
+            });
+
+        app.add_option("--proxy-batch", m_PoolSettings.proxyBatchWindow, "", true)
+            ->check(CLI::Range(0, 1000));
+
         app.add_flag("--nocolor", g_logNoColor, "");
 
         app.add_flag("--syslog", g_logSyslog, "");
 
         app.add_flag("--stdout", g_logStdout, "");
 
+        app.add_option("--log-file", g_logFile, "");
+
 #if API_CORE
 
         app.add_option("--api-bind", m_api_bind, "", true)
@@ -305,6 +334,12 @@ public:
 
         app.add_option("--api-password", m_api_password, "");
 
+        app.add_option("--api-max-connections", m_api_max_connections, "", true)
+            ->check(CLI::Range(0, 1024));
+
+        app.add_option("--api-idle-timeout", m_api_idle_timeout, "", true)
+            ->check(CLI::Range(0, 86400));
+
 #endif
 
 #if ETH_ETHASHCL || ETH_ETHASHCUDA || ETH_ETHASH_CPU
@@ -350,10 +385,30 @@ public:
 
         app.add_option("--cpu-devices,--cp-devices", m_CPSettings.devices, "");
 
+        app.add_set("--cpu-kernel,--cp-kernel", m_CPSettings.kernel,
+            {"auto", "scalar", "avx2", "avx512"}, "", true);
+
+        m_CPSettings.dagDir = DagStore::defaultDir();
+        app.add_option("--cpu-dag-dir,--cp-dag-dir", m_CPSettings.dagDir, "", true);
+
+        app.add_option("--cpu-dag-threads,--cp-dag-threads", m_CPSettings.dagThreads, "", true)
+            ->check(CLI::Range(0, 1024));
+
+        app.add_set("--cpu-hugepages,--cp-hugepages", m_CPSettings.hugePages,
+            {"none", "thp", "2mb", "1gb"}, "", true);
+
+        app.add_flag("--cpu-numa,--cp-numa", m_CPSettings.numa, "");
+
 #endif
 
         app.add_flag("--noeval", m_FarmSettings.noEval, "");
 
+        app.add_option("--eval-threads", m_FarmSettings.evalThreads, "", true)
+            ->check(CLI::Range(1, 64));
+
+        app.add_option("--eval-cache", m_FarmSettings.evalCache, "", true)
+            ->check(CLI::Range(1, 65536));
+
         app.add_option("-L,--dag-load-mode", m_FarmSettings.dagLoadMode, "", true)->check(CLI::Range(1));
 
         bool cl_miner = false;
@@ -366,7 +421,33 @@ public:
 #if ETH_ETHASHCPU
         app.add_flag("--cpu", cpu_miner, "");
 #endif
-        auto sim_opt = app.add_option("-Z,--simulation,-M,--benchmark", m_PoolSettings.benchmarkBlock, "", true);
+        auto sim_opt = app.add_option("-Z,--simulation,-M,--benchmark", m_PoolSettings.simulation.block, "", true);
+
+        app.add_option("--sim-job-interval", m_PoolSettings.simulation.jobInterval, "", true)
+            ->check(CLI::Range(0, 3600000));
+
+        app.add_option("--sim-job-burst", m_PoolSettings.simulation.jobBurst, "", true)
+            ->check(CLI::Range(1, 100));
+
+        app.add_option("--sim-share-rate", m_PoolSettings.simulation.shareRate, "", true)
+            ->check(CLI::Range(0.0, 1000.0));
+
+        app.add_option("--sim-epoch-interval", m_PoolSettings.simulation.epochInterval, "", true)
+            ->check(CLI::Range(0, 86400));
+
+        app.add_option("--sim-duration", m_PoolSettings.simulation.duration, "", true)
+            ->check(CLI::Range(0, 864000));
+
+        app.add_option("--sim-report", m_PoolSettings.simulation.reportFile, "", true);
+
+        app.add_option("--bench-stratum", m_benchStratum, "", true);
+
+        app.add_option("--record", m_PoolSettings.recordFile, "", true);
+
+        auto replay_opt = app.add_option("--replay", m_PoolSettings.replayFile, "", true);
+
+        app.add_option("--replay-speed", m_PoolSettings.replaySpeed, "", true)
+            ->check(CLI::Range(0.0, 1000.0));
 
         app.add_option("--tstop", m_FarmSettings.tempStop, "", true)->check(CLI::Range(30, 100));
         app.add_option("--tstart", m_FarmSettings.tempStart, "", true)->check(CLI::Range(30, 100));
@@ -423,15 +504,27 @@ public:
         {
             m_mode = OperationMode::Simulation;
             pools.clear();
+
+            // One simulated pool for each share of a split
+            size_t count = std::max<size_t>(m_PoolSettings.poolWeights.size(), 1);
+            for (size_t i = 0; i < count; i++)
+                m_PoolSettings.connections.push_back(
+                    std::shared_ptr<URI>(new URI("simulation://localhost:0", true)));
+        }
+        else if (replay_opt->count())
+        {
+            // A replay is a simulation fed with recorded traffic
+            m_mode = OperationMode::Simulation;
+            pools.clear();
             m_PoolSettings.connections.push_back(
-                std::shared_ptr<URI>(new URI("simulation://localhost:0", true)));
+                std::shared_ptr<URI>(new URI("replay://localhost:0", true)));
         }
         else
         {
             m_mode = OperationMode::Mining;
         }
 
-        if (!m_shouldListDevices && m_mode != OperationMode::Simulation)
+        if (!m_shouldListDevices && m_mode != OperationMode::Simulation && m_benchStratum.empty())
         {
             if (!pools.size())
                 throw std::invalid_argument(
@@ -507,6 +600,23 @@ public:
 
     void execute()
     {
+        // Parsing benchmark needs no device
+        if (!m_benchStratum.empty())
+        {
+            ifstream traffic(m_benchStratum);
+            if (!traffic)
+                throw std::invalid_argument("Can't read " + m_benchStratum);
+            StratumParser::benchmark(traffic, cout);
+            return;
+        }
+
+        // A proxy serves its work to other instances and mines nothing itself
+        if (m_PoolSettings.proxyPort && !m_shouldListDevices)
+        {
+            run();
+            return;
+        }
+
 #if ETH_ETHASHCL
         if (m_minerType == MinerType::CL || m_minerType == MinerType::Mixed)
             CLMiner::enumDevices(m_DevicesCollection);
@@ -741,21 +851,7 @@ public:
         if (!subscribedDevices)
             throw std::runtime_error("No mining device selected. Aborting ...");
 
-        // Enable
-        g_running = true;
-
-        // Signal traps
-#if defined(__linux__) || defined(__APPLE__)
-        signal(SIGSEGV, MinerCLI::signalHandler);
-#endif
-        signal(SIGINT, MinerCLI::signalHandler);
-        signal(SIGTERM, MinerCLI::signalHandler);
-
-        // Initialize Farm
-        new Farm(m_DevicesCollection, m_FarmSettings, m_CUSettings, m_CLSettings, m_CPSettings);
-
-        // Run Miner
-        doMiner();
+        run();
     }
 
     void help()
@@ -846,6 +942,47 @@ public:
                  << "    -Z,--simulation     UINT [0 ..] Default not set" << endl
                  << "                        Mining test. Used to test hashing speed." << endl
                  << "                        Specify the block number to test on." << endl
+                 << endl
+                 << "    The following options turn the benchmark or simulation into a load" << endl
+                 << "    test. At the end of the run results are printed in json: job switch" << endl
+                 << "    latencies, share verification time, stale rate, effective hashrate" << endl
+                 << endl
+                 << "    --sim-job-interval  UINT [0 .. 3600000] Default = 0" << endl
+                 << "                        Milliseconds between new jobs. 0 sends a single job" << endl
+                 << "    --sim-job-burst     UINT [1 .. 100] Default = 1" << endl
+                 << "                        Jobs sent back to back each time, as when a pool" << endl
+                 << "                        sends several notifications at once" << endl
+                 << "    --sim-share-rate    FLOAT [0 .. 1000] Default = 0" << endl
+                 << "                        Shares per second difficulty is set for, from the" << endl
+                 << "                        measured hashrate. 0 keeps difficulty 1" << endl
+                 << "    --sim-epoch-interval UINT [0 .. 86400] Default = 0" << endl
+                 << "                        Seconds between forced epoch switches. 0 = never" << endl
+                 << "    --sim-duration      UINT [0 .. 864000] Default = 0" << endl
+                 << "                        Seconds the run lasts. 0 runs till stopped" << endl
+                 << "    --sim-report        FILE Default not set" << endl
+                 << "                        Where to write the json results instead of" << endl
+                 << "                        standard output" << endl
+                 << endl
+                 << "    --bench-stratum     FILE Default not set" << endl
+                 << "                        Stratum test. Measures framing and parsing of" << endl
+                 << "                        recorded pool traffic: one json message per line" << endl
+                 << "                        (lines logged with -v 1 are fine)." << endl
+                 << "                        Session recordings are accepted too." << endl
+                 << endl
+                 << "    --record            FILE Default not set" << endl
+                 << "                        Record every line exchanged with pools, with" << endl
+                 << "                        monotonic timestamps, to be played back later" << endl
+                 << "                        with --replay" << endl
+                 << endl
+                 << "    --replay            FILE Default not set" << endl
+                 << "                        Mining test. Play back a recording made with" << endl
+                 << "                        --record through the stratum or getwork client" << endl
+                 << "                        it was made with. Submissions are accepted." << endl
+                 << "                        Prints job and solution latencies at the end" << endl
+                 << endl
+                 << "    --replay-speed      FLOAT [0 .. 1000] Default = 1" << endl
+                 << "                        Speed factor of the replay. 0 plays the lines" << endl
+                 << "                        as fast as the client takes them" << endl
                  << endl;
         }
 
@@ -879,6 +1016,20 @@ public:
                  << "                        Be advised passwords are sent unencrypted over "
                     "plain "
                     "TCP!!"
+                 << endl
+                 << "    --api-max-connections INT [0 .. 1024] Default = 32" << endl
+                 << "                        Set the number of connections the API server "
+                    "keeps open"
+                 << endl
+                 << "                        at once. Further ones are closed right away. 0 = "
+                    "unlimited"
+                 << endl
+                 << "    --api-idle-timeout  INT [0 .. 86400] Default = 300" << endl
+                 << "                        Set the seconds after which an idle API connection "
+                    "is closed."
+                 << endl
+                 << "                        Subscribers receive telemetry, so they're not idle. "
+                    "0 = never"
                  << endl;
         }
 
@@ -965,6 +1116,37 @@ public:
                  << "                        Space separated list of device indexes to use" << endl
                  << "                        eg --cp-devices 0 2 3" << endl
                  << "                        If not set all available CPUs will be used" << endl
+                 << "    --cp-kernel         TEXT Default = 'auto'" << endl
+                 << "                        Set the search kernel. Can be one of" << endl
+                 << "                        'auto'   Widest kernel supported by the CPU" << endl
+                 << "                        'scalar' One nonce at a time (ethash::search)" << endl
+                 << "                        'avx2'   4 nonces at a time" << endl
+                 << "                        'avx512' 8 nonces at a time" << endl
+                 << "                        Unsupported kernels fall back to 'auto'" << endl
+                 << "    --cp-dag-dir        TEXT Default = '~/.ethminer/dag'" << endl
+                 << "                        Directory where generated DAGs are stored as" << endl
+                 << "                        <epoch>.bin and memory mapped from. Reused across"
+                 << endl
+                 << "                        restarts and ethminer instances, the next epoch is"
+                 << endl
+                 << "                        generated in background. Set to '' to keep DAGs"
+                 << endl
+                 << "                        in memory only" << endl
+                 << "    --cp-dag-threads    UINT [0 .. 1024] Default = 0" << endl
+                 << "                        Number of threads generating the DAG" << endl
+                 << "                        0 uses one thread per logical CPU" << endl
+                 << "    --cp-hugepages      TEXT Default = 'none'" << endl
+                 << "                        Back the DAG with huge pages. Can be one of" << endl
+                 << "                        'none' Regular pages" << endl
+                 << "                        'thp'  Transparent huge pages" << endl
+                 << "                        '2mb'  Reserved 2MB pages (vm.nr_hugepages)" << endl
+                 << "                        '1gb'  Reserved 1GB pages" << endl
+                 << "                        Falls back to 'thp' when no page is reserved." << endl
+                 << "                        DAGs mapped from --cp-dag-dir are copied to" << endl
+                 << "                        anonymous memory for this. Linux only" << endl
+                 << "    --cp-numa           FLAG" << endl
+                 << "                        Keep a copy of the DAG on each NUMA node, used" << endl
+                 << "                        by the CPUs of that node. Linux only" << endl
                  << endl;
         }
 
@@ -982,6 +1164,17 @@ public:
                  << endl
                  << "                        Value expressed in milliseconds" << endl
                  << "                        It has no meaning in stratum mode" << endl
+                 << "                        Polls are up to 4 times less frequent till a new"
+                 << endl
+                 << "                        block is due" << endl
+                 << "    --getwork-push      URL Default not set" << endl
+                 << "                        Where the getwork node tells about new work" << endl
+                 << "                        ws://host:port subscribes to new block headers" << endl
+                 << "                        http://host:port/path keeps a long poll pending" << endl
+                 << "                        Long polls are also used when the node announces"
+                 << endl
+                 << "                        them with a X-Long-Polling header" << endl
+                 << "                        Polling goes on as a safety net" << endl
                  << "    --farm-retries      INT[1 .. 99999] Default = 3" << endl
                  << "                        Set number of reconnection retries to same pool"
                  << endl
@@ -993,6 +1186,20 @@ public:
                  << "                        reconnect to the primary (the first) connection."
                  << endl
                  << "                        before switching to a fail-over connection" << endl
+                 << "    --failover-standby  INT[0 .. 8] Default = 0" << endl
+                 << "                        Number of fail-over connections kept connected," << endl
+                 << "                        subscribed and authorized in standby. When the" << endl
+                 << "                        active connection drops the first ready one" << endl
+                 << "                        takes over at once with its latest job" << endl
+                 << "                        Only stratum connections are kept in standby" << endl
+                 << "    --pool-split        INT[1 .. 1000] ... Default not set" << endl
+                 << "                        Mines the first connections at once, each for" << endl
+                 << "                        its share of the hashrate. One weight per pool" << endl
+                 << "                        e.g. --pool-split 3 1 gives 3/4 of the hashrate" << endl
+                 << "                        to the first pool and 1/4 to the second." << endl
+                 << "                        Further connections are fail-overs of the first" << endl
+                 << "                        Up to 8 pools. Devices are split among pools;" << endl
+                 << "                        a device alone takes turns between them" << endl
                  << "    --work-timeout      INT[180 .. 99999] Default = 180" << endl
                  << "                        If no new work received from pool after this" << endl
                  << "                        amount of time the connection is dropped" << endl
@@ -1025,11 +1232,20 @@ public:
                  << endl
                  << "                        channel prefix)" << endl
                  << "    --stdout            FLAG Log to stdout instead of stderr" << endl
+                 << "    --log-file          FILE Also append log lines (monochrome) to FILE" << endl
                  << "    --noeval            FLAG By-pass host software re-evaluation of GPUs"
                  << endl
                  << "                        found nonces. Trims some ms. from submission" << endl
                  << "                        time but it may increase rejected solution rate."
                  << endl
+                 << "    --eval-threads      UINT [1 .. 64] Default = 2" << endl
+                 << "                        Number of threads re-evaluating found nonces." << endl
+                 << "                        Bursts of solutions are verified in parallel" << endl
+                 << "    --eval-cache        UINT [1 .. 65536] Default = 256" << endl
+                 << "                        Memory (MB) for the epoch contexts used to verify" << endl
+                 << "                        nonces. Keeps pools switching between epochs from" << endl
+                 << "                        rebuilding light caches. The latest one is always" << endl
+                 << "                        kept" << endl
                  << "    --list-devices      FLAG Lists the detected OpenCL/CUDA devices and "
                     "exits"
                  << endl
@@ -1204,11 +1420,45 @@ public:
                  << endl
                  << "        tls12       Encrypted tcp connection with TLS 1.2" << endl
                  << "        ssl         Encrypted tcp connection with TLS 1.2" << endl
+                 << endl
+                 << "    Proxy mode :" << endl
+                 << endl
+                 << "    One instance keeps the pool connection (with its fail-overs) and" << endl
+                 << "    serves the work to other ethminer instances, which connect to it" << endl
+                 << "    with -P stratum2+tcp://worker@host:port. Each of them gets its own" << endl
+                 << "    share of the nonce space. The proxy mines nothing itself." << endl
+                 << endl
+                 << "    --proxy-port        UINT [1 .. 65535] Default not set" << endl
+                 << "                        Run as a stratum proxy listening on this port" << endl
+                 << "    --proxy-address     TEXT Default 0.0.0.0" << endl
+                 << "                        Address the proxy listens on" << endl
+                 << "    --proxy-batch       UINT [0 .. 1000] Default 20" << endl
+                 << "                        Milliseconds the shares of all miners are" << endl
+                 << "                        collected to be submitted to the pool at once" << endl
                  << endl;
         }
     }
 
 private:
+    void run()
+    {
+        // Enable
+        g_running = true;
+
+        // Signal traps
+#if defined(__linux__) || defined(__APPLE__)
+        signal(SIGSEGV, MinerCLI::signalHandler);
+#endif
+        signal(SIGINT, MinerCLI::signalHandler);
+        signal(SIGTERM, MinerCLI::signalHandler);
+
+        // Initialize Farm
+        new Farm(m_DevicesCollection, m_FarmSettings, m_CUSettings, m_CLSettings, m_CPSettings);
+
+        // Run Miner
+        doMiner();
+    }
+
     void doMiner()
     {
 
@@ -1219,7 +1469,8 @@ private:
 
 #if API_CORE
 
-        ApiServer api(m_api_address, m_api_port, m_api_password);
+        ApiServer api(m_api_address, m_api_port, m_api_password, m_api_max_connections,
+            m_api_idle_timeout);
         if (m_api_port)
             api.start();
 
@@ -1265,6 +1516,7 @@ private:
     MinerType m_minerType = MinerType::Mixed;
     OperationMode m_mode = OperationMode::None;
     bool m_shouldListDevices = false;
+    std::string m_benchStratum;  // Recorded pool traffic to benchmark stratum parsing on
 
     FarmSettings m_FarmSettings;  // Operating settings for Farm
     PoolSettings m_PoolSettings;  // Operating settings for PoolManager
@@ -1289,6 +1541,8 @@ private:
     string m_api_address = "0.0.0.0";   // API interface binding address (Default any)
     int m_api_port = 0;                 // API interface binding port
     string m_api_password;              // API interface write protection password
+    unsigned m_api_max_connections = 32;  // API connections open at once (0 = unlimited)
+    unsigned m_api_idle_timeout = 300;    // Seconds before an idle API connection is closed
 #endif
 
 #if ETH_DBUS
@@ -1369,6 +1623,7 @@ int main(int argc, char** argv)
 #endif
 
             cli.execute();
+            flushLog();
             cout << endl << endl;
             return 0;
         }
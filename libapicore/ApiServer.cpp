@@ -1,5 +1,10 @@
 #include "ApiServer.h"
 
+#include <openssl/sha.h>
+#include <zlib.h>
+
+#include <boost/algorithm/string.hpp>
+
 #include <ethminer/buildinfo.h>
 
 #include <libethcore/Farm.h>
@@ -15,6 +20,167 @@
 #define HTTP_ROW1_COLOR "#ffffff"
 #define HTTP_ROWRED_COLOR "#f46542"
 
+namespace
+{
+const size_t c_maxPending = 256 * 1024;  // Bytes queued to a client over which nothing more is
+const size_t c_eventBatch = 64;          // Events read from the feed at once
+const size_t c_maxHeaders = 16 * 1024;   // Larger HTTP request headers are refused
+const size_t c_maxBody = 64 * 1024;      // Larger HTTP request bodies are refused
+const size_t c_maxMessage = 64 * 1024;   // Larger Json or WebSocket messages are refused
+const size_t c_gzipMin = 1024;           // Smaller HTTP responses are not worth compressing
+const unsigned c_sweepInterval = 5;      // Seconds between checks of idle connections
+const char* c_wsGuid = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+uint64_t unixMs()
+{
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    return uint64_t(std::chrono::duration_cast<std::chrono::milliseconds>(now).count());
+}
+
+/*
+Parses the HTTP request at _offset of _data. Lines may end with CRLF or LF.
+Returns its length, headers and body, or 0 if it was not all received yet.
+An invalid request gets _request.status set and takes all the data, the
+connection being closed once it's answered
+*/
+size_t parseHttpRequest(std::string const& _data, size_t _offset, HttpRequest& _request)
+{
+    auto fail = [&](unsigned _status, const char* _error) {
+        _request.status = _status;
+        _request.error = _error;
+        _request.keepAlive = false;
+        return _data.size() - _offset;
+    };
+
+    // Empty lines before a request are ignored
+    size_t pos = _data.find_first_not_of("\r\n", _offset);
+    bool first = true;
+    for (;;)
+    {
+        size_t eol = (pos == std::string::npos ? pos : _data.find('\n', pos));
+        if (eol == std::string::npos)
+        {
+            if (_data.size() - _offset > c_maxHeaders)
+                return fail(431, "431 Request Header Fields Too Large");
+            return 0;
+        }
+        size_t end = (eol > pos && _data[eol - 1] == '\r' ? eol - 1 : eol);
+        std::string line = _data.substr(pos, end - pos);
+        pos = eol + 1;
+
+        if (first)
+        {
+            // Request line: method, target and version
+            first = false;
+            size_t sp1 = line.find(' ');
+            size_t sp2 = (sp1 == std::string::npos ? sp1 : line.find(' ', sp1 + 1));
+            if (sp2 == std::string::npos || line.find(' ', sp2 + 1) != std::string::npos)
+                return fail(400, "400 Bad Request");
+            _request.method = line.substr(0, sp1);
+            std::string target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+            std::string version = line.substr(sp2 + 1);
+            if (_request.method.empty() || _request.method.size() > 16 ||
+                _request.method.find_first_not_of("ABCDEFGHIJKLMNOPQRSTUVWXYZ") !=
+                    std::string::npos ||
+                target.empty() || target[0] != '/')
+                return fail(400, "400 Bad Request");
+            if (version != "HTTP/1.0" && version != "HTTP/1.1")
+                return fail(505, "505 HTTP Version Not Supported");
+            _request.version = version;
+            _request.path = target.substr(0, target.find('?'));
+            continue;
+        }
+
+        if (line.empty())
+            break;  // End of headers
+
+        size_t colon = line.find(':');
+        if (colon == std::string::npos || colon == 0 || line[0] == ' ' || line[0] == '\t')
+            return fail(400, "400 Bad Request");
+        std::string name = boost::to_lower_copy(line.substr(0, colon));
+        std::string value = boost::trim_copy(line.substr(colon + 1));
+        auto it = _request.headers.find(name);
+        if (it == _request.headers.end())
+            _request.headers[name] = value;
+        else
+            it->second += ", " + value;
+    }
+
+    // Requests are not expected to have a body, but pipelined ones must be told apart
+    size_t length = 0;
+    if (_request.headers.count("transfer-encoding"))
+        return fail(501, "501 Not Implemented");
+    auto it = _request.headers.find("content-length");
+    if (it != _request.headers.end())
+    {
+        if (it->second.empty() || it->second.size() > 9 ||
+            it->second.find_first_not_of("0123456789") != std::string::npos)
+            return fail(400, "400 Bad Request");
+        length = std::stoul(it->second);
+        if (length > c_maxBody)
+            return fail(413, "413 Payload Too Large");
+    }
+    if (_data.size() - pos < length)
+        return 0;
+
+    it = _request.headers.find("connection");
+    std::string connection = (it == _request.headers.end() ? "" : it->second);
+    _request.keepAlive = (_request.version == "HTTP/1.1" ?
+                              !boost::icontains(connection, "close") :
+                              boost::icontains(connection, "keep-alive"));
+    return pos + length - _offset;
+}
+
+// Compresses in gzip format. Empty if it failed
+std::string gzip(std::string const& _data)
+{
+    z_stream zs = {};
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) !=
+        Z_OK)
+        return "";
+    std::string out(deflateBound(&zs, uLong(_data.size())), '\0');
+    zs.next_in = (Bytef*)_data.data();
+    zs.avail_in = uInt(_data.size());
+    zs.next_out = (Bytef*)&out[0];
+    zs.avail_out = uInt(out.size());
+    int ret = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return (ret == Z_STREAM_END ? out : "");
+}
+
+// JSON Merge Patch (RFC 7386) turning _from into _to
+Json::Value jsonDelta(Json::Value const& _from, Json::Value const& _to)
+{
+    Json::Value delta = Json::Value(Json::objectValue);
+    for (auto const& name : _from.getMemberNames())
+        if (!_to.isMember(name))
+            delta[name] = Json::Value::null;
+    for (auto const& name : _to.getMemberNames())
+    {
+        Json::Value const& to = _to[name];
+        if (!_from.isMember(name))
+        {
+            delta[name] = to;
+            continue;
+        }
+        Json::Value const& from = _from[name];
+        if (from.isObject() && to.isObject())
+        {
+            Json::Value changes = jsonDelta(from, to);
+            if (!changes.empty())
+                delta[name] = changes;
+        }
+        else if (from != to)
+        {
+            delta[name] = to;
+        }
+    }
+    return delta;
+}
+
+}  // namespace
+
 
 /* helper functions getting values from a JSON request */
 static bool getRequestValue(const char* membername, bool& refValue, Json::Value& jRequest,
@@ -222,11 +388,15 @@ static bool parseRequestId(Json::Value& jRequest, Json::Value& jResponse)
     return false;
 }
 
-ApiServer::ApiServer(string address, int portnum, string password)
+ApiServer::ApiServer(string address, int portnum, string password, unsigned maxConnections,
+    unsigned idleTimeout)
   : m_password(std::move(password)),
     m_address(address),
     m_acceptor(g_io_service),
-    m_io_strand(g_io_service)
+    m_io_strand(g_io_service),
+    m_maxConnections(maxConnections),
+    m_idleTimeout(idleTimeout),
+    m_sweepTimer(g_io_service)
 {
     if (portnum < 0)
     {
@@ -269,6 +439,19 @@ void ApiServer::start()
     cnote << "Api server listening on port " + to_string(m_acceptor.local_endpoint().port())
           << (m_password.empty() ? "." : ". Authentication needed.");
     m_running.store(true, std::memory_order_relaxed);
+
+    // Posted at most once at a time, whatever the rate of events
+    EventFeed::onPublished([this]() {
+        if (!m_pushPending.exchange(true, std::memory_order_relaxed))
+            g_io_service.post(m_io_strand.wrap(boost::bind(&ApiServer::pushEvents, this)));
+    });
+
+    if (m_idleTimeout)
+    {
+        m_sweepTimer.expires_from_now(boost::posix_time::seconds(c_sweepInterval));
+        m_sweepTimer.async_wait(m_io_strand.wrap(
+            boost::bind(&ApiServer::sweep, this, boost::asio::placeholders::error)));
+    }
     m_workThread = std::thread{boost::bind(&ApiServer::begin_accept, this)};
 }
 
@@ -278,6 +461,8 @@ void ApiServer::stop()
     if (!m_running.load(std::memory_order_relaxed))
         return;
 
+    EventFeed::onPublished(nullptr);
+    m_sweepTimer.cancel();
     m_acceptor.cancel();
     m_acceptor.close();
     m_workThread.join();
@@ -292,8 +477,8 @@ void ApiServer::begin_accept()
     if (!isRunning())
         return;
 
-    auto session =
-        std::make_shared<ApiConnection>(m_io_strand, ++lastSessionId, m_readonly, m_password);
+    auto session = std::make_shared<ApiConnection>(
+        m_io_strand, ++lastSessionId, m_readonly, m_password, m_cache);
     m_acceptor.async_accept(
         session->socket(), m_io_strand.wrap(boost::bind(&ApiServer::handle_accept, this, session,
                                boost::asio::placeholders::error)));
@@ -303,7 +488,16 @@ void ApiServer::handle_accept(std::shared_ptr<ApiConnection> session, boost::sys
 {
     // Start new connection
     // cnote << "ApiServer::handle_accept";
-    if (!ec)
+    if (!ec && m_maxConnections && m_sessions.size() >= m_maxConnections)
+    {
+        // Closed at once rather than left waiting
+        if (!(m_refused++ % 100))
+            cwarn << "API : Refused connection as " << m_maxConnections
+                  << " are open already. Refused so far: " << m_refused;
+        boost::system::error_code ignored;
+        session->socket().close(ignored);
+    }
+    else if (!ec)
     {
         session->onDisconnected([&](int id) {
             // Destroy pointer to session
@@ -330,9 +524,40 @@ void ApiServer::handle_accept(std::shared_ptr<ApiConnection> session, boost::sys
     begin_accept();
 }
 
+void ApiServer::sweep(const boost::system::error_code& ec)
+{
+    if (ec || !isRunning())
+        return;
+
+    auto now = std::chrono::steady_clock::now();
+    auto sessions = m_sessions;
+    for (auto const& session : sessions)
+        if (now - session->lastActivity() >= std::chrono::seconds(m_idleTimeout))
+            session->disconnect();
+
+    m_sweepTimer.expires_from_now(boost::posix_time::seconds(c_sweepInterval));
+    m_sweepTimer.async_wait(
+        m_io_strand.wrap(boost::bind(&ApiServer::sweep, this, boost::asio::placeholders::error)));
+}
+
+void ApiServer::pushEvents()
+{
+    m_pushPending.store(false, std::memory_order_relaxed);
+
+    // A session may go away meanwhile
+    auto sessions = m_sessions;
+    for (auto const& session : sessions)
+        session->pushEvents();
+}
+
 void ApiConnection::disconnect()
 {
     // cnote << "ApiConnection::disconnect";
+    // Handlers of pending operations end up here too
+    if (m_disconnected)
+        return;
+    m_disconnected = true;
+    unsubscribe();
 
     // Cancel pending operations
     m_socket.cancel();
@@ -350,22 +575,29 @@ void ApiConnection::disconnect()
     }
 }
 
-ApiConnection::ApiConnection(
-    boost::asio::io_service::strand& _strand, int id, bool readonly, string password)
+ApiConnection::ApiConnection(boost::asio::io_service::strand& _strand, int id, bool readonly,
+    string password, ApiCache& _cache)
   : m_sessionId(id),
     m_socket(g_io_service),
     m_io_strand(_strand),
     m_readonly(readonly),
-    m_password(std::move(password))
+    m_password(std::move(password)),
+    m_cache(_cache)
 {
     m_jSwBuilder.settings_["indentation"] = "";
     if (!m_password.empty())
         m_is_authenticated = false;
 }
 
+ApiConnection::~ApiConnection()
+{
+    unsubscribe();
+}
+
 void ApiConnection::start()
 {
     // cnote << "ApiConnection::start";
+    m_lastActivity = std::chrono::steady_clock::now();
     recvSocketData();
 }
 
@@ -449,12 +681,63 @@ void ApiConnection::processRequest(Json::Value& jRequest, Json::Value& jResponse
     cnote << "API : Method " << _method << " requested";
     if (_method == "miner_getstat1")
     {
-        jResponse["result"] = getMinerStat1();
+        m_cachedResult = getCached(ApiCache::Stat1);
     }
 
     else if (_method == "miner_getstatdetail")
     {
-        jResponse["result"] = getMinerStatDetail();
+        m_cachedResult = getCached(ApiCache::StatDetail);
+    }
+
+    else if (_method == "miner_getlatency")
+    {
+        jResponse["result"] = getLatency();
+    }
+
+    else if (_method == "miner_subscribe")
+    {
+        Json::Value jRequestParams;
+        if (!getRequestValue("params", jRequestParams, jRequest, true, jResponse))
+            return;
+
+        unsigned events = (1u << unsigned(EventType::Max)) - 1;
+        if (jRequestParams.isMember("events"))
+        {
+            if (!jRequestParams["events"].isArray())
+            {
+                jResponse["error"]["code"] = -32602;
+                jResponse["error"]["message"] = "Invalid type of value 'events'";
+                return;
+            }
+            events = 0;
+            for (auto const& jEvent : jRequestParams["events"])
+            {
+                unsigned i = 0;
+                while (i < unsigned(EventType::Max) &&
+                       jEvent.asString() != EventFeed::name(EventType(i)))
+                    i++;
+                if (i == unsigned(EventType::Max))
+                {
+                    jResponse["error"]["code"] = -422;
+                    jResponse["error"]["message"] = "Unknown event " + jEvent.asString();
+                    return;
+                }
+                events |= 1u << i;
+            }
+        }
+
+        subscribe(events);
+        jResponse["result"]["seq"] = Json::UInt64(m_eventCursor);
+        jResponse["result"]["events"] = Json::Value(Json::arrayValue);
+        for (unsigned i = 0; i < unsigned(EventType::Max); i++)
+            if (events & (1u << i))
+                jResponse["result"]["events"].append(EventFeed::name(EventType(i)));
+    }
+
+    else if (_method == "miner_unsubscribe")
+    {
+        unsubscribe();
+        jResponse["result"] = true;
     }
 
     else if (_method == "miner_shuffle")
@@ -479,8 +762,20 @@ void ApiConnection::processRequest(Json::Value& jRequest, Json::Value& jResponse
         // to prevent locking
         if (!checkApiWriteAccess(m_readonly, jResponse))
             return;
+
+        // Optionally keep devices and their DAGs
+        bool warm = false;
+        Json::Value jRequestParams;
+        if (jRequest.isMember("params"))
+        {
+            if (!getRequestValue("params", jRequestParams, jRequest, false, jResponse))
+                return;
+            if (!getRequestValue("warm", warm, jRequestParams, true, jResponse))
+                return;
+        }
+
         jResponse["result"] = true;
-        Farm::f().restart_async();
+        Farm::f().restart_async(warm);
     }
 
     else if (_method == "miner_reboot")
@@ -748,221 +1043,710 @@ void ApiConnection::processRequest(Json::Value& jRequest, Json::Value& jResponse
 
 void ApiConnection::recvSocketData()
 {
+    if (m_reading || !m_socket.is_open() || m_closeWhenSent)
+        return;
+    m_reading = true;
     boost::asio::async_read(m_socket, m_recvBuffer, boost::asio::transfer_at_least(1),
-        m_io_strand.wrap(boost::bind(&ApiConnection::onRecvSocketDataCompleted, this,
+        m_io_strand.wrap(boost::bind(&ApiConnection::onRecvSocketDataCompleted, shared_from_this(),
             boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred)));
 }
 
 void ApiConnection::onRecvSocketDataCompleted(
     const boost::system::error_code& ec, std::size_t bytes_transferred)
 {
-    /*
-    Standard http request detection pattern
-    1st group : any UPPERCASE word
-    2nd group : the path
-    3rd group : HTTP version
-    */
-    static std::regex http_pattern("^([A-Z]{1,6}) (\\/[\\S]*) (HTTP\\/1\\.[0-9]{1})");
-    std::smatch http_matches;
-
-    if (!ec && bytes_transferred > 0)
-    {
-        // Extract received message and free the buffer
-        std::string rx_message(
-            boost::asio::buffer_cast<const char*>(m_recvBuffer.data()), bytes_transferred);
-        m_recvBuffer.consume(bytes_transferred);
-        m_message.append(rx_message);
-
-        std::string line;
-        std::string linedelimiter;
-        std::size_t linedelimiteroffset;
-
-        if (m_message.size() < 4)
-            return;  // Wait for other data to come in
-
-        if (std::regex_search(
-                m_message, http_matches, http_pattern, std::regex_constants::match_default))
+    m_reading = false;
+    if (ec || !bytes_transferred)
+    {
+        disconnect();
+        return;
+    }
+
+    // Extract received message and free the buffer
+    m_lastActivity = std::chrono::steady_clock::now();
+    m_message.append(
+        boost::asio::buffer_cast<const char*>(m_recvBuffer.data()), bytes_transferred);
+    m_recvBuffer.consume(bytes_transferred);
+    processReceived();
+}
+
+/**
+ * @brief Processes the requests received as long as the client takes the responses,
+ * then reads more
+ */
+void ApiConnection::processReceived()
+{
+    if (m_protocol == Protocol::Unknown)
+    {
+        // Json requests are objects, HTTP ones start with the method
+        size_t first = m_message.find_first_not_of(" \t\r\n");
+        if (first == std::string::npos)
         {
-            // We got an HTTP request
-            std::string http_method = http_matches[1].str();
-            std::string http_path = http_matches[2].str();
-            std::string http_ver = http_matches[3].str();
+            m_message.clear();
+            recvSocketData();
+            return;
+        }
+        m_protocol = (std::isupper((unsigned char)m_message[first]) ? Protocol::Http :
+                                                                      Protocol::JsonRpc);
+    }
 
-            // Do we support method ?
-            if (http_method != "GET")
-            {
-                std::string what = "Method " + http_method + " not allowed";
-                std::stringstream ss;
-                ss << http_ver << " "
-                   << "405 Method not allowed\r\n"
-                   << "Server: " << ethminer_get_buildinfo()->project_name_with_version << "\r\n"
-                   << "Content-Type: text/plain\r\n"
-                   << "Content-Length: " << what.size() << "\r\n\r\n"
-                   << what << "\r\n";
-                sendSocketData(ss.str(), true);
-                m_message.clear();
-                return;
-            }
+    switch (m_protocol)
+    {
+    case Protocol::Http:
+        processHttp();
+        break;
+    case Protocol::WebSocket:
+        processFrames();
+        break;
+    default:
+        processLines();
+        break;
+    }
+}
 
-            // Do we support path ?
-            if (http_path != "/" && http_path != "/getstat1")
-            {
-                std::string what =
-                    "The requested resource " + http_path + " not found on this server";
-                std::stringstream ss;
-                ss << http_ver << " "
-                   << "404 Not Found\r\n"
-                   << "Server: " << ethminer_get_buildinfo()->project_name_with_version << "\r\n"
-                   << "Content-Type: text/plain\r\n"
-                   << "Content-Length: " << what.size() << "\r\n\r\n"
-                   << what << "\r\n";
-                sendSocketData(ss.str(), true);
-                m_message.clear();
-                return;
-            }
+void ApiConnection::processLines()
+{
+    // Process each line in the transmission
+    size_t offset = 0;
+    size_t eol;
+    while (!backlogged() && (eol = m_message.find('\n', offset)) != std::string::npos)
+    {
+        std::string line = m_message.substr(offset, eol - offset);
+        offset = eol + 1;
+        boost::trim(line);
+        if (!line.empty())
+            processMessage(line);
+    }
+    m_message.erase(0, offset);
+
+    if (m_message.size() > c_maxMessage)
+    {
+        cwarn << "API : Got a request too large";
+        disconnect();
+        return;
+    }
+    if (!backlogged())
+        recvSocketData();
+}
+
+void ApiConnection::processHttp()
+{
+    // Requests may be pipelined: each is answered in turn
+    size_t offset = 0;
+    while (!m_closeWhenSent && !backlogged())
+    {
+        HttpRequest request;
+        size_t length = parseHttpRequest(m_message, offset, request);
+        if (!length)
+            break;
+        offset += length;
+
+        if (request.status)
+        {
+            sendHttpResponse(request, request.error.c_str(), "text/plain", request.error);
+            break;
+        }
+        serveHttp(request);
+        if (m_protocol == Protocol::WebSocket)
+        {
+            // Frames may follow right away
+            m_message.erase(0, offset);
+            processFrames();
+            return;
+        }
+    }
+    m_message.erase(0, offset);
+
+    if (!backlogged())
+        recvSocketData();
+}
+
+void ApiConnection::serveHttp(HttpRequest const& _request)
+{
+    auto header = _request.headers.find("upgrade");
+    if (header != _request.headers.end() && boost::iequals(header->second, "websocket"))
+    {
+        header = _request.headers.find("sec-websocket-key");
+        if (_request.method != "GET" || _request.path != "/" || header == _request.headers.end())
+        {
+            HttpRequest failed = _request;
+            failed.keepAlive = false;
+            sendHttpResponse(failed, "400 Bad Request", "text/plain",
+                "Upgrades to WebSocket are served on GET / only");
+            return;
+        }
 
-            //// Get all the lines - we actually don't care much
-            //// until we support other http methods or paths
-            //// Keep this for future use (if any)
-            //// Remember to #include <boost/algorithm/string.hpp>
-            // std::vector<std::string> lines;
-            // boost::split(lines, m_message, [](char _c) { return _c == '\n'; });
+        unsigned char digest[SHA_DIGEST_LENGTH];
+        std::string key = header->second + c_wsGuid;
+        SHA1((const unsigned char*)key.data(), key.size(), digest);
+        std::stringstream ss;
+        ss << _request.version << " "
+           << "101 Switching Protocols\r\n"
+           << "Server: " << ethminer_get_buildinfo()->project_name_with_version << "\r\n"
+           << "Upgrade: websocket\r\n"
+           << "Connection: Upgrade\r\n"
+           << "Sec-WebSocket-Accept: " << toBase64(digest, sizeof(digest)) << "\r\n\r\n";
+        sendSocketData(ss.str());
+        m_protocol = Protocol::WebSocket;
+        return;
+    }
 
-            std::stringstream ss;  // Builder of the response
+    // Do we support method ?
+    if (_request.method != "GET" && _request.method != "HEAD")
+    {
+        sendHttpResponse(_request, "405 Method Not Allowed", "text/plain",
+            "Method " + _request.method + " not allowed", "Allow: GET, HEAD\r\n");
+        return;
+    }
+
+    // Do we support path ?
+    ApiCache::Body body;
+    const char* contentType;
+    if (_request.path == "/metrics")
+    {
+        body = ApiCache::Metrics;
+        contentType = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+    }
+    else if (_request.path == "/" || _request.path == "/getstat1")
+    {
+        body = ApiCache::Html;
+        contentType = "text/html; charset=utf-8";
+    }
+    else
+    {
+        sendHttpResponse(_request, "404 Not Found", "text/plain",
+            "The requested resource " + _request.path + " not found on this server");
+        return;
+    }
 
-            if (http_method == "GET" && (http_path == "/" || http_path == "/getstat1"))
+    try
+    {
+        auto content = getCached(body);
+        std::string headers;
+        header = _request.headers.find("accept-encoding");
+        if (content->size() >= c_gzipMin && header != _request.headers.end() &&
+            boost::icontains(header->second, "gzip"))
+        {
+            auto gzipped = getCachedGzip(body);
+            if (!gzipped->empty())
             {
-                try
-                {
-                    std::string body = getHttpMinerStatDetail();
-                    ss.clear();
-                    ss << http_ver << " "
-                       << "200 Ok Error\r\n"
-                       << "Server: " << ethminer_get_buildinfo()->project_name_with_version
-                       << "\r\n"
-                       << "Content-Type: text/html; charset=utf-8\r\n"
-                       << "Content-Length: " << body.size() << "\r\n\r\n"
-                       << body << "\r\n";
-                }
-                catch (const std::exception& _ex)
-                {
-                    std::string what = "Internal error : " + std::string(_ex.what());
-                    ss.clear();
-                    ss << http_ver << " "
-                       << "500 Internal Server Error\r\n"
-                       << "Server: " << ethminer_get_buildinfo()->project_name_with_version
-                       << "\r\n"
-                       << "Content-Type: text/plain\r\n"
-                       << "Content-Length: " << what.size() << "\r\n\r\n"
-                       << what << "\r\n";
-                }
+                content = gzipped;
+                headers = "Content-Encoding: gzip\r\n";
             }
+        }
+        sendHttpResponse(
+            _request, "200 OK", contentType, *content, headers + "Vary: Accept-Encoding\r\n");
+    }
+    catch (const std::exception& _ex)
+    {
+        sendHttpResponse(_request, "500 Internal Server Error", "text/plain",
+            "Internal error : " + std::string(_ex.what()));
+    }
+}
 
-            sendSocketData(ss.str(), true);
-            m_message.clear();
+void ApiConnection::processMessage(std::string const& _message)
+{
+    // Test validity of chunk and process
+    Json::Value jMsg;
+    Json::Value jRes;
+    Json::Reader jRdr;
+    m_cachedResult.reset();
+    if (jRdr.parse(_message, jMsg))
+    {
+        try
+        {
+            // Run in sync so no 2 different async reads may overlap
+            processRequest(jMsg, jRes);
         }
-        else
+        catch (const std::exception& _ex)
         {
-            // We got a Json request
-            // Process each line in the transmission
-            linedelimiter = "\n";
+            m_cachedResult.reset();
+            jRes = Json::Value();
+            jRes["jsonrpc"] = "2.0";
+            jRes["id"] = Json::Value::null;
+            jRes["error"]["errorcode"] = "500";
+            jRes["error"]["message"] = _ex.what();
+        }
+    }
+    else
+    {
+        jRes = Json::Value();
+        jRes["jsonrpc"] = "2.0";
+        jRes["id"] = Json::Value::null;
+        jRes["error"]["errorcode"] = "-32700";
+        string what = jRdr.getFormattedErrorMessages();
+        boost::replace_all(what, "\n", " ");
+        cwarn << "API : Got invalid Json message " << what;
+        jRes["error"]["message"] = "Json parse error : " + what;
+    }
 
-            linedelimiteroffset = m_message.find(linedelimiter);
-            while (linedelimiteroffset != string::npos)
-            {
-                if (linedelimiteroffset > 0)
-                {
-                    line = m_message.substr(0, linedelimiteroffset);
-                    boost::trim(line);
-
-                    if (!line.empty())
-                    {
-                        // Test validity of chunk and process
-                        Json::Value jMsg;
-                        Json::Value jRes;
-                        Json::Reader jRdr;
-                        if (jRdr.parse(line, jMsg))
-                        {
-                            try
-                            {
-                                // Run in sync so no 2 different async reads may overlap
-                                processRequest(jMsg, jRes);
-                            }
-                            catch (const std::exception& _ex)
-                            {
-                                jRes = Json::Value();
-                                jRes["jsonrpc"] = "2.0";
-                                jRes["id"] = Json::Value::null;
-                                jRes["error"]["errorcode"] = "500";
-                                jRes["error"]["message"] = _ex.what();
-                            }
-                        }
-                        else
-                        {
-                            jRes = Json::Value();
-                            jRes["jsonrpc"] = "2.0";
-                            jRes["id"] = Json::Value::null;
-                            jRes["error"]["errorcode"] = "-32700";
-                            string what = jRdr.getFormattedErrorMessages();
-                            boost::replace_all(what, "\n", " ");
-                            cwarn << "API : Got invalid Json message " << what;
-                            jRes["error"]["message"] = "Json parse error : " + what;
-                        }
-
-                        // Send response to client
-                        sendSocketData(jRes);
-                    }
-                }
+    // Send response to client. A cached result is spliced in as
+    // is, with members in the order jsoncpp writes them
+    if (m_cachedResult)
+        sendMessage("{\"id\":" + Json::writeString(m_jSwBuilder, jRes["id"]) +
+                    ",\"jsonrpc\":\"2.0\",\"result\":" + *m_cachedResult + "}");
+    else
+        sendMessage(Json::writeString(m_jSwBuilder, jRes));
+    m_cachedResult.reset();
 
-                // Next line (if any)
-                m_message.erase(0, linedelimiteroffset + 1);
-                linedelimiteroffset = m_message.find(linedelimiter);
-            }
+    // A new subscription starts with telemetry
+    pushEvents();
+}
+
+void ApiConnection::processFrames()
+{
+    // Process all complete frames already received
+    WebSocketFrame frame;
+    while (!backlogged())
+    {
+        size_t size = decodeWebSocketFrame(
+            (const unsigned char*)m_message.data(), m_message.size(), frame);
 
-            // Eventually keep reading from socket
-            if (m_socket.is_open())
-                recvSocketData();
+        // Frames from clients are always masked
+        if (frame.length + m_wsMessage.size() > c_maxMessage ||
+            (m_message.size() >= 2 && !frame.masked))
+        {
+            cwarn << "API : Got invalid WebSocket frame";
+            disconnect();
+            return;
+        }
+        if (!size)
+            break;
+        m_message.erase(0, size);
+
+        std::string& payload = frame.payload;
+        switch (frame.opcode)
+        {
+        case 0x0:  // Continuation
+        case 0x1:  // Text
+        case 0x2:  // Binary
+            m_wsMessage += payload;
+            if (frame.fin)
+            {
+                std::string message;
+                message.swap(m_wsMessage);
+                boost::trim(message);
+                if (!message.empty())
+                    processMessage(message);
+            }
+            break;
+        case 0x8:  // Close
+            sendSocketData(encodeWebSocketFrame(0x8, payload.substr(0, 2)), true);
+            return;
+        case 0x9:  // Ping
+            sendSocketData(encodeWebSocketFrame(0xA, payload));
+            break;
+        default:  // Pong and anything else
+            break;
         }
     }
+
+    // Eventually keep reading from socket
+    if (!backlogged())
+        recvSocketData();
+}
+
+void ApiConnection::sendMessage(std::string const& _message)
+{
+    if (m_protocol == Protocol::WebSocket)
+        sendSocketData(encodeWebSocketFrame(0x1, _message));
     else
+        sendSocketData(_message + "\n");
+}
+
+void ApiConnection::sendHttpResponse(HttpRequest const& _request, const char* _status,
+    const char* _contentType, std::string const& _body, std::string const& _headers)
+{
+    std::stringstream ss;
+    ss << (_request.version.empty() ? "HTTP/1.1" : _request.version) << " " << _status << "\r\n"
+       << "Server: " << ethminer_get_buildinfo()->project_name_with_version << "\r\n"
+       << "Content-Type: " << _contentType << "\r\n"
+       << "Content-Length: " << _body.size() << "\r\n"
+       << _headers << "Connection: " << (_request.keepAlive ? "keep-alive" : "close")
+       << "\r\n\r\n";
+    if (_request.method != "HEAD")
+        ss << _body;
+    sendSocketData(ss.str(), !_request.keepAlive);
+}
+
+void ApiConnection::sendSocketData(std::string const& _s, bool _disconnect)
+{
+    if (!m_socket.is_open() || m_closeWhenSent)
+        return;
+    m_pending += _s;
+    if (_disconnect)
+        m_closeWhenSent = true;
+    if (!m_sending.empty())
+        return;  // Written once the write in progress completes
+
+    m_sending.swap(m_pending);
+    async_write(m_socket, boost::asio::buffer(m_sending),
+        m_io_strand.wrap(boost::bind(&ApiConnection::onSendSocketDataCompleted, shared_from_this(),
+            boost::asio::placeholders::error)));
+}
+
+void ApiConnection::onSendSocketDataCompleted(const boost::system::error_code& ec)
+{
+    m_sending.clear();
+    if (ec)
     {
         disconnect();
+        return;
+    }
+    m_lastActivity = std::chrono::steady_clock::now();
+
+    if (!m_pending.empty())
+    {
+        m_sending.swap(m_pending);
+        async_write(m_socket, boost::asio::buffer(m_sending),
+            m_io_strand.wrap(boost::bind(&ApiConnection::onSendSocketDataCompleted, shared_from_this(),
+                boost::asio::placeholders::error)));
+    }
+    else if (m_closeWhenSent)
+    {
+        disconnect();
+    }
+    else
+    {
+        // The client keeps up, there's room for more events and responses
+        pushEvents();
+        processReceived();
+    }
+}
+
+bool ApiConnection::backlogged() const
+{
+    return m_sending.size() + m_pending.size() >= c_maxPending;
+}
+
+void ApiConnection::subscribe(unsigned _events)
+{
+    if (!m_subscribed)
+    {
+        EventFeed::addReader();
+        m_subscribed = true;
+        m_eventCursor = EventFeed::head();
     }
+    m_events = _events;
+    m_telemetrySent = 0;  // Pushed in full first
 }
 
-void ApiConnection::sendSocketData(Json::Value const& jReq, bool _disconnect)
+void ApiConnection::unsubscribe()
 {
-    if (!m_socket.is_open())
+    if (!m_subscribed)
         return;
-    std::stringstream line;
-    line << Json::writeString(m_jSwBuilder, jReq) << std::endl;
-    sendSocketData(line.str(), _disconnect);
+    EventFeed::removeReader();
+    m_subscribed = false;
 }
 
-void ApiConnection::sendSocketData(std::string const& _s, bool _disconnect)
+void ApiConnection::pushEvents()
 {
-    if (!m_socket.is_open())
+    if (!m_subscribed || !m_socket.is_open() || m_closeWhenSent)
         return;
-    std::ostream os(&m_sendBuffer);
-    os << _s;
 
-    async_write(m_socket, m_sendBuffer,
-        m_io_strand.wrap(boost::bind(&ApiConnection::onSendSocketDataCompleted, this,
-            boost::asio::placeholders::error, _disconnect)));
+    // Events wait in the feed while the client is slow to take what was sent.
+    // It's told if it fell so far behind that some were dropped
+    std::vector<std::shared_ptr<const Event>> events;
+    while (m_sending.size() + m_pending.size() < c_maxPending)
+    {
+        if ((m_events & (1u << unsigned(EventType::Telemetry))) && !m_telemetrySent)
+            sendTelemetry(m_eventCursor, unixMs());
+
+        events.clear();
+        uint64_t dropped = EventFeed::read(m_eventCursor, events, c_eventBatch);
+        if (dropped)
+        {
+            sendEvent(m_eventCursor - events.size(), unixMs(), "lost",
+                "{\"events\":" + std::to_string(dropped) + "}");
+            m_telemetrySent = 0;
+        }
+        if (events.empty())
+            break;
+
+        for (auto const& event : events)
+        {
+            if (!(m_events & (1u << unsigned(event->type))))
+                continue;
+            if (event->type == EventType::Telemetry)
+                sendTelemetry(event->seq, event->time);
+            else
+                sendEvent(event->seq, event->time, EventFeed::name(event->type), event->data);
+        }
+    }
 }
 
-void ApiConnection::onSendSocketDataCompleted(const boost::system::error_code& ec, bool _disconnect)
+void ApiConnection::sendEvent(
+    uint64_t _seq, uint64_t _time, const char* _type, std::string const& _data)
 {
-    if (ec || _disconnect)
-        disconnect();
+    sendMessage("{\"jsonrpc\":\"2.0\",\"method\":\"miner_event\",\"params\":{\"data\":" +
+                _data + ",\"seq\":" + std::to_string(_seq) + ",\"time\":" +
+                std::to_string(_time) + ",\"type\":\"" + _type + "\"}}");
+}
+
+/**
+ * @brief Pushes the miner_getstatdetail result of the latest telemetry snapshot: only
+ * what changed if the client got the snapshot before, all of it otherwise
+ */
+void ApiConnection::sendTelemetry(uint64_t _seq, uint64_t _time)
+{
+    auto snapshot = Farm::f().telemetrySnapshot();
+    if (!snapshot->version || snapshot->version == m_telemetrySent)
+        return;
+
+    // Rendered once per snapshot for all subscribers
+    if (snapshot->version != m_cache.pushedVersion)
+    {
+        Json::Value detail = getMinerStatDetail(*snapshot);
+        Json::Value data;
+        data["version"] = Json::UInt64(snapshot->version);
+        m_cache.pushDelta.reset();
+        if (m_cache.pushedVersion)
+        {
+            data["since"] = Json::UInt64(m_cache.pushedVersion);
+            data["delta"] = jsonDelta(m_cache.pushedDetail, detail);
+            m_cache.pushDelta =
+                std::make_shared<const std::string>(Json::writeString(m_jSwBuilder, data));
+            data.removeMember("since");
+            data.removeMember("delta");
+        }
+        data["full"] = detail;
+        m_cache.pushFull =
+            std::make_shared<const std::string>(Json::writeString(m_jSwBuilder, data));
+        m_cache.deltaFrom = m_cache.pushedVersion;
+        m_cache.pushedVersion = snapshot->version;
+        m_cache.pushedDetail = std::move(detail);
+    }
+
+    bool delta = (m_cache.pushDelta && m_telemetrySent == m_cache.deltaFrom);
+    sendEvent(_seq, _time, EventFeed::name(EventType::Telemetry),
+        (delta ? *m_cache.pushDelta : *m_cache.pushFull));
+    m_telemetrySent = snapshot->version;
+}
+
+namespace
+{
+std::string metricLabel(std::string const& _value)
+{
+    std::string escaped;
+    for (char c : _value)
+    {
+        if (c == '\\' || c == '"')
+            escaped += '\\';
+        if (c == '\n')
+            escaped += "\\n";
+        else
+            escaped += c;
+    }
+    return escaped;
+}
+
+void metricFamily(std::ostream& _os, char const* _name, char const* _type, char const* _help)
+{
+    _os << "# TYPE " << _name << " " << _type << "\n"
+        << "# HELP " << _name << " " << _help << "\n";
+}
+
+std::string renderMetrics(TelemetrySnapshot const& _s)
+{
+    TelemetryType const& t = _s.telemetry;
+    std::ostringstream os;
+    os << std::setprecision(12);
+
+    metricFamily(os, "ethminer_build", "info", "Version of the miner");
+    os << "ethminer_build_info{version=\""
+       << metricLabel(ethminer_get_buildinfo()->project_name_with_version) << "\"} 1\n";
+    metricFamily(os, "ethminer_uptime_seconds", "gauge", "Time since mining started");
+    os << "ethminer_uptime_seconds "
+       << std::chrono::duration_cast<std::chrono::seconds>(_s.tstamp - t.start).count() << "\n";
+
+    /* Devices */
+    metricFamily(os, "ethminer_device", "info", "Mining devices");
+    for (unsigned i = 0; i < _s.descriptors.size(); i++)
+    {
+        DeviceDescriptor const& d = _s.descriptors[i];
+        os << "ethminer_device_info{device=\"" << i << "\",pci=\""
+           << metricLabel(d.uniqueId) << "\",name=\""
+           << metricLabel(d.clDetected ? d.clName : d.cuName) << "\",mode=\""
+           << (d.subscriptionType == DeviceSubscriptionTypeEnum::Cuda ? "CUDA" : "OpenCL")
+           << "\"} 1\n";
+    }
+    metricFamily(os, "ethminer_device_hashrate", "gauge", "Hashes per second of the device");
+    for (unsigned i = 0; i < t.miners.size(); i++)
+        os << "ethminer_device_hashrate{device=\"" << i << "\"} " << t.miners[i].hashrate << "\n";
+    metricFamily(os, "ethminer_device_paused", "gauge", "Whether the device is paused");
+    for (unsigned i = 0; i < t.miners.size(); i++)
+        os << "ethminer_device_paused{device=\"" << i << "\"} " << t.miners[i].paused << "\n";
+    metricFamily(os, "ethminer_device_solutions", "counter", "Solutions found by the device");
+    for (unsigned i = 0; i < t.miners.size(); i++)
+    {
+        SolutionAccountType const& s = t.miners[i].solutions;
+        os << "ethminer_device_solutions_total{device=\"" << i << "\",result=\"accepted\"} "
+           << s.accepted << "\n"
+           << "ethminer_device_solutions_total{device=\"" << i << "\",result=\"rejected\"} "
+           << s.rejected << "\n"
+           << "ethminer_device_solutions_total{device=\"" << i << "\",result=\"failed\"} "
+           << s.failed << "\n"
+           << "ethminer_device_solutions_total{device=\"" << i << "\",result=\"wasted\"} "
+           << s.wasted << "\n";
+    }
+    metricFamily(os, "ethminer_device_dag_generation_seconds", "gauge",
+        "Time the latest DAG generation of the device took");
+    for (unsigned i = 0; i < t.miners.size(); i++)
+        os << "ethminer_device_dag_generation_seconds{device=\"" << i << "\"} "
+           << t.miners[i].dagMs / 1000.0 << "\n";
+    if (t.hwmon)
+    {
+        metricFamily(os, "ethminer_device_temperature_celsius", "gauge", "Device temperature");
+        for (unsigned i = 0; i < t.miners.size(); i++)
+            os << "ethminer_device_temperature_celsius{device=\"" << i << "\"} "
+               << t.miners[i].sensors.tempC << "\n";
+        metricFamily(os, "ethminer_device_fan_ratio", "gauge", "Device fan speed");
+        for (unsigned i = 0; i < t.miners.size(); i++)
+            os << "ethminer_device_fan_ratio{device=\"" << i << "\"} "
+               << t.miners[i].sensors.fanP / 100.0 << "\n";
+        metricFamily(os, "ethminer_device_power_watts", "gauge", "Device power draw");
+        for (unsigned i = 0; i < t.miners.size(); i++)
+            os << "ethminer_device_power_watts{device=\"" << i << "\"} "
+               << t.miners[i].sensors.powerW << "\n";
+    }
+
+    /* Farm */
+    metricFamily(os, "ethminer_hashrate", "gauge", "Hashes per second of all devices");
+    os << "ethminer_hashrate " << t.farm.hashrate << "\n";
+    metricFamily(os, "ethminer_solutions", "counter", "Solutions found by all devices");
+    os << "ethminer_solutions_total{result=\"accepted\"} " << t.farm.solutions.accepted << "\n"
+       << "ethminer_solutions_total{result=\"rejected\"} " << t.farm.solutions.rejected << "\n"
+       << "ethminer_solutions_total{result=\"failed\"} " << t.farm.solutions.failed << "\n"
+       << "ethminer_solutions_total{result=\"wasted\"} " << t.farm.solutions.wasted << "\n";
+    metricFamily(os, "ethminer_dag_generating", "gauge", "Whether a DAG is being generated");
+    os << "ethminer_dag_generating{background=\"" << (t.dag.background ? "true" : "false")
+       << "\"} " << t.dag.generating << "\n";
+    metricFamily(os, "ethminer_dag_progress_ratio", "gauge", "Progress of the DAG generation");
+    os << "ethminer_dag_progress_ratio "
+       << (t.dag.itemsTotal ? double(t.dag.itemsDone) / t.dag.itemsTotal : 0.0) << "\n";
+    metricFamily(os, "ethminer_verifier_queued", "gauge", "Solutions waiting for verification");
+    os << "ethminer_verifier_queued " << t.verifier.queued << "\n";
+    metricFamily(os, "ethminer_verifier_solutions", "counter", "Solutions verified on host");
+    os << "ethminer_verifier_solutions_total{result=\"valid\"} " << t.verifier.verified << "\n"
+       << "ethminer_verifier_solutions_total{result=\"failed\"} " << t.verifier.failed << "\n";
+
+    /* Pool */
+    PoolManager& pm = PoolManager::p();
+    metricFamily(os, "ethminer_pool_connected", "gauge", "Whether the pool is connected");
+    os << "ethminer_pool_connected " << pm.isConnected() << "\n";
+    metricFamily(os, "ethminer_pool_switches", "counter", "Switches between pool connections");
+    os << "ethminer_pool_switches_total " << pm.getConnectionSwitches() << "\n";
+    metricFamily(os, "ethminer_epoch", "gauge", "Epoch of the current job");
+    os << "ethminer_epoch " << pm.getCurrentEpoch() << "\n";
+    metricFamily(os, "ethminer_epoch_changes", "counter", "Epoch changes");
+    os << "ethminer_epoch_changes_total " << pm.getEpochChanges() << "\n";
+    metricFamily(os, "ethminer_difficulty", "gauge", "Difficulty of the current job");
+    os << "ethminer_difficulty " << pm.getCurrentDifficulty() << "\n";
+
+    /* Latency (pool latency is the "acked" stage) */
+    metricFamily(os, "ethminer_latency_seconds", "summary",
+        "Latency of jobs on their way to the devices and of solutions back to the pool");
+    for (unsigned i = 0; i < unsigned(TraceStage::Max); i++)
+    {
+        TraceStage stage = TraceStage(i);
+        TraceStats stats = LatencyTrace::stats(stage);
+        std::string labels = std::string("flow=\"") +
+                             (stage < TraceStage::SolutionVerified ? "work" : "solutions") +
+                             "\",stage=\"" + LatencyTrace::name(stage) + "\"";
+        os << "ethminer_latency_seconds{" << labels << ",quantile=\"0.5\"} " << stats.p50 / 1e6
+           << "\n"
+           << "ethminer_latency_seconds{" << labels << ",quantile=\"0.99\"} " << stats.p99 / 1e6
+           << "\n"
+           << "ethminer_latency_seconds{" << labels << ",quantile=\"1\"} " << stats.max / 1e6
+           << "\n"
+           << "ethminer_latency_seconds_count{" << labels << "} " << stats.count << "\n";
+    }
+
+    metricFamily(os, "ethminer_log_dropped_lines", "counter", "Log lines dropped");
+    os << "ethminer_log_dropped_lines_total " << droppedLogLines() << "\n";
+
+    os << "# EOF\n";
+    return os.str();
+}
+
+}  // namespace
+
+/**
+ * @brief Returns a body rendered from the latest telemetry snapshot, rendering it
+ * only if no connection did since the snapshot was published
+ */
+std::shared_ptr<const std::string> ApiConnection::getCached(ApiCache::Body _body)
+{
+    auto snapshot = Farm::f().telemetrySnapshot();
+    if (snapshot != m_cache.snapshot)
+    {
+        m_cache.snapshot = snapshot;
+        for (auto& body : m_cache.bodies)
+            body.reset();
+        for (auto& body : m_cache.gzipped)
+            body.reset();
+    }
+
+    auto& body = m_cache.bodies[_body];
+    if (!body)
+    {
+        switch (_body)
+        {
+        case ApiCache::Stat1:
+            body = std::make_shared<const std::string>(
+                Json::writeString(m_jSwBuilder, getMinerStat1(*snapshot)));
+            break;
+        case ApiCache::StatDetail:
+            body = std::make_shared<const std::string>(
+                Json::writeString(m_jSwBuilder, getMinerStatDetail(*snapshot)));
+            break;
+        case ApiCache::Html:
+            body = std::make_shared<const std::string>(getHttpMinerStatDetail(*snapshot));
+            break;
+        default:
+            body = std::make_shared<const std::string>(renderMetrics(*snapshot));
+            break;
+        }
+    }
+    return body;
 }
 
-Json::Value ApiConnection::getMinerStat1()
+std::shared_ptr<const std::string> ApiConnection::getCachedGzip(ApiCache::Body _body)
+{
+    auto body = getCached(_body);
+    auto& gzipped = m_cache.gzipped[_body];
+    if (!gzipped)
+        gzipped = std::make_shared<const std::string>(gzip(*body));
+    return gzipped;
+}
+
+/**
+ * @brief Return latency percentiles of the stages jobs and solutions go through
+ * @return Json::Value
+ */
+Json::Value ApiConnection::getLatency()
+{
+    Json::Value jRes;
+    for (unsigned i = 0; i < unsigned(TraceStage::Max); i++)
+    {
+        TraceStage stage = TraceStage(i);
+        TraceStats stats = LatencyTrace::stats(stage);
+
+        Json::Value jStage;
+        jStage["count"] = Json::UInt64(stats.count);
+        jStage["p50"] = stats.p50;
+        jStage["p99"] = stats.p99;
+        jStage["max"] = stats.max;
+        const char* flow = (stage < TraceStage::SolutionVerified ? "work" : "solutions");
+        jRes[flow][LatencyTrace::name(stage)] = jStage;
+    }
+    return jRes;
+}
+
+Json::Value ApiConnection::getMinerStat1(TelemetrySnapshot const& _s)
 {
     auto connection = PoolManager::p().getActiveConnection();
-    TelemetryType t = Farm::f().Telemetry();
-    auto runningTime =
-        std::chrono::duration_cast<std::chrono::minutes>(steady_clock::now() - t.start);
+    TelemetryType const& t = _s.telemetry;
+    auto runningTime = std::chrono::duration_cast<std::chrono::minutes>(_s.tstamp - t.start);
 
 
     ostringstream totalMhEth;
@@ -1018,14 +1802,13 @@ Json::Value ApiConnection::getMinerStat1()
     return jRes;
 }
 
-Json::Value ApiConnection::getMinerStatDetailPerMiner(
-    const TelemetryType& _t, std::shared_ptr<Miner> _miner)
+Json::Value ApiConnection::getMinerStatDetailPerMiner(TelemetrySnapshot const& _s, unsigned _index)
 {
-    unsigned _index = _miner->Index();
-    std::chrono::steady_clock::time_point _now = std::chrono::steady_clock::now();
+    TelemetryType const& _t = _s.telemetry;
+    std::chrono::steady_clock::time_point _now = _s.tstamp;
 
     Json::Value jRes;
-    DeviceDescriptor minerDescriptor = _miner->getDescriptor();
+    DeviceDescriptor const& minerDescriptor = _s.descriptors.at(_index);
 
     jRes["_index"] = _index;
     jRes["_mode"] =
@@ -1066,14 +1849,16 @@ Json::Value ApiConnection::getMinerStatDetailPerMiner(
                                                              // share
 
     mininginfo["shares"] = jshares;
-    mininginfo["paused"] = _miner->paused();
-    mininginfo["pause_reason"] = _miner->paused() ? _miner->pausedString() : Json::Value::null;
+    std::string const& pauseReason = _s.pauseReasons.at(_index);
+    mininginfo["paused"] = !pauseReason.empty();
+    mininginfo["pause_reason"] = pauseReason.empty() ? Json::Value::null : pauseReason;
 
     /* Nonce infos */
-    auto segment_width = Farm::f().get_segment_width();
-    uint64_t gpustartnonce = Farm::f().get_nonce_scrambler() + ((uint64_t)_index << segment_width);
-    jsegment.append(toHex(uint64_t(gpustartnonce), HexPrefix::Add));
-    jsegment.append(toHex(uint64_t(gpustartnonce + (1LL << segment_width)), HexPrefix::Add));
+    NonceRange range;
+    if (_index < _s.coverage.lastTo.size())
+        range = _s.coverage.lastTo.at(_index);
+    jsegment.append(toHex(range.start, HexPrefix::Add));
+    jsegment.append(toHex(uint64_t(range.start + range.count), HexPrefix::Add));
     mininginfo["segment"] = jsegment;
 
     /* Hash & Share infos */
@@ -1085,9 +1870,9 @@ Json::Value ApiConnection::getMinerStatDetailPerMiner(
     return jRes;
 }
 
-std::string ApiConnection::getHttpMinerStatDetail()
+std::string ApiConnection::getHttpMinerStatDetail(TelemetrySnapshot const& _s)
 {
-    Json::Value jStat = getMinerStatDetail();
+    Json::Value jStat = getMinerStatDetail(_s);
     uint64_t durationSeconds = jStat["host"]["runtime"].asUInt64();
     int hours = (int)(durationSeconds / 3600);
     durationSeconds -= (hours * 3600);
@@ -1194,15 +1979,15 @@ std::string ApiConnection::getHttpMinerStatDetail()
  * Eg: Calculating runtime, (current) difficulty and submitted shares must not match the hashrate.
  * Inspired by Andrea Lanfranchi comment on issue 1232:
  *    https://github.com/ethereum-mining/ethminer/pull/1232#discussion_r193995891
+ * Times are as of the snapshot, not of the request
  * @return The json result
  */
-Json::Value ApiConnection::getMinerStatDetail()
+Json::Value ApiConnection::getMinerStatDetail(TelemetrySnapshot const& _s)
 {
-    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
-    TelemetryType t = Farm::f().Telemetry();
+    const std::chrono::steady_clock::time_point now = _s.tstamp;
+    TelemetryType const& t = _s.telemetry;
 
-    auto runningTime = std::chrono::duration_cast<std::chrono::seconds>(
-        std::chrono::steady_clock::now() - t.start);
+    auto runningTime = std::chrono::duration_cast<std::chrono::seconds>(now - t.start);
 
     // ostringstream version;
     Json::Value devices = Json::Value(Json::arrayValue);
@@ -1248,20 +2033,49 @@ Json::Value ApiConnection::getMinerStatDetail()
                                                                 // found share
     mininginfo["shares"] = sharesinfo;
 
+    Json::Value daginfo;
+    Json::Value dagitems = Json::Value(Json::arrayValue);
+    daginfo["generating"] = t.dag.generating;
+    daginfo["background"] = t.dag.background;
+    daginfo["epoch"] = t.dag.epoch;
+    dagitems.append(t.dag.itemsDone);
+    dagitems.append(t.dag.itemsTotal);
+    daginfo["items"] = dagitems;
+    daginfo["eta"] = t.dag.eta;
+    mininginfo["dag"] = daginfo;
+
+    Json::Value verifierinfo;
+    Json::Value latencyinfo = Json::Value(Json::arrayValue);
+    verifierinfo["queued"] = t.verifier.queued;
+    verifierinfo["verified"] = Json::UInt64(t.verifier.verified);
+    verifierinfo["failed"] = Json::UInt64(t.verifier.failed);
+    verifierinfo["batch"] = t.verifier.lastBatch;
+    latencyinfo.append(t.verifier.latencyAvg);
+    latencyinfo.append(t.verifier.latencyMax);
+    verifierinfo["latency"] = latencyinfo;
+
+    Json::Value contextsinfo;
+    EpochContextCacheStats contexts = EthashAux::contextCacheStats();
+    contextsinfo["epochs"] = contexts.epochs;
+    contextsinfo["memory"] = Json::UInt64(contexts.memory);
+    contextsinfo["hits"] = Json::UInt64(contexts.hits);
+    contextsinfo["misses"] = Json::UInt64(contexts.misses);
+    verifierinfo["contexts"] = contextsinfo;
+    mininginfo["verifier"] = verifierinfo;
+
     /* Monitors Info */
     Json::Value monitorinfo;
-    auto tstop = Farm::f().get_tstop();
-    if (tstop)
+    if (_s.tstop)
     {
         Json::Value tempsinfo = Json::Value(Json::arrayValue);
-        tempsinfo.append(Farm::f().get_tstart());
-        tempsinfo.append(tstop);
+        tempsinfo.append(_s.tstart);
+        tempsinfo.append(_s.tstop);
         monitorinfo["temperatures"] = tempsinfo;
     }
 
     /* Devices related info */
-    for (shared_ptr<Miner> miner : Farm::f().getMiners())
-        devices.append(getMinerStatDetailPerMiner(t, miner));
+    for (unsigned i = 0; i < _s.descriptors.size(); i++)
+        devices.append(getMinerStatDetailPerMiner(_s, i));
 
     jRes["devices"] = devices;
 
@@ -1,6 +1,6 @@
 #pragma once
 
-#include <regex>
+#include <map>
 
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
@@ -8,6 +8,7 @@
 
 #include <json/json.h>
 
+#include <libethcore/EventFeed.h>
 #include <libethcore/Farm.h>
 #include <libethcore/Miner.h>
 #include <libpoolprotocols/PoolManager.h>
@@ -18,17 +19,62 @@ using namespace std::chrono;
 
 using boost::asio::ip::tcp;
 
-class ApiConnection
+/// What the API renders from telemetry, shared by all connections. Each body
+/// is rendered at most once per telemetry snapshot (see Farm::telemetrySnapshot)
+/// and sent as is until the next one. Only used on the API strand, thus not locked
+struct ApiCache
+{
+    enum Body
+    {
+        Stat1,       // miner_getstat1 result
+        StatDetail,  // miner_getstatdetail result
+        Html,        // Status page
+        Metrics,     // OpenMetrics exposition
+        Max
+    };
+
+    std::shared_ptr<const TelemetrySnapshot> snapshot;  // What the bodies were rendered from
+    std::shared_ptr<const std::string> bodies[Max];
+    std::shared_ptr<const std::string> gzipped[Max];  // Bodies compressed, empty if it failed
+
+    // Telemetry pushed to subscribers, as of snapshot pushedVersion: all of it,
+    // and what changed since the snapshot pushed before
+    uint64_t pushedVersion = 0;
+    uint64_t deltaFrom = 0;
+    Json::Value pushedDetail;  // miner_getstatdetail result
+    std::shared_ptr<const std::string> pushFull;
+    std::shared_ptr<const std::string> pushDelta;
+};
+
+/// An HTTP/1.x request, as far as the API cares
+struct HttpRequest
+{
+    std::string method;
+    std::string path;                            // Without the query, if any
+    std::string version;                         // "HTTP/1.0" or "HTTP/1.1"
+    std::map<std::string, std::string> headers;  // By lower case name
+    bool keepAlive = false;                      // Whether the connection stays open after it
+    unsigned status = 0;                         // Error to respond with if invalid, 0 otherwise
+    std::string error;
+};
+
+class ApiConnection : public std::enable_shared_from_this<ApiConnection>
 {
 public:
 
-    ApiConnection(boost::asio::io_service::strand& _strand, int id, bool readonly, string password);
+    ApiConnection(boost::asio::io_service::strand& _strand, int id, bool readonly, string password,
+        ApiCache& _cache);
 
-    ~ApiConnection() = default;
+    ~ApiConnection();
 
     void start();
+    void disconnect();
+
+    // Sends subscribed events the client hasn't got yet, as long as it keeps up
+    void pushEvents();
 
-    Json::Value getMinerStat1();
+    // When something was last received or sent
+    std::chrono::steady_clock::time_point lastActivity() const { return m_lastActivity; }
 
     using Disconnected = std::function<void(int const&)>;
     void onDisconnected(Disconnected const& _handler) { m_onDisconnected = _handler; }
@@ -38,19 +84,46 @@ public:
     tcp::socket& socket() { return m_socket; }
 
 private:
-    void disconnect();
+    enum class Protocol
+    {
+        Unknown,  // Nothing received yet
+        JsonRpc,  // Requests and responses are lines
+        Http,
+        WebSocket  // Upgraded from HTTP, requests and responses are WebSocket messages
+    };
+
     void processRequest(Json::Value& jRequest, Json::Value& jResponse);
+    void processMessage(std::string const& _message);
+    void processReceived();
+    void processLines();
+    void processHttp();
+    void processFrames();
+    void serveHttp(HttpRequest const& _request);
     void recvSocketData();
     void onRecvSocketDataCompleted(
         const boost::system::error_code& ec, std::size_t bytes_transferred);
-    void sendSocketData(Json::Value const& jReq, bool _disconnect = false);
+    void sendMessage(std::string const& _message);
+    void sendHttpResponse(HttpRequest const& _request, const char* _status,
+        const char* _contentType, std::string const& _body, std::string const& _headers = "");
     void sendSocketData(std::string const& _s, bool _disconnect = false);
-    void onSendSocketDataCompleted(const boost::system::error_code& ec, bool _disconnect = false);
+    void onSendSocketDataCompleted(const boost::system::error_code& ec);
+    bool backlogged() const;
+
+    void subscribe(unsigned _events);
+    void unsubscribe();
+    void sendEvent(uint64_t _seq, uint64_t _time, const char* _type, std::string const& _data);
+    void sendTelemetry(uint64_t _seq, uint64_t _time);
+
+    Json::Value getMinerStat1(TelemetrySnapshot const& _s);
+    Json::Value getMinerStatDetail(TelemetrySnapshot const& _s);
+    Json::Value getMinerStatDetailPerMiner(TelemetrySnapshot const& _s, unsigned _index);
 
-    Json::Value getMinerStatDetail();
-    Json::Value getMinerStatDetailPerMiner(const TelemetryType& _t, std::shared_ptr<Miner> _miner);
+    Json::Value getLatency();
 
-    std::string getHttpMinerStatDetail();
+    std::string getHttpMinerStatDetail(TelemetrySnapshot const& _s);
+
+    std::shared_ptr<const std::string> getCached(ApiCache::Body _body);
+    std::shared_ptr<const std::string> getCachedGzip(ApiCache::Body _body);
 
     Disconnected m_onDisconnected;
 
@@ -58,23 +131,40 @@ private:
 
     tcp::socket m_socket;
     boost::asio::io_service::strand& m_io_strand;
-    boost::asio::streambuf m_sendBuffer;
     boost::asio::streambuf m_recvBuffer;
     Json::StreamWriterBuilder m_jSwBuilder;
 
     std::string m_message;  // The internal message string buffer
+    std::string m_sending;  // Being written, empty if nothing is
+    std::string m_pending;  // To write once m_sending is
+    bool m_reading = false;
+    bool m_closeWhenSent = false;
+    bool m_disconnected = false;
+    std::chrono::steady_clock::time_point m_lastActivity = std::chrono::steady_clock::now();
+
+    Protocol m_protocol = Protocol::Unknown;  // Told by the first bytes received
+    std::string m_wsMessage;                  // Fragments of the WebSocket message being read
+
+    bool m_subscribed = false;
+    unsigned m_events = 0;         // Mask of (1 << EventType) subscribed to
+    uint64_t m_eventCursor = 0;    // Seq of the latest event read from the feed
+    uint64_t m_telemetrySent = 0;  // Version of the latest telemetry pushed, 0 for none
 
     bool m_readonly = false;
     std::string m_password = "";
 
     bool m_is_authenticated = true;
+
+    ApiCache& m_cache;
+    std::shared_ptr<const std::string> m_cachedResult;  // Result of the request, already serialized
 };
 
 
 class ApiServer
 {
 public:
-    ApiServer(string address, int portnum, string password);
+    ApiServer(string address, int portnum, string password, unsigned maxConnections,
+        unsigned idleTimeout);
     bool isRunning() { return m_running.load(std::memory_order_relaxed); };
     void start();
     void stop();
@@ -82,6 +172,8 @@ public:
 private:
     void begin_accept();
     void handle_accept(std::shared_ptr<ApiConnection> session, boost::system::error_code ec);
+    void pushEvents();
+    void sweep(const boost::system::error_code& ec);
 
     int lastSessionId = 0;
 
@@ -94,4 +186,10 @@ private:
     tcp::acceptor m_acceptor;
     boost::asio::io_service::strand m_io_strand;
     std::vector<std::shared_ptr<ApiConnection>> m_sessions;
+    unsigned m_maxConnections;  // Connections open at once, 0 for no limit
+    unsigned m_idleTimeout;     // Seconds after which idle connections are closed, 0 for never
+    unsigned m_refused = 0;     // Connections refused for being one too many
+    boost::asio::deadline_timer m_sweepTimer;
+    ApiCache m_cache;
+    std::atomic<bool> m_pushPending = {false};  // Whether pushEvents() was posted already
 };
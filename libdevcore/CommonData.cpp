@@ -199,3 +199,96 @@ std::string dev::padRight(std::string _value, size_t _length, char _fillChar)
         _value.resize(_length, _fillChar);
     return _value;
 }
+
+std::string dev::toBase64(const unsigned char* _data, size_t _size)
+{
+    static const char* c_chars =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string ret;
+    for (size_t i = 0; i < _size; i += 3)
+    {
+        unsigned v = unsigned(_data[i]) << 16;
+        if (i + 1 < _size)
+            v |= unsigned(_data[i + 1]) << 8;
+        if (i + 2 < _size)
+            v |= _data[i + 2];
+        ret += c_chars[(v >> 18) & 0x3f];
+        ret += c_chars[(v >> 12) & 0x3f];
+        ret += (i + 1 < _size ? c_chars[(v >> 6) & 0x3f] : '=');
+        ret += (i + 2 < _size ? c_chars[v & 0x3f] : '=');
+    }
+    return ret;
+}
+
+std::string dev::encodeWebSocketFrame(
+    unsigned char _opcode, std::string const& _payload, const unsigned char* _mask)
+{
+    const char maskBit = (_mask ? char(0x80) : 0);
+    std::string frame;
+    frame += char(0x80 | _opcode);
+    if (_payload.size() < 126)
+    {
+        frame += char(maskBit | _payload.size());
+    }
+    else if (_payload.size() < 65536)
+    {
+        frame += char(maskBit | 126);
+        frame += char(_payload.size() >> 8);
+        frame += char(_payload.size() & 0xff);
+    }
+    else
+    {
+        frame += char(maskBit | 127);
+        for (int i = 7; i >= 0; i--)
+            frame += char((uint64_t(_payload.size()) >> (i * 8)) & 0xff);
+    }
+    if (!_mask)
+        return frame + _payload;
+
+    frame.append((const char*)_mask, 4);
+    for (size_t i = 0; i < _payload.size(); i++)
+        frame += char(_payload[i] ^ _mask[i % 4]);
+    return frame;
+}
+
+size_t dev::decodeWebSocketFrame(
+    const unsigned char* _data, size_t _size, WebSocketFrame& _frame)
+{
+    _frame = WebSocketFrame();
+    if (_size < 2)
+        return 0;
+    _frame.fin = (_data[0] & 0x80) != 0;
+    _frame.opcode = _data[0] & 0x0f;
+    _frame.masked = (_data[1] & 0x80) != 0;
+    uint64_t length = _data[1] & 0x7f;
+    size_t header = 2;
+    if (length == 126)
+    {
+        if (_size < 4)
+            return 0;
+        length = (uint64_t(_data[2]) << 8) | _data[3];
+        header = 4;
+    }
+    else if (length == 127)
+    {
+        if (_size < 10)
+            return 0;
+        length = 0;
+        for (int i = 0; i < 8; i++)
+            length = (length << 8) | _data[2 + i];
+        header = 10;
+    }
+    if (_frame.masked)
+        header += 4;
+    if (_size < header)
+        return 0;
+    _frame.length = length;
+    if (_size - header < length)
+        return 0;
+
+    _frame.payload.assign((const char*)_data + header, size_t(length));
+    if (_frame.masked)
+        for (size_t i = 0; i < _frame.payload.size(); i++)
+            _frame.payload[i] ^= _data[header - 4 + i % 4];
+    return header + size_t(length);
+}
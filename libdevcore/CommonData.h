@@ -207,6 +207,29 @@ inline std::string toCompactHex(uint32_t _n, HexPrefix _prefix = HexPrefix::Dont
 /// @p _all if true will escape all characters, not just the unprintable ones.
 std::string escaped(std::string const& _s, bool _all = true);
 
+/// Encodes bytes in base64, with padding.
+std::string toBase64(const unsigned char* _data, size_t _size);
+
+/// A WebSocket (RFC 6455) frame.
+struct WebSocketFrame
+{
+    bool fin = false;
+    unsigned char opcode = 0;
+    bool masked = false;
+    uint64_t length = 0;  ///< Of the payload, known as soon as the header is complete
+    std::string payload;  ///< Unmasked
+};
+
+/// Encodes a WebSocket frame. Clients mask theirs with the 4 bytes of @p _mask,
+/// servers pass nullptr.
+std::string encodeWebSocketFrame(
+    unsigned char _opcode, std::string const& _payload, const unsigned char* _mask = nullptr);
+
+/// Decodes the WebSocket frame at the beginning of @p _data into @p _frame.
+/// @returns the size of the frame, or 0 if it's not complete yet. Its length is
+/// set as soon as its header is, so frames too large can be refused early.
+size_t decodeWebSocketFrame(const unsigned char* _data, size_t _size, WebSocketFrame& _frame);
+
 // General datatype convenience functions.
 
 /// Determine bytes required to encode the given integer value. @returns 0 if @a _i is zero.
@@ -0,0 +1,101 @@
+/*
+    This file is part of ethminer.
+
+    ethminer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    ethminer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "LatencyTrace.h"
+
+using namespace std;
+using namespace dev;
+
+namespace
+{
+const unsigned c_traceSamples = 1024;  // Retained samples per stage
+
+struct TraceRing
+{
+    atomic<uint64_t> count = {0};
+    atomic<uint32_t> samples[c_traceSamples];
+};
+
+TraceRing s_rings[unsigned(TraceStage::Max)];
+
+}  // namespace
+
+
+void LatencyTrace::record(TraceStage _stage, chrono::steady_clock::time_point _origin) noexcept
+{
+    if (_origin.time_since_epoch().count() == 0)
+        return;
+    record(_stage,
+        chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - _origin));
+}
+
+void LatencyTrace::record(TraceStage _stage, chrono::microseconds _elapsed) noexcept
+{
+    TraceRing& ring = s_rings[unsigned(_stage)];
+    uint64_t slot = ring.count.fetch_add(1, memory_order_relaxed);
+    uint32_t us = uint32_t(min<int64_t>(max<int64_t>(_elapsed.count(), 0), UINT32_MAX));
+    ring.samples[slot % c_traceSamples].store(us, memory_order_relaxed);
+}
+
+TraceStats LatencyTrace::stats(TraceStage _stage)
+{
+    TraceRing& ring = s_rings[unsigned(_stage)];
+    TraceStats s;
+    s.count = ring.count.load(memory_order_relaxed);
+    if (!s.count)
+        return s;
+
+    // Samples may be overwritten meanwhile: good enough for percentiles
+    vector<uint32_t> samples(size_t(min<uint64_t>(s.count, c_traceSamples)));
+    for (size_t i = 0; i < samples.size(); i++)
+        samples[i] = ring.samples[i].load(memory_order_relaxed);
+    sort(samples.begin(), samples.end());
+
+    s.p50 = samples[(samples.size() - 1) * 50 / 100];
+    s.p99 = samples[(samples.size() - 1) * 99 / 100];
+    s.max = samples.back();
+    return s;
+}
+
+const char* LatencyTrace::name(TraceStage _stage) noexcept
+{
+    switch (_stage)
+    {
+    case TraceStage::WorkParsed:
+        return "parsed";
+    case TraceStage::WorkDispatched:
+        return "dispatched";
+    case TraceStage::WorkSet:
+        return "set";
+    case TraceStage::WorkLaunched:
+        return "launched";
+    case TraceStage::WorkSwitched:
+        return "switched";
+    case TraceStage::SolutionVerified:
+        return "verified";
+    case TraceStage::SolutionSent:
+        return "sent";
+    case TraceStage::SolutionAcked:
+        return "acked";
+    default:
+        return "unknown";
+    }
+}
@@ -0,0 +1,70 @@
+/*
+    This file is part of ethminer.
+
+    ethminer is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    ethminer is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+namespace dev
+{
+/// Stages traced on the way of jobs from the pool to the devices and of
+/// solutions back to the pool
+enum class TraceStage : unsigned
+{
+    WorkParsed = 0,    // Job message(s) parsed, since bytes received
+    WorkDispatched,    // Job handed to the farm by PoolManager, since bytes received
+    WorkSet,           // Job published to all miners by Farm, since bytes received
+    WorkLaunched,      // First kernel launched on the job by a miner, since bytes received
+    WorkSwitched,      // First kernel launched on the job by a miner, since handed to it
+    SolutionVerified,  // Solution re-evaluated on host, since found
+    SolutionSent,      // Solution written to the pool connection, since found
+    SolutionAcked,     // Pool response to a submission, since sent
+    Max
+};
+
+struct TraceStats
+{
+    uint64_t count = 0;  // Samples recorded since start
+    unsigned p50 = 0;    // Median over the retained samples (us)
+    unsigned p99 = 0;    // 99th percentile over the retained samples (us)
+    unsigned max = 0;    // Highest of the retained samples (us)
+};
+
+/**
+ * @brief Always-on latency tracing of job switches and solution submissions.
+ *
+ * Each stage keeps its latest samples in a fixed-size ring. Recording is a
+ * clock read and two relaxed atomic operations, so it can be done from any
+ * thread, miners included.
+ */
+class LatencyTrace
+{
+public:
+    /**
+     * @brief Records the time elapsed since @p _origin. Ignored if @p _origin was never set
+     */
+    static void record(TraceStage _stage, std::chrono::steady_clock::time_point _origin) noexcept;
+
+    static void record(TraceStage _stage, std::chrono::microseconds _elapsed) noexcept;
+
+    static TraceStats stats(TraceStage _stage);
+
+    static const char* name(TraceStage _stage) noexcept;
+};
+
+}  // namespace dev
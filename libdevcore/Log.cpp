@@ -17,7 +17,14 @@
 
 #include "Log.h"
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <thread>
 
 #ifdef __APPLE__
@@ -36,6 +43,7 @@ unsigned g_logOptions = 0;
 bool g_logNoColor = false;
 bool g_logSyslog = false;
 bool g_logStdout = false;
+std::string g_logFile;
 
 const char* LogChannel::name()
 {
@@ -51,20 +59,10 @@ const char* NoteChannel::name()
 }
 
 LogOutputStreamBase::LogOutputStreamBase(char const* _id)
+  : m_id(_id), m_tstamp(std::chrono::system_clock::now())
 {
     static std::locale logLocl = std::locale("");
-        m_sstr.imbue(logLocl);
-        if (g_logSyslog)
-            m_sstr << std::left << std::setw(8) << getThreadName() << " " EthReset;
-        else
-        {
-            time_t rawTime = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-            char buf[24];
-            if (strftime(buf, 24, "%X", localtime(&rawTime)) == 0)
-                buf[0] = '\0';  // empty if case strftime fails
-            m_sstr << _id << " " EthViolet << buf << " " EthBlue << std::left << std::setw(8)
-                   << getThreadName() << " " EthReset;
-        }
+    m_sstr.imbue(logLocl);
 }
 
 /// Associate a name with each thread for nice logging.
@@ -78,6 +76,14 @@ thread_local char const* ThreadLocalLogName::name;
 
 ThreadLocalLogName g_logThreadName("main");
 
+namespace
+{
+// getThreadName() asks the system, which on Linux is a read in /proc
+thread_local char t_logName[16];
+thread_local bool t_logNamed = false;
+
+}  // namespace
+
 string dev::getThreadName()
 {
 #if defined(__linux__) || defined(__APPLE__)
@@ -92,6 +98,7 @@ string dev::getThreadName()
 
 void dev::setThreadName(char const* _n)
 {
+    t_logNamed = false;
 #if defined(__linux__)
     pthread_setname_np(pthread_self(), _n);
 #elif defined(__APPLE__)
@@ -132,3 +139,327 @@ void dev::simpleDebugOut(std::string const& _s)
         return;
     }
 }
+
+namespace
+{
+const size_t c_ringSize = 512;  // Log lines a thread can have pending
+const std::chrono::milliseconds c_writerIdle(100);
+
+struct LogRecord
+{
+    uint64_t seq = 0;  // Order of the lines among all threads
+    std::chrono::system_clock::time_point tstamp;
+    char const* id = nullptr;
+    char thread[16];
+    std::string text;
+};
+
+// Single producer (the logging thread), single consumer (the writer)
+class LogRing
+{
+public:
+    bool push(LogRecord& _record)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) == c_ringSize)
+            return false;
+        std::swap(m_slots[tail % c_ringSize], _record);
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(LogRecord& _record)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire))
+            return false;
+        std::swap(m_slots[head % c_ringSize], _record);
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const
+    {
+        return m_head.load(std::memory_order_relaxed) == m_tail.load(std::memory_order_acquire);
+    }
+
+    std::atomic<bool> closed = {false};  // Thread gone, only left to be drained
+
+private:
+    LogRecord m_slots[c_ringSize];
+    std::atomic<size_t> m_head = {0};
+    std::atomic<size_t> m_tail = {0};
+};
+
+std::atomic<bool> s_writerGone = {false};
+
+class LogWriter
+{
+public:
+    static LogWriter& get()
+    {
+        static LogWriter writer;
+        return writer;
+    }
+
+    ~LogWriter()
+    {
+        {
+            std::lock_guard<std::mutex> l(x_wake);
+            m_stopping = true;
+        }
+        m_wake.notify_one();
+        m_thread.join();
+        s_writerGone = true;
+    }
+
+    void post(LogRecord& _record);
+    void flush();
+    uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+    LogWriter() : m_thread(&LogWriter::run, this) {}
+
+    void run();
+    bool drain(std::vector<LogRecord>& _batch);
+    bool pending();
+    void write(std::vector<LogRecord>& _batch);
+
+    std::mutex x_rings;
+    std::vector<std::shared_ptr<LogRing>> m_rings;
+
+    std::atomic<uint64_t> m_seq = {0};      // Lines posted
+    std::atomic<uint64_t> m_written = {0};  // Lines written (or dropped)
+    std::atomic<uint64_t> m_dropped = {0};
+    uint64_t m_reported = 0;                // Drops already told about
+
+    std::mutex x_wake;
+    std::condition_variable m_wake;
+    std::condition_variable m_flushed;
+    std::atomic<bool> m_idle = {false};
+    bool m_stopping = false;
+    std::ofstream m_file;
+
+    std::thread m_thread;
+};
+
+// Gives the ring back to the writer when the thread exits
+struct LogRingHolder
+{
+    ~LogRingHolder()
+    {
+        if (ring)
+            ring->closed = true;
+    }
+    std::shared_ptr<LogRing> ring;
+};
+
+thread_local LogRingHolder t_logRing;
+
+void LogWriter::post(LogRecord& _record)
+{
+    if (!t_logRing.ring)
+    {
+        t_logRing.ring = std::make_shared<LogRing>();
+        std::lock_guard<std::mutex> l(x_rings);
+        m_rings.push_back(t_logRing.ring);
+    }
+
+    _record.seq = m_seq.fetch_add(1, std::memory_order_relaxed);
+    if (!t_logRing.ring->push(_record))
+    {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        m_written.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // The writer only needs waking when it's about to sleep
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_idle.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> l(x_wake);
+        m_wake.notify_one();
+    }
+}
+
+void LogWriter::flush()
+{
+    uint64_t target = m_seq.load(std::memory_order_relaxed);
+    std::unique_lock<std::mutex> l(x_wake);
+    m_wake.notify_one();
+    m_flushed.wait_for(l, std::chrono::seconds(1),
+        [&] { return m_written.load(std::memory_order_relaxed) >= target; });
+}
+
+bool LogWriter::drain(std::vector<LogRecord>& _batch)
+{
+    std::lock_guard<std::mutex> l(x_rings);
+    for (auto it = m_rings.begin(); it != m_rings.end();)
+    {
+        // Closed before being drained: nothing comes after
+        bool closed = (*it)->closed.load(std::memory_order_acquire);
+        LogRecord record;
+        while ((*it)->pop(record))
+            _batch.push_back(std::move(record));
+        if (closed)
+            it = m_rings.erase(it);
+        else
+            ++it;
+    }
+    return !_batch.empty();
+}
+
+bool LogWriter::pending()
+{
+    std::lock_guard<std::mutex> l(x_rings);
+    for (auto& ring : m_rings)
+        if (!ring->empty() || ring->closed.load(std::memory_order_relaxed))
+            return true;
+    return false;
+}
+
+void LogWriter::run()
+{
+    setThreadName("log");
+
+    std::vector<LogRecord> batch;
+    while (true)
+    {
+        batch.clear();
+        if (drain(batch))
+        {
+            write(batch);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> l(x_wake);
+        m_flushed.notify_all();
+        if (m_stopping)
+            break;
+
+        // Lines posted while going idle are seen by the check, later ones wake us up
+        m_idle.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!pending())
+            m_wake.wait_for(l, c_writerIdle);
+        m_idle.store(false, std::memory_order_relaxed);
+    }
+}
+
+void LogWriter::write(std::vector<LogRecord>& _batch)
+{
+    std::sort(_batch.begin(), _batch.end(),
+        [](LogRecord const& _a, LogRecord const& _b) { return _a.seq < _b.seq; });
+
+    uint64_t dropped = m_dropped.load(std::memory_order_relaxed);
+    if (dropped != m_reported)
+    {
+        LogRecord record;
+        record.tstamp = std::chrono::system_clock::now();
+        record.id = WarnChannel::name();
+        strcpy(record.thread, "log");
+        record.text = std::to_string(dropped - m_reported) + " log lines dropped";
+        record.seq = _batch.back().seq;
+        _batch.push_back(std::move(record));
+        m_reported = dropped;
+    }
+
+    std::stringstream out;
+    std::stringstream line;
+    std::time_t lastTime = 0;
+    char timeBuf[24] = "";
+    for (auto const& record : _batch)
+    {
+        line.str(std::string());
+        if (g_logSyslog)
+        {
+            line << std::left << std::setw(8) << record.thread << " " EthReset << record.text;
+        }
+        else
+        {
+            // Lines mostly come by the second
+            time_t rawTime = std::chrono::system_clock::to_time_t(record.tstamp);
+            if (rawTime != lastTime)
+            {
+                lastTime = rawTime;
+                if (strftime(timeBuf, sizeof(timeBuf), "%X", localtime(&rawTime)) == 0)
+                    timeBuf[0] = '\0';  // empty if case strftime fails
+            }
+            line << record.id << " " EthViolet << timeBuf << " " EthBlue << std::left
+                 << std::setw(8) << record.thread << " " EthReset << record.text;
+        }
+        std::string text = line.str();
+
+        bool skip = false;
+        std::string plain;
+        for (auto it : text)
+        {
+            if (!skip && it == '\x1b')
+                skip = true;
+            else if (skip && it == 'm')
+                skip = false;
+            else if (!skip)
+                plain += it;
+        }
+        out << (g_logNoColor ? plain : text) << '\n';
+
+        if (!g_logFile.empty())
+        {
+            if (!m_file.is_open())
+                m_file.open(g_logFile, std::ios::out | std::ios::app);
+            m_file << plain << '\n';
+        }
+    }
+
+    try
+    {
+        std::ostream& os = g_logStdout ? std::cout : std::clog;
+        os << out.str();
+        os.flush();
+        if (m_file.is_open())
+            m_file.flush();
+    }
+    catch (...)
+    {
+    }
+
+    m_written.fetch_add(_batch.size(), std::memory_order_relaxed);
+}
+
+}  // namespace
+
+void LogOutputStreamBase::post()
+{
+    if (!t_logNamed)
+    {
+        string name = getThreadName();
+        strncpy(t_logName, name.c_str(), sizeof(t_logName) - 1);
+        t_logName[sizeof(t_logName) - 1] = '\0';
+        t_logNamed = true;
+    }
+
+    // Past the end of main: no writer to hand the line to
+    if (s_writerGone.load(std::memory_order_relaxed))
+    {
+        simpleDebugOut(m_sstr.str());
+        return;
+    }
+
+    LogRecord record;
+    record.tstamp = m_tstamp;
+    record.id = m_id;
+    memcpy(record.thread, t_logName, sizeof(record.thread));
+    record.text = m_sstr.str();
+    LogWriter::get().post(record);
+}
+
+void dev::flushLog()
+{
+    if (!s_writerGone.load(std::memory_order_relaxed))
+        LogWriter::get().flush();
+}
+
+uint64_t dev::droppedLogLines()
+{
+    return s_writerGone.load(std::memory_order_relaxed) ? 0 : LogWriter::get().dropped();
+}
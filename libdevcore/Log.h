@@ -41,6 +41,12 @@
 #define LOG_PROGRAMFLOW 256
 #define LOG_NEXT 512
 
+/// Channels with a higher verbosity are compiled out: their lines cost nothing,
+/// not even the evaluation of what is shifted to them.
+#ifndef ETH_LOG_VERBOSITY
+#define ETH_LOG_VERBOSITY 9
+#endif
+
 #if DEV_BUILD
 #define DEV_BUILD_LOG_PROGRAMFLOW(_S, _V) \
     if (g_logOptions & LOG_PROGRAMFLOW)   \
@@ -56,12 +62,19 @@ extern unsigned g_logOptions;
 extern bool g_logNoColor;
 extern bool g_logSyslog;
 extern bool g_logStdout;
+extern std::string g_logFile;
 
 namespace dev
 {
 /// A simple log-output function that prints log messages to stdout.
 void simpleDebugOut(std::string const&);
 
+/// Waits (a second at most) for the log lines posted so far to be written out.
+void flushLog();
+
+/// Log lines dropped because a thread logged faster than they could be written.
+uint64_t droppedLogLines();
+
 /// Set the current thread's log name.
 void setThreadName(char const* _n);
 
@@ -73,16 +86,22 @@ std::string getThreadName();
 struct LogChannel
 {
     static const char* name();
+    static const int verbosity = 1;
 };
 struct WarnChannel : public LogChannel
 {
     static const char* name();
+    static const int verbosity = 0;
 };
 struct NoteChannel : public LogChannel
 {
     static const char* name();
 };
 
+/// Log entries are handed over to a single writer thread, which adds the
+/// timestamp and writes them out. The thread logging never waits on the
+/// terminal, syslog or a file: if it logs faster than they take lines in,
+/// its newest lines are dropped (and counted).
 class LogOutputStreamBase
 {
 public:
@@ -95,6 +114,10 @@ public:
     }
 
 protected:
+    void post();
+
+    char const* m_id;
+    std::chrono::system_clock::time_point m_tstamp;
     std::stringstream m_sstr;  ///< The accrued log entry.
 };
 
@@ -103,13 +126,15 @@ template <class Id>
 class LogOutputStream : LogOutputStreamBase
 {
 public:
+    static constexpr bool enabled = (Id::verbosity <= ETH_LOG_VERBOSITY);
+
     /// Construct a new object.
     /// If _term is true the the prefix info is terminated with a ']' character; if not it ends only
     /// with a '|' character.
     LogOutputStream() : LogOutputStreamBase(Id::name()) {}
 
-    /// Destructor. Posts the accrued log entry to the g_logPost function.
-    ~LogOutputStream() { simpleDebugOut(m_sstr.str()); }
+    /// Destructor. Posts the accrued log entry to the writer thread.
+    ~LogOutputStream() { post(); }
 
     /// Shift arbitrary data to the log. Spaces will be added between items as required.
     template <class T>
@@ -120,7 +145,17 @@ public:
     }
 };
 
-#define clog(X) dev::LogOutputStream<X>()
+/// Swallows the stream, so both branches of clog() are void
+struct LogVoidify
+{
+    template <class Id>
+    void operator&(LogOutputStream<Id> const&)
+    {}
+};
+
+#define clog(X)                                 \
+    !dev::LogOutputStream<X>::enabled ? (void)0 \
+                                      : dev::LogVoidify() & dev::LogOutputStream<X>()
 
 // Simple cout-like stream objects for accessing common log channels.
 // Dirties the global namespace, but oh so convenient...
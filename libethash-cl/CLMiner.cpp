@@ -295,9 +295,17 @@ void CLMiner::workLoop()
     // The work package currently processed by GPU.
     WorkPackage current;
     current.header = h256();
+    unsigned currentGeneration = 0;
 
-    if (!initDevice())
-    return;
+    // The most recent work package assigned
+    WorkPackage w;
+    unsigned workGeneration = 0;
+
+    // Header upload of prefetchWork the next launch has to wait for
+    vector<cl::Event> uploaded;
+
+    if (!startDevice())
+        return;
 
     try
     {
@@ -335,13 +343,15 @@ void CLMiner::workLoop()
                 results.count = 0;
 
             // Wait for work or 3 seconds (whichever the first)
-            const WorkPackage w = work();
+            if (newWork(workGeneration))
+                w = work(workGeneration);
             if (!w)
             {
                 boost::system_time const timeout =
                     boost::get_system_time() + boost::posix_time::seconds(3);
                 boost::mutex::scoped_lock l(x_work);
-                m_new_work_signal.timed_wait(l, timeout);
+                if (!newWork(workGeneration))
+                    m_new_work_signal.timed_wait(l, timeout);
                 continue;
             }
 
@@ -350,11 +360,18 @@ void CLMiner::workLoop()
 
                 if (current.epoch != w.epoch)
                 {
-                    m_abortqueue.clear();
+                    {
+                        boost::mutex::scoped_lock l(x_prefetch);
+                        m_abortqueue.clear();
+                        m_prefetched = false;
+                        m_prefetchEvent = cl::Event();
+                    }
 
                     if (!initEpoch())
                         break;  // This will simply exit the thread
 
+                    boost::mutex::scoped_lock l(x_prefetch);
+                    m_headerIdx = 0;
                     m_abortqueue.push_back(cl::CommandQueue(m_context[0], m_device));
                 }
 
@@ -362,20 +379,35 @@ void CLMiner::workLoop()
                 const uint64_t target = (uint64_t)(u64)((u256)w.boundary >> 192);
                 assert(target > 0);
 
-                startNonce = w.startNonce;
-
-                // Update header constant buffer.
-                m_queue[0].enqueueWriteBuffer(
-                    m_header[0], CL_FALSE, 0, w.header.size, w.header.data());
+                // Switch to the other header buffer: either prefetchWork has
+                // already uploaded this header into it or it is uploaded now
+                {
+                    boost::mutex::scoped_lock l(x_prefetch);
+                    m_headerIdx ^= 1;
+                    if (m_prefetched && m_prefetchGen == workGeneration)
+                    {
+                        uploaded.assign(1, m_prefetchEvent);
+                    }
+                    else
+                    {
+                        // Not to be overwritten by an upload still in flight
+                        vector<cl::Event> inflight;
+                        if (m_prefetched)
+                            inflight.push_back(m_prefetchEvent);
+                        m_queue[0].enqueueWriteBuffer(m_header[m_headerIdx], CL_FALSE, 0,
+                            w.header.size, w.header.data(), &inflight);
+                    }
+                    m_prefetched = false;
+                }
                 // zero the result count
                 m_queue[0].enqueueWriteBuffer(m_searchBuffer[0], CL_FALSE,
                     offsetof(SearchResults, count),
                     m_settings.noExit ? sizeof(zerox3[0]) : sizeof(zerox3), zerox3);
 
-                m_searchKernel.setArg(0, m_searchBuffer[0]);  // Supply output buffer to kernel.
-                m_searchKernel.setArg(1, m_header[0]);        // Supply header buffer to kernel.
-                m_searchKernel.setArg(2, m_dag[0]);           // Supply DAG buffer to kernel.
-                m_searchKernel.setArg(3, m_dag[1]);           // Supply DAG buffer to kernel.
+                m_searchKernel.setArg(0, m_searchBuffer[0]);      // Supply output buffer to kernel.
+                m_searchKernel.setArg(1, m_header[m_headerIdx]);  // Supply header buffer to kernel.
+                m_searchKernel.setArg(2, m_dag[0]);               // Supply DAG buffer to kernel.
+                m_searchKernel.setArg(3, m_dag[1]);               // Supply DAG buffer to kernel.
                 m_searchKernel.setArg(4, m_dagItems);
                 m_searchKernel.setArg(6, target);
 
@@ -389,10 +421,17 @@ void CLMiner::workLoop()
 #endif
             }
 
-            // Run the kernel.
-            m_searchKernel.setArg(5, startNonce);
-            m_queue[0].enqueueNDRangeKernel(
-                m_searchKernel, cl::NullRange, m_settings.globalWorkSize, m_settings.localWorkSize);
+            // Run the kernel on the next nonces. Once the job has none left
+            // only the results of the last run are still to be reported
+            bool launched = nextNonces(m_settings.globalWorkSize, startNonce);
+            if (launched)
+            {
+                m_searchKernel.setArg(5, startNonce);
+                m_queue[0].enqueueNDRangeKernel(m_searchKernel, cl::NullRange,
+                    m_settings.globalWorkSize, m_settings.localWorkSize,
+                    uploaded.empty() ? nullptr : &uploaded);
+                uploaded.clear();
+            }
 
             if (results.count)
             {
@@ -414,10 +453,21 @@ void CLMiner::workLoop()
                 }
             }
 
-            current = w;  // kernel now processing newest work
+            // Nothing left to search: idle till new work
+            if (!launched)
+            {
+                w = WorkPackage();
+                continue;
+            }
+
+            // kernel now processing newest work
+            if (currentGeneration != workGeneration)
+            {
+                workLaunched(w);
+                current = w;
+                currentGeneration = workGeneration;
+            }
             current.startNonce = startNonce;
-            // Increase start nonce for following kernel execution.
-            startNonce += m_settings.globalWorkSize;
             // Report hash count
             if (m_settings.noExit)
                 updateHashRate(m_settings.globalWorkSize, 1);
@@ -426,9 +476,18 @@ void CLMiner::workLoop()
         }
 
         if (m_queue.size())
+        {
             m_queue[0].finish();
 
-        clear_buffer();
+            // Device is kept for a warm restart: drop the results of the
+            // last run (as a cold restart would) and the abort flag
+            if (keepDevice())
+                m_queue[0].enqueueWriteBuffer(m_searchBuffer[0], CL_TRUE,
+                    offsetof(SearchResults, count), sizeof(zerox3), zerox3);
+        }
+
+        if (!keepDevice())
+            clear_buffer();
     }
     catch (cl::Error const& _e)
     {
@@ -440,15 +499,51 @@ void CLMiner::workLoop()
 
 void CLMiner::kick_miner()
 {
-    // Memory for abort Cannot be static because crashes on macOS.
-    const uint32_t one = 1;
-    if (!m_settings.noExit && !m_abortqueue.empty())
-        m_abortqueue[0].enqueueWriteBuffer(
-            m_searchBuffer[0], CL_TRUE, offsetof(SearchResults, abort), sizeof(one), &one);
+    // Not waited for: the caller may be the network strand. The running
+    // kernel sees the flag as soon as the device gets it
+    if (!m_settings.noExit)
+    {
+        boost::mutex::scoped_lock l(x_prefetch);
+        if (!m_abortqueue.empty())
+        {
+            m_abortqueue[0].enqueueWriteBuffer(m_searchBuffer[0], CL_FALSE,
+                offsetof(SearchResults, abort), sizeof(m_abortFlag), &m_abortFlag);
+            m_abortqueue[0].flush();
+        }
+    }
 
     m_new_work_signal.notify_one();
 }
 
+void CLMiner::prefetchWork(WorkPackage const& _work, unsigned _generation)
+{
+    boost::mutex::scoped_lock l(x_prefetch);
+
+    // Not before the epoch is loaded. Headers of another epoch are dropped
+    // by the miner thread when it switches epoch
+    if (m_abortqueue.empty() || m_header.size() < 2)
+        return;
+
+    unsigned idx = m_headerIdx ^ 1;
+    try
+    {
+        // An earlier upload may still read the same host copy
+        if (m_prefetched)
+            m_prefetchEvent.wait();
+        m_prefetchHeader[idx] = _work.header;
+        m_abortqueue[0].enqueueWriteBuffer(m_header[idx], CL_FALSE, 0, m_prefetchHeader[idx].size,
+            m_prefetchHeader[idx].data(), nullptr, &m_prefetchEvent);
+        m_abortqueue[0].flush();
+        m_prefetchGen = _generation;
+        m_prefetched = true;
+    }
+    catch (cl::Error const& err)
+    {
+        cwarn << ethCLErrorHelper("Header prefetch failed", err);
+        m_prefetched = false;
+    }
+}
+
 void CLMiner::enumDevices(std::map<string, DeviceDescriptor>& _DevicesCollection)
 {
     // Load available platforms
@@ -929,6 +1024,7 @@ bool CLMiner::initEpoch_internal()
         cllog << "Creating buffer for header.";
         m_header.clear();
         m_header.push_back(cl::Buffer(m_context[0], CL_MEM_READ_ONLY, 32));
+        m_header.push_back(cl::Buffer(m_context[0], CL_MEM_READ_ONLY, 32));
 
         m_searchKernel.setArg(1, m_header[0]);
         m_searchKernel.setArg(2, m_dag[0]);
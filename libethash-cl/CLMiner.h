@@ -56,6 +56,8 @@ protected:
 
     void kick_miner() override;
 
+    void prefetchWork(WorkPackage const& _work, unsigned _generation) override;
+
 private:
     
     void workLoop() override;
@@ -87,6 +89,16 @@ private:
     unsigned m_dagItems = 0;
     uint64_t m_lastNonce = 0;
 
+    // Headers are double buffered: the one of the running kernel and the
+    // one prefetchWork uploads on the abort queue ahead of the next launch
+    boost::mutex x_prefetch;
+    unsigned m_headerIdx = 0;    // Header buffer of the launched kernels
+    h256 m_prefetchHeader[2];    // Host copies of the uploads in flight
+    cl::Event m_prefetchEvent;   // Last upload
+    bool m_prefetched = false;   // Last upload not taken by the miner thread yet
+    unsigned m_prefetchGen = 0;  // Work generation of the last upload
+    cl_uint m_abortFlag = 1;     // Host memory of the (non blocking) abort writes
+
 };
 
 }  // namespace eth
@@ -32,6 +32,8 @@ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
 #include <libethcore/Farm.h>
 #include <ethash/ethash.hpp>
 
+#include <fstream>
+
 #include <boost/version.hpp>
 
 #if 0
@@ -172,9 +174,17 @@ struct CPUChannel : public LogChannel
 
 
 CPUMiner::CPUMiner(unsigned _index, CPSettings _settings, DeviceDescriptor& _device)
-  : Miner("cpu-", _index), m_settings(_settings)
+  : Miner("cpu-", _index), m_settings(_settings), m_kernel(CPUSearch::detect())
 {
     m_deviceDescriptor = _device;
+
+    if (m_settings.kernel == "scalar")
+        m_kernel = CPUSearchKernel::Scalar;
+    else if (m_settings.kernel == "avx2" && m_kernel != CPUSearchKernel::Scalar)
+        m_kernel = CPUSearchKernel::AVX2;
+    else if (m_settings.kernel != "auto" && m_settings.kernel != CPUSearch::name(m_kernel))
+        cwarn << "cp-" << m_index << " search kernel " << m_settings.kernel
+              << " not supported. Using " << CPUSearch::name(m_kernel);
 }
 
 
@@ -195,7 +205,12 @@ bool CPUMiner::initDevice()
     DEV_BUILD_LOG_PROGRAMFLOW(cpulog, "cp-" << m_index << " CPUMiner::initDevice begin");
 
     cpulog << "Using CPU: " << m_deviceDescriptor.cpCpuNumer << " " << m_deviceDescriptor.cuName
-           << " Memory : " << dev::getFormattedMemory((double)m_deviceDescriptor.totalMemory);
+           << " Memory : " << dev::getFormattedMemory((double)m_deviceDescriptor.totalMemory)
+           << " Kernel : " << CPUSearch::name(m_kernel) << " (" << CPUSearch::lanes(m_kernel)
+           << " lanes)";
+    if (m_deviceDescriptor.cpNumaNode >= 0)
+        cpulog << "NUMA node : " << m_deviceDescriptor.cpNumaNode
+               << (m_settings.numa ? " (local DAG copy)" : "");
 
 #if defined(__APPLE__) || defined(__MACOSX)
 /* Not supported on MAC OSX. See https://developer.apple.com/library/archive/releasenotes/Performance/RN-AffinityAPI/ */
@@ -236,9 +251,27 @@ bool CPUMiner::initDevice()
  * If we get here it means epoch has changed so it's not necessary
  * to check again dag sizes. They're changed for sure
  * We've all related infos in m_epochContext (.dagSize, .dagNumItems, .lightSize, .lightNumItems)
+ *
+ * The full dataset is shared by all CPU miners (and, through the on-disk cache,
+ * by restarts and other instances): the first miner to get here generates or
+ * maps it, the others wait for it.
  */
 bool CPUMiner::initEpoch_internal()
 {
+    resume(MinerPauseEnum::PauseDueToInitEpochError);
+
+    m_dag.reset();
+    try
+    {
+        // Miner thread is already pinned so a node replica is first touched locally
+        m_dag = Farm::f().dagStore().acquire(
+            m_epochContext.epochNumber, m_settings.numa ? m_deviceDescriptor.cpNumaNode : -1);
+    }
+    catch (const std::exception& _ex)
+    {
+        cwarn << "cp-" << m_index << " " << _ex.what();
+        pause(MinerPauseEnum::PauseDueToInitEpochError);
+    }
     return true;
 }
 
@@ -252,20 +285,25 @@ bool CPUMiner::initEpoch_internal()
 */
 void CPUMiner::kick_miner()
 {
-    m_new_work.store(true, std::memory_order_relaxed);
+    {
+        // Not to be missed by a miner about to wait
+        boost::mutex::scoped_lock l(x_work);
+        m_new_work.store(true, std::memory_order_relaxed);
+    }
     m_new_work_signal.notify_one();
 }
 
 
 void CPUMiner::search(const dev::eth::WorkPackage& w)
 {
-    constexpr size_t blocksize = 30;
+    // Multiple of every kernel's lanes count
+    constexpr size_t blocksize = 32;
 
-    const auto& context = ethash::get_global_epoch_context_full(w.epoch);
     const auto header = ethash::hash256_from_bytes(w.header.data());
     const auto boundary = ethash::hash256_from_bytes(w.boundary.data());
-    auto nonce = w.startNonce;
+    uint64_t nonce;
 
+    workLaunched(w);
     while (true)
     {
         if (m_new_work.load(std::memory_order_relaxed))  // new work arrived ?
@@ -277,8 +315,18 @@ void CPUMiner::search(const dev::eth::WorkPackage& w)
         if (shouldStop())
             break;
 
+        // Nothing left to search on this job: idle till the next one
+        if (!nextNonces(blocksize, nonce))
+        {
+            boost::system_time const timeout =
+                boost::get_system_time() + boost::posix_time::seconds(1);
+            boost::mutex::scoped_lock l(x_work);
+            if (!m_new_work.load(std::memory_order_relaxed))
+                m_new_work_signal.timed_wait(l, timeout);
+            continue;
+        }
 
-        auto r = ethash::search(context, header, boundary, nonce, blocksize);
+        auto r = CPUSearch::search(m_kernel, *m_dag, header, boundary, nonce, blocksize);
         if (r.solution_found)
         {
             h256 mix{reinterpret_cast<byte*>(r.mix_hash.bytes), h256::ConstructFromPointer};
@@ -288,7 +336,6 @@ void CPUMiner::search(const dev::eth::WorkPackage& w)
                    << " Sol: " << toHex(sol.nonce, HexPrefix::Add) << EthReset;
             Farm::f().submitProof(sol);
         }
-        nonce += blocksize;
 
         // Update the hash rate
         updateHashRate(blocksize, 1);
@@ -305,20 +352,22 @@ void CPUMiner::workLoop()
 
     WorkPackage current;
     current.header = h256();
+    unsigned workGeneration = 0;
 
-    if (!initDevice())
+    if (!startDevice())
         return;
 
     while (!shouldStop())
     {
         // Wait for work or 3 seconds (whichever the first)
-        const WorkPackage w = work();
+        const WorkPackage w = work(workGeneration);
         if (!w)
         {
             boost::system_time const timeout =
                 boost::get_system_time() + boost::posix_time::seconds(3);
             boost::mutex::scoped_lock l(x_work);
-            m_new_work_signal.timed_wait(l, timeout);
+            if (!newWork(workGeneration))
+                m_new_work_signal.timed_wait(l, timeout);
             continue;
         }
 
@@ -354,9 +403,42 @@ void CPUMiner::workLoop()
 }
 
 
+/*
+ * Maps logical CPUs to their NUMA node. Empty when unknown (or not NUMA)
+ */
+static std::map<unsigned, int> getNumaNodes()
+{
+    std::map<unsigned, int> nodes;
+#if defined(__linux__)
+    // Each node lists its CPUs as ranges, eg "0-7,16-23"
+    for (int node = 0;; node++)
+    {
+        ifstream f("/sys/devices/system/node/node" + to_string(node) + "/cpulist");
+        if (!f)
+            break;
+        string range;
+        while (getline(f, range, ','))
+        {
+            unsigned first = 0, last = 0;
+            char dash;
+            istringstream r(range);
+            if (!(r >> first))
+                continue;
+            if (!(r >> dash >> last))
+                last = first;
+            for (unsigned cpu = first; cpu <= last; cpu++)
+                nodes[cpu] = node;
+        }
+    }
+#endif
+    return nodes;
+}
+
+
 void CPUMiner::enumDevices(std::map<string, DeviceDescriptor>& _DevicesCollection)
 {
     unsigned numDevices = getNumDevices();
+    std::map<unsigned, int> numaNodes = getNumaNodes();
 
     for (unsigned i = 0; i < numDevices; i++)
     {
@@ -373,7 +455,8 @@ void CPUMiner::enumDevices(std::map<string, DeviceDescriptor>& _DevicesCollectio
 
         s.str("");
         s.clear();
-        s << "ethash::eval()/boost " << (BOOST_VERSION / 100000) << "."
+        s << "ethash::search(" << CPUSearch::name(CPUSearch::detect()) << ")/boost "
+          << (BOOST_VERSION / 100000) << "."
           << (BOOST_VERSION / 100 % 1000) << "." << (BOOST_VERSION % 100);
         deviceDescriptor.name = s.str();
         deviceDescriptor.uniqueId = uniqueId;
@@ -381,6 +464,8 @@ void CPUMiner::enumDevices(std::map<string, DeviceDescriptor>& _DevicesCollectio
         deviceDescriptor.totalMemory = getTotalPhysAvailableMemory();
 
         deviceDescriptor.cpCpuNumer = i;
+        auto node = numaNodes.find(i);
+        deviceDescriptor.cpNumaNode = (node != numaNodes.end() ? node->second : -1);
 
         _DevicesCollection[uniqueId] = deviceDescriptor;
     }
@@ -23,6 +23,8 @@ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <functional>
 
+#include "CPUSearch.h"
+
 namespace dev
 {
 namespace eth
@@ -47,6 +49,8 @@ private:
     atomic<bool> m_new_work = {false};
     void workLoop() override;
     CPSettings m_settings;
+    CPUSearchKernel m_kernel;
+    std::shared_ptr<const EpochDag> m_dag;
 };
 
 
@@ -0,0 +1,158 @@
+/*
+This file is part of ethminer.
+
+ethminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ethminer is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+#include "CPUSearch.h"
+#include "CPUSearchKernel.h"
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+
+namespace
+{
+enum class CPUFeature
+{
+    AVX2,
+    AVX512F
+};
+
+bool cpuSupports(CPUFeature _feature)
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int regs[4];
+    __cpuid(regs, 0);
+    if (regs[0] < 7)
+        return false;
+
+    // The OS must save the YMM (and ZMM) state on context switches
+    __cpuid(regs, 1);
+    if (!(regs[2] & (1 << 27)))
+        return false;
+    unsigned long long xcr0 = _xgetbv(0);
+
+    __cpuidex(regs, 7, 0);
+    switch (_feature)
+    {
+    case CPUFeature::AVX2:
+        return (xcr0 & 0x06) == 0x06 && (regs[1] & (1 << 5));
+    case CPUFeature::AVX512F:
+        return (xcr0 & 0xe6) == 0xe6 && (regs[1] & (1 << 16));
+    }
+    return false;
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    // Also checks the OS has enabled the extended register state
+    __builtin_cpu_init();
+    switch (_feature)
+    {
+    case CPUFeature::AVX2:
+        return __builtin_cpu_supports("avx2");
+    case CPUFeature::AVX512F:
+        return __builtin_cpu_supports("avx512f");
+    }
+    return false;
+#else
+    (void)_feature;
+    return false;
+#endif
+}
+
+struct ScalarLanes
+{
+    static constexpr unsigned lanes = 1;
+    typedef uint64_t u64;
+    typedef uint32_t u32;
+
+    static inline u64 set64(uint64_t _v) { return _v; }
+    static inline u64 load64(const uint64_t* _p) { return *_p; }
+    static inline void store64(uint64_t* _p, u64 _v) { *_p = _v; }
+    static inline u64 xor64(u64 _a, u64 _b) { return _a ^ _b; }
+    static inline u64 andnot64(u64 _a, u64 _b) { return ~_a & _b; }
+    static inline u64 add64(u64 _a, u64 _b) { return _a + _b; }
+    static inline u64 rol64(u64 _v, int _n) { return _n ? (_v << _n) | (_v >> (64 - _n)) : _v; }
+
+    static inline u32 load32(const uint32_t* _p) { return *_p; }
+    static inline void store32(uint32_t* _p, u32 _v) { *_p = _v; }
+    static inline u32 fnv32(u32 _a, u32 _b) { return (_a * cpusearch::c_fnvPrime) ^ _b; }
+    static inline u32 gather32(const int32_t* _base, u64 _idx) { return uint32_t(_base[_idx]); }
+};
+
+}  // namespace
+
+
+CPUSearchKernel CPUSearch::detect() noexcept
+{
+    if (cpusearch::c_haveAVX512 && cpuSupports(CPUFeature::AVX512F))
+        return CPUSearchKernel::AVX512;
+    if (cpusearch::c_haveAVX2 && cpuSupports(CPUFeature::AVX2))
+        return CPUSearchKernel::AVX2;
+    return CPUSearchKernel::Scalar;
+}
+
+
+const char* CPUSearch::name(CPUSearchKernel _kernel) noexcept
+{
+    switch (_kernel)
+    {
+    case CPUSearchKernel::AVX2:
+        return "avx2";
+    case CPUSearchKernel::AVX512:
+        return "avx512";
+    default:
+        return "scalar";
+    }
+}
+
+
+unsigned CPUSearch::lanes(CPUSearchKernel _kernel) noexcept
+{
+    switch (_kernel)
+    {
+    case CPUSearchKernel::AVX2:
+        return 4;
+    case CPUSearchKernel::AVX512:
+        return 8;
+    default:
+        return 1;
+    }
+}
+
+
+ethash::search_result CPUSearch::search(CPUSearchKernel _kernel, const EpochDag& _dag,
+    const ethash::hash256& _header, const ethash::hash256& _boundary, uint64_t _startNonce,
+    size_t _iterations) noexcept
+{
+    const size_t batches = (_iterations + lanes(_kernel) - 1) / lanes(_kernel);
+
+    switch (_kernel)
+    {
+    case CPUSearchKernel::AVX2:
+        return cpusearch::searchAVX2(
+            _dag.items, _dag.numItems, _header, _boundary, _startNonce, batches);
+    case CPUSearchKernel::AVX512:
+        return cpusearch::searchAVX512(
+            _dag.items, _dag.numItems, _header, _boundary, _startNonce, batches);
+    default:
+        return cpusearch::searchLanes<ScalarLanes>(
+            _dag.items, _dag.numItems, _header, _boundary, _startNonce, batches);
+    }
+}
@@ -0,0 +1,69 @@
+/*
+This file is part of ethminer.
+
+ethminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ethminer is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <libethcore/DagStore.h>
+
+#include <ethash/ethash.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace dev
+{
+namespace eth
+{
+enum class CPUSearchKernel
+{
+    Scalar,
+    AVX2,
+    AVX512
+};
+
+/**
+ * @brief Ethash search over a range of nonces on the host CPU.
+ *
+ * The SIMD kernels hash several nonces at once: Keccak states are interleaved
+ * one nonce per vector lane, DAG items are fetched with gathers and the FNV
+ * mixing is done vector-wide. The kernel is picked at runtime from the
+ * CPUID feature bits, the scalar one (a single lane) remains the fallback.
+ */
+class CPUSearch
+{
+public:
+    /** @brief Returns the widest kernel both compiled in and supported by this CPU */
+    static CPUSearchKernel detect() noexcept;
+
+    static const char* name(CPUSearchKernel _kernel) noexcept;
+
+    /** @brief Number of nonces hashed in parallel by the kernel */
+    static unsigned lanes(CPUSearchKernel _kernel) noexcept;
+
+    /**
+     * @brief Searches @p _iterations nonces starting at @p _startNonce.
+     *
+     * SIMD kernels round @p _iterations up to a multiple of lanes().
+     * Returns the first nonce (in nonce order) meeting the boundary, if any.
+     */
+    static ethash::search_result search(CPUSearchKernel _kernel, const EpochDag& _dag,
+        const ethash::hash256& _header, const ethash::hash256& _boundary, uint64_t _startNonce,
+        size_t _iterations) noexcept;
+};
+
+}  // namespace eth
+}  // namespace dev
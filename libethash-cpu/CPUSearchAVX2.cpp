@@ -0,0 +1,106 @@
+/*
+This file is part of ethminer.
+
+ethminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ethminer is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ 4 lanes ethash kernel. Built with AVX2 enabled (see CMakeLists.txt), only
+ ever called after CPUSearch::detect() has checked the CPU supports it.
+*/
+
+#include "CPUSearchKernel.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace dev
+{
+namespace eth
+{
+namespace cpusearch
+{
+#if defined(__AVX2__)
+
+const bool c_haveAVX2 = true;
+
+namespace
+{
+struct AVX2Lanes
+{
+    static constexpr unsigned lanes = 4;
+    typedef __m256i u64;
+    typedef __m128i u32;
+
+    static inline u64 set64(uint64_t _v) { return _mm256_set1_epi64x(int64_t(_v)); }
+    static inline u64 load64(const uint64_t* _p)
+    {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(_p));
+    }
+    static inline void store64(uint64_t* _p, u64 _v)
+    {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(_p), _v);
+    }
+    static inline u64 xor64(u64 _a, u64 _b) { return _mm256_xor_si256(_a, _b); }
+    static inline u64 andnot64(u64 _a, u64 _b) { return _mm256_andnot_si256(_a, _b); }
+    static inline u64 add64(u64 _a, u64 _b) { return _mm256_add_epi64(_a, _b); }
+    static inline u64 rol64(u64 _v, int _n)
+    {
+        return _mm256_or_si256(_mm256_sll_epi64(_v, _mm_cvtsi32_si128(_n)),
+            _mm256_srl_epi64(_v, _mm_cvtsi32_si128(64 - _n)));
+    }
+
+    static inline u32 load32(const uint32_t* _p)
+    {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(_p));
+    }
+    static inline void store32(uint32_t* _p, u32 _v)
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(_p), _v);
+    }
+    static inline u32 fnv32(u32 _a, u32 _b)
+    {
+        return _mm_xor_si128(_mm_mullo_epi32(_a, _mm_set1_epi32(int(c_fnvPrime))), _b);
+    }
+    static inline u32 gather32(const int32_t* _base, u64 _idx)
+    {
+        return _mm256_i64gather_epi32(reinterpret_cast<const int*>(_base), _idx, 4);
+    }
+};
+
+}  // namespace
+
+ethash::search_result searchAVX2(const ethash_hash1024* _dag, uint32_t _dagItems,
+    const ethash::hash256& _header, const ethash::hash256& _boundary, uint64_t _startNonce,
+    size_t _batches) noexcept
+{
+    return searchLanes<AVX2Lanes>(_dag, _dagItems, _header, _boundary, _startNonce, _batches);
+}
+
+#else
+
+const bool c_haveAVX2 = false;
+
+ethash::search_result searchAVX2(const ethash_hash1024*, uint32_t, const ethash::hash256&,
+    const ethash::hash256&, uint64_t, size_t) noexcept
+{
+    return ethash::search_result{};
+}
+
+#endif
+
+}  // namespace cpusearch
+}  // namespace eth
+}  // namespace dev
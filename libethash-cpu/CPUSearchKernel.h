@@ -0,0 +1,228 @@
+/*
+This file is part of ethminer.
+
+ethminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ethminer is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ Lane generic ethash hashimoto used by the SIMD search kernels.
+
+ Every kernel translation unit is compiled with its own instruction set
+ flags and instantiates searchLanes<> with its own vector traits type V,
+ which must provide:
+
+   V::lanes                           number of nonces hashed at once
+   V::u64 / V::u32                    one 64 / 32 bit word per lane
+   set64, load64, store64             broadcast and array transfers
+   xor64, andnot64 (~a & b), rol64, add64
+   load32, store32
+   fnv32(a, b)                        a * FNV_PRIME ^ b
+   gather32(base, idx)                base[idx[lane]] for each lane
+
+ Apart from the kernel entry points, nothing in here but templates and
+ internal linkage constants, so the per-ISA instantiations can never be
+ merged by the linker.
+*/
+
+#pragma once
+
+#include <ethash/ethash.hpp>
+
+#include <cstdint>
+#include <cstring>
+
+namespace dev
+{
+namespace eth
+{
+namespace cpusearch
+{
+ethash::search_result searchAVX2(const ethash_hash1024* _dag, uint32_t _dagItems,
+    const ethash::hash256& _header, const ethash::hash256& _boundary, uint64_t _startNonce,
+    size_t _batches) noexcept;
+ethash::search_result searchAVX512(const ethash_hash1024* _dag, uint32_t _dagItems,
+    const ethash::hash256& _header, const ethash::hash256& _boundary, uint64_t _startNonce,
+    size_t _batches) noexcept;
+
+/** @brief Whether the kernel translation unit was built with its instruction set enabled */
+extern const bool c_haveAVX2;
+extern const bool c_haveAVX512;
+
+static const uint32_t c_fnvPrime = 0x01000193;
+static const int c_datasetAccesses = 64;
+static const int c_mixWords = 32;  // 32-bit words in a 1024-bit DAG item
+
+static const uint64_t c_keccakRoundConstants[24] = {0x0000000000000001, 0x0000000000008082,
+    0x800000000000808a, 0x8000000080008000, 0x000000000000808b, 0x0000000080000001,
+    0x8000000080008081, 0x8000000000008009, 0x000000000000008a, 0x0000000000000088,
+    0x0000000080008009, 0x000000008000000a, 0x000000008000808b, 0x800000000000008b,
+    0x8000000000008089, 0x8000000000008003, 0x8000000000008002, 0x8000000000000080,
+    0x000000000000800a, 0x800000008000000a, 0x8000000080008081, 0x8000000000008080,
+    0x0000000080000001, 0x8000000080008008};
+
+// Rho offsets indexed by x + 5 * y
+static const int c_keccakRotations[25] = {0, 1, 62, 28, 27, 36, 44, 6, 55, 20, 3, 10, 43, 25,
+    39, 41, 45, 15, 21, 8, 18, 2, 61, 56, 14};
+
+template <class V>
+inline void keccakf1600(typename V::u64* A)
+{
+    typename V::u64 B[25], C[5], D[5];
+
+    for (int round = 0; round < 24; ++round)
+    {
+        // Theta
+        for (int x = 0; x < 5; ++x)
+            C[x] = V::xor64(V::xor64(V::xor64(A[x], A[x + 5]), V::xor64(A[x + 10], A[x + 15])),
+                A[x + 20]);
+        for (int x = 0; x < 5; ++x)
+            D[x] = V::xor64(C[(x + 4) % 5], V::rol64(C[(x + 1) % 5], 1));
+        for (int y = 0; y < 25; y += 5)
+            for (int x = 0; x < 5; ++x)
+                A[y + x] = V::xor64(A[y + x], D[x]);
+
+        // Rho and Pi
+        for (int y = 0; y < 5; ++y)
+            for (int x = 0; x < 5; ++x)
+                B[y + 5 * ((2 * x + 3 * y) % 5)] =
+                    V::rol64(A[x + 5 * y], c_keccakRotations[x + 5 * y]);
+
+        // Chi
+        for (int y = 0; y < 25; y += 5)
+            for (int x = 0; x < 5; ++x)
+                A[y + x] =
+                    V::xor64(B[y + x], V::andnot64(B[y + (x + 1) % 5], B[y + (x + 2) % 5]));
+
+        // Iota
+        A[0] = V::xor64(A[0], V::set64(c_keccakRoundConstants[round]));
+    }
+}
+
+template <class V>
+inline ethash::search_result searchLanes(const ethash_hash1024* _dag, uint32_t _dagItems,
+    const ethash::hash256& _header, const ethash::hash256& _boundary, uint64_t _startNonce,
+    size_t _batches) noexcept
+{
+    typedef typename V::u64 u64;
+    typedef typename V::u32 u32;
+    constexpr unsigned L = V::lanes;
+
+    const int32_t* dagWords = reinterpret_cast<const int32_t*>(_dag);
+
+    u64 state[25], seed[8];
+    u32 mix[c_mixWords], cmix[8];
+    uint64_t words[L], seeds[8][L];
+    uint32_t lanes[L], seedInit[L];
+    uint64_t index[L];
+
+    ethash::search_result result{};
+
+    for (size_t batch = 0; batch < _batches; ++batch)
+    {
+        const uint64_t nonce = _startNonce + batch * L;
+
+        // Seed: keccak512(header . nonce) with one nonce per lane
+        for (unsigned l = 0; l < L; ++l)
+            words[l] = nonce + l;
+        for (int i = 0; i < 4; ++i)
+            state[i] = V::set64(_header.word64s[i]);
+        state[4] = V::load64(words);
+        state[5] = V::set64(0x01);
+        for (int i = 6; i < 25; ++i)
+            state[i] = V::set64(0);
+        state[8] = V::set64(0x8000000000000000);
+        keccakf1600<V>(state);
+
+        for (int i = 0; i < 8; ++i)
+        {
+            seed[i] = state[i];
+            V::store64(seeds[i], state[i]);
+        }
+        for (int w = 0; w < 16; ++w)
+        {
+            for (unsigned l = 0; l < L; ++l)
+                lanes[l] = static_cast<uint32_t>(seeds[w / 2][l] >> (32 * (w & 1)));
+            mix[w] = mix[w + 16] = V::load32(lanes);
+        }
+        for (unsigned l = 0; l < L; ++l)
+            seedInit[l] = static_cast<uint32_t>(seeds[0][l]);
+
+        // DAG accesses: item indexes are resolved per lane, loads and FNV are vector-wide
+        for (uint32_t i = 0; i < c_datasetAccesses; ++i)
+        {
+            V::store32(lanes, mix[i % c_mixWords]);
+            for (unsigned l = 0; l < L; ++l)
+            {
+                const uint32_t p = ((i ^ seedInit[l]) * c_fnvPrime ^ lanes[l]) % _dagItems;
+                index[l] = static_cast<uint64_t>(p) * c_mixWords;
+            }
+            const u64 base = V::load64(index);
+            for (int j = 0; j < c_mixWords; ++j)
+                mix[j] = V::fnv32(
+                    mix[j], V::gather32(dagWords, V::add64(base, V::set64(uint64_t(j)))));
+        }
+
+        // Compress the mix to 256 bits
+        for (int k = 0; k < 8; ++k)
+            cmix[k] = V::fnv32(
+                V::fnv32(V::fnv32(mix[4 * k], mix[4 * k + 1]), mix[4 * k + 2]), mix[4 * k + 3]);
+
+        uint32_t cmixes[8][L];
+        for (int k = 0; k < 8; ++k)
+            V::store32(cmixes[k], cmix[k]);
+
+        // Final: keccak256(seed . cmix)
+        for (int i = 0; i < 8; ++i)
+            state[i] = seed[i];
+        for (int i = 0; i < 4; ++i)
+        {
+            for (unsigned l = 0; l < L; ++l)
+                words[l] = uint64_t(cmixes[2 * i][l]) | (uint64_t(cmixes[2 * i + 1][l]) << 32);
+            state[8 + i] = V::load64(words);
+        }
+        state[12] = V::set64(0x01);
+        for (int i = 13; i < 25; ++i)
+            state[i] = V::set64(0);
+        state[16] = V::set64(0x8000000000000000);
+        keccakf1600<V>(state);
+
+        uint64_t finals[4][L];
+        for (int i = 0; i < 4; ++i)
+            V::store64(finals[i], state[i]);
+
+        for (unsigned l = 0; l < L; ++l)
+        {
+            ethash::hash256 final;
+            for (int i = 0; i < 4; ++i)
+                final.word64s[i] = finals[i][l];
+
+            // Both hashes are big endian numbers
+            if (std::memcmp(final.bytes, _boundary.bytes, sizeof(final.bytes)) > 0)
+                continue;
+
+            result.solution_found = true;
+            result.nonce = nonce + l;
+            result.final_hash = final;
+            for (int k = 0; k < 8; ++k)
+                result.mix_hash.word32s[k] = cmixes[k][l];
+            return result;
+        }
+    }
+
+    return result;
+}
+
+}  // namespace cpusearch
+}  // namespace eth
+}  // namespace dev
@@ -189,11 +189,12 @@ void CUDAMiner::workLoop()
 {
     WorkPackage current;
     current.header = h256();
+    unsigned workGeneration = 0;
 
     m_search_buf.resize(m_settings.streams);
     m_streams.resize(m_settings.streams);
 
-    if (!initDevice())
+    if (!startDevice())
         return;
 
     try
@@ -201,7 +202,7 @@ void CUDAMiner::workLoop()
         while (!shouldStop())
         {
             // Wait for work or 3 seconds (whichever the first)
-            const WorkPackage w = work();
+            const WorkPackage w = work(workGeneration);
             if (!w)
             {
                 boost::system_time const timeout =
@@ -230,11 +231,12 @@ void CUDAMiner::workLoop()
             uint64_t upper64OfBoundary = (uint64_t)(u64)((u256)current.boundary >> 192);
 
             // Eventually start searching
-            search(current.header.data(), upper64OfBoundary, current.startNonce, w);
+            search(current.header.data(), upper64OfBoundary, w);
         }
 
-        // Reset miner and stop working
-        CUDA_SAFE_CALL(cudaDeviceReset());
+        // Reset miner and stop working, unless restarting warm
+        if (!keepDevice())
+            CUDA_SAFE_CALL(cudaDeviceReset());
     }
     catch (cuda_runtime_error const& _e)
     {
@@ -322,8 +324,7 @@ void CUDAMiner::enumDevices(std::map<string, DeviceDescriptor>& _DevicesCollecti
     }
 }
 
-void CUDAMiner::search(
-    uint8_t const* header, uint64_t target, uint64_t start_nonce, const dev::eth::WorkPackage& w)
+void CUDAMiner::search(uint8_t const* header, uint64_t target, const dev::eth::WorkPackage& w)
 {
     set_header(*reinterpret_cast<hash32_t const*>(header));
     if (m_current_target != target)
@@ -332,18 +333,27 @@ void CUDAMiner::search(
         m_current_target = target;
     }
 
+    // Nonces each stream is searching
+    std::vector<uint64_t> stream_nonce(m_settings.streams);
+    std::vector<bool> running(m_settings.streams, false);
+
     // prime each stream, clear search result buffers and start the search
     uint32_t current_index;
-    for (current_index = 0; current_index < m_settings.streams;
-         current_index++, start_nonce += m_batch_size)
+    for (current_index = 0; current_index < m_settings.streams; current_index++)
     {
+        if (!nextNonces(m_batch_size, stream_nonce[current_index]))
+            break;
+
         cudaStream_t stream = m_streams[current_index];
         volatile Search_results& buffer(*m_search_buf[current_index]);
         buffer.count = 0;
 
         // Run the batch for this stream
-        run_ethash_search(m_settings.gridSize, m_settings.blockSize, stream, &buffer, start_nonce);
+        run_ethash_search(m_settings.gridSize, m_settings.blockSize, stream, &buffer,
+            stream_nonce[current_index]);
+        running[current_index] = true;
     }
+    workLaunched(w);
 
     // process stream batches until we get new work.
     bool done = false;
@@ -360,9 +370,12 @@ void CUDAMiner::search(
             done = paused();
 
         // This inner loop will process each cuda stream individually
-        for (current_index = 0; current_index < m_settings.streams;
-             current_index++, start_nonce += m_batch_size)
+        uint32_t completed = 0;
+        for (current_index = 0; current_index < m_settings.streams; current_index++)
         {
+            if (!running[current_index])
+                continue;
+
             // Each pass of this loop will wait for a stream to exit,
             // save any found solutions, then restart the stream
             // on the next group of nonces.
@@ -370,6 +383,7 @@ void CUDAMiner::search(
 
             // Wait for the stream complete
             CUDA_SAFE_CALL(cudaStreamSynchronize(stream));
+            completed++;
 
             if (shouldStop())
             {
@@ -400,14 +414,17 @@ void CUDAMiner::search(
             }
 
             // restart the stream on the next batch of nonces
-            // unless we are done for this round.
-            if (!done)
-                run_ethash_search(
-                    m_settings.gridSize, m_settings.blockSize, stream, &buffer, start_nonce);
+            // unless we are done for this round or the job has
+            // no nonces left
+            uint64_t nonce_base = stream_nonce[current_index];
+            running[current_index] =
+                !done && nextNonces(m_batch_size, stream_nonce[current_index]);
+            if (running[current_index])
+                run_ethash_search(m_settings.gridSize, m_settings.blockSize, stream, &buffer,
+                    stream_nonce[current_index]);
 
             if (found_count)
             {
-                uint64_t nonce_base = start_nonce - m_streams_batch_size;
                 for (uint32_t i = 0; i < found_count; i++)
                 {
                     uint64_t nonce = nonce_base + gids[i];
@@ -421,7 +438,8 @@ void CUDAMiner::search(
         }
 
         // Update the hash rate
-        updateHashRate(m_batch_size, m_settings.streams);
+        if (completed)
+            updateHashRate(m_batch_size, completed);
 
         // Bail out if it's shutdown time
         if (shouldStop())
@@ -429,6 +447,15 @@ void CUDAMiner::search(
             m_new_work.store(false, std::memory_order_relaxed);
             break;
         }
+
+        // All the job's nonces are searched: idle till the next one
+        if (!done && !completed)
+        {
+            boost::system_time const timeout =
+                boost::get_system_time() + boost::posix_time::seconds(1);
+            boost::mutex::scoped_lock l(x_work);
+            m_new_work_signal.timed_wait(l, timeout);
+        }
     }
 
 #ifdef DEV_BUILD
@@ -38,8 +38,7 @@ public:
     static int getNumDevices();
     static void enumDevices(std::map<string, DeviceDescriptor>& _DevicesCollection);
 
-    void search(
-        uint8_t const* header, uint64_t target, uint64_t _startN, const dev::eth::WorkPackage& w);
+    void search(uint8_t const* header, uint64_t target, const dev::eth::WorkPackage& w);
 
 protected:
     bool initDevice() override;
@@ -0,0 +1,194 @@
+/*
+ This file is part of ethminer.
+
+ ethminer is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ ethminer is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+#include <libdevcore/CommonData.h>
+#include <libdevcore/Log.h>
+
+#include "DagBuilder.h"
+#include "EthashAux.h"
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+namespace
+{
+// Items handed out at once to a thread. Small enough to keep threads
+// balanced till the end and to check for interruptions frequently
+const uint32_t c_chunkItems = 4096;
+
+#if defined(__linux__)
+cpu_set_t processCpus()
+{
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    if (sched_getaffinity(0, sizeof(cpus), &cpus))
+        for (int i = 0; i < CPU_SETSIZE; i++)
+            CPU_SET(i, &cpus);
+    return cpus;
+}
+
+// Taken before main(), thus before any miner thread pins itself
+const cpu_set_t s_processCpus = processCpus();
+
+// The node lists its CPUs as ranges, eg "0-7,16-23"
+bool nodeCpus(int _node, cpu_set_t& _cpus)
+{
+    CPU_ZERO(&_cpus);
+    if (_node < 0)
+        return false;
+    ifstream f("/sys/devices/system/node/node" + to_string(_node) + "/cpulist");
+    string range;
+    while (getline(f, range, ','))
+    {
+        unsigned first = 0, last = 0;
+        char dash;
+        istringstream r(range);
+        if (!(r >> first))
+            continue;
+        if (!(r >> dash >> last))
+            last = first;
+        for (unsigned cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+            if (CPU_ISSET(cpu, &s_processCpus))
+                CPU_SET(cpu, &_cpus);
+    }
+    return CPU_COUNT(&_cpus) > 0;
+}
+#endif
+
+}  // namespace
+
+
+DagBuilder::DagBuilder(unsigned _threads) : m_threads(_threads)
+{
+    if (!m_threads)
+        m_threads = max(1u, thread::hardware_concurrency());
+}
+
+bool DagBuilder::build(const ethash::epoch_context& _context, ethash_hash1024* _items,
+    const atomic<bool>& _stop, int _node)
+{
+    const uint32_t numItems = uint32_t(_context.full_dataset_num_items);
+    const auto startInit = chrono::steady_clock::now();
+
+    m_epoch.store(_context.epoch_number, memory_order_relaxed);
+    m_itemsTotal.store(numItems, memory_order_relaxed);
+    m_itemsDone.store(0, memory_order_relaxed);
+    m_start.store(startInit.time_since_epoch().count(), memory_order_relaxed);
+    m_generating.store(true, memory_order_release);
+
+    atomic<uint32_t> nextChunk = {0};
+    auto worker = [&]() {
+        while (!_stop.load(memory_order_relaxed))
+        {
+            uint32_t first = nextChunk.fetch_add(c_chunkItems, memory_order_relaxed);
+            if (first >= numItems)
+                break;
+            uint32_t last = min(numItems, first + c_chunkItems);
+            for (uint32_t i = first; i < last; i++)
+                EthashAux::calculateDatasetItem(_context, i, _items[i]);
+            m_itemsDone.fetch_add(last - first, memory_order_relaxed);
+        }
+    };
+
+    // No more threads than the node has CPUs
+    unsigned threads = m_threads;
+#if defined(__linux__)
+    cpu_set_t cpus;
+    if (nodeCpus(_node, cpus))
+        threads = min(threads, unsigned(CPU_COUNT(&cpus)));
+#endif
+
+    // The calling thread takes its share too
+    vector<thread> pool;
+    for (unsigned t = 1; t < threads; t++)
+        pool.emplace_back([&]() {
+            setThreadName("dag");
+            releaseAffinity(_node);
+            worker();
+        });
+    worker();
+    for (auto& t : pool)
+        t.join();
+
+    m_generating.store(false, memory_order_relaxed);
+
+    if (_stop.load(memory_order_relaxed))
+        return false;
+
+    auto dagTime =
+        chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - startInit);
+    cnote << dev::getFormattedMemory(double(numItems) * sizeof(ethash_hash1024))
+          << " of DAG data generated in " << dagTime.count() << " ms. (" << threads
+          << " threads)";
+    return true;
+}
+
+void DagBuilder::releaseAffinity(int _node)
+{
+#if defined(__linux__)
+    cpu_set_t cpus;
+    if (!nodeCpus(_node, cpus))
+        cpus = s_processCpus;
+    if (sched_setaffinity(0, sizeof(cpus), &cpus))
+        cwarn << "Unable to widen DAG thread affinity : " << strerror(errno);
+#else
+    (void)_node;
+#endif
+}
+
+bool DagBuilder::knowsNode(int _node)
+{
+#if defined(__linux__)
+    cpu_set_t cpus;
+    return nodeCpus(_node, cpus);
+#else
+    (void)_node;
+    return false;
+#endif
+}
+
+DagProgressType DagBuilder::progress() const
+{
+    DagProgressType p;
+    if (!m_generating.load(memory_order_acquire))
+        return p;
+
+    p.generating = true;
+    p.epoch = m_epoch.load(memory_order_relaxed);
+    p.itemsTotal = m_itemsTotal.load(memory_order_relaxed);
+    p.itemsDone = m_itemsDone.load(memory_order_relaxed);
+
+    auto elapsed = chrono::steady_clock::now() -
+                   chrono::steady_clock::time_point(
+                       chrono::steady_clock::duration(m_start.load(memory_order_relaxed)));
+    auto seconds = chrono::duration_cast<chrono::seconds>(elapsed).count();
+    if (p.itemsDone)
+        p.eta = unsigned(seconds * (p.itemsTotal - p.itemsDone) / p.itemsDone);
+    return p;
+}
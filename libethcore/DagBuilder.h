@@ -0,0 +1,85 @@
+/*
+ This file is part of ethminer.
+
+ ethminer is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ ethminer is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+#include <ethash/ethash.hpp>
+
+#include "Miner.h"
+
+namespace dev
+{
+namespace eth
+{
+/**
+ * @brief Generates a full ethash dataset on the host.
+ *
+ * The item range is split in chunks handed out to a pool of threads, each
+ * writing its items straight into the destination buffer. Progress can be
+ * polled from any thread while a build is running.
+ */
+class DagBuilder
+{
+public:
+    /**
+     * @param _threads Number of generating threads. 0 = one per logical CPU
+     */
+    DagBuilder(unsigned _threads);
+
+    /**
+     * @brief Fills @p _items with all the dataset items of the epoch of @p _context.
+     * @param _node When >= 0 and the CPUs of that NUMA node are known, the spawned
+     *  threads run on them only, so pages they first touch are local to the node
+     * @return false if interrupted by @p _stop
+     */
+    bool build(const ethash::epoch_context& _context, ethash_hash1024* _items,
+        const std::atomic<bool>& _stop, int _node = -1);
+
+    /**
+     * @brief Progress of the running build (generating false if none)
+     */
+    DagProgressType progress() const;
+
+    unsigned threads() const { return m_threads; }
+
+    /**
+     * @brief Lets the calling thread run on all the CPUs the process started with,
+     * or those of NUMA node @p _node when >= 0 and known. Miner threads pin
+     * themselves to a single CPU, which threads they spawn inherit
+     */
+    static void releaseAffinity(int _node = -1);
+
+    /**
+     * @brief Whether the CPUs of NUMA node @p _node are known, thus builds can be kept on it
+     */
+    static bool knowsNode(int _node);
+
+private:
+    unsigned m_threads;
+
+    std::atomic<bool> m_generating = {false};
+    std::atomic<int> m_epoch = {-1};
+    std::atomic<uint32_t> m_itemsDone = {0};
+    std::atomic<uint32_t> m_itemsTotal = {0};
+    std::atomic<std::chrono::steady_clock::rep> m_start = {0};
+};
+
+}  // namespace eth
+}  // namespace dev
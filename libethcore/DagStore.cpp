@@ -0,0 +1,430 @@
+/*
+ This file is part of ethminer.
+
+ ethminer is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ ethminer is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <random>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/anonymous_shared_memory.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <libdevcore/CommonData.h>
+#include <libdevcore/Log.h>
+
+#include "DagStore.h"
+#include "EthashAux.h"
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+namespace fs = boost::filesystem;
+namespace bip = boost::interprocess;
+
+namespace
+{
+const char c_dagMagic[8] = {'E', 'T', 'H', 'D', 'A', 'G', 0, 0};
+const uint32_t c_dagVersion = 2;
+const size_t c_dagHeaderSize = 4096;  // Keeps the items page aligned in the mapping
+const uint32_t c_sampledItems = 256;  // Items recomputed to check a file when loaded
+
+#if defined(__linux__)
+#if !defined(MAP_HUGE_SHIFT)
+#define MAP_HUGE_SHIFT 26
+#endif
+#if !defined(MADV_HUGEPAGE)
+#define MADV_HUGEPAGE 14
+#endif
+#endif
+
+struct DagFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    int32_t epoch;
+    uint32_t numItems;
+    uint32_t reserved;
+};
+
+/*
+ * Recomputes a few items picked at random, one in each of as many slices of
+ * the dataset. Reading the whole file would cost as much as generating it,
+ * while a file renamed in place only once complete is mostly at risk of
+ * coming from another build or having been damaged in large blocks.
+ */
+bool sample(const ethash::epoch_context& _context, const ethash_hash1024* _items)
+{
+    const uint32_t numItems = uint32_t(_context.full_dataset_num_items);
+    const uint32_t slice = max(numItems / c_sampledItems, 1u);
+    mt19937 rng(random_device{}());
+    uniform_int_distribution<uint32_t> offset(0, slice - 1);
+
+    ethash_hash1024 item;
+    for (uint32_t first = 0; first < numItems; first += slice)
+    {
+        uint32_t i = min(first + offset(rng), numItems - 1);
+        EthashAux::calculateDatasetItem(_context, i, item);
+        if (memcmp(&item, &_items[i], sizeof(item)))
+            return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+
+DagStore::DagStore(const CPSettings& _settings)
+  : m_dir(_settings.dagDir),
+    m_hugePages(_settings.hugePages),
+    m_builder(_settings.dagThreads),
+    m_prefetchBuilder(1)
+{}
+
+DagStore::~DagStore()
+{
+    m_stop.store(true, memory_order_relaxed);
+    if (m_prefetchThread.joinable())
+        m_prefetchThread.join();
+}
+
+std::string DagStore::defaultDir()
+{
+#if defined(_WIN32)
+    const char* base = getenv("LOCALAPPDATA");
+    if (!base)
+        return "";
+    return (fs::path(base) / "ethminer" / "dag").string();
+#else
+    const char* base = getenv("HOME");
+    if (!base)
+        return "";
+    return (fs::path(base) / ".ethminer" / "dag").string();
+#endif
+}
+
+std::string DagStore::filePath(int _epoch) const
+{
+    return (fs::path(m_dir) / (to_string(_epoch) + ".bin")).string();
+}
+
+std::shared_ptr<const EpochDag> DagStore::acquire(int _epoch, int _node)
+{
+    unique_lock<mutex> l(x_dags);
+
+    if (!m_current || m_current->epoch != _epoch)
+    {
+        // Don't generate twice what is already being generated in background
+        m_prefetchDone.wait(l, [&] { return m_prefetchEpoch != _epoch; });
+
+        m_current.reset();
+        m_replicas.clear();
+
+        shared_ptr<EpochDag> dag;
+        m_currentAnonymous = false;
+        m_currentNode = -1;
+        if (!m_dir.empty())
+        {
+            dag = load(_epoch);
+            if (!dag)
+                dag = generateToFile(_epoch, m_builder);
+        }
+        if (!dag)
+        {
+            dag = generateInMemory(_epoch, _node);
+            m_currentAnonymous = true;
+            if (DagBuilder::knowsNode(_node))
+                m_currentNode = _node;
+        }
+        if (!dag)
+            throw runtime_error("Unable to provide DAG for epoch " + to_string(_epoch));
+
+        m_current = dag;
+
+        if (!m_dir.empty())
+            prefetch(_epoch + 1);
+    }
+
+    // Page cache can't be backed by huge pages: a private copy is needed
+    if (_node < 0 && (m_hugePages == "none" || m_currentAnonymous))
+        return m_current;
+
+    auto it = m_replicas.find(_node);
+    if (it != m_replicas.end())
+        return it->second;
+
+    // Generated in memory by threads of this node already: it's its replica
+    if (_node >= 0 && m_currentAnonymous && _node == m_currentNode)
+    {
+        m_replicas[_node] = m_current;
+        return m_current;
+    }
+
+    auto replica = replicate(*m_current, _node);
+    if (!replica)
+        return m_current;
+    m_replicas[_node] = replica;
+    return replica;
+}
+
+std::shared_ptr<EpochDag> DagStore::load(int _epoch)
+{
+    const string path = filePath(_epoch);
+
+    try
+    {
+        if (!fs::exists(path))
+            return nullptr;
+
+        bip::file_mapping mapping(path.c_str(), bip::read_only);
+        bip::mapped_region region(mapping, bip::read_only);
+
+        const uint32_t numItems = uint32_t(ethash::calculate_full_dataset_num_items(_epoch));
+        DagFileHeader header;
+        bool valid = (region.get_size() ==
+                      c_dagHeaderSize + size_t(numItems) * sizeof(ethash_hash1024));
+        if (valid)
+        {
+            memcpy(&header, region.get_address(), sizeof(header));
+            valid = !memcmp(header.magic, c_dagMagic, sizeof(c_dagMagic)) &&
+                    header.version == c_dagVersion && header.epoch == _epoch &&
+                    header.numItems == numItems;
+        }
+        if (valid)
+        {
+            auto items = reinterpret_cast<const ethash_hash1024*>(
+                static_cast<const char*>(region.get_address()) + c_dagHeaderSize);
+            valid = sample(*EthashAux::context(_epoch), items);
+        }
+        if (!valid)
+        {
+            cwarn << "Discarding invalid DAG file " << path;
+            region = bip::mapped_region();
+            fs::remove(path);
+            return nullptr;
+        }
+
+        cnote << "Epoch " << _epoch << " DAG mapped from " << path;
+        auto memory = make_shared<bip::mapped_region>(std::move(region));
+        auto items = reinterpret_cast<const ethash_hash1024*>(
+            static_cast<const char*>(memory->get_address()) + c_dagHeaderSize);
+        return make_shared<EpochDag>(_epoch, numItems, items, memory);
+    }
+    catch (const std::exception& _ex)
+    {
+        cwarn << "Unable to load DAG file " << path << " : " << _ex.what();
+        return nullptr;
+    }
+}
+
+std::shared_ptr<EpochDag> DagStore::generateToFile(int _epoch, DagBuilder& _builder)
+{
+    const string path = filePath(_epoch);
+    string tmpPath;
+    shared_ptr<EpochDag> dag;
+
+    try
+    {
+        const auto context = EthashAux::context(_epoch);
+        const uint32_t numItems = uint32_t(context->full_dataset_num_items);
+        const size_t fileSize = c_dagHeaderSize + size_t(numItems) * sizeof(ethash_hash1024);
+
+        fs::create_directories(m_dir);
+
+        // Writing to a mapping of a file which can't grow ends in SIGBUS
+        if (fs::space(m_dir).available < fileSize)
+        {
+            cwarn << "Not enough disk space in " << m_dir << " to store epoch " << _epoch
+                  << " DAG (" << dev::getFormattedMemory((double)fileSize) << ")";
+            return nullptr;
+        }
+
+        // Concurrent ethminer instances may generate the same epoch
+        tmpPath = (fs::path(m_dir) / fs::unique_path(to_string(_epoch) + ".%%%%%%%%.tmp"))
+                      .string();
+        {
+            filebuf fbuf;
+            if (!fbuf.open(tmpPath, ios_base::in | ios_base::out | ios_base::trunc |
+                                        ios_base::binary))
+                throw runtime_error("Unable to create file");
+            fbuf.pubseekoff(fileSize - 1, ios_base::beg);
+            fbuf.sputc(0);
+        }
+
+        bip::file_mapping mapping(tmpPath.c_str(), bip::read_write);
+        auto region = make_shared<bip::mapped_region>(mapping, bip::read_write);
+        auto items = reinterpret_cast<ethash_hash1024*>(
+            static_cast<char*>(region->get_address()) + c_dagHeaderSize);
+
+        cnote << "Generating epoch " << _epoch << " DAG to " << path;
+        if (!_builder.build(*context, items, m_stop))
+        {
+            region.reset();
+            fs::remove(tmpPath);
+            return nullptr;
+        }
+
+        DagFileHeader header = {};
+        memcpy(header.magic, c_dagMagic, sizeof(c_dagMagic));
+        header.version = c_dagVersion;
+        header.epoch = _epoch;
+        header.numItems = numItems;
+        memcpy(region->get_address(), &header, sizeof(header));
+        region->flush();
+
+        // Publish atomically only once complete. The mapping stays valid
+        // across the rename and is handed out as is: no need to check it
+        fs::rename(tmpPath, path);
+        dag = make_shared<EpochDag>(_epoch, numItems, items, region);
+    }
+    catch (const std::exception& _ex)
+    {
+        cwarn << "Unable to store DAG file " << path << " : " << _ex.what();
+        boost::system::error_code ec;
+        if (!tmpPath.empty())
+            fs::remove(tmpPath, ec);
+        return nullptr;
+    }
+
+    return dag;
+}
+
+std::shared_ptr<EpochDag> DagStore::generateInMemory(int _epoch, int _node)
+{
+    const auto context = EthashAux::context(_epoch);
+    const uint32_t numItems = uint32_t(context->full_dataset_num_items);
+
+    auto memory = allocate(size_t(numItems) * sizeof(ethash_hash1024));
+    auto items = static_cast<ethash_hash1024*>(memory.get());
+
+    cnote << "Generating epoch " << _epoch << " DAG in memory";
+    if (!m_builder.build(*context, items, m_stop, _node))
+        return nullptr;
+
+    return make_shared<EpochDag>(_epoch, numItems, items, memory);
+}
+
+std::shared_ptr<EpochDag> DagStore::replicate(const EpochDag& _dag, int _node)
+{
+    try
+    {
+        auto memory = allocate(_dag.size);
+
+        // Pages are placed on the node of the thread first touching them
+        memcpy(memory.get(), _dag.items, _dag.size);
+
+        if (_node >= 0)
+            cnote << "Epoch " << _dag.epoch << " DAG replicated on NUMA node " << _node;
+        return make_shared<EpochDag>(
+            _dag.epoch, _dag.numItems, static_cast<const ethash_hash1024*>(memory.get()), memory);
+    }
+    catch (const std::exception& _ex)
+    {
+        cwarn << "Unable to replicate DAG : " << _ex.what();
+        return nullptr;
+    }
+}
+
+/*
+ * Anonymous memory for a dataset, backed by huge pages as requested.
+ * Explicit huge pages (2mb, 1gb) must have been reserved by the administrator
+ * (e.g. vm.nr_hugepages), if none is available transparent ones are tried.
+ */
+std::shared_ptr<void> DagStore::allocate(size_t _size)
+{
+#if defined(__linux__)
+    void* p = MAP_FAILED;
+    size_t size = _size;
+
+    if (m_hugePages == "2mb" || m_hugePages == "1gb")
+    {
+        const int shift = (m_hugePages == "1gb" ? 30 : 21);
+        const size_t page = size_t(1) << shift;
+        size = (_size + page - 1) & ~(page - 1);
+        p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (shift << MAP_HUGE_SHIFT), -1, 0);
+        if (p == MAP_FAILED)
+        {
+            cwarn << "No " << m_hugePages << " huge pages available (" << strerror(errno)
+                  << "). Using transparent huge pages";
+            size = _size;
+        }
+    }
+
+    if (p == MAP_FAILED)
+    {
+        p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            throw runtime_error(string("Unable to allocate DAG memory : ") + strerror(errno));
+        if (m_hugePages != "none" && madvise(p, size, MADV_HUGEPAGE))
+            cwarn << "Transparent huge pages not available (" << strerror(errno) << ")";
+    }
+
+    return shared_ptr<void>(p, [size](void* _p) { munmap(_p, size); });
+#else
+    if (m_hugePages != "none")
+        cwarn << "Huge pages for DAG not supported on this platform";
+    auto region = make_shared<bip::mapped_region>(bip::anonymous_shared_memory(_size));
+    return shared_ptr<void>(region, region->get_address());
+#endif
+}
+
+DagProgressType DagStore::progress() const
+{
+    DagProgressType p = m_builder.progress();
+    if (!p.generating)
+    {
+        p = m_prefetchBuilder.progress();
+        p.background = p.generating;
+    }
+    return p;
+}
+
+void DagStore::prefetch(int _epoch)
+{
+    // Called with x_dags held
+    if (m_prefetchEpoch != -1)
+        return;
+    if (m_prefetchThread.joinable())
+        m_prefetchThread.join();
+
+    boost::system::error_code ec;
+    if (fs::exists(filePath(_epoch), ec))
+        return;
+
+    m_prefetchEpoch = _epoch;
+    m_prefetchThread = thread(&DagStore::prefetchLoop, this, _epoch);
+}
+
+void DagStore::prefetchLoop(int _epoch)
+{
+    setThreadName("dag");
+    DagBuilder::releaseAffinity();
+
+    // Mapping is released immediately: all we want is the file
+    generateToFile(_epoch, m_prefetchBuilder);
+
+    lock_guard<mutex> l(x_dags);
+    m_prefetchEpoch = -1;
+    m_prefetchDone.notify_all();
+}
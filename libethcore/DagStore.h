@@ -0,0 +1,134 @@
+/*
+ This file is part of ethminer.
+
+ ethminer is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ ethminer is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <ethash/ethash.hpp>
+
+#include "DagBuilder.h"
+
+namespace dev
+{
+namespace eth
+{
+/**
+ * @brief A fully generated ethash dataset (DAG) for one epoch.
+ * Read only once published by the DagStore, shared by all host side miners.
+ */
+class EpochDag
+{
+public:
+    EpochDag(int _epoch, uint32_t _numItems, const ethash_hash1024* _items,
+        std::shared_ptr<void> _memory)
+      : epoch(_epoch),
+        numItems(_numItems),
+        size(size_t(_numItems) * sizeof(ethash_hash1024)),
+        items(_items),
+        m_memory(std::move(_memory))
+    {}
+
+    const int epoch;
+    const uint32_t numItems;
+    const size_t size;
+    const ethash_hash1024* const items;
+
+private:
+    std::shared_ptr<void> m_memory;  // Owns the mapping items live in
+};
+
+/**
+ * @brief Provides the full ethash dataset to host side (CPU) miners.
+ *
+ * When a directory is set datasets are persisted as <dir>/<epoch>.bin
+ * (a header followed by the items, spot checked when loaded) and memory mapped
+ * read only, so restarts and other ethminer instances on the same host reuse
+ * them through the page cache. After an epoch has been acquired the next
+ * one is generated to disk in the background, by a single thread so as not
+ * to steal too much from mining.
+ * With no directory datasets are generated in (anonymous) memory only.
+ *
+ * Miners may also ask for a copy of the dataset local to their NUMA node.
+ * Copies, and datasets generated in memory, may be backed by huge pages to
+ * spare TLB misses on the random DAG accesses.
+ * @threadsafe
+ */
+class DagStore
+{
+public:
+    DagStore(const CPSettings& _settings);
+    ~DagStore();
+
+    /**
+     * @brief Returns the dataset for @p _epoch, loading or generating it if needed.
+     * Blocks until the dataset is available. Throws std::runtime_error on failure.
+     * @param _node When >= 0 a replica of the dataset is returned, created on first
+     *  request by the calling thread which must thus run on NUMA node @p _node.
+     */
+    std::shared_ptr<const EpochDag> acquire(int _epoch, int _node = -1);
+
+    /**
+     * @brief Progress of DAG generation, the one miners are waiting for first
+     */
+    DagProgressType progress() const;
+
+    /**
+     * @brief Default location of the on-disk cache (~/.ethminer/dag)
+     */
+    static std::string defaultDir();
+
+private:
+    std::string filePath(int _epoch) const;
+
+    std::shared_ptr<EpochDag> load(int _epoch);
+    std::shared_ptr<EpochDag> generateToFile(int _epoch, DagBuilder& _builder);
+    std::shared_ptr<EpochDag> generateInMemory(int _epoch, int _node);
+    std::shared_ptr<EpochDag> replicate(const EpochDag& _dag, int _node);
+
+    std::shared_ptr<void> allocate(size_t _size);
+
+    void prefetch(int _epoch);
+    void prefetchLoop(int _epoch);
+
+    std::string m_dir;
+    std::string m_hugePages;
+
+    DagBuilder m_builder;          // Generates DAGs miners wait for
+    DagBuilder m_prefetchBuilder;  // Generates next epoch DAGs
+
+    std::mutex x_dags;
+    std::shared_ptr<const EpochDag> m_current;  // Most recently acquired dataset
+    bool m_currentAnonymous = false;             // Whether m_current is not file backed
+    int m_currentNode = -1;  // NUMA node m_current is local to when anonymous
+    std::map<int, std::shared_ptr<const EpochDag>> m_replicas;  // Copies of m_current by node
+
+    std::condition_variable m_prefetchDone;
+    std::thread m_prefetchThread;
+    int m_prefetchEpoch = -1;  // Epoch being generated in background (-1 none)
+
+    std::atomic<bool> m_stop = {false};
+};
+
+}  // namespace eth
+}  // namespace dev
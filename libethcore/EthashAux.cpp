@@ -17,17 +17,164 @@
 
 #include "EthashAux.h"
 
+#include <future>
+#include <list>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
 #include <ethash/ethash.hpp>
+#include <ethash/keccak.hpp>
 
+using namespace std;
 using namespace dev;
 using namespace eth;
 
-Result EthashAux::eval(int epoch, h256 const& _headerHash, uint64_t _nonce) noexcept
+namespace
+{
+struct ContextCache
+{
+    mutex x_contexts;
+    list<EpochContextPtr> contexts;  // Most recently used first
+    map<int, shared_future<EpochContextPtr>> building;  // Contexts being built, by epoch
+    size_t budget = size_t(256) << 20;
+    EpochContextCacheStats stats;
+};
+
+ContextCache& contextCache()
+{
+    static ContextCache cache;
+    return cache;
+}
+
+size_t contextMemory(const ethash::epoch_context& _context)
+{
+    return ethash::get_light_cache_size(_context.light_cache_num_items);
+}
+
+void trimContextCache(ContextCache& _cache)
+{
+    while (_cache.contexts.size() > 1 && _cache.stats.memory > _cache.budget)
+    {
+        _cache.stats.memory -= contextMemory(*_cache.contexts.back());
+        _cache.contexts.pop_back();
+    }
+    _cache.stats.epochs = unsigned(_cache.contexts.size());
+}
+
+}  // namespace
+
+
+EpochContextPtr EthashAux::context(int _epoch)
+{
+    ContextCache& cache = contextCache();
+    promise<EpochContextPtr> built;
+    shared_future<EpochContextPtr> building;
+    {
+        lock_guard<mutex> l(cache.x_contexts);
+
+        for (auto it = cache.contexts.begin(); it != cache.contexts.end(); it++)
+        {
+            if ((*it)->epoch_number != _epoch)
+                continue;
+            cache.stats.hits++;
+            cache.contexts.splice(cache.contexts.begin(), cache.contexts, it);
+            return cache.contexts.front();
+        }
+
+        // Users of the same epoch wait for it rather than building it twice
+        auto it = cache.building.find(_epoch);
+        if (it != cache.building.end())
+        {
+            cache.stats.hits++;
+            building = it->second;
+        }
+        else
+        {
+            cache.stats.misses++;
+            cache.building[_epoch] = built.get_future().share();
+        }
+    }
+    if (building.valid())
+        return building.get();
+
+    // Takes hundreds of milliseconds
+    EpochContextPtr context(ethash::create_epoch_context(_epoch));
+
+    {
+        lock_guard<mutex> l(cache.x_contexts);
+        cache.building.erase(_epoch);
+        if (context)
+        {
+            cache.contexts.push_front(context);
+            cache.stats.memory += contextMemory(*context);
+            trimContextCache(cache);
+        }
+    }
+
+    if (!context)
+    {
+        runtime_error error("Unable to allocate context for epoch " + to_string(_epoch));
+        built.set_exception(make_exception_ptr(error));
+        throw error;
+    }
+    built.set_value(context);
+    return context;
+}
+
+void EthashAux::setContextCacheSize(size_t _bytes)
+{
+    ContextCache& cache = contextCache();
+    lock_guard<mutex> l(cache.x_contexts);
+    cache.budget = _bytes;
+    trimContextCache(cache);
+}
+
+EpochContextCacheStats EthashAux::contextCacheStats()
+{
+    ContextCache& cache = contextCache();
+    lock_guard<mutex> l(cache.x_contexts);
+    return cache.stats;
+}
+
+Result EthashAux::eval(int epoch, h256 const& _headerHash, uint64_t _nonce)
+{
+    return eval(*context(epoch), _headerHash, _nonce);
+}
+
+Result EthashAux::eval(
+    const ethash::epoch_context& _context, h256 const& _headerHash, uint64_t _nonce) noexcept
 {
     auto headerHash = ethash::hash256_from_bytes(_headerHash.data());
-    auto& context = ethash::get_global_epoch_context(epoch);
-    auto result = ethash::hash(context, headerHash, _nonce);
+    auto result = ethash::hash(_context, headerHash, _nonce);
     h256 mix{reinterpret_cast<byte*>(result.mix_hash.bytes), h256::ConstructFromPointer};
     h256 final{reinterpret_cast<byte*>(result.final_hash.bytes), h256::ConstructFromPointer};
     return {final, mix};
-}
\ No newline at end of file
+}
+
+void EthashAux::calculateDatasetItem(
+    const ethash::epoch_context& _context, uint32_t _index, ethash_hash1024& _item) noexcept
+{
+    static const uint32_t fnvPrime = 0x01000193;
+    static const uint32_t datasetParents = 256;
+
+    const ethash_hash512* cache = _context.light_cache;
+    const uint32_t cacheItems = static_cast<uint32_t>(_context.light_cache_num_items);
+
+    for (uint32_t half = 0; half < 2; ++half)
+    {
+        const uint32_t index = _index * 2 + half;
+
+        ethash_hash512 mix = cache[index % cacheItems];
+        mix.word32s[0] ^= index;
+        mix = ethash::keccak512(mix.bytes, sizeof(mix));
+
+        for (uint32_t j = 0; j < datasetParents; ++j)
+        {
+            const uint32_t parent = ((index ^ j) * fnvPrime ^ mix.word32s[j % 16]) % cacheItems;
+            for (int w = 0; w < 16; ++w)
+                mix.word32s[w] = (mix.word32s[w] * fnvPrime) ^ cache[parent].word32s[w];
+        }
+        _item.hash512s[half] = ethash::keccak512(mix.bytes, sizeof(mix));
+    }
+}
@@ -17,6 +17,8 @@
 
 #pragma once
 
+#include <memory>
+
 #include <libdevcore/Common.h>
 #include <libdevcore/Exceptions.h>
 #include <libdevcore/Worker.h>
@@ -33,10 +35,46 @@ struct Result
     h256 mixHash;
 };
 
+struct EpochContextCacheStats
+{
+    unsigned epochs = 0;  // Epoch contexts cached
+    size_t memory = 0;    // Bytes held by cached light caches
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
+
+using EpochContextPtr = std::shared_ptr<const ethash::epoch_context>;
+
 class EthashAux
 {
 public:
-    static Result eval(int epoch, h256 const& _headerHash, uint64_t _nonce) noexcept;
+    /**
+     * @brief Light (verification) context of @p _epoch.
+     *
+     * Contexts are kept in a LRU cache bounded by setContextCacheSize(), so
+     * switching back and forth between epochs (multi coin pools) doesn't
+     * rebuild the light cache each time. The most recent one is always kept.
+     * Contexts are built with the cache unlocked: lookups of other epochs
+     * don't wait, those of the epoch being built wait for it.
+     * Throws std::runtime_error when the context can't be allocated.
+     */
+    static EpochContextPtr context(int _epoch);
+
+    static void setContextCacheSize(size_t _bytes);
+
+    static EpochContextCacheStats contextCacheStats();
+
+    // Throws as context() does
+    static Result eval(int epoch, h256 const& _headerHash, uint64_t _nonce);
+    static Result eval(const ethash::epoch_context& _context, h256 const& _headerHash,
+        uint64_t _nonce) noexcept;
+
+    /**
+     * @brief Computes the 1024-bit full dataset (DAG) item @p _index from the light cache.
+     * Same result as ethash's own (lazy) full dataset generation.
+     */
+    static void calculateDatasetItem(
+        const ethash::epoch_context& _context, uint32_t _index, ethash_hash1024& _item) noexcept;
 };
 
 struct EpochContext
@@ -47,6 +85,7 @@ struct EpochContext
     const ethash_hash512* lightCache;
     int dagNumItems;
     uint64_t dagSize;
+    EpochContextPtr context;  // Owns lightCache
 };
 
 struct WorkPackage
@@ -68,6 +107,8 @@ struct WorkPackage
     uint16_t exSizeBytes = 0;
 
     std::string algo = "ethash";
+
+    std::chrono::steady_clock::time_point tstamp;  // When received from pool (for tracing)
 };
 
 struct Solution
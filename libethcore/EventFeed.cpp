@@ -0,0 +1,140 @@
+/*
+ This file is part of ethminer.
+
+ ethminer is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ ethminer is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+#include "EventFeed.h"
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+namespace
+{
+const size_t c_feedEvents = 1024;  // Events kept for readers behind
+
+struct Feed
+{
+    mutex x_feed;
+    vector<shared_ptr<const Event>> ring = vector<shared_ptr<const Event>>(c_feedEvents);
+    uint64_t head = 0;  // Seq of the latest event
+    function<void()> onPublished;
+    atomic<unsigned> readers = {0};
+};
+
+Feed& feed()
+{
+    static Feed s_feed;
+    return s_feed;
+}
+
+}  // namespace
+
+
+bool EventFeed::active() noexcept
+{
+    return feed().readers.load(memory_order_relaxed) != 0;
+}
+
+void EventFeed::publish(EventType _type, Json::Value const& _data)
+{
+    Json::StreamWriterBuilder builder;
+    builder.settings_["indentation"] = "";
+    auto event = make_shared<Event>();
+    event->type = _type;
+    auto now = chrono::system_clock::now().time_since_epoch();
+    event->time = uint64_t(chrono::duration_cast<chrono::milliseconds>(now).count());
+    event->data = Json::writeString(builder, _data);
+
+    Feed& f = feed();
+    function<void()> onPublished;
+    {
+        lock_guard<mutex> l(f.x_feed);
+        event->seq = ++f.head;
+        f.ring[event->seq % c_feedEvents] = event;
+        onPublished = f.onPublished;
+    }
+    if (onPublished)
+        onPublished();
+}
+
+uint64_t EventFeed::read(uint64_t& _cursor, vector<shared_ptr<const Event>>& _events, size_t _max)
+{
+    Feed& f = feed();
+    lock_guard<mutex> l(f.x_feed);
+
+    uint64_t dropped = 0;
+    uint64_t oldest = (f.head > c_feedEvents ? f.head - c_feedEvents + 1 : 1);
+    if (_cursor + 1 < oldest)
+    {
+        dropped = oldest - _cursor - 1;
+        _cursor = oldest - 1;
+    }
+    for (; _cursor < f.head && _max; _max--)
+        _events.push_back(f.ring[++_cursor % c_feedEvents]);
+    return dropped;
+}
+
+uint64_t EventFeed::head()
+{
+    Feed& f = feed();
+    lock_guard<mutex> l(f.x_feed);
+    return f.head;
+}
+
+void EventFeed::addReader()
+{
+    feed().readers.fetch_add(1, memory_order_relaxed);
+}
+
+void EventFeed::removeReader()
+{
+    feed().readers.fetch_sub(1, memory_order_relaxed);
+}
+
+void EventFeed::onPublished(function<void()> const& _handler)
+{
+    Feed& f = feed();
+    lock_guard<mutex> l(f.x_feed);
+    f.onPublished = _handler;
+}
+
+const char* EventFeed::name(EventType _type) noexcept
+{
+    switch (_type)
+    {
+    case EventType::Telemetry:
+        return "telemetry";
+    case EventType::Job:
+        return "job";
+    case EventType::SolutionFound:
+        return "solution_found";
+    case EventType::SolutionAccepted:
+        return "solution_accepted";
+    case EventType::SolutionRejected:
+        return "solution_rejected";
+    case EventType::PoolSwitch:
+        return "pool_switch";
+    case EventType::EpochChange:
+        return "epoch_change";
+    default:
+        return "unknown";
+    }
+}
@@ -0,0 +1,99 @@
+/*
+ This file is part of ethminer.
+
+ ethminer is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ ethminer is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <json/json.h>
+
+namespace dev
+{
+namespace eth
+{
+/// What happened. Readers pick the types they want with a mask of (1 << type)
+enum class EventType : unsigned
+{
+    Telemetry = 0,     // Telemetry collected, see Farm::telemetrySnapshot
+    Job,               // New job from a pool
+    SolutionFound,     // Solution found by a device, before it's submitted
+    SolutionAccepted,  // Solution accepted by the pool
+    SolutionRejected,  // Solution rejected by the pool
+    PoolSwitch,        // Connection to a pool established, after a switch or not
+    EpochChange,       // Job of a new epoch
+    Max
+};
+
+struct Event
+{
+    uint64_t seq = 0;   // One more than the event before
+    uint64_t time = 0;  // Milliseconds since the Unix epoch
+    EventType type = EventType::Max;
+    std::string data;  // Json object, serialized
+};
+
+/**
+ * @brief Bounded fan-out queue of the events of the miner.
+ *
+ * Events are kept in a fixed-size ring. Publishing never waits on readers:
+ * once the ring is full the oldest event is dropped. Each reader keeps its own
+ * cursor and reads at its own pace, being told how many events it missed if
+ * it fell too far behind. Thread safe.
+ */
+class EventFeed
+{
+public:
+    /**
+     * @brief Whether anybody reads events. Publishers should not bother building
+     * events otherwise
+     */
+    static bool active() noexcept;
+
+    static void publish(EventType _type, Json::Value const& _data);
+
+    /**
+     * @brief Appends to @p _events up to @p _max events following @p _cursor and moves
+     * it past them
+     * @return How many events following @p _cursor were dropped before being read
+     */
+    static uint64_t read(
+        uint64_t& _cursor, std::vector<std::shared_ptr<const Event>>& _events, size_t _max);
+
+    /**
+     * @brief Seq of the latest event, where new readers start from
+     */
+    static uint64_t head();
+
+    static void addReader();
+    static void removeReader();
+
+    /**
+     * @brief Called on the publishing thread after each event. Must not block
+     */
+    static void onPublished(std::function<void()> const& _handler);
+
+    static const char* name(EventType _type) noexcept;
+};
+
+}  // namespace eth
+}  // namespace dev
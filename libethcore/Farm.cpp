@@ -34,7 +34,17 @@ namespace dev
 {
 namespace eth
 {
+namespace
+{
+const double c_splitDecay = 0.99;   // Weight of hashes done for pools at each collection, decaying
+const double c_splitStick = 0.5;    // Share of its hashrate a pool must still need to keep a miner
+const double c_epochDwell = 60.0;   // Seconds a miner mines an epoch at least before changing it
+const double c_epochPayoff = 20.0;  // Times its DAG generation a miner mines an epoch at least
+
+}  // namespace
+
 Farm* Farm::m_this = nullptr;
+const unsigned Farm::c_maxPools;
 
 Farm::Farm(std::map<std::string, DeviceDescriptor>& _DevicesCollection,
     FarmSettings _settings, CUSettings _CUSettings, CLSettings _CLSettings, CPSettings _CPSettings)
@@ -42,6 +52,9 @@ Farm::Farm(std::map<std::string, DeviceDescriptor>& _DevicesCollection,
     m_CUSettings(std::move(_CUSettings)),
     m_CLSettings(std::move(_CLSettings)),
     m_CPSettings(std::move(_CPSettings)),
+    m_dagStore(m_CPSettings),
+    m_verifier(m_Settings.evalThreads, !m_Settings.noEval,
+        [this](const Solution& _s, bool _valid) { onSolutionVerified(_s, _valid); }),
     m_io_strand(g_io_service),
     m_collectTimer(g_io_service),
     m_DevicesCollection(_DevicesCollection)
@@ -50,6 +63,12 @@ Farm::Farm(std::map<std::string, DeviceDescriptor>& _DevicesCollection,
 
     m_this = this;
 
+    EthashAux::setContextCacheSize(size_t(m_Settings.evalCache) << 20);
+
+    for (unsigned i = 0; i < c_maxPools; i++)
+        m_pools.push_back(std::unique_ptr<PoolSlot>(new PoolSlot(i)));
+    m_pools[0]->weight = 1;
+
     // Init HWMON if needed
     if (m_Settings.hwMon)
     {
@@ -197,50 +216,189 @@ void Farm::shuffle()
     m_nonce_scrambler = uniform_int_distribution<uint64_t>()(engine);
 }
 
-void Farm::setWork(WorkPackage const& _newWp)
+void Farm::setWork(unsigned _pool, WorkPackage const& _newWp)
 {
     // Set work to each miner giving it's own starting nonce
     Guard l(x_minerWork);
+    if (_pool >= c_maxPools)
+        return;
+    PoolSlot& slot = *m_pools[_pool];
+    bool wasIdle = !slot.wp;
 
     // Retrieve appropriate EpochContext
-    if (m_currentWp.epoch != _newWp.epoch)
+    bool newEpoch = (slot.wp.epoch != _newWp.epoch);
+    if (newEpoch)
     {
-        ethash::epoch_context _ec = ethash::get_global_epoch_context(_newWp.epoch);
-        m_currentEc.epochNumber = _newWp.epoch;
-        m_currentEc.lightNumItems = _ec.light_cache_num_items;
-        m_currentEc.lightSize = ethash::get_light_cache_size(_ec.light_cache_num_items);
-        m_currentEc.dagNumItems = _ec.full_dataset_num_items;
-        m_currentEc.dagSize = ethash::get_full_dataset_size(_ec.full_dataset_num_items);
-        m_currentEc.lightCache = _ec.light_cache;
-
-        for (auto const& miner : m_miners)
-            miner->setEpoch(m_currentEc);
+        EpochContextPtr _ec = EthashAux::context(_newWp.epoch);
+        slot.ec.epochNumber = _newWp.epoch;
+        slot.ec.lightNumItems = _ec->light_cache_num_items;
+        slot.ec.lightSize = ethash::get_light_cache_size(_ec->light_cache_num_items);
+        slot.ec.dagNumItems = _ec->full_dataset_num_items;
+        slot.ec.dagSize = ethash::get_full_dataset_size(_ec->full_dataset_num_items);
+        slot.ec.lightCache = _ec->light_cache;
+        slot.ec.context = _ec;
     }
 
-    m_currentWp = _newWp;
+    slot.wp = _newWp;
 
     // Check if we need to shuffle per work (ergodicity == 2)
-    if (m_Settings.ergodicity == 2 && m_currentWp.exSizeBytes == 0)
+    if (m_Settings.ergodicity == 2 && slot.wp.exSizeBytes == 0)
         shuffle();
 
-    uint64_t _startNonce;
-    if (m_currentWp.exSizeBytes > 0)
+    // Nonce space of the job. With extranonce it's what the pool leaves to
+    // us, otherwise the whole range starting at the randomly selected nonce
+    uint64_t base = m_nonce_scrambler;
+    uint64_t size = 0;
+    if (slot.wp.exSizeBytes > 0)
     {
-        // Equally divide the residual segment among miners
-        _startNonce = m_currentWp.startNonce;
-        m_nonce_segment_with =
-            (unsigned int)log2(pow(2, 64 - (m_currentWp.exSizeBytes * 4)) / m_miners.size());
+        base = slot.wp.startNonce;
+        size = uint64_t(1) << (64 - std::min<unsigned>(slot.wp.exSizeBytes * 4, 63));
     }
-    else
+    slot.job = slot.scheduler.reset(slot.wp.header, base, size, m_miners.size());
+
+    // Published once, miners take their nonces in chunks as they go
+    slot.published = std::make_shared<const WorkPackage>(slot.wp);
+    for (unsigned i = 0; i < m_miners.size(); i++)
     {
-        // Get the randomly selected nonce
-        _startNonce = m_nonce_scrambler;
+        if (m_minerPool[i] != _pool)
+            continue;
+        if (newEpoch)
+        {
+            m_miners[i]->setEpoch(slot.ec);
+            m_minerEpochSince[i] = std::chrono::steady_clock::now();
+        }
+        m_miners[i]->setWork(slot.published, slot.job);
     }
 
-    for (unsigned int i = 0; i < m_miners.size(); i++)
+    // A pool getting its first work may take miners from others. The split
+    // starts over, so it doesn't catch up on the time it was out
+    if (wasIdle && slot.weight)
     {
-        m_currentWp.startNonce = _startNonce + ((uint64_t)i << m_nonce_segment_with);
-        m_miners.at(i)->setWork(m_currentWp);
+        for (auto& s : m_pools)
+            s->hashes = 0.0;
+        assignMiners(0.0);
+    }
+
+    LatencyTrace::record(TraceStage::WorkSet, slot.wp.tstamp);
+}
+
+void Farm::setPoolWeight(unsigned _pool, unsigned _weight)
+{
+    Guard l(x_minerWork);
+    if (_pool >= c_maxPools || m_pools[_pool]->weight == _weight)
+        return;
+    m_pools[_pool]->weight = _weight;
+    for (auto& s : m_pools)
+        s->hashes = 0.0;
+    assignMiners(0.0);
+}
+
+float Farm::poolHashRate(unsigned _pool)
+{
+    Guard l(x_minerWork);
+    float hr = 0.0f;
+    for (unsigned i = 0; i < m_minerPool.size() && i < m_minerHashRate.size(); i++)
+        if (m_minerPool[i] == _pool)
+            hr += m_minerHashRate[i];
+    return hr;
+}
+
+std::vector<unsigned> Farm::minerPools()
+{
+    Guard l(x_minerWork);
+    return m_minerPool;
+}
+
+void Farm::publishWork(unsigned _minerIdx)
+{
+    PoolSlot& slot = *m_pools[m_minerPool[_minerIdx]];
+    if (!slot.published)
+        return;
+    m_miners[_minerIdx]->setEpoch(slot.ec);
+    m_miners[_minerIdx]->setWork(slot.published, slot.job);
+}
+
+void Farm::assignMiners(double _elapsed)
+{
+    // Pools which can be mined
+    std::vector<unsigned> active;
+    double weights = 0.0;
+    for (unsigned p = 0; p < c_maxPools; p++)
+        if (m_pools[p]->weight && m_pools[p]->wp)
+        {
+            active.push_back(p);
+            weights += m_pools[p]->weight;
+        }
+    if (active.empty() || m_miners.empty())
+        return;
+
+    // Hashrate of each miner. Those not measured yet count as equal
+    std::vector<double> hr(m_miners.size(), 1.0);
+    double total = 0.0;
+    for (unsigned i = 0; i < m_miners.size(); i++)
+    {
+        if (i < m_minerHashRate.size() && m_minerHashRate[i] > 0)
+            hr[i] = m_minerHashRate[i];
+        total += hr[i];
+    }
+
+    // Account hashes done for each pool since last time
+    for (auto& slot : m_pools)
+        slot->hashes *= c_splitDecay;
+    for (unsigned i = 0; i < m_miners.size(); i++)
+        m_pools[m_minerPool[i]]->hashes += hr[i] * _elapsed;
+    double done = 0.0;
+    for (unsigned p : active)
+        done += m_pools[p]->hashes;
+
+    // Hashes each pool needs over the next interval to catch up with its weight
+    double interval = m_collectInterval / 1000.0;
+    std::vector<double> need(c_maxPools, 0.0);
+    for (unsigned p : active)
+        need[p] = (done + total * interval) * m_pools[p]->weight / weights - m_pools[p]->hashes;
+
+    // Fastest miners first. A miner stays with its pool while it's still needed there,
+    // else goes where it's needed most among pools of the epoch it has loaded. Only
+    // when none of those needs it does it change epoch, and not before its DAG paid off
+    auto now = std::chrono::steady_clock::now();
+    std::vector<unsigned> order(m_miners.size());
+    for (unsigned i = 0; i < order.size(); i++)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(),
+        [&hr](unsigned a, unsigned b) { return hr[a] > hr[b]; });
+    for (unsigned i : order)
+    {
+        double hashes = hr[i] * interval;
+        unsigned current = m_minerPool[i];
+        unsigned pick = current;
+        bool stays = std::find(active.begin(), active.end(), current) != active.end();
+        if (!stays || need[current] < hashes * c_splitStick)
+        {
+            int epoch = m_pools[current]->ec.epochNumber;
+            int same = -1, other = -1;
+            for (unsigned p : active)
+            {
+                int& best = (stays && m_pools[p]->ec.epochNumber == epoch) ? same : other;
+                if (best < 0 || need[p] > need[best])
+                    best = p;
+            }
+            double dwell =
+                std::max(c_epochDwell, c_epochPayoff * m_miners[i]->dagTime() / 1000.0);
+            bool settled = !stays || std::chrono::duration<double>(
+                                         now - m_minerEpochSince[i]).count() >= dwell;
+            if (same >= 0 && (other < 0 || !settled || need[same] >= hashes * c_splitStick))
+                pick = same;
+            else
+                pick = other;
+        }
+        need[pick] -= hashes;
+        if (pick != current)
+        {
+            if (m_pools[pick]->ec.epochNumber != m_pools[current]->ec.epochNumber)
+                m_minerEpochSince[i] = now;
+            m_minerPool[i] = pick;
+            publishWork(i);
+        }
     }
 }
 
@@ -297,6 +455,17 @@ bool Farm::start()
         // Initialize DAG Load mode
         Miner::setDagLoadInfo(m_Settings.dagLoadMode, (unsigned int)m_miners.size());
 
+        // New miners get the work there is at once
+        m_minerPool.assign(m_miners.size(), 0);
+        m_minerHashRate.assign(m_miners.size(), 0.0f);
+        m_minerEpochSince.assign(m_miners.size(), std::chrono::steady_clock::time_point());
+        assignMiners(0.0);
+        for (unsigned i = 0; i < m_miners.size(); i++)
+            publishWork(i);
+
+        // Readers see the devices before the first collection
+        publishTelemetry();
+
         m_isMining.store(true, std::memory_order_relaxed);
     }
     else
@@ -329,6 +498,9 @@ void Farm::stop()
             }
 
             m_miners.clear();
+            m_minerPool.clear();
+            m_minerHashRate.clear();
+            m_minerEpochSince.clear();
             m_isMining.store(false, std::memory_order_relaxed);
         }
     }
@@ -371,8 +543,27 @@ void Farm::resume()
 /**
  * @brief Stop all mining activities and Starts them again
  */
-void Farm::restart()
+void Farm::restart(bool _warm)
 {
+    if (_warm && isMining())
+    {
+        // Miners are kept: only their threads are restarted and devices
+        // which were mining keep their DAG
+        cnote << "Restart miners (warm)...";
+        std::vector<std::shared_ptr<Miner>> miners;
+        {
+            Guard l(x_minerWork);
+            miners = m_miners;
+            for (auto const& miner : miners)
+                miner->triggerRestartWorking();
+        }
+
+        // Without the lock: pools keep handing out work while miners stop
+        for (auto const& miner : miners)
+            miner->finishRestartWorking();
+        return;
+    }
+
     if (m_onMinerRestart)
         m_onMinerRestart();
 }
@@ -380,9 +571,10 @@ void Farm::restart()
 /**
  * @brief Stop all mining activities and Starts them again (async post)
  */
-void Farm::restart_async()
+void Farm::restart_async(bool _warm)
 {
-    m_io_strand.get_io_service().post(m_io_strand.wrap(boost::bind(&Farm::restart, this)));
+    m_io_strand.get_io_service().post(
+        m_io_strand.wrap(boost::bind(&Farm::restart, this, _warm)));
 }
 
 /**
@@ -474,6 +666,19 @@ Json::Value Farm::get_nonce_scrambler_json()
     jRes["device_width"] = m_nonce_segment_with;
     jRes["device_count"] = (uint64_t)m_miners.size();
 
+    NonceCoverageType c = m_pools[0]->scheduler.coverage();
+    Json::Value jCoverage;
+    jCoverage["base"] = toHex(c.base, HexPrefix::Add);
+    jCoverage["size"] = c.size ? Json::Value(toHex(c.size, HexPrefix::Add)) : Json::Value::null;
+    jCoverage["assigned"] = toHex(c.assigned, HexPrefix::Add);
+    jCoverage["chunks"] = c.chunks;
+    jCoverage["exhausted"] = c.exhausted;
+    Json::Value jDevices = Json::Value(Json::arrayValue);
+    for (uint64_t assigned : c.assignedTo)
+        jDevices.append(toHex(assigned, HexPrefix::Add));
+    jCoverage["devices"] = jDevices;
+    jRes["coverage"] = jCoverage;
+
     return jRes;
 }
 
@@ -483,27 +688,32 @@ void Farm::setTStartTStop(unsigned tstart, unsigned tstop)
     m_Settings.tempStop = tstop;
 }
 
+bool Farm::nextNonceRange(unsigned _minerIdx, unsigned _job, float _hashrate,
+    uint64_t _granularity, NonceRange& _range)
+{
+    // Job numbers tell pools apart
+    if (!_job)
+        return false;
+    return m_pools[(_job - 1) % c_maxPools]->scheduler.next(
+        _minerIdx, _job, _hashrate, _granularity, m_nonce_segment_with, _range);
+}
+
 void Farm::submitProof(Solution const& _s)
 {
-    g_io_service.post(m_io_strand.wrap(boost::bind(&Farm::submitProofAsync, this, _s)));
+    m_verifier.push(_s);
 }
 
-void Farm::submitProofAsync(Solution const& _s)
+void Farm::onSolutionVerified(Solution const& _s, bool _valid)
 {
-    if (!m_Settings.noEval)
+    LatencyTrace::record(TraceStage::SolutionVerified, _s.tstamp);
+    if (!_valid)
     {
-        Result r = EthashAux::eval(_s.work.epoch, _s.work.header, _s.nonce);
-        if (r.value > _s.work.boundary)
-        {
-            accountSolution(_s.midx, SolutionAccountingEnum::Failed);
-            cwarn << "GPU " << _s.midx
-                  << " gave incorrect result. Lower overclocking values if it happens frequently.";
-            return;
-        }
-        m_onSolutionFound(Solution{_s.nonce, r.mixHash, _s.work, _s.tstamp, _s.midx});
+        accountSolution(_s.midx, SolutionAccountingEnum::Failed);
+        cwarn << "GPU " << _s.midx
+              << " gave incorrect result. Lower overclocking values if it happens frequently.";
+        return;
     }
-    else
-        m_onSolutionFound(_s);
+    m_onSolutionFound(_s);
 
 #ifdef DEV_BUILD
     if (g_logOptions & LOG_SUBMIT)
@@ -523,6 +733,7 @@ void Farm::collectData(const boost::system::error_code& ec)
 
     // Reset hashrate (it will accumulate from miners)
     float farm_hr = 0.0f;
+    std::vector<float> minerHashRate(m_miners.size(), 0.0f);
 
     // Process miners
     for (auto const& miner : m_miners)
@@ -530,8 +741,10 @@ void Farm::collectData(const boost::system::error_code& ec)
         int minerIdx = miner->Index();
         float hr = (miner->paused() ? 0.0f : miner->RetrieveHashRate());
         farm_hr += hr;
+        minerHashRate.at(minerIdx) = hr;
         m_telemetry.miners.at(minerIdx).hashrate = hr;
         m_telemetry.miners.at(minerIdx).paused = miner->paused();
+        m_telemetry.miners.at(minerIdx).dagMs = miner->dagTime();
 
 
         if (m_Settings.hwMon)
@@ -646,12 +859,52 @@ void Farm::collectData(const boost::system::error_code& ec)
         miner->TriggerHashRateUpdate();
     }
 
+    m_telemetry.dag = m_dagStore.progress();
+    m_telemetry.verifier = m_verifier.stats();
+
+    // Follow the weights of the pools
+    {
+        Guard l(x_minerWork);
+        m_minerHashRate.swap(minerHashRate);
+        assignMiners(m_collectInterval / 1000.0);
+    }
+
+    publishTelemetry();
+
     // Resubmit timer for another loop
     m_collectTimer.expires_from_now(boost::posix_time::milliseconds(m_collectInterval));
     m_collectTimer.async_wait(
         m_io_strand.wrap(boost::bind(&Farm::collectData, this, boost::asio::placeholders::error)));
 }
 
+void Farm::publishTelemetry()
+{
+    auto snapshot = std::make_shared<TelemetrySnapshot>();
+    snapshot->telemetry = m_telemetry;
+    for (auto const& miner : m_miners)
+    {
+        snapshot->descriptors.push_back(miner->getDescriptor());
+        snapshot->pauseReasons.push_back(miner->paused() ? miner->pausedString() : "");
+    }
+    snapshot->coverage = nonceCoverage();
+    snapshot->tstart = m_Settings.tempStart;
+    snapshot->tstop = m_Settings.tempStop;
+
+    uint64_t version;
+    {
+        Guard l(x_snapshot);
+        version = snapshot->version = m_snapshot->version + 1;
+        m_snapshot = snapshot;
+    }
+
+    if (EventFeed::active())
+    {
+        Json::Value data;
+        data["version"] = Json::UInt64(version);
+        EventFeed::publish(EventType::Telemetry, data);
+    }
+}
+
 bool Farm::spawn_file_in_bin_dir(const char* filename, const std::vector<std::string>& args)
 {
     std::string fn = boost::dll::program_location().parent_path().string() +
@@ -18,6 +18,7 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
 #include <list>
 #include <thread>
 
@@ -32,7 +33,11 @@
 #include <libdevcore/Common.h>
 #include <libdevcore/Worker.h>
 
+#include <libethcore/DagStore.h>
+#include <libethcore/EventFeed.h>
 #include <libethcore/Miner.h>
+#include <libethcore/NonceScheduler.h>
+#include <libethcore/SolutionVerifier.h>
 
 #include <libhwmon/wrapnvml.h>
 #if defined(__linux)
@@ -52,20 +57,49 @@ struct FarmSettings
 {
     unsigned dagLoadMode = 0;  // 0 = Parallel; 1 = Serialized
     bool noEval = false;       // Whether or not to re-evaluate solutions
+    unsigned evalThreads = 2;  // Threads re-evaluating solutions
+    unsigned evalCache = 256;  // Memory (MB) for cached epoch contexts used to re-evaluate
     unsigned hwMon = 0;        // 0 - No monitor; 1 - Temp and Fan; 2 - Temp Fan Power
     unsigned ergodicity = 0;   // 0=default, 1=per session, 2=per job
     unsigned tempStart = 40;   // Temperature threshold to restart mining (if paused)
     unsigned tempStop = 0;     // Temperature threshold to pause mining (overheating)
 };
 
+/**
+ * @brief Telemetry as of one collection, along with what readers need to know
+ * about the devices. Never modified once published, so it can be read from any
+ * thread without copying it nor touching the miners
+ */
+struct TelemetrySnapshot
+{
+    uint64_t version = 0;  // One more for each snapshot
+    std::chrono::steady_clock::time_point tstamp = std::chrono::steady_clock::now();
+    TelemetryType telemetry;
+    std::vector<DeviceDescriptor> descriptors;  // By miner index
+    std::vector<std::string> pauseReasons;      // By miner index, empty if not paused
+    NonceCoverageType coverage;
+    unsigned tstart = 0;
+    unsigned tstop = 0;
+};
+
 /**
  * @brief A collective of Miners.
  * Miners ask for work, then submit proofs
+ *
+ * Work may come from several pools at once, each weighing for a share of
+ * the hashrate. Each miner works for a single pool at a time: miners are
+ * handed out so that hashes done for each pool follow the weights, moving
+ * them from a pool to another as needed. With fewer miners than pools this
+ * takes turns. Moving to a pool on another epoch means a new DAG, so miners
+ * rather stay with pools of the epoch they have loaded and only change epoch
+ * once they've mined long enough to make up for building it.
  * @threadsafe
  */
 class Farm : public FarmFace
 {
 public:
+    static const unsigned c_maxPools = 8;  // Most pools mined at once
+
     unsigned tstart = 0, tstop = 0;
 
     Farm(std::map<std::string, DeviceDescriptor>& _DevicesCollection,
@@ -85,7 +119,29 @@ public:
      * @brief Sets the current mining mission.
      * @param _wp The work package we wish to be mining.
      */
-    void setWork(WorkPackage const& _newWp);
+    void setWork(WorkPackage const& _newWp) { setWork(0, _newWp); }
+
+    /**
+     * @brief Sets the current mining mission of a pool
+     * @param _pool Pool index, below c_maxPools. Pool 0 is the only one by default
+     */
+    void setWork(unsigned _pool, WorkPackage const& _newWp);
+
+    /**
+     * @brief Sets the share of the hashrate a pool gets, relative to others.
+     *  Pools weighing 0 get no miner. Pool 0 weighs 1 by default, others 0
+     */
+    void setPoolWeight(unsigned _pool, unsigned _weight);
+
+    /**
+     * @brief Gets the hashrate of the miners working for a pool
+     */
+    float poolHashRate(unsigned _pool);
+
+    /**
+     * @brief Gets the pool each miner is working for
+     */
+    std::vector<unsigned> minerPools();
 
     /**
      * @brief Start a number of miners.
@@ -115,13 +171,15 @@ public:
 
     /**
      * @brief Stop all mining activities and Starts them again
+     * @param _warm Restart miners' threads only, keeping devices initialized
+     *  and DAGs loaded. Otherwise miners are destroyed and created anew
      */
-    void restart();
+    void restart(bool _warm = false);
 
     /**
      * @brief Stop all mining activities and Starts them again (async post)
      */
-    void restart_async();
+    void restart_async(bool _warm = false);
 
     /**
      * @brief Returns whether or not the farm has been started
@@ -140,6 +198,20 @@ public:
      */
     TelemetryType& Telemetry() { return m_telemetry; }
 
+    /**
+     * @brief Telemetry as of the latest collection. Never null, safe from any thread
+     */
+    std::shared_ptr<const TelemetrySnapshot> telemetrySnapshot() const
+    {
+        Guard l(x_snapshot);
+        return m_snapshot;
+    }
+
+    /**
+     * @brief Gets the full datasets provider for host side miners
+     */
+    DagStore& dagStore() { return m_dagStore; }
+
     /**
      * @brief Gets current hashrate
      */
@@ -205,7 +277,7 @@ public:
     uint64_t get_nonce_scrambler() override { return m_nonce_scrambler; }
 
     /**
-     * @brief Gets the actual width of each subsegment assigned to miners
+     * @brief Gets the most nonces (as exponent of 2) a miner gets at once
      */
     unsigned get_segment_width() override { return m_nonce_segment_with; }
 
@@ -215,11 +287,11 @@ public:
     void set_nonce_scrambler(uint64_t n) { m_nonce_scrambler = n; }
 
     /**
-     * @brief Sets the actual width of each subsegment assigned to miners
+     * @brief Sets the most nonces (as exponent of 2) a miner gets at once
      */
     void set_nonce_segment_width(unsigned n)
     {
-        if (!m_currentWp.exSizeBytes)
+        if (!m_pools[0]->wp.exSizeBytes)
             m_nonce_segment_with = n;
     }
 
@@ -229,6 +301,11 @@ public:
      */
     Json::Value get_nonce_scrambler_json();
 
+    /**
+     * @brief Nonce space coverage of the current job
+     */
+    NonceCoverageType nonceCoverage() const { return m_pools[0]->scheduler.coverage(); }
+
     void setTStartTStop(unsigned tstart, unsigned tstop);
 
     unsigned get_tstart() override { return m_Settings.tempStart; }
@@ -243,16 +320,41 @@ public:
      */
     void submitProof(Solution const& _s) override;
 
+    bool nextNonceRange(unsigned _minerIdx, unsigned _job, float _hashrate,
+        uint64_t _granularity, NonceRange& _range) override;
+
 private:
+    // The work of a pool and what's needed to hand it out to miners
+    struct PoolSlot
+    {
+        PoolSlot(unsigned _index) : scheduler(_index + 1, c_maxPools) {}
+
+        WorkPackage wp;
+        EpochContext ec;
+        std::shared_ptr<const WorkPackage> published;  // Shared among the pool's miners
+        unsigned job = 0;
+        unsigned weight = 0;
+        double hashes = 0.0;          // Hashes done lately, older ones weighing less
+        NonceScheduler scheduler;     // Hands out nonces of the pool's job to its miners
+    };
+
     std::atomic<bool> m_paused = {false};
 
-    // Async submits solution serializing execution
-    // in Farm's strand
-    void submitProofAsync(Solution const& _s);
+    // Hands miners out to pools following the weights. Needs x_minerWork
+    void assignMiners(double _elapsed);
+
+    // Gives a miner the work of the pool it works for. Needs x_minerWork
+    void publishWork(unsigned _minerIdx);
+
+    // Hands on a solution once re-evaluated (verifier thread)
+    void onSolutionVerified(Solution const& _s, bool _valid);
 
     // Collects data about hashing and hardware status
     void collectData(const boost::system::error_code& ec);
 
+    // Replaces the telemetry snapshot with one of the current telemetry
+    void publishTelemetry();
+
     /**
      * @brief Spawn a file - must be located in the directory of ethminer binary
      * @return false if file was not found or it is not executeable
@@ -262,13 +364,19 @@ private:
     mutable Mutex x_minerWork;
     std::vector<std::shared_ptr<Miner>> m_miners;  // Collection of miners
 
-    WorkPackage m_currentWp;
-    EpochContext m_currentEc;
+    std::vector<std::unique_ptr<PoolSlot>> m_pools;  // c_maxPools of them, never resized
+    std::vector<unsigned> m_minerPool;                // Pool each miner works for
+    std::vector<float> m_minerHashRate;               // Of each miner as of the last collection
+    std::vector<std::chrono::steady_clock::time_point> m_minerEpochSince;  // Of each miner's DAG
 
     std::atomic<bool> m_isMining = {false};
 
     TelemetryType m_telemetry;  // Holds progress and status info for farm and miners
 
+    mutable Mutex x_snapshot;
+    std::shared_ptr<const TelemetrySnapshot> m_snapshot =
+        std::make_shared<TelemetrySnapshot>();  // Replaced, never modified
+
     SolutionFound m_onSolutionFound;
     MinerRestart m_onMinerRestart;
 
@@ -277,17 +385,19 @@ private:
     CLSettings m_CLSettings;  // OpenCL settings passed to CL Miner instantiator
     CPSettings m_CPSettings;  // CPU settings passed to CPU Miner instantiator
 
+    DagStore m_dagStore;  // Full datasets for CPU Miners
+
+    SolutionVerifier m_verifier;  // Re-evaluates solutions before submission
+
     boost::asio::io_service::strand m_io_strand;
     boost::asio::deadline_timer m_collectTimer;
     static const int m_collectInterval = 5000;
 
     string m_pool_addresses;
 
-    // StartNonce (non-NiceHash Mode) and
-    // segment width assigned to each GPU as exponent of 2
-    // considering an average block time of 15 seconds
-    // a single device GPU should need a speed of 286 Mh/s
-    // before it consumes the whole 2^32 segment
+    // StartNonce (non-NiceHash Mode) and the most nonces handed
+    // out to a miner at once as exponent of 2. Chunks are sized on
+    // hashrate, so this only caps them for very fast devices
     uint64_t m_nonce_scrambler;
     unsigned int m_nonce_segment_with = 32;
 
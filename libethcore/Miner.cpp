@@ -33,31 +33,46 @@ DeviceDescriptor Miner::getDescriptor()
     return m_deviceDescriptor;
 }
 
-void Miner::setWork(WorkPackage const& _work)
+void Miner::setWork(std::shared_ptr<const WorkPackage> const& _work, unsigned _job)
 {
+    unsigned generation;
+    bool prefetch;
     {
-
         boost::mutex::scoped_lock l(x_work);
 
         // Void work if this miner is paused
-        if (paused())
-            m_work.header = h256();
-        else
+        prefetch = (_work && !paused());
+        if (prefetch)
             m_work = _work;
+        else
+            m_work.reset();
+        m_workJob = _job;
+        m_workTstamp = std::chrono::steady_clock::now();
+        generation = m_workGeneration.fetch_add(1, std::memory_order_release) + 1;
 
 #ifdef DEV_BUILD
-        m_workSwitchStart = std::chrono::steady_clock::now();
+        m_workSwitchStart = m_workTstamp;
 #endif
     }
 
+    // The header goes to the device before the running kernel is aborted,
+    // so the next launch finds it there
+    if (prefetch)
+        prefetchWork(*_work, generation);
     kick_miner();
 }
 
 void Miner::pause(MinerPauseEnum what) 
 {
-    boost::mutex::scoped_lock l(x_pause);
-    m_pauseFlags.set(what);
-    m_work.header = h256();
+    {
+        boost::mutex::scoped_lock l(x_pause);
+        m_pauseFlags.set(what);
+    }
+    {
+        boost::mutex::scoped_lock l(x_work);
+        m_work.reset();
+        m_workGeneration.fetch_add(1, std::memory_order_release);
+    }
     kick_miner();
 }
 
@@ -131,6 +146,39 @@ void Miner::TriggerHashRateUpdate() noexcept
     m_hashRate = 0.0;
 }
 
+void Miner::restartWorking()
+{
+    triggerRestartWorking();
+    finishRestartWorking();
+}
+
+void Miner::triggerRestartWorking()
+{
+    // Only a running loop leaves the device in a known good state. A loop
+    // which failed (or never managed) to initialize gets a full start
+    m_keepDevice.store(!shouldStop(), std::memory_order_relaxed);
+    triggerStopWorking();
+    kick_miner();
+}
+
+void Miner::finishRestartWorking()
+{
+    // Waits for the loop to exit, which may take long if it's busy
+    // generating or uploading a DAG
+    stopWorking();
+    startWorking();
+}
+
+bool Miner::startDevice()
+{
+    if (m_keepDevice.exchange(false, std::memory_order_relaxed) && m_deviceReady)
+        return true;
+
+    m_epochLoaded = -1;
+    m_deviceReady = initDevice();
+    return m_deviceReady;
+}
+
 bool Miner::initEpoch()
 {
     // When loading of DAG is sequential wait for
@@ -148,9 +196,22 @@ bool Miner::initEpoch()
             return false;
     }
 
-    // Run the internal initialization
-    // specific for miner
-    bool result = initEpoch_internal();
+    // Run the internal initialization specific for miner
+    // unless the device still holds this epoch's DAG
+    bool result = true;
+    if (m_epochLoaded != m_epochContext.epochNumber)
+    {
+        auto start = std::chrono::steady_clock::now();
+        result = initEpoch_internal();
+        m_dagMs.store(unsigned(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                   std::chrono::steady_clock::now() - start)
+                                   .count()),
+            std::memory_order_relaxed);
+        m_epochLoaded = (result && !pauseTest(MinerPauseEnum::PauseDueToInitEpochError) &&
+                            !pauseTest(MinerPauseEnum::PauseDueToInsufficientMemory)) ?
+                            m_epochContext.epochNumber :
+                            -1;
+    }
 
     // Advance to next miner or reset to zero for 
     // next run if all have processed
@@ -166,10 +227,36 @@ bool Miner::initEpoch()
     return result;
 }
 
-WorkPackage Miner::work() const
+WorkPackage Miner::work(unsigned& _generation)
 {
     boost::mutex::scoped_lock l(x_work);
-    return m_work;
+    _generation = m_workGeneration.load(std::memory_order_relaxed);
+    m_nonceJob = m_workJob;
+    m_nonceTstamp = m_workTstamp;
+    m_nonces = NonceRange();
+    if (!m_work)
+        return WorkPackage();
+    return *m_work;
+}
+
+void Miner::workLaunched(WorkPackage const& _work)
+{
+    LatencyTrace::record(TraceStage::WorkLaunched, _work.tstamp);
+    LatencyTrace::record(TraceStage::WorkSwitched, m_nonceTstamp);
+}
+
+bool Miner::nextNonces(uint64_t _count, uint64_t& _start)
+{
+    if (m_nonces.count < _count &&
+        !FarmFace::f().nextNonceRange(m_index, m_nonceJob, RetrieveHashRate(), _count, m_nonces))
+    {
+        m_nonces = NonceRange();
+        return false;
+    }
+    _start = m_nonces.start;
+    m_nonces.start += _count;
+    m_nonces.count -= _count;
+    return true;
 }
 
 void Miner::updateHashRate(uint32_t _groupSize, uint32_t _increment) noexcept
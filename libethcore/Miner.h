@@ -24,6 +24,7 @@
 
 #include "EthashAux.h"
 #include <libdevcore/Common.h>
+#include <libdevcore/LatencyTrace.h>
 #include <libdevcore/Log.h>
 #include <libdevcore/Worker.h>
 
@@ -116,6 +117,11 @@ struct CLSettings : public MinerSettings
 // Holds settings for CPU Miner
 struct CPSettings : public MinerSettings
 {
+    string kernel = "auto";     // Search kernel : auto (widest supported), scalar, avx2, avx512
+    string dagDir;              // On-disk DAG cache directory. Empty keeps DAGs in memory only
+    unsigned dagThreads = 0;    // Threads generating the DAG. 0 = one per logical CPU
+    string hugePages = "none";  // Huge pages backing DAG copies : none, thp, 2mb, 1gb
+    bool numa = false;          // Give each NUMA node its own copy of the DAG
 };
 
 struct SolutionAccountType
@@ -159,6 +165,7 @@ struct TelemetryAccountType
     bool paused = false;
     HwSensorsType sensors;
     SolutionAccountType solutions;
+    unsigned dagMs = 0;  // Duration of the latest DAG generation (or load)
 };
 
 struct DeviceDescriptor
@@ -200,6 +207,7 @@ struct DeviceDescriptor
     unsigned int cuComputeMinor;
 
     int cpCpuNumer;   // For CPU
+    int cpNumaNode = -1;
 };
 
 struct HwMonitorInfo
@@ -221,6 +229,33 @@ enum MinerPauseEnum
 };
 
 /// Keeps track of progress for farm and miners
+struct DagProgressType
+{
+    int epoch = -1;
+    bool generating = false;  // Whether a DAG is being generated
+    bool background = false;  // Whether it's the next epoch being generated in advance
+    uint32_t itemsDone = 0;
+    uint32_t itemsTotal = 0;
+    unsigned eta = 0;  // Estimated seconds to completion
+    string str()
+    {
+        unsigned percent = itemsTotal ? unsigned(uint64_t(itemsDone) * 100 / itemsTotal) : 0;
+        return "DAG " + to_string(epoch) + " " + to_string(percent) + "% " +
+               to_string(eta / 60) + ":" + (eta % 60 < 10 ? "0" : "") + to_string(eta % 60);
+    };
+};
+
+/// Solutions re-evaluation counters
+struct VerifierStatsType
+{
+    unsigned queued = 0;      // Solutions waiting for (or under) verification
+    uint64_t verified = 0;    // Solutions found valid
+    uint64_t failed = 0;      // Solutions not meeting their boundary
+    unsigned lastBatch = 0;   // Solutions in the latest batch
+    unsigned latencyAvg = 0;  // Moving average of queue to verdict time (us)
+    unsigned latencyMax = 0;  // Highest queue to verdict time (us)
+};
+
 struct TelemetryType
 {
     bool hwmon = false;
@@ -228,6 +263,8 @@ struct TelemetryType
 
     TelemetryAccountType farm;
     std::vector<TelemetryAccountType> miners;
+    DagProgressType dag;
+    VerifierStatsType verifier;
     std::string str()
     {
         std::stringstream _ret;
@@ -280,6 +317,10 @@ struct TelemetryType
         _ret << EthTealBold << std::fixed << std::setprecision(2) << hr << " "
              << suffixes[magnitude] << EthReset << " - ";
 
+        // Miners are waiting for it
+        if (dag.generating && !dag.background)
+            _ret << EthYellow << dag.str() << EthReset << " - ";
+
         int i = -1;                 // Current miner index
         int m = miners.size() - 1;  // Max miner index
         for (TelemetryAccountType miner : miners)
@@ -309,6 +350,13 @@ struct TelemetryType
 };
 
 
+/// A run of nonces handed out to a miner
+struct NonceRange
+{
+    uint64_t start = 0;
+    uint64_t count = 0;
+};
+
 /**
  * @brief Class for hosting one or more Miners.
  * @warning Must be implemented in a threadsafe manner since it will be called from multiple
@@ -335,6 +383,15 @@ public:
     virtual uint64_t get_nonce_scrambler() = 0;
     virtual unsigned get_segment_width() = 0;
 
+    /**
+     * @brief Called from a Miner to get its next chunk of nonces of the current job
+     * @param _job The job the miner is working on (as given by Miner::setWork)
+     * @param _granularity Nonces searched by a single launch of the miner
+     * @return false if the job is stale or no nonce is left to search
+     */
+    virtual bool nextNonceRange(unsigned _minerIdx, unsigned _job, float _hashrate,
+        uint64_t _granularity, NonceRange& _range) = 0;
+
 private:
     static FarmFace* m_this;
 };
@@ -368,8 +425,10 @@ public:
 
     /**
      * @brief Assigns hashing work to this instance
+     * @param _work The job, shared (read only) among all miners
+     * @param _job Nonce scheduler job the instance gets its nonces from
      */
-    void setWork(WorkPackage const& _work);
+    void setWork(std::shared_ptr<const WorkPackage> const& _work, unsigned _job);
 
     /**
      * @brief Assigns Epoch context to this instance
@@ -387,6 +446,30 @@ public:
      */
     virtual void kick_miner() = 0;
 
+    /**
+     * @brief Hands the header of new work to the device ahead of the miner thread
+     * Called by setWork, on the thread publishing work, right before the kick.
+     * The miner thread takes it over if it switches to work of @p _generation
+     */
+    virtual void prefetchWork(WorkPackage const& _work, unsigned _generation)
+    {
+        (void)_work;
+        (void)_generation;
+    }
+
+    /**
+     * @brief Stops and starts again the worker thread. A miner which was running
+     *  keeps its device initialized and its DAG loaded (warm restart)
+     */
+    void restartWorking();
+
+    /**
+     * @brief Two halves of restartWorking(), so several miners can be told to stop
+     *  at once and waited for after. The first one returns without waiting
+     */
+    void triggerRestartWorking();
+    void finishRestartWorking();
+
     /**
      * @brief Pauses mining setting a reason flag
      */
@@ -420,12 +503,29 @@ public:
 
     void TriggerHashRateUpdate() noexcept;
 
+    /**
+     * @brief Milliseconds the latest epoch initialization (DAG generation) took
+     */
+    unsigned dagTime() const noexcept { return m_dagMs.load(std::memory_order_relaxed); }
+
 protected:
     /**
      * @brief Initializes miner's device.
      */
     virtual bool initDevice() = 0;
 
+    /**
+     * @brief Initializes miner's device unless it was kept initialized by a
+     *  warm restart. To be called by workLoop() before anything else.
+     */
+    bool startDevice();
+
+    /**
+     * @brief Whether workLoop() is exiting for a warm restart, thus has to
+     *  leave device resources (contexts, DAG buffers) allocated
+     */
+    bool keepDevice() const { return m_keepDevice.load(std::memory_order_relaxed); }
+
     /**
      * @brief Initializes miner to current (or changed) epoch.
      */
@@ -436,10 +536,34 @@ protected:
      */
     virtual bool initEpoch_internal() = 0;
 
+    /**
+     * @brief Whether work has been assigned since generation @p _generation.
+     * Cheap enough (a relaxed atomic load) to be polled on every kernel launch.
+     */
+    bool newWork(unsigned _generation) const
+    {
+        return m_workGeneration.load(std::memory_order_relaxed) != _generation;
+    }
+
     /**
      * @brief Returns current workpackage this miner is working on
+     * @param _generation Receives the generation of the returned work
+     * @note Drops whatever is left of the nonces taken for the previous work
+     */
+    WorkPackage work(unsigned& _generation);
+
+    /**
+     * @brief Takes the nonces of the next launch from the chunk of the current
+     *  work, getting a new chunk from the farm when it runs short
+     * @param _count Nonces searched by a launch. Must be the same on each call
+     * @return false if no nonce is left to search for the current work
+     */
+    bool nextNonces(uint64_t _count, uint64_t& _start);
+
+    /**
+     * @brief Traces the first launch on the work last returned by work()
      */
-    WorkPackage work() const;
+    void workLaunched(WorkPackage const& _work);
 
     void updateHashRate(uint32_t _groupSize, uint32_t _increment) noexcept;
 
@@ -466,7 +590,22 @@ protected:
 private:
     bitset<MinerPauseEnum::Pause_MAX> m_pauseFlags;
 
-    WorkPackage m_work;
+    std::atomic<bool> m_keepDevice = {false};  // Warm restart requested
+    bool m_deviceReady = false;                // initDevice() succeeded
+    int m_epochLoaded = -1;                    // Epoch whose DAG the device holds
+    std::atomic<unsigned> m_dagMs = {0};       // Time initEpoch_internal() last took
+
+    // Published work slot. Written under x_work, the generation is bumped
+    // on each change so miners only lock and copy when something changed
+    std::shared_ptr<const WorkPackage> m_work;
+    unsigned m_workJob = 0;
+    std::atomic<unsigned> m_workGeneration = {0};
+    std::chrono::steady_clock::time_point m_workTstamp;  // When the slot was written
+
+    // Miner thread only
+    unsigned m_nonceJob = 0;  // Job of the work being searched
+    std::chrono::steady_clock::time_point m_nonceTstamp;  // When it was handed to this miner
+    NonceRange m_nonces;      // What's left of the last chunk taken
 
     std::chrono::steady_clock::time_point m_hashTime = std::chrono::steady_clock::now();
     std::atomic<float> m_hashRate = {0.0};
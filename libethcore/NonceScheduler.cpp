@@ -0,0 +1,111 @@
+/*
+ This file is part of ethminer.
+
+ ethminer is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ ethminer is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include "NonceScheduler.h"
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+namespace
+{
+const float c_chunkSeconds = 2.0f;  // Time a chunk should keep a miner busy
+const uint64_t c_firstRuns = 4;     // Chunk of a miner with no hashrate yet, in launches
+const unsigned c_tailShares = 4;    // Bounded spaces: chunks of at most size / (miners * this)
+
+}  // namespace
+
+
+unsigned NonceScheduler::reset(
+    h256 const& _header, uint64_t _base, uint64_t _size, unsigned _miners)
+{
+    lock_guard<mutex> l(x_scheduler);
+
+    m_miners = max(_miners, 1u);
+    m_coverage.assignedTo.resize(m_miners, 0);
+    m_coverage.lastTo.resize(m_miners);
+    if (m_coverage.job && _header == m_header && _base == m_coverage.base &&
+        _size == m_coverage.size)
+        return m_coverage.job;
+
+    m_header = _header;
+    m_cursor = 0;
+    m_coverage.job = (m_coverage.job ? m_coverage.job + m_jobStep : m_firstJob);
+    m_coverage.base = _base;
+    m_coverage.size = _size;
+    m_coverage.assigned = 0;
+    m_coverage.chunks = 0;
+    m_coverage.exhausted = false;
+    fill(m_coverage.assignedTo.begin(), m_coverage.assignedTo.end(), 0);
+    fill(m_coverage.lastTo.begin(), m_coverage.lastTo.end(), NonceRange());
+    return m_coverage.job;
+}
+
+bool NonceScheduler::next(unsigned _minerIdx, unsigned _job, float _hashrate,
+    uint64_t _granularity, unsigned _maxWidth, NonceRange& _range)
+{
+    uint64_t granularity = max<uint64_t>(_granularity, 1);
+    uint64_t chunk = granularity * c_firstRuns;
+    if (_hashrate > 0)
+        chunk = uint64_t(_hashrate * c_chunkSeconds);
+    if (_maxWidth < 64)
+        chunk = min(chunk, uint64_t(1) << _maxWidth);
+
+    lock_guard<mutex> l(x_scheduler);
+
+    if (_job != m_coverage.job || m_coverage.exhausted)
+        return false;
+
+    if (m_coverage.size)
+    {
+        uint64_t remaining = m_coverage.size - m_cursor;
+        chunk = min(chunk, max(m_coverage.size / (m_miners * c_tailShares), granularity));
+        chunk = min(chunk, remaining);
+    }
+
+    // Kernels only search whole launches: a tail shorter than one would
+    // overflow the space, so it's left alone
+    chunk = max(chunk / granularity, uint64_t(1)) * granularity;
+    if (m_coverage.size && chunk > m_coverage.size - m_cursor)
+    {
+        m_coverage.exhausted = true;
+        return false;
+    }
+
+    _range.start = m_coverage.base + m_cursor;
+    _range.count = chunk;
+    m_cursor += chunk;  // Wraps around on the whole 2^64 range
+
+    m_coverage.assigned += chunk;
+    m_coverage.chunks++;
+    if (_minerIdx < m_miners)
+    {
+        m_coverage.assignedTo[_minerIdx] += chunk;
+        m_coverage.lastTo[_minerIdx] = _range;
+    }
+    if (m_coverage.size && m_cursor == m_coverage.size)
+        m_coverage.exhausted = true;
+    return true;
+}
+
+NonceCoverageType NonceScheduler::coverage() const
+{
+    lock_guard<mutex> l(x_scheduler);
+    return m_coverage;
+}
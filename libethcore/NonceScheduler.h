@@ -0,0 +1,99 @@
+/*
+ This file is part of ethminer.
+
+ ethminer is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ ethminer is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+#include "Miner.h"
+
+namespace dev
+{
+namespace eth
+{
+/// Nonce space coverage of the current job
+struct NonceCoverageType
+{
+    unsigned job = 0;                // Changes with header or nonce space
+    uint64_t base = 0;               // First nonce of the space
+    uint64_t size = 0;               // Nonces in the space. 0 = the whole 2^64 range
+    uint64_t assigned = 0;           // Nonces handed out so far
+    uint64_t chunks = 0;             // Chunks handed out so far
+    bool exhausted = false;          // Whether no nonce is left to hand out
+    std::vector<uint64_t> assignedTo;  // Nonces handed out to each miner
+    std::vector<NonceRange> lastTo;    // Last chunk handed out to each miner
+};
+
+/**
+ * @brief Hands out the nonce space of a job in chunks.
+ *
+ * All chunks are cut from a single cursor so no two miners ever search the
+ * same nonces, and miners come back for more as they run out: faster devices
+ * simply come back more often. A chunk covers about c_chunkSeconds at the
+ * miner's hashrate. When the space is bounded (extranonce) chunks are also
+ * kept small enough for all miners to share its tail.
+ * Schedulers of different pools number their jobs apart, so the job alone
+ * tells which one a miner has to come back to.
+ * @threadsafe
+ */
+class NonceScheduler
+{
+public:
+    /**
+     * @param _firstJob Number of the first job
+     * @param _jobStep Numbers of later jobs are this much apart
+     */
+    NonceScheduler(unsigned _firstJob = 1, unsigned _jobStep = 1)
+      : m_firstJob(_firstJob), m_jobStep(_jobStep)
+    {}
+
+    /**
+     * @brief Starts handing out a new nonce space. The current job (and what was
+     *  already handed out of it) is kept if neither header nor space changed, so
+     *  a re-sent job or restarted miners never search nonces twice.
+     * @param _size Nonces in the space, 0 for the whole 2^64 range
+     * @return The job miners have to refer to
+     */
+    unsigned reset(h256 const& _header, uint64_t _base, uint64_t _size, unsigned _miners);
+
+    /**
+     * @brief Cuts the next chunk of nonces for a miner
+     * @param _job The job the miner is working on. Stale jobs get nothing
+     * @param _hashrate Miner's hashrate, 0 if not measured yet
+     * @param _granularity Chunks are a multiple of this many nonces
+     * @param _maxWidth Chunks never exceed 2^_maxWidth nonces
+     * @return false if the job is stale or its nonce space exhausted
+     */
+    bool next(unsigned _minerIdx, unsigned _job, float _hashrate, uint64_t _granularity,
+        unsigned _maxWidth, NonceRange& _range);
+
+    NonceCoverageType coverage() const;
+
+private:
+    mutable std::mutex x_scheduler;
+
+    const unsigned m_firstJob;
+    const unsigned m_jobStep;
+    h256 m_header;
+    unsigned m_miners = 1;
+    uint64_t m_cursor = 0;  // Offset from base of the next nonce to hand out
+    NonceCoverageType m_coverage;
+};
+
+}  // namespace eth
+}  // namespace dev
@@ -0,0 +1,247 @@
+/*
+ This file is part of ethminer.
+
+ ethminer is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ ethminer is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include <libdevcore/Log.h>
+
+#include "SolutionVerifier.h"
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+
+SolutionVerifier::SolutionVerifier(unsigned _threads, bool _eval, Verified _handler)
+  : m_eval(_eval), m_handler(std::move(_handler))
+{
+    if (m_eval)
+        for (unsigned t = 1; t < _threads; t++)
+            m_workers.emplace_back(&SolutionVerifier::workerLoop, this);
+    m_dispatcher = thread(&SolutionVerifier::dispatchLoop, this);
+}
+
+SolutionVerifier::~SolutionVerifier()
+{
+    m_stop.store(true, memory_order_relaxed);
+    {
+        lock_guard<mutex> l(x_wait);
+        m_wake.notify_one();
+    }
+    {
+        lock_guard<mutex> l(x_work);
+        m_workReady.notify_all();
+    }
+    m_dispatcher.join();
+    for (auto& t : m_workers)
+        t.join();
+
+    // Drop whatever was pushed too late to be verified
+    Node* node = m_head.exchange(nullptr, memory_order_acquire);
+    while (node)
+    {
+        Node* next = node->next;
+        delete node;
+        node = next;
+    }
+}
+
+void SolutionVerifier::push(const Solution& _s)
+{
+    Node* node = new Node{_s, chrono::steady_clock::now(), nullptr};
+    m_queued.fetch_add(1, memory_order_relaxed);
+
+    Node* head = m_head.load(memory_order_relaxed);
+    do
+        node->next = head;
+    while (!m_head.compare_exchange_weak(head, node, memory_order_release, memory_order_relaxed));
+
+    // Only the push finding the queue empty needs to wake the dispatcher
+    if (!head)
+    {
+        lock_guard<mutex> l(x_wait);
+        m_wake.notify_one();
+    }
+}
+
+VerifierStatsType SolutionVerifier::stats() const
+{
+    VerifierStatsType s;
+    s.queued = m_queued.load(memory_order_relaxed);
+    s.verified = m_verified.load(memory_order_relaxed);
+    s.failed = m_failed.load(memory_order_relaxed);
+    s.lastBatch = m_lastBatch.load(memory_order_relaxed);
+    s.latencyAvg = m_latencyAvg.load(memory_order_relaxed);
+    s.latencyMax = m_latencyMax.load(memory_order_relaxed);
+    return s;
+}
+
+void SolutionVerifier::dispatchLoop()
+{
+    setThreadName("verify");
+
+    vector<Job> batch;
+    while (true)
+    {
+        {
+            unique_lock<mutex> l(x_wait);
+            m_wake.wait(l, [&] {
+                return m_stop.load(memory_order_relaxed) ||
+                       m_head.load(memory_order_relaxed) != nullptr;
+            });
+        }
+        if (m_stop.load(memory_order_relaxed))
+            return;
+
+        // Take everything queued so far. The list is newest first
+        batch.clear();
+        for (Node* node = m_head.exchange(nullptr, memory_order_acquire); node;
+             node = node->next)
+            batch.push_back(Job{node, Result{}, false});
+        reverse(batch.begin(), batch.end());
+
+        verify(batch);
+
+        for (auto& job : batch)
+            delete job.node;
+    }
+}
+
+void SolutionVerifier::verify(vector<Job>& _batch)
+{
+    // Solutions of a batch almost always share the epoch: evaluate them
+    // in runs with one context lookup each
+    if (m_eval)
+    {
+        auto run = _batch.begin();
+        while (run != _batch.end())
+        {
+            int epoch = run->node->solution.work.epoch;
+            auto end = find_if(run, _batch.end(),
+                [&](const Job& _j) { return _j.node->solution.work.epoch != epoch; });
+            try
+            {
+                evaluate(run, size_t(end - run));
+            }
+            catch (const std::exception& _ex)
+            {
+                // Left unevaluated, thus invalid
+                cwarn << "Unable to verify solutions : " << _ex.what();
+            }
+            run = end;
+        }
+    }
+
+    const auto now = chrono::steady_clock::now();
+    for (auto& job : _batch)
+    {
+        const Solution& s = job.node->solution;
+        bool valid = true;
+        if (m_eval)
+            valid = (job.evaluated && job.result.value <= s.work.boundary);
+
+        unsigned latency = unsigned(
+            chrono::duration_cast<chrono::microseconds>(now - job.node->queued).count());
+        unsigned avg = m_latencyAvg.load(memory_order_relaxed);
+        m_latencyAvg.store(avg ? avg - avg / 8 + latency / 8 : latency, memory_order_relaxed);
+        if (latency > m_latencyMax.load(memory_order_relaxed))
+            m_latencyMax.store(latency, memory_order_relaxed);
+
+        m_queued.fetch_sub(1, memory_order_relaxed);
+        if (valid)
+            m_verified.fetch_add(1, memory_order_relaxed);
+        else
+            m_failed.fetch_add(1, memory_order_relaxed);
+
+        if (m_eval)
+            m_handler(Solution{s.nonce, job.result.mixHash, s.work, s.tstamp, s.midx}, valid);
+        else
+            m_handler(s, true);
+    }
+    m_lastBatch.store(unsigned(_batch.size()), memory_order_relaxed);
+}
+
+void SolutionVerifier::evaluate(vector<Job>::iterator _jobs, size_t _count)
+{
+    const EpochContextPtr context = EthashAux::context(_jobs->node->solution.work.epoch);
+
+    unique_lock<mutex> l(x_work);
+    // Workers late for the previous batch must be out before it's replaced
+    m_workDone.wait(l, [&] { return m_busy == 0; });
+    m_context = context.get();
+    m_jobs = _jobs;
+    m_jobCount = _count;
+    m_next.store(0, memory_order_relaxed);
+    m_done.store(0, memory_order_relaxed);
+
+    // Not worth waking anybody for a single solution
+    if (_count > 1 && !m_workers.empty())
+    {
+        m_generation++;
+        m_workReady.notify_all();
+    }
+    l.unlock();
+
+    // The dispatcher takes its share too
+    runJobs();
+
+    l.lock();
+    m_workDone.wait(l, [&] { return m_done.load(memory_order_acquire) == _count; });
+}
+
+void SolutionVerifier::runJobs()
+{
+    size_t i;
+    while ((i = m_next.fetch_add(1, memory_order_relaxed)) < m_jobCount)
+    {
+        Job& job = m_jobs[i];
+        job.result =
+            EthashAux::eval(*m_context, job.node->solution.work.header, job.node->solution.nonce);
+        job.evaluated = true;
+        if (m_done.fetch_add(1, memory_order_acq_rel) + 1 == m_jobCount)
+        {
+            lock_guard<mutex> l(x_work);
+            m_workDone.notify_all();
+        }
+    }
+}
+
+void SolutionVerifier::workerLoop()
+{
+    setThreadName("verify");
+
+    unsigned generation = 0;
+    while (true)
+    {
+        {
+            unique_lock<mutex> l(x_work);
+            m_workReady.wait(l, [&] {
+                return m_stop.load(memory_order_relaxed) || m_generation != generation;
+            });
+            if (m_stop.load(memory_order_relaxed))
+                return;
+            generation = m_generation;
+            m_busy++;
+        }
+
+        runJobs();
+
+        lock_guard<mutex> l(x_work);
+        if (--m_busy == 0)
+            m_workDone.notify_all();
+    }
+}
@@ -0,0 +1,124 @@
+/*
+ This file is part of ethminer.
+
+ ethminer is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ ethminer is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <ethash/ethash.hpp>
+
+#include "EthashAux.h"
+#include "Miner.h"
+
+namespace dev
+{
+namespace eth
+{
+/**
+ * @brief Re-evaluates solutions found by miners before they're submitted.
+ *
+ * Miners push solutions into a lock-free queue. A dispatcher thread drains
+ * it in batches, has them hashed by a small pool of threads (sharing the
+ * epoch context per batch) and hands them on in submission order.
+ * Verification thus never waits on the Farm's strand.
+ * @threadsafe
+ */
+class SolutionVerifier
+{
+public:
+    using Verified = std::function<void(const Solution&, bool _valid)>;
+
+    /**
+     * @param _threads Number of hashing threads, the dispatcher included
+     * @param _eval Whether to re-evaluate at all (false passes solutions through)
+     * @param _handler Called from the dispatcher thread, in order, with each solution
+     *  (carrying the evaluated mix hash) and whether it meets its boundary
+     */
+    SolutionVerifier(unsigned _threads, bool _eval, Verified _handler);
+    ~SolutionVerifier();
+
+    /**
+     * @brief Queues a solution for verification. Never blocks
+     */
+    void push(const Solution& _s);
+
+    /**
+     * @brief Queue depth and latency counters
+     */
+    VerifierStatsType stats() const;
+
+private:
+    struct Node
+    {
+        Solution solution;
+        std::chrono::steady_clock::time_point queued;
+        Node* next;
+    };
+
+    struct Job
+    {
+        Node* node;
+        Result result;
+        bool evaluated;
+    };
+
+    void dispatchLoop();
+    void workerLoop();
+    void verify(std::vector<Job>& _batch);
+    void evaluate(std::vector<Job>::iterator _jobs, size_t _count);
+    void runJobs();
+
+    bool m_eval;
+    Verified m_handler;
+
+    std::atomic<Node*> m_head = {nullptr};  // Most recently pushed (LIFO till drained)
+
+    std::mutex x_wait;
+    std::condition_variable m_wake;  // Signals the dispatcher the queue is no longer empty
+    std::atomic<bool> m_stop = {false};
+
+    // Batch being shared with the workers
+    std::mutex x_work;
+    std::condition_variable m_workReady;
+    std::condition_variable m_workDone;
+    unsigned m_generation = 0;  // Bumped on each new batch
+    unsigned m_busy = 0;        // Workers inside runJobs()
+    const ethash::epoch_context* m_context = nullptr;
+    std::vector<Job>::iterator m_jobs;
+    size_t m_jobCount = 0;
+    std::atomic<size_t> m_next = {0};
+    std::atomic<size_t> m_done = {0};
+
+    std::atomic<unsigned> m_queued = {0};
+    std::atomic<uint64_t> m_verified = {0};
+    std::atomic<uint64_t> m_failed = {0};
+    std::atomic<unsigned> m_lastBatch = {0};
+    std::atomic<unsigned> m_latencyAvg = {0};  // Moving average, microseconds
+    std::atomic<unsigned> m_latencyMax = {0};  // Microseconds
+
+    std::vector<std::thread> m_workers;
+    std::thread m_dispatcher;
+};
+
+}  // namespace eth
+}  // namespace dev
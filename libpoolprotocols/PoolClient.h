@@ -6,6 +6,7 @@
 
 #include <libethcore/Miner.h>
 #include <libpoolprotocols/PoolURI.h>
+#include <libpoolprotocols/testing/SessionRecorder.h>
 
 extern boost::asio::io_service g_io_service;
 
@@ -69,10 +70,18 @@ public:
     // Releases the pointer to the connection definition
     void unsetConnection() { m_conn = nullptr; }
 
+    // Records the lines exchanged with the pool
+    void setRecorder(std::shared_ptr<SessionRecorder> _recorder) { m_recorder = _recorder; }
+
     virtual void connect() = 0;
     virtual void disconnect() = 0;
     virtual void submitHashrate(uint64_t const& rate, string const& id) = 0;
     virtual void submitSolution(const Solution& solution) = 0;
+    virtual void submitSolutions(const std::vector<Solution>& solutions)
+    {
+        for (auto const& s : solutions)
+            submitSolution(s);
+    }
     virtual bool isConnected() { return m_connected.load(memory_order_relaxed); }
     virtual bool isPendingState() { return false; }
 
@@ -111,6 +120,9 @@ protected:
 
     std::shared_ptr<URI> m_conn = nullptr;
 
+    std::shared_ptr<SessionRecorder> m_recorder = nullptr;
+    unsigned m_recSession = 0;  // Recorded session of the connection. 0 if none
+
     SolutionAccepted m_onSolutionAccepted;
     SolutionRejected m_onSolutionRejected;
     Disconnected m_onDisconnected;
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <chrono>
 
 #include "PoolManager.h"
@@ -8,12 +9,49 @@ using namespace eth;
 
 PoolManager* PoolManager::m_this = nullptr;
 
+const unsigned c_standbyRecheck = 5;  // Seconds between checks of standby connections
+const unsigned c_parallelRetry = 3;   // Seconds before a parallel pool connects again
+const size_t c_jobsKept = 256;        // Jobs solutions are still routed for
+
+namespace
+{
+void publishJob(WorkPackage const& _wp, std::string const& _pool)
+{
+    if (!EventFeed::active())
+        return;
+    Json::Value data;
+    data["pool"] = _pool;
+    data["job"] = _wp.job;
+    data["header"] = _wp.header.hex(HexPrefix::Add);
+    data["epoch"] = _wp.epoch;
+    data["block"] = (_wp.block >= 0 ? Json::Value(_wp.block) : Json::Value::null);
+    data["difficulty"] = dev::getHashesToTarget(_wp.boundary.hex(HexPrefix::Add));
+    EventFeed::publish(EventType::Job, data);
+}
+
+void publishVerdict(EventType _type, std::string const& _pool, unsigned _minerIdx,
+    std::chrono::milliseconds _responseDelay, bool _asStale)
+{
+    if (!EventFeed::active())
+        return;
+    Json::Value data;
+    data["pool"] = _pool;
+    data["device"] = _minerIdx;
+    data["delay"] = Json::UInt64(_responseDelay.count());
+    if (_type == EventType::SolutionAccepted)
+        data["stale"] = _asStale;
+    EventFeed::publish(_type, data);
+}
+
+}  // namespace
+
 PoolManager::PoolManager(PoolSettings _settings)
   : m_Settings(std::move(_settings)),
     m_io_strand(g_io_service),
     m_failovertimer(g_io_service),
     m_submithrtimer(g_io_service),
-    m_reconnecttimer(g_io_service)
+    m_reconnecttimer(g_io_service),
+    m_standbytimer(g_io_service)
 {
     DEV_BUILD_LOG_PROGRAMFLOW(cnote, "PoolManager::PoolManager() begin");
 
@@ -35,13 +73,34 @@ PoolManager::PoolManager(PoolSettings _settings)
     });
 
     Farm::f().onSolutionFound([&](const Solution& sol) {
+        // Solutions go back to the pool which issued the job
+        PoolClient* client = p_client.get();
+        if (!m_parallel.empty())
+        {
+            Guard l(x_jobs);
+            auto it = m_jobPools.find(std::make_pair(sol.work.job, sol.work.header));
+            if (it != m_jobPools.end() && it->second)
+                client = m_parallel[it->second - 1]->client.get();
+        }
+
         // Solution should passthrough only if client is
         // properly connected. Otherwise we'll have the bad behavior
         // to log nonce submission but receive no response
 
-        if (p_client && p_client->isConnected())
+        if (EventFeed::active())
+        {
+            Json::Value data;
+            data["device"] = sol.midx;
+            data["nonce"] = toHex(sol.nonce, HexPrefix::Add);
+            data["job"] = sol.work.job;
+            data["header"] = sol.work.header.hex(HexPrefix::Add);
+            data["wasted"] = !(client && client->isConnected());
+            EventFeed::publish(EventType::SolutionFound, data);
+        }
+
+        if (client && client->isConnected())
         {
-            p_client->submitSolution(sol);
+            client->submitSolution(sol);
         }
         else
         {
@@ -52,81 +111,89 @@ PoolManager::PoolManager(PoolSettings _settings)
         return false;
     });
 
+    if (!m_Settings.recordFile.empty())
+        m_recorder = std::make_shared<SessionRecorder>(m_Settings.recordFile);
 
-    DEV_BUILD_LOG_PROGRAMFLOW(cnote, "PoolManager::PoolManager() end");
-}
+    if (m_Settings.proxyPort)
+    {
+        m_proxy = std::unique_ptr<StratumProxy>(new StratumProxy(
+            m_Settings.proxyAddress, m_Settings.proxyPort, m_Settings.proxyBatchWindow));
+        m_proxy->onSolution([&](const std::vector<Solution>& _solutions) {
+            if (!p_client || !p_client->isConnected())
+                return false;
+            p_client->submitSolutions(_solutions);
+            return true;
+        });
+    }
 
-void PoolManager::setClientHandlers()
-{
-    p_client->onConnected([&]() {
+    // The first connections are mined at once, each for a share of the hashrate
+    if (m_Settings.poolWeights.size() > 1 && m_proxy)
+    {
+        cwarn << "A proxy serves a single pool. Hashrate is not split";
+    }
+    else if (m_Settings.poolWeights.size() > 1)
+    {
+        auto& conns = m_Settings.connections;
+        size_t count = std::min(m_Settings.poolWeights.size(), size_t(Farm::c_maxPools));
+        count = std::min(count, conns.size());
+        if (count < m_Settings.poolWeights.size())
+            cwarn << "Hashrate is split among the first " << count << " connections only";
+        for (size_t i = 1; i < count; i++)
         {
+            std::unique_ptr<ParallelPool> pool(new ParallelPool());
+            pool->conn = conns[i];
+            pool->slot = unsigned(i);
+            pool->weight = m_Settings.poolWeights[i];
+            pool->host = conns[i]->Host() + ":" + to_string(conns[i]->Port());
+            m_parallel.push_back(std::move(pool));
+        }
 
-            // If HostName is already an IP address no need to append the
-            // effective ip address.
-            if (p_client->getConnection()->HostNameType() == dev::UriHostNameType::Dns ||
-                p_client->getConnection()->HostNameType() == dev::UriHostNameType::Basic)
-            {
-                string ep = p_client->ActiveEndPoint();
-                if (!ep.empty())
-                    m_selectedHost = p_client->getConnection()->Host() + ep;
-            }
-
-            cnote << "Established connection to " << m_selectedHost;
-            m_connectionAttempt = 0;
-
-            // Reset current WorkPackage
-            m_currentWp.job.clear();
-            m_currentWp.header = h256();
-
-            // Shuffle if needed
-            if (Farm::f().get_ergodicity() == 1U)
-                Farm::f().shuffle();
+        // Those left are fail-over connections of the first one
+        conns.erase(conns.begin() + 1, conns.begin() + count);
+        if (!m_parallel.empty())
+            Farm::f().setPoolWeight(0, m_Settings.poolWeights[0]);
+    }
 
-            // Rough implementation to return to primary pool
-            // after specified amount of time
-            if (m_activeConnectionIdx != 0 && m_Settings.poolFailoverTimeout)
-            {
-                m_failovertimer.expires_from_now(
-                    boost::posix_time::minutes(m_Settings.poolFailoverTimeout));
-                m_failovertimer.async_wait(m_io_strand.wrap(boost::bind(
-                    &PoolManager::failovertimer_elapsed, this, boost::asio::placeholders::error)));
-            }
-            else
-            {
-                m_failovertimer.cancel();
-            }
-        }
+    DEV_BUILD_LOG_PROGRAMFLOW(cnote, "PoolManager::PoolManager() end");
+}
 
-        if (!Farm::f().isMining())
-        {
-            cnote << "Spinning up miners...";
-            Farm::f().start();
-        }
-        else if (Farm::f().paused())
+void PoolManager::setClientHandlers(PoolClient* _client)
+{
+    // Standby clients share these handlers: only the active one drives the farm
+    _client->onConnected([this, _client]() {
+        if (_client != m_activeClient.load(std::memory_order_relaxed))
         {
-            cnote << "Resume mining ...";
-            Farm::f().resume();
+            cnote << "Standby connection to " << _client->getConnection()->Host() << ":"
+                  << _client->getConnection()->Port() << " established";
+            return;
         }
+        connected();
+    });
 
-        // Activate timing for HR submission
-        if (m_Settings.reportHashrate)
+    _client->onDisconnected([this, _client]() {
+        if (_client != m_activeClient.load(std::memory_order_relaxed))
         {
-            m_submithrtimer.expires_from_now(boost::posix_time::seconds(m_Settings.hashRateInterval));
-            m_submithrtimer.async_wait(m_io_strand.wrap(boost::bind(
-                &PoolManager::submithrtimer_elapsed, this, boost::asio::placeholders::error)));
+            Guard l(x_clients);
+            for (auto& s : m_standby)
+                if (s->client.get() == _client)
+                {
+                    cnote << "Standby connection to " << s->conn->Host() << ":"
+                          << s->conn->Port() << " lost";
+                    s->lost = true;
+                    s->wp = WorkPackage();
+                }
+            return;
         }
 
-        // Signal async operations have completed
-        m_async_pending.store(false, std::memory_order_relaxed);
-
-    });
-
-    p_client->onDisconnected([&]() {
         cnote << "Disconnected from " << m_selectedHost;
 
         // Clear current connection
         p_client->unsetConnection();
         m_currentWp.header = h256();
+        if (!m_parallel.empty())
+            Farm::f().setPoolWeight(0, 0);
+        if (m_proxy)
+            m_proxy->upstreamDisconnected();
 
         // Stop timing actors
         m_failovertimer.cancel();
@@ -143,94 +210,416 @@ void PoolManager::setClientHandlers()
         }
         else
         {
-            // Signal we will reconnect async
+            // Signal we will reconnect async. Mining is suspended there
+            // unless a standby connection takes over
             m_async_pending.store(true, std::memory_order_relaxed);
-
-            // Suspend mining and submit new connection request
-            cnote << "No connection. Suspend mining ...";
-            Farm::f().pause();
             g_io_service.post(m_io_strand.wrap(boost::bind(&PoolManager::rotateConnect, this)));
         }
     });
 
-    p_client->onWorkReceived([&](WorkPackage const& wp) {
-
-        // Should not happen !
-        if (!wp)
+    _client->onWorkReceived([this, _client](WorkPackage const& wp) {
+        Guard l(x_clients);
+        if (_client != m_activeClient.load(std::memory_order_relaxed))
+        {
+            for (auto& s : m_standby)
+                if (s->client.get() == _client)
+                    s->wp = wp;
             return;
+        }
+        workReceived(wp);
+    });
 
-        int _currentEpoch = m_currentWp.epoch;
-        bool newEpoch = (_currentEpoch == -1);
+    _client->onSolutionAccepted(
+        [&](std::chrono::milliseconds const& _responseDelay, unsigned const& _minerIdx, bool _asStale) {
+            std::stringstream ss;
+            ss << std::setw(4) << std::setfill(' ') << _responseDelay.count() << " ms. "
+               << m_selectedHost;
+            cnote << EthLime "**Accepted" << (_asStale ? " stale": "") << EthReset << ss.str();
+            LatencyTrace::record(TraceStage::SolutionAcked, _responseDelay);
+            publishVerdict(EventType::SolutionAccepted, m_selectedHost, _minerIdx, _responseDelay,
+                _asStale);
+            accountPool(0, SolutionAccountingEnum::Accepted);
+            if (m_proxy)
+                m_proxy->solutionAnswered(_minerIdx, true);
+            else
+                Farm::f().accountSolution(_minerIdx, SolutionAccountingEnum::Accepted);
+        });
 
-        // In EthereumStratum/2.0.0 epoch number is set in session
-        if (!newEpoch)
-        {
-            if (p_client->getConnection()->StratumMode() == 3)
-                newEpoch = (wp.epoch != m_currentWp.epoch);
+    _client->onSolutionRejected(
+        [&](std::chrono::milliseconds const& _responseDelay, unsigned const& _minerIdx) {
+            std::stringstream ss;
+            ss << std::setw(4) << std::setfill(' ') << _responseDelay.count() << " ms. "
+               << m_selectedHost;
+            cwarn << EthRed "**Rejected" EthReset << ss.str();
+            LatencyTrace::record(TraceStage::SolutionAcked, _responseDelay);
+            publishVerdict(
+                EventType::SolutionRejected, m_selectedHost, _minerIdx, _responseDelay, false);
+            accountPool(0, SolutionAccountingEnum::Rejected);
+            if (m_proxy)
+                m_proxy->solutionAnswered(_minerIdx, false);
             else
-                newEpoch = (wp.seed != m_currentWp.seed);
+                Farm::f().accountSolution(_minerIdx, SolutionAccountingEnum::Rejected);
+        });
+}
+
+void PoolManager::setParallelHandlers(ParallelPool* _pool)
+{
+    PoolClient* client = _pool->client.get();
+    unsigned slot = _pool->slot;
+
+    client->onConnected([this, _pool]() {
+        cnote << "Established connection to " << _pool->host << " for a share of "
+              << _pool->weight;
+        if (!Farm::f().isMining())
+        {
+            cnote << "Spinning up miners...";
+            Farm::f().start();
         }
+        else if (Farm::f().paused())
+        {
+            cnote << "Resume mining ...";
+            Farm::f().resume();
+        }
+    });
 
-        bool newDiff = (wp.boundary != m_currentWp.boundary);
+    client->onDisconnected([this, _pool]() {
+        cnote << "Disconnected from " << _pool->host;
+        Farm::f().setPoolWeight(_pool->slot, 0);
+        bool working = (p_client && p_client->isConnected() && m_currentWp);
+        {
+            Guard l(x_jobs);
+            _pool->wp = WorkPackage();
+            for (auto& p : m_parallel)
+                working = working || p->wp;
+        }
+        if (m_stopping.load(std::memory_order_relaxed))
+            return;
 
-        m_currentWp = wp;
+        if (!working && Farm::f().isMining() && !Farm::f().paused())
+        {
+            cnote << "No connection. Suspend mining ...";
+            Farm::f().pause();
+        }
 
-        if (newEpoch)
+        if (_pool->conn->IsUnrecoverable())
         {
-            m_epochChanges.fetch_add(1, std::memory_order_relaxed);
+            cwarn << "Giving up " << _pool->host;
+            return;
+        }
+        _pool->retrytimer.expires_from_now(boost::posix_time::seconds(
+            m_Settings.delayBeforeRetry ? m_Settings.delayBeforeRetry : c_parallelRetry));
+        _pool->retrytimer.async_wait(
+            m_io_strand.wrap([this, _pool](const boost::system::error_code& ec) {
+                if (!ec)
+                    parallelConnect(_pool);
+            }));
+    });
 
-            // If epoch is valued in workpackage take it
-            if (wp.epoch == -1)
+    client->onWorkReceived([this, _pool](WorkPackage const& wp) {
+        if (!wp)
+            return;
+        WorkPackage w = wp;
+        {
+            // Epoch as for the active connection
+            Guard l(x_jobs);
+            if (w.epoch == -1)
             {
-                if (m_currentWp.block >= 0)
-                    m_currentWp.epoch = m_currentWp.block / 30000;
+                if (_pool->wp && _pool->wp.seed == w.seed)
+                    w.epoch = _pool->wp.epoch;
+                else if (w.block >= 0)
+                    w.epoch = w.block / 30000;
                 else
-                    m_currentWp.epoch = ethash::find_epoch_number(
-                        ethash::hash256_from_bytes(m_currentWp.seed.data()));
+                    w.epoch = ethash::find_epoch_number(ethash::hash256_from_bytes(w.seed.data()));
             }
+            _pool->wp = w;
+        }
+        addJob(w, _pool->slot);
+
+        cnote << "Job: " EthWhite << w.header.abridged()
+              << (w.block != -1 ? (" block " + to_string(w.block)) : "") << EthReset << " "
+              << _pool->host;
+
+        LatencyTrace::record(TraceStage::WorkDispatched, w.tstamp);
+        publishJob(w, _pool->host);
+        Farm::f().setWork(_pool->slot, w);
+        Farm::f().setPoolWeight(_pool->slot, _pool->weight);
+    });
+
+    client->onSolutionAccepted([this, _pool, slot](std::chrono::milliseconds const& _responseDelay,
+                                   unsigned const& _minerIdx, bool _asStale) {
+        std::stringstream ss;
+        ss << std::setw(4) << std::setfill(' ') << _responseDelay.count() << " ms. "
+           << _pool->host;
+        cnote << EthLime "**Accepted" << (_asStale ? " stale" : "") << EthReset << ss.str();
+        LatencyTrace::record(TraceStage::SolutionAcked, _responseDelay);
+        publishVerdict(
+            EventType::SolutionAccepted, _pool->host, _minerIdx, _responseDelay, _asStale);
+        accountPool(slot, SolutionAccountingEnum::Accepted);
+        Farm::f().accountSolution(_minerIdx, SolutionAccountingEnum::Accepted);
+    });
+
+    client->onSolutionRejected([this, _pool, slot](std::chrono::milliseconds const& _responseDelay,
+                                   unsigned const& _minerIdx) {
+        std::stringstream ss;
+        ss << std::setw(4) << std::setfill(' ') << _responseDelay.count() << " ms. "
+           << _pool->host;
+        cwarn << EthRed "**Rejected" EthReset << ss.str();
+        LatencyTrace::record(TraceStage::SolutionAcked, _responseDelay);
+        publishVerdict(EventType::SolutionRejected, _pool->host, _minerIdx, _responseDelay, false);
+        accountPool(slot, SolutionAccountingEnum::Rejected);
+        Farm::f().accountSolution(_minerIdx, SolutionAccountingEnum::Rejected);
+    });
+}
+
+void PoolManager::parallelConnect(ParallelPool* _pool)
+{
+    if (!m_running.load(std::memory_order_relaxed) || m_stopping.load(std::memory_order_relaxed))
+        return;
+
+    // Same client on each connection, so solutions always find it
+    if (!_pool->client)
+    {
+        _pool->client = createClient(_pool->conn);
+        if (!_pool->client)
+            return;
+        setParallelHandlers(_pool);
+        _pool->client->setConnection(_pool->conn);
+    }
+    cnote << "Selected pool " << _pool->host << " for a share of " << _pool->weight;
+    _pool->client->connect();
+}
+
+void PoolManager::addJob(WorkPackage const& _wp, unsigned _slot)
+{
+    if (m_parallel.empty())
+        return;
+
+    Guard l(x_jobs);
+    auto key = std::make_pair(_wp.job, _wp.header);
+    if (!m_jobPools.emplace(key, _slot).second)
+        return;
+    m_jobOrder.push_back(key);
+    if (m_jobOrder.size() > c_jobsKept)
+    {
+        m_jobPools.erase(m_jobOrder.front());
+        m_jobOrder.pop_front();
+    }
+}
+
+void PoolManager::accountPool(unsigned _slot, SolutionAccountingEnum _accounting)
+{
+    Guard l(x_jobs);
+    SolutionAccountType& account = m_poolSolutions[_slot];
+    if (_accounting == SolutionAccountingEnum::Accepted)
+        account.accepted++;
+    else if (_accounting == SolutionAccountingEnum::Rejected)
+        account.rejected++;
+    account.tstamp = std::chrono::steady_clock::now();
+}
+
+void PoolManager::connected()
+{
+    {
+
+        // If HostName is already an IP address no need to append the
+        // effective ip address.
+        if (p_client->getConnection()->HostNameType() == dev::UriHostNameType::Dns ||
+            p_client->getConnection()->HostNameType() == dev::UriHostNameType::Basic)
+        {
+            string ep = p_client->ActiveEndPoint();
+            if (!ep.empty())
+                m_selectedHost = p_client->getConnection()->Host() + ep;
+        }
+
+        cnote << "Established connection to " << m_selectedHost;
+        m_connectionAttempt = 0;
+
+        if (EventFeed::active())
+        {
+            Json::Value data;
+            data["pool"] = m_selectedHost;
+            data["index"] = m_activeConnectionIdx;
+            data["switches"] = getConnectionSwitches();
+            EventFeed::publish(EventType::PoolSwitch, data);
+        }
+
+        // Reset current WorkPackage
+        m_currentWp.job.clear();
+        m_currentWp.header = h256();
+
+        // Shuffle if needed
+        if (Farm::f().get_ergodicity() == 1U)
+            Farm::f().shuffle();
+
+        // Rough implementation to return to primary pool
+        // after specified amount of time
+        if (m_activeConnectionIdx != 0 && m_Settings.poolFailoverTimeout)
+        {
+            m_failovertimer.expires_from_now(
+                boost::posix_time::minutes(m_Settings.poolFailoverTimeout));
+            m_failovertimer.async_wait(m_io_strand.wrap(boost::bind(
+                &PoolManager::failovertimer_elapsed, this, boost::asio::placeholders::error)));
         }
         else
         {
-            m_currentWp.epoch = _currentEpoch;
+            m_failovertimer.cancel();
         }
+    }
 
-        if (newDiff || newEpoch)
-            showMiningAt();
+    if (!Farm::f().isMining())
+    {
+        cnote << "Spinning up miners...";
+        Farm::f().start();
+    }
+    else if (Farm::f().paused())
+    {
+        cnote << "Resume mining ...";
+        Farm::f().resume();
+    }
 
-        cnote << "Job: " EthWhite << m_currentWp.header.abridged()
-              << (m_currentWp.block != -1 ? (" block " + to_string(m_currentWp.block)) : "")
-              << EthReset << " " << m_selectedHost;
+    // Activate timing for HR submission
+    if (m_Settings.reportHashrate)
+    {
+        m_submithrtimer.expires_from_now(boost::posix_time::seconds(m_Settings.hashRateInterval));
+        m_submithrtimer.async_wait(m_io_strand.wrap(boost::bind(
+            &PoolManager::submithrtimer_elapsed, this, boost::asio::placeholders::error)));
+    }
 
-        Farm::f().setWork(m_currentWp);
-    });
+    // Signal async operations have completed
+    m_async_pending.store(false, std::memory_order_relaxed);
 
-    p_client->onSolutionAccepted(
-        [&](std::chrono::milliseconds const& _responseDelay, unsigned const& _minerIdx, bool _asStale) {
-            std::stringstream ss;
-            ss << std::setw(4) << std::setfill(' ') << _responseDelay.count() << " ms. "
-               << m_selectedHost;
-            cnote << EthLime "**Accepted" << (_asStale ? " stale": "") << EthReset << ss.str();
-            Farm::f().accountSolution(_minerIdx, SolutionAccountingEnum::Accepted);
-        });
+    // Get the connections we'd fail over to ready
+    if (m_Settings.standbyConnections)
+        g_io_service.post(m_io_strand.wrap(boost::bind(&PoolManager::refillStandby, this)));
+}
 
-    p_client->onSolutionRejected(
-        [&](std::chrono::milliseconds const& _responseDelay, unsigned const& _minerIdx) {
-            std::stringstream ss;
-            ss << std::setw(4) << std::setfill(' ') << _responseDelay.count() << " ms. "
-               << m_selectedHost;
-            cwarn << EthRed "**Rejected" EthReset << ss.str();
-            Farm::f().accountSolution(_minerIdx, SolutionAccountingEnum::Rejected);
-        });
+void PoolManager::workReceived(WorkPackage const& wp)
+{
+    // Should not happen !
+    if (!wp)
+        return;
+
+    int _currentEpoch = m_currentWp.epoch;
+    bool newEpoch = (_currentEpoch == -1);
+
+    // In EthereumStratum/2.0.0 epoch number is set in session
+    if (!newEpoch)
+    {
+        if (p_client->getConnection()->StratumMode() == 3)
+            newEpoch = (wp.epoch != m_currentWp.epoch);
+        else
+            newEpoch = (wp.seed != m_currentWp.seed);
+    }
+
+    bool newDiff = (wp.boundary != m_currentWp.boundary);
+
+    m_currentWp = wp;
+
+    if (newEpoch)
+    {
+        m_epochChanges.fetch_add(1, std::memory_order_relaxed);
+
+        // If epoch is valued in workpackage take it
+        if (wp.epoch == -1)
+        {
+            if (m_currentWp.block >= 0)
+                m_currentWp.epoch = m_currentWp.block / 30000;
+            else
+                m_currentWp.epoch = ethash::find_epoch_number(
+                    ethash::hash256_from_bytes(m_currentWp.seed.data()));
+        }
+
+        if (EventFeed::active())
+        {
+            Json::Value data;
+            data["pool"] = m_selectedHost;
+            data["epoch"] = m_currentWp.epoch;
+            EventFeed::publish(EventType::EpochChange, data);
+        }
+    }
+    else
+    {
+        m_currentWp.epoch = _currentEpoch;
+    }
+
+    if (newDiff || newEpoch)
+        showMiningAt();
+
+    cnote << "Job: " EthWhite << m_currentWp.header.abridged()
+          << (m_currentWp.block != -1 ? (" block " + to_string(m_currentWp.block)) : "")
+          << EthReset << " " << m_selectedHost;
+
+    LatencyTrace::record(TraceStage::WorkDispatched, m_currentWp.tstamp);
+    publishJob(m_currentWp, m_selectedHost);
+    addJob(m_currentWp, 0);
+    Farm::f().setWork(m_currentWp);
+    if (!m_parallel.empty())
+        Farm::f().setPoolWeight(0, m_Settings.poolWeights[0]);
+    if (m_proxy)
+        m_proxy->setWork(m_currentWp);
 }
 
 void PoolManager::stop()
 {
     DEV_BUILD_LOG_PROGRAMFLOW(cnote, "PoolManager::stop() begin");
+    if (m_proxy)
+        m_proxy->stop();
+
     if (m_running.load(std::memory_order_relaxed))
     {
         m_async_pending.store(true, std::memory_order_relaxed);
         m_stopping.store(true, std::memory_order_relaxed);
 
+        if (!m_parallel.empty())
+        {
+            std::vector<PoolClient*> clients;
+            for (auto& p : m_parallel)
+            {
+                p->retrytimer.cancel();
+                if (p->client && p->client->isConnected())
+                    clients.push_back(p->client.get());
+            }
+            for (auto c : clients)
+                c->disconnect();
+
+            // Wait for async operations to complete
+            bool pending = !clients.empty();
+            for (unsigned i = 0; pending && i < 20; i++)
+            {
+                this_thread::sleep_for(chrono::milliseconds(100));
+                pending = false;
+                for (auto c : clients)
+                    pending = pending || c->isConnected() || c->isPendingState();
+            }
+        }
+
+        if (m_Settings.standbyConnections)
+        {
+            m_standbytimer.cancel();
+            std::vector<PoolClient*> standby;
+            {
+                Guard l(x_clients);
+                for (auto& s : m_standby)
+                    if (s->client->isConnected())
+                        standby.push_back(s->client.get());
+            }
+            for (auto c : standby)
+                c->disconnect();
+
+            // Wait for async operations to complete
+            bool pending = !standby.empty();
+            for (unsigned i = 0; pending && i < 20; i++)
+            {
+                this_thread::sleep_for(chrono::milliseconds(100));
+                Guard l(x_clients);
+                pending = false;
+                for (auto& s : m_standby)
+                    pending = pending || s->client->isConnected() || s->client->isPendingState();
+            }
+            Guard l(x_clients);
+            m_standby.clear();
+        }
+
         if (p_client && p_client->isConnected())
         {
             p_client->disconnect();
@@ -307,6 +696,7 @@ void PoolManager::setActiveConnectionCommon(unsigned int idx)
         m_connectionSwitches.fetch_add(1, std::memory_order_relaxed);
         m_activeConnectionIdx = idx;
         m_connectionAttempt = 0;
+        m_switchRequested = true;
         p_client->disconnect();
     }
     else
@@ -363,6 +753,36 @@ Json::Value PoolManager::getConnectionsJson()
         JConn["index"] = (unsigned)i;
         JConn["active"] = (i == m_activeConnectionIdx ? true : false);
         JConn["uri"] = m_Settings.connections[i]->str();
+        if (!m_parallel.empty() && i == m_activeConnectionIdx)
+        {
+            Guard l(x_jobs);
+            JConn["weight"] = m_Settings.poolWeights[0];
+            JConn["shares"].append(m_poolSolutions[0].accepted);
+            JConn["shares"].append(m_poolSolutions[0].rejected);
+        }
+        if (m_Settings.standbyConnections)
+        {
+            Guard l(x_clients);
+            bool ready = false;
+            for (auto& s : m_standby)
+                ready = ready || (s->conn == m_Settings.connections[i] && !s->lost && s->wp);
+            JConn["standby"] = ready;
+        }
+        jRes.append(JConn);
+    }
+
+    // Pools mined at once with the active connection come last
+    for (auto& p : m_parallel)
+    {
+        Json::Value JConn;
+        JConn["index"] = jRes.size();
+        JConn["active"] = (p->client && p->client->isConnected());
+        JConn["uri"] = p->conn->str();
+        JConn["parallel"] = true;
+        Guard l(x_jobs);
+        JConn["weight"] = p->weight;
+        JConn["shares"].append(m_poolSolutions[p->slot].accepted);
+        JConn["shares"].append(m_poolSolutions[p->slot].rejected);
         jRes.append(JConn);
     }
     return jRes;
@@ -370,10 +790,42 @@ Json::Value PoolManager::getConnectionsJson()
 
 void PoolManager::start()
 {
+    if (m_proxy)
+        m_proxy->start();
+
     m_running.store(true, std::memory_order_relaxed);
     m_async_pending.store(true, std::memory_order_relaxed);
     m_connectionSwitches.fetch_add(1, std::memory_order_relaxed);
     g_io_service.post(m_io_strand.wrap(boost::bind(&PoolManager::rotateConnect, this)));
+
+    for (auto& p : m_parallel)
+        g_io_service.post(
+            m_io_strand.wrap(boost::bind(&PoolManager::parallelConnect, this, p.get())));
+}
+
+std::unique_ptr<PoolClient> PoolManager::createClient(std::shared_ptr<URI> _conn)
+{
+    std::unique_ptr<PoolClient> client = nullptr;
+    if (_conn->Family() == ProtocolFamily::GETWORK)
+        client = std::unique_ptr<PoolClient>(
+            new EthGetworkClient(m_Settings.noWorkTimeout, m_Settings.getWorkPollInterval,
+                m_Settings.getWorkPush));
+    if (_conn->Family() == ProtocolFamily::STRATUM)
+        client = std::unique_ptr<PoolClient>(
+            new EthStratumClient(m_Settings.noWorkTimeout, m_Settings.noResponseTimeout));
+    if (_conn->Family() == ProtocolFamily::SIMULATION)
+        client = std::unique_ptr<PoolClient>(new SimulateClient(m_Settings.simulation));
+    if (_conn->Family() == ProtocolFamily::REPLAY)
+        client = std::unique_ptr<PoolClient>(new ReplayClient(m_Settings.replayFile,
+            m_Settings.replaySpeed, m_Settings.noWorkTimeout, m_Settings.noResponseTimeout));
+
+    if (client)
+    {
+        setClientHandlers(client.get());
+        if (m_recorder)
+            client->setRecorder(m_recorder);
+    }
+    return client;
 }
 
 void PoolManager::rotateConnect()
@@ -385,6 +837,23 @@ void PoolManager::rotateConnect()
     if (m_activeConnectionIdx >= m_Settings.connections.size())
         m_activeConnectionIdx = 0;
 
+    // A standby connection takes over with no gap
+    if (promoteStandby())
+        return;
+
+    // Pools mined at once keep the farm busy
+    bool working = false;
+    {
+        Guard l(x_jobs);
+        for (auto& p : m_parallel)
+            working = working || p->wp;
+    }
+    if (Farm::f().isMining() && !Farm::f().paused() && !working)
+    {
+        cnote << "No connection. Suspend mining ...";
+        Farm::f().pause();
+    }
+
     // If this connection is marked Unrecoverable then discard it
     if (m_Settings.connections.at(m_activeConnectionIdx)->IsUnrecoverable())
     {
@@ -418,17 +887,8 @@ void PoolManager::rotateConnect()
         if (p_client)
             p_client = nullptr;
 
-        if (m_Settings.connections.at(m_activeConnectionIdx)->Family() == ProtocolFamily::GETWORK)
-            p_client =
-                std::unique_ptr<PoolClient>(new EthGetworkClient(m_Settings.noWorkTimeout, m_Settings.getWorkPollInterval));
-        if (m_Settings.connections.at(m_activeConnectionIdx)->Family() == ProtocolFamily::STRATUM)
-            p_client = std::unique_ptr<PoolClient>(
-                new EthStratumClient(m_Settings.noWorkTimeout, m_Settings.noResponseTimeout));
-        if (m_Settings.connections.at(m_activeConnectionIdx)->Family() == ProtocolFamily::SIMULATION)
-            p_client = std::unique_ptr<PoolClient>(new SimulateClient(m_Settings.benchmarkBlock));
-
-        if (p_client)
-            setClientHandlers();
+        p_client = createClient(m_Settings.connections.at(m_activeConnectionIdx));
+        m_activeClient.store(p_client.get(), std::memory_order_relaxed);
 
         // Count connectionAttempts
         m_connectionAttempt++;
@@ -472,6 +932,110 @@ void PoolManager::rotateConnect()
     }
 }
 
+bool PoolManager::promoteStandby()
+{
+    bool requested = m_switchRequested;
+    m_switchRequested = false;
+    if (!m_Settings.standbyConnections || m_stopping.load(std::memory_order_relaxed))
+        return false;
+
+    Guard l(x_clients);
+
+    // The connection asked for, or else the first ready in fail-over order
+    auto& conns = m_Settings.connections;
+    size_t last = (requested ? 1 : conns.size());
+    for (size_t i = (requested ? 0 : 1); i < last; i++)
+    {
+        unsigned idx = unsigned((m_activeConnectionIdx + i) % conns.size());
+        for (auto it = m_standby.begin(); it != m_standby.end(); it++)
+        {
+            StandbyClient& s = **it;
+            if (s.conn != conns[idx] || s.lost || !s.wp || !s.client->isConnected())
+                continue;
+
+            if (idx != m_activeConnectionIdx)
+                m_connectionSwitches.fetch_add(1, std::memory_order_relaxed);
+            m_activeConnectionIdx = idx;
+            m_connectionAttempt = 0;
+            m_selectedHost = s.conn->Host() + ":" + to_string(s.conn->Port());
+
+            WorkPackage wp = s.wp;
+            p_client = std::move(s.client);
+            m_activeClient.store(p_client.get(), std::memory_order_relaxed);
+            m_standby.erase(it);
+
+            cnote << "Switched to standby connection " << m_selectedHost;
+            connected();
+            workReceived(wp);
+            return true;
+        }
+    }
+    return false;
+}
+
+void PoolManager::refillStandby()
+{
+    if (!m_running.load(std::memory_order_relaxed) || m_stopping.load(std::memory_order_relaxed))
+        return;
+
+    // The connections a failure of the active one would move to, in order
+    std::vector<std::shared_ptr<URI>> wanted;
+    auto& conns = m_Settings.connections;
+    for (size_t i = 1; i < conns.size() && wanted.size() < m_Settings.standbyConnections; i++)
+    {
+        auto& conn = conns[(m_activeConnectionIdx + i) % conns.size()];
+        if (conn->Host() == "exit")
+            break;
+        if (conn->Family() == ProtocolFamily::STRATUM && !conn->IsUnrecoverable())
+            wanted.push_back(conn);
+    }
+
+    std::vector<PoolClient*> release;
+    std::vector<PoolClient*> connect;
+    {
+        Guard l(x_clients);
+        for (auto it = m_standby.begin(); it != m_standby.end();)
+        {
+            PoolClient* c = (*it)->client.get();
+            bool isWanted = (std::find(wanted.begin(), wanted.end(), (*it)->conn) != wanted.end());
+            if (((*it)->lost || !isWanted) && !c->isConnected() && !c->isPendingState())
+            {
+                it = m_standby.erase(it);
+                continue;
+            }
+            if (!isWanted && c->isConnected())
+                release.push_back(c);
+            it++;
+        }
+
+        for (auto& conn : wanted)
+        {
+            bool found = false;
+            for (auto& s : m_standby)
+                found = found || (s->conn == conn);
+            if (found)
+                continue;
+
+            std::unique_ptr<StandbyClient> s(new StandbyClient());
+            s->conn = conn;
+            s->client = createClient(conn);
+            s->client->setConnection(conn);
+            connect.push_back(s->client.get());
+            m_standby.push_back(std::move(s));
+        }
+    }
+
+    // Outside the lock as clients may call back synchronously
+    for (auto c : release)
+        c->disconnect();
+    for (auto c : connect)
+        c->connect();
+
+    m_standbytimer.expires_from_now(boost::posix_time::seconds(c_standbyRecheck));
+    m_standbytimer.async_wait(m_io_strand.wrap(boost::bind(
+        &PoolManager::standbytimer_elapsed, this, boost::asio::placeholders::error)));
+}
+
 void PoolManager::showMiningAt()
 {
     // Should not happen
@@ -494,6 +1058,7 @@ void PoolManager::failovertimer_elapsed(const boost::system::error_code& ec)
                 m_activeConnectionIdx = 0;
                 m_connectionAttempt = 0;
                 m_connectionSwitches.fetch_add(1, std::memory_order_relaxed);
+                m_switchRequested = true;
                 cnote << "Failover timeout reached, retrying connection to primary pool";
                 p_client->disconnect();
             }
@@ -508,8 +1073,18 @@ void PoolManager::submithrtimer_elapsed(const boost::system::error_code& ec)
         if (m_running.load(std::memory_order_relaxed))
         {
 
+            // A proxy reports what its miners report
+            uint64_t rate = m_proxy ? m_proxy->hashRate() : uint64_t(Farm::f().HashRate());
+            if (!m_parallel.empty())
+                rate = uint64_t(Farm::f().poolHashRate(0));
             if (p_client && p_client->isConnected())
-                p_client->submitHashrate((uint32_t)Farm::f().HashRate(), m_Settings.hashRateId);
+                p_client->submitHashrate(rate, m_Settings.hashRateId);
+
+            // Each pool gets the hashrate of the miners working for it
+            for (auto& p : m_parallel)
+                if (p->client && p->client->isConnected())
+                    p->client->submitHashrate(
+                        uint64_t(Farm::f().poolHashRate(p->slot)), m_Settings.hashRateId);
 
             // Resubmit actor
             m_submithrtimer.expires_from_now(boost::posix_time::seconds(m_Settings.hashRateInterval));
@@ -533,6 +1108,12 @@ void PoolManager::reconnecttimer_elapsed(const boost::system::error_code& ec)
     }
 }
 
+void PoolManager::standbytimer_elapsed(const boost::system::error_code& ec)
+{
+    if (!ec)
+        refillStandby();
+}
+
 int PoolManager::getCurrentEpoch()
 {
     return m_currentWp.epoch;
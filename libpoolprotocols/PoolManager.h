@@ -1,16 +1,22 @@
 #pragma once
 
+#include <deque>
 #include <iostream>
+#include <map>
 
 #include <json/json.h>
 
+#include <libdevcore/Guards.h>
 #include <libdevcore/Worker.h>
 #include <libethcore/Farm.h>
 #include <libethcore/Miner.h>
 
 #include "PoolClient.h"
 #include "getwork/EthGetworkClient.h"
+#include "proxy/StratumProxy.h"
 #include "stratum/EthStratumClient.h"
+#include "testing/ReplayClient.h"
+#include "testing/SessionRecorder.h"
 #include "testing/SimulateClient.h"
 
 using namespace std;
@@ -23,6 +29,7 @@ struct PoolSettings
 {
     std::vector<std::shared_ptr<URI>> connections;  // List of connection definitions
     unsigned getWorkPollInterval = 500;             // Interval (ms) between getwork requests
+    std::string getWorkPush;  // Where getwork nodes tell about new work (ws:// or http://)
     unsigned noWorkTimeout = 180;       // If no new jobs in this number of seconds drop connection
     unsigned noResponseTimeout = 2;     // If no response in this number of seconds drop connection
     unsigned poolFailoverTimeout = 0;   // Return to primary pool after this number of minutes
@@ -32,7 +39,16 @@ struct PoolSettings
         h256::random().hex(HexPrefix::Add);  // Unique identifier for HashRate submission
     unsigned connectionMaxRetries = 3;  // Max number of connection retries
     unsigned delayBeforeRetry = 0;      // Delay seconds before connect retry
-    unsigned benchmarkBlock = 0;        // Block number used by SimulateClient to test performances
+    SimulationSettings simulation;      // What SimulateClient generates to test performances
+    std::string proxyAddress = "0.0.0.0";  // Address the stratum proxy listens on
+    unsigned proxyPort = 0;                // Port of the stratum proxy. 0 = not a proxy
+    unsigned proxyBatchWindow = 20;        // Milliseconds shares are collected before submission
+    unsigned standbyConnections = 0;       // Fail-over connections kept connected in standby
+    std::vector<unsigned> poolWeights;     // Shares of the hashrate of the first connections,
+                                           // mined at once. Empty = one at a time
+    std::string recordFile;                // Where to record the traffic with pools. Empty = none
+    std::string replayFile;                // Recording played back by ReplayClient
+    float replaySpeed = 1.0f;              // Replay speed factor. 0 = as fast as possible
 };
 
 class PoolManager
@@ -55,11 +71,46 @@ public:
     double getCurrentDifficulty();
     unsigned getConnectionSwitches();
     unsigned getEpochChanges();
+    bool isProxy() { return m_proxy != nullptr; }
+    bool isSplit() { return !m_parallel.empty(); }
+    std::string getProxyStatus() { return (m_proxy ? m_proxy->str() : ""); }
 
 private:
-    void rotateConnect();
+    // A fail-over connection kept subscribed and authorized, ready to take over
+    struct StandbyClient
+    {
+        std::shared_ptr<URI> conn;
+        std::unique_ptr<PoolClient> client;
+        WorkPackage wp;  // Latest job received
+        bool lost = false;
+    };
+
+    // A pool mined along with the active connection, for a share of the hashrate
+    struct ParallelPool
+    {
+        ParallelPool() : retrytimer(g_io_service) {}
+
+        std::shared_ptr<URI> conn;
+        std::unique_ptr<PoolClient> client;
+        unsigned slot = 0;  // Farm pool index
+        unsigned weight = 0;
+        std::string host;
+        WorkPackage wp;     // Latest job received
+        boost::asio::deadline_timer retrytimer;
+    };
 
-    void setClientHandlers();
+    void rotateConnect();
+    bool promoteStandby();
+    void refillStandby();
+
+    std::unique_ptr<PoolClient> createClient(std::shared_ptr<URI> _conn);
+    void setClientHandlers(PoolClient* _client);
+    void setParallelHandlers(ParallelPool* _pool);
+    void parallelConnect(ParallelPool* _pool);
+    void addJob(WorkPackage const& _wp, unsigned _slot);
+    void accountPool(unsigned _slot, SolutionAccountingEnum _accounting);
+    void connected();
+    void workReceived(WorkPackage const& wp);
 
     void showMiningAt();
 
@@ -70,6 +121,7 @@ private:
     void failovertimer_elapsed(const boost::system::error_code& ec);
     void submithrtimer_elapsed(const boost::system::error_code& ec);
     void reconnecttimer_elapsed(const boost::system::error_code& ec);
+    void standbytimer_elapsed(const boost::system::error_code& ec);
 
     std::atomic<bool> m_running = {false};
     std::atomic<bool> m_stopping = {false};
@@ -88,8 +140,25 @@ private:
     boost::asio::deadline_timer m_failovertimer;
     boost::asio::deadline_timer m_submithrtimer;
     boost::asio::deadline_timer m_reconnecttimer;
+    boost::asio::deadline_timer m_standbytimer;
 
     std::unique_ptr<PoolClient> p_client = nullptr;
+    std::atomic<PoolClient*> m_activeClient = {nullptr};  // Tells handlers apart from standby ones
+
+    Mutex x_clients;  // Guards standby clients and the switch of the active one
+    std::vector<std::unique_ptr<StandbyClient>> m_standby;
+    bool m_switchRequested = false;  // Active connection chosen by user or failover timeout
+
+    std::vector<std::unique_ptr<ParallelPool>> m_parallel;  // Farm pools 1 and on
+
+    // Which pool issued the jobs solutions may come for, by job and header
+    Mutex x_jobs;
+    std::map<std::pair<std::string, h256>, unsigned> m_jobPools;
+    std::deque<std::pair<std::string, h256>> m_jobOrder;
+    SolutionAccountType m_poolSolutions[Farm::c_maxPools];  // Guarded by x_jobs
+
+    std::unique_ptr<StratumProxy> m_proxy = nullptr;  // Serves the work to other instances
+    std::shared_ptr<SessionRecorder> m_recorder = nullptr;  // Records pool sessions for replay
 
     std::atomic<unsigned> m_epochChanges = {0};
 
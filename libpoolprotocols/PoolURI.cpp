@@ -68,11 +68,12 @@ static std::map<std::string, SchemeAttributes> s_schemes = {
     {"stratumss", {ProtocolFamily::STRATUM, SecureLevel::TLS12, 999}},
 
     /*
-    The following scheme is only meant for simulation operations
-    It's not meant to be used with -P arguments
+    The following schemes are only meant for simulation operations
+    They're not meant to be used with -P arguments
     */
 
-    {"simulation", {ProtocolFamily::SIMULATION, SecureLevel::NONE, 999}}
+    {"simulation", {ProtocolFamily::SIMULATION, SecureLevel::NONE, 999}},
+    {"replay", {ProtocolFamily::REPLAY, SecureLevel::NONE, 999}}
 };
 
 static bool url_decode(const std::string& in, std::string& out)
@@ -138,7 +139,7 @@ URI::URI(std::string uri, bool _sim) : m_uri{std::move(uri)}
         throw std::runtime_error("Invalid authority");
 
     // Simulation scheme is only allowed if specifically set
-    if (!_sim && m_scheme == "simulation")
+    if (!_sim && (m_scheme == "simulation" || m_scheme == "replay"))
         throw std::runtime_error("Invalid scheme");
 
     // Check scheme is allowed
@@ -38,7 +38,8 @@ enum class ProtocolFamily
 {
     GETWORK = 0,
     STRATUM,
-    SIMULATION
+    SIMULATION,
+    REPLAY
 };
 
 enum class UriHostNameType
@@ -10,9 +10,20 @@ using namespace eth;
 
 using boost::asio::ip::tcp;
 
-EthGetworkClient::EthGetworkClient(int worktimeout, unsigned farmRecheckPeriod)
+namespace
+{
+const unsigned c_pollRelax = 4;        // Polls are farther apart by this while no block is due
+const unsigned c_pushPoll = 5000;      // Milliseconds between safety net polls with notifications
+const unsigned c_blockTimeMin = 1000;  // Bounds to the average block time in milliseconds
+const unsigned c_blockTimeMax = 120000;
+
+}  // namespace
+
+EthGetworkClient::EthGetworkClient(
+    int worktimeout, unsigned farmRecheckPeriod, std::string const& push)
   : PoolClient(),
     m_farmRecheckPeriod(farmRecheckPeriod),
+    m_txQueue(64),
     m_io_strand(g_io_service),
     m_socket(g_io_service),
     m_resolver(g_io_service),
@@ -28,6 +39,9 @@ EthGetworkClient::EthGetworkClient(int worktimeout, unsigned farmRecheckPeriod)
     jGetWork["method"] = "eth_getWork";
     jGetWork["params"] = Json::Value(Json::arrayValue);
     m_jsonGetWork = std::string(Json::writeString(m_jSwBuilder, jGetWork));
+
+    if (!push.empty())
+        startNotifier(push);
 }
 
 EthGetworkClient::~EthGetworkClient()
@@ -69,30 +83,41 @@ void EthGetworkClient::connect()
         // No need to use the resolver if host is already an IP address
         m_endpoints.push(boost::asio::ip::tcp::endpoint(
             boost::asio::ip::address::from_string(m_conn->Host()), m_conn->Port()));
-        send(m_jsonGetWork);
+        send(1, m_jsonGetWork);
     }
 }
 
 void EthGetworkClient::disconnect()
 {
-    // Release session
-    m_connected.store(false, memory_order_relaxed);
-    if (m_session)
-    {
-        m_conn->addDuration(m_session->duration());
-    }
-    m_session = nullptr;
-
-    m_connecting.store(false, std::memory_order_relaxed);
-    m_txPending.store(false, std::memory_order_relaxed);
-    m_getwork_timer.cancel();
-
-    m_txQueue.consume_all([](std::string* l) { delete l; });
-    m_request.consume(m_request.capacity());
-    m_response.consume(m_response.capacity());
-
-    if (m_onDisconnected)
-        m_onDisconnected();
+    // Connection state lives on the strand
+    m_io_strand.dispatch([this]() {
+        // Release session
+        m_connected.store(false, memory_order_relaxed);
+        if (m_session)
+        {
+            m_conn->addDuration(m_session->duration());
+        }
+        m_session = nullptr;
+
+        if (m_recorder && m_recSession)
+            m_recorder->end(m_recSession);
+        m_recSession = 0;
+
+        m_connecting.store(false, std::memory_order_relaxed);
+        m_txPending.store(false, std::memory_order_relaxed);
+        m_getwork_timer.cancel();
+        if (m_notifier)
+            m_notifier->stop();
+
+        closeSocket();
+        m_txQueue.consume_all([](Request* r) { delete r; });
+        m_toWrite.clear();
+        m_inflight.clear();
+        m_getworkPending = false;
+
+        if (m_onDisconnected)
+            m_onDisconnected();
+    });
 }
 
 void EthGetworkClient::begin_connect()
@@ -102,8 +127,10 @@ void EthGetworkClient::begin_connect()
         // Pick the first endpoint in list.
         // Eventually endpoints get discarded on connection errors
         m_endpoint = m_endpoints.front();
+        m_socketConnecting = true;
         m_socket.async_connect(
-            m_endpoint, m_io_strand.wrap(boost::bind(&EthGetworkClient::handle_connect, this, _1)));
+            m_endpoint, m_io_strand.wrap(boost::bind(&EthGetworkClient::handle_connect, this,
+                            boost::asio::placeholders::error)));
     }
     else
     {
@@ -114,8 +141,15 @@ void EthGetworkClient::begin_connect()
 
 void EthGetworkClient::handle_connect(const boost::system::error_code& ec)
 {
+    m_socketConnecting = false;
     if (!ec && m_socket.is_open())
     {
+        boost::system::error_code oec;
+        m_socket.set_option(boost::asio::socket_base::keep_alive(true), oec);
+        m_socket.set_option(boost::asio::ip::tcp::no_delay(true), oec);
+        m_socketOpen = true;
+        m_responses = 0;
+        m_response.consume(m_response.size());
 
         // If in "connecting" phase raise the proper event
         if (m_connecting.load(std::memory_order_relaxed))
@@ -128,59 +162,28 @@ void EthGetworkClient::handle_connect(const boost::system::error_code& ec)
             
             m_connecting.store(false, std::memory_order_relaxed);
 
+            if (m_recorder)
+                m_recSession = m_recorder->begin(ProtocolFamily::GETWORK, 0);
+
             if (m_onConnected)
                 m_onConnected();
             m_current_tstamp = std::chrono::steady_clock::now();
+            m_blockTstamp = m_current_tstamp;
+            m_expectBlock = -1;
+            m_getworkAgain = false;
+            if (m_notifier)
+                m_notifier->start();
         }
 
-        // Retrieve 1st line waiting in the queue and submit
-        // if other lines waiting they will be processed 
-        // at the end of the processed request
-        Json::Reader jRdr;
-        std::string* line;
-        std::ostream os(&m_request);
-        if (!m_txQueue.empty())
+        // Requests left unanswered by the previous connection go first
+        while (!m_inflight.empty())
         {
-            while (m_txQueue.pop(line))
-            {
-                if (line->size())
-                {
-
-                    jRdr.parse(*line, m_pendingJReq);
-                    m_pending_tstamp = std::chrono::steady_clock::now();
-
-                    // Make sure path begins with "/"
-                    string _path = (m_conn->Path().empty() ? "/" : m_conn->Path());
-
-                    os << "POST " << _path << " HTTP/1.0\r\n";
-                    os << "Host: " << m_conn->Host() << "\r\n";
-                    os << "Content-Type: application/json"
-                       << "\r\n";
-                    os << "Content-Length: " << line->length() << "\r\n";
-                    os << "Connection: close\r\n\r\n";  // Double line feed to mark the
-                                                        // beginning of body
-                    // The payload
-                    os << *line;
-
-                    // Out received message only for debug purpouses
-                    if (g_logOptions & LOG_JSON)
-                        cnote << " >> " << *line;
-
-                    delete line;
-
-                    async_write(m_socket, m_request,
-                        m_io_strand.wrap(boost::bind(&EthGetworkClient::handle_write, this,
-                            boost::asio::placeholders::error)));
-                    break;
-                }
-                delete line;
-            }
-        }
-        else
-        {
-            m_txPending.store(false, std::memory_order_relaxed);
+            m_toWrite.push_front(std::move(m_inflight.back()));
+            m_inflight.pop_back();
         }
 
+        recvSocketData();
+        flush();
     }
     else
     {
@@ -190,164 +193,359 @@ void EthGetworkClient::handle_connect(const boost::system::error_code& ec)
             // Pop it and retry
             cwarn << "Error connecting to " << m_conn->Host() << ":" << toString(m_conn->Port())
                   << " : " << ec.message();
+            closeSocket();
             m_endpoints.pop();
             begin_connect();
         }
     }
 }
 
-void EthGetworkClient::handle_write(const boost::system::error_code& ec)
+void EthGetworkClient::flush()
 {
-    if (!ec)
+    m_txPending.store(false, std::memory_order_relaxed);
+    if (!m_session && !m_connecting.load(std::memory_order_relaxed))
     {
-        // Transmission succesfully sent.
-        // Read the response async. 
-        async_read(m_socket, m_response, boost::asio::transfer_all(),
-            m_io_strand.wrap(boost::bind(&EthGetworkClient::handle_read, this,
-                boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred)));
+        m_txQueue.consume_all([](Request* r) { delete r; });
+        return;
     }
-    else
+
+    Request* req;
+    while (m_txQueue.pop(req))
     {
-        if (ec != boost::asio::error::operation_aborted)
+        // No need to poll again till the pending poll is answered
+        if (req->id == 1 && m_getworkPending)
         {
-            cwarn << "Error writing to " << m_conn->Host() << ":" << toString(m_conn->Port())
-                  << " : " << ec.message();
-            m_endpoints.pop();
-            begin_connect();
+            delete req;
+            continue;
         }
+        if (req->id == 1)
+            m_getworkPending = true;
+
+        m_toWrite.push_back(std::move(*req));
+        delete req;
     }
+
+    if (m_toWrite.empty() || m_writing)
+        return;
+    if (!m_socketOpen)
+    {
+        if (!m_socketConnecting)
+            begin_connect();
+        return;
+    }
+
+    // Write all requests at once. Responses will come in the same order
+    // Make sure path begins with "/"
+    string _path = (m_conn->Path().empty() ? "/" : m_conn->Path());
+    auto data = std::make_shared<std::string>();
+    size_t requests = m_toWrite.size();
+    while (!m_toWrite.empty())
+    {
+        Request& r = m_toWrite.front();
+        data->append("POST ").append(_path).append(" HTTP/1.1\r\n");
+        data->append("Host: ").append(m_conn->Host()).append("\r\n");
+        data->append("Content-Type: application/json\r\n");
+        data->append("Content-Length: ").append(to_string(r.body.size())).append("\r\n");
+        data->append("Connection: keep-alive\r\n\r\n");  // Double line feed to mark the
+                                                         // beginning of body
+        // The payload
+        data->append(r.body);
+
+        // Out received message only for debug purpouses
+        if (g_logOptions & LOG_JSON)
+            cnote << " >> " << r.body;
+        if (m_recorder)
+            m_recorder->sent(m_recSession, r.body.data(), r.body.data() + r.body.size());
+
+        r.tstamp = std::chrono::steady_clock::now();
+        m_inflight.push_back(std::move(r));
+        m_toWrite.pop_front();
+    }
+
+    m_writing = true;
+    async_write(m_socket, boost::asio::buffer(*data),
+        m_io_strand.wrap([this, data, requests](const boost::system::error_code& ec, std::size_t) {
+            handle_write(ec, requests);
+        }));
 }
 
-void EthGetworkClient::handle_read(
-    const boost::system::error_code& ec, std::size_t bytes_transferred)
+void EthGetworkClient::handle_write(const boost::system::error_code& ec, size_t _requests)
 {
-    if (!ec || ec == boost::asio::error::eof)
+    if (ec == boost::asio::error::operation_aborted)
+        return;
+
+    m_writing = false;
+    if (ec)
     {
-        // Close socket
-        if (m_socket.is_open())
-            m_socket.close();
+        socketFailed(ec, "writing to");
+        return;
+    }
 
-        // Get the whole message
-        std::string rx_message(
-            boost::asio::buffer_cast<const char*>(m_response.data()), bytes_transferred);
-        m_response.consume(bytes_transferred);
+    // The requests written are the last in flight, but for those already
+    // answered. Responses are timed from now on
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = m_inflight.end() - std::min(_requests, m_inflight.size());
+         it != m_inflight.end(); it++)
+    {
+        it->tstamp = now;
+        if (it->found != std::chrono::steady_clock::time_point())
+            LatencyTrace::record(TraceStage::SolutionSent, it->found);
+    }
 
-        // Empty response ?
-        if (!rx_message.size())
-        {
-            cwarn << "Invalid response from " << m_conn->Host() << ":" << toString(m_conn->Port());
-            disconnect();
-            return;
-        }
+    // More requests came in the meantime
+    if (!m_toWrite.empty())
+        flush();
+}
 
-        // Read message by lines.
-        // First line is http status
-        // Other lines are headers
-        // A double "\r\n" identifies begin of body
-        // The rest is body
-        std::string line;
-        std::string linedelimiter = "\r\n";
-        std::size_t delimiteroffset = rx_message.find(linedelimiter);
-
-        unsigned int linenum = 0;
-        bool isHeader = true;
-        while (rx_message.length() && delimiteroffset != std::string::npos)
-        {
-            linenum++;
-            line = rx_message.substr(0, delimiteroffset);
-            rx_message.erase(0, delimiteroffset + 2);
-            
-            // This identifies the beginning of body
-            if (line.empty())
-            {
-                isHeader = false;
-                delimiteroffset = rx_message.find(linedelimiter);
-                if (delimiteroffset != std::string::npos)
-                    continue;
-                boost::replace_all(rx_message, "\n", "");
-                line = rx_message;
-            }
+void EthGetworkClient::recvSocketData()
+{
+    async_read_until(m_socket, m_response, "\r\n\r\n",
+        m_io_strand.wrap(boost::bind(&EthGetworkClient::handle_read_headers, this,
+            boost::asio::placeholders::error)));
+}
 
-            // Http status
-            if (isHeader && linenum == 1)
-            {
-                if (line.substr(0, 7) != "HTTP/1.")
-                {
-                    cwarn << "Invalid response from " << m_conn->Host() << ":"
-                          << toString(m_conn->Port());
-                    disconnect();
-                    return;
-                }
-                std::size_t spaceoffset = line.find(' ');
-                if (spaceoffset == std::string::npos)
-                {
-                    cwarn << "Invalid response from " << m_conn->Host() << ":"
-                          << toString(m_conn->Port());
-                    disconnect();
-                    return;
-                }
-                std::string status = line.substr(spaceoffset + 1);
-                if (status.substr(0, 3) != "200")
-                {
-                    cwarn << m_conn->Host() << ":" << toString(m_conn->Port())
-                          << " reported status " << status;
-                    disconnect();
-                    return;
-                }
-            }
+void EthGetworkClient::handle_read_headers(const boost::system::error_code& ec)
+{
+    if (ec)
+    {
+        socketFailed(ec, "reading from");
+        return;
+    }
 
-            // Body
-            if (!isHeader)
-            {
-                // Out received message only for debug purpouses
-                if (g_logOptions & LOG_JSON)
-                    cnote << " << " << line;
-
-                // Test validity of chunk and process
-                Json::Value jRes;
-                Json::Reader jRdr;
-                if (jRdr.parse(line, jRes))
-                {
-                    // Run in sync so no 2 different async reads may overlap
-                    processResponse(jRes);
-                }
-                else
-                {
-                    string what = jRdr.getFormattedErrorMessages();
-                    boost::replace_all(what, "\n", " ");
-                    cwarn << "Got invalid Json message : " << what;
-                }
+    std::string headers(
+        boost::asio::buffer_cast<const char*>(m_response.data()), m_response.size());
+    size_t headersEnd = headers.find("\r\n\r\n");
+    headers.erase(headersEnd);
+    m_response.consume(headersEnd + 4);
 
-            }
+    // First line is http status
+    // Other lines are headers
+    if (headers.substr(0, 7) != "HTTP/1.")
+    {
+        cwarn << "Invalid response from " << m_conn->Host() << ":" << toString(m_conn->Port());
+        disconnect();
+        return;
+    }
+    std::size_t spaceoffset = headers.find(' ');
+    std::string status =
+        (spaceoffset == std::string::npos ? "" : headers.substr(spaceoffset + 1, 3));
+    if (status != "200")
+    {
+        std::string line = headers.substr(0, headers.find("\r\n"));
+        cwarn << m_conn->Host() << ":" << toString(m_conn->Port()) << " reported status "
+              << (spaceoffset == std::string::npos ? line : line.substr(spaceoffset + 1));
+        disconnect();
+        return;
+    }
 
-            delimiteroffset = rx_message.find(linedelimiter);
-        }
+    // A node holding long polls tells where to send them
+    std::string original = headers;
+    boost::algorithm::to_lower(headers);
+    std::size_t longpolloffset = headers.find("\r\nx-long-polling:");
+    if (longpolloffset != std::string::npos && !m_notifier)
+    {
+        std::string url = original.substr(longpolloffset + 18);
+        url = boost::trim_copy(url.substr(0, url.find("\r\n")));
+        if (url.find("://") == std::string::npos)
+            url = "http://" + m_conn->Host() + ":" + toString(m_conn->Port()) +
+                  (url.empty() || url[0] != '/' ? "/" : "") + url;
+        startNotifier(url);
+    }
+    bool http10 = (headers.compare(0, 8, "http/1.0") == 0);
+    m_closeAfter = (headers.find("\r\nconnection: close") != std::string::npos) ||
+                   (http10 && headers.find("\r\nconnection: keep-alive") == std::string::npos);
+    m_bodyChunked = (headers.find("\r\ntransfer-encoding: chunked") != std::string::npos);
+    std::size_t lengthoffset = headers.find("\r\ncontent-length:");
+    m_bodyToEof = (!m_bodyChunked && lengthoffset == std::string::npos);
+    m_bodyLength =
+        (lengthoffset == std::string::npos ? 0 :
+                                             std::strtoul(headers.c_str() + lengthoffset + 17,
+                                                 nullptr, 10));
+
+    if (m_bodyChunked)
+    {
+        async_read_until(m_socket, m_response, "\r\n0\r\n\r\n",
+            m_io_strand.wrap(boost::bind(&EthGetworkClient::handle_read_body, this,
+                boost::asio::placeholders::error)));
+    }
+    else if (m_bodyToEof)
+    {
+        async_read(m_socket, m_response, boost::asio::transfer_all(),
+            m_io_strand.wrap(boost::bind(&EthGetworkClient::handle_read_body, this,
+                boost::asio::placeholders::error)));
+    }
+    else if (m_response.size() < m_bodyLength)
+    {
+        async_read(m_socket, m_response,
+            boost::asio::transfer_exactly(m_bodyLength - m_response.size()),
+            m_io_strand.wrap(boost::bind(&EthGetworkClient::handle_read_body, this,
+                boost::asio::placeholders::error)));
+    }
+    else
+    {
+        handle_read_body(boost::system::error_code());
+    }
+}
+
+void EthGetworkClient::handle_read_body(const boost::system::error_code& ec)
+{
+    if (ec && !(m_bodyToEof && ec == boost::asio::error::eof))
+    {
+        socketFailed(ec, "reading from");
+        return;
+    }
 
-        // Is there anything else in the queue
-        if (!m_txQueue.empty())
+    std::string body;
+    const char* data = boost::asio::buffer_cast<const char*>(m_response.data());
+    if (m_bodyChunked)
+    {
+        // Each chunk is its size in hex, a line feed, the data and a line feed
+        std::string chunks(data, m_response.size());
+        size_t offset = 0;
+        for (;;)
         {
-            begin_connect();
+            size_t eol = chunks.find("\r\n", offset);
+            size_t size = std::strtoul(chunks.c_str() + offset, nullptr, 16);
+            offset = eol + 2;
+            if (eol == std::string::npos || !size)
+                break;
+            body.append(chunks, offset, size);
+            offset += size + 2;
         }
-        else
+        m_response.consume(std::min(m_response.size(), offset + 2));
+    }
+    else if (m_bodyToEof)
+    {
+        body.assign(data, m_response.size());
+        m_response.consume(m_response.size());
+        m_closeAfter = true;
+    }
+    else
+    {
+        body.assign(data, m_bodyLength);
+        m_response.consume(m_bodyLength);
+    }
+
+    m_responses++;
+    processHttpResponse(body);
+
+    // Disconnected meanwhile
+    if (!m_socketOpen)
+        return;
+
+    if (m_closeAfter)
+    {
+        // The node won't take more requests on this connection. Those
+        // already written go again on a new one
+        closeSocket();
+        while (!m_inflight.empty())
         {
-            // Signal end of async send/receive operations
-            m_txPending.store(false, std::memory_order_relaxed);
+            m_toWrite.push_front(std::move(m_inflight.back()));
+            m_inflight.pop_back();
         }
+        if (!m_toWrite.empty())
+            flush();
+        return;
+    }
 
+    recvSocketData();
+}
+
+void EthGetworkClient::processHttpResponse(std::string& _body)
+{
+    if (m_inflight.empty())
+    {
+        cwarn << "Unexpected response from " << m_conn->Host() << ":"
+              << toString(m_conn->Port());
+        return;
+    }
+
+    // Responses come in the order of requests
+    Request req = std::move(m_inflight.front());
+    m_inflight.pop_front();
+    bool isGetwork = (req.id == 0 || req.id == 1);
+    if (isGetwork)
+        m_getworkPending = false;
+
+    boost::replace_all(_body, "\n", "");
+    boost::trim(_body);
+
+    // Out received message only for debug purpouses
+    if (g_logOptions & LOG_JSON)
+        cnote << " << " << _body;
+    if (m_recorder)
+        m_recorder->received(m_recSession, _body.data(), _body.data() + _body.size());
+
+    // Test validity of chunk and process
+    Json::Value jRes;
+    Json::Reader jRdr;
+    if (jRdr.parse(_body, jRes))
+    {
+        processResponse(jRes, req);
     }
     else
     {
-        if (ec != boost::asio::error::operation_aborted)
+        string what = jRdr.getFormattedErrorMessages();
+        boost::replace_all(what, "\n", " ");
+        cwarn << "Got invalid Json message : " << what;
+
+        // Keep polling
+        if (isGetwork)
         {
-            cwarn << "Error reading from :" << m_conn->Host() << ":" << toString(m_conn->Port())
-                  << " : "
-                  << ec.message();
-            disconnect();
+            m_getwork_timer.expires_from_now(boost::posix_time::milliseconds(pollDelay()));
+            m_getwork_timer.async_wait(
+                m_io_strand.wrap(boost::bind(&EthGetworkClient::getwork_timer_elapsed, this,
+                    boost::asio::placeholders::error)));
         }
-       
+    }
+
+    // Work changed after this eth_getWork was sent
+    if (isGetwork && m_getworkAgain && m_session)
+    {
+        m_getworkAgain = false;
+        send(1, m_jsonGetWork);
     }
 }
 
+void EthGetworkClient::closeSocket()
+{
+    m_socketOpen = false;
+    m_writing = false;
+    if (m_socket.is_open())
+    {
+        boost::system::error_code ec;
+        m_socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+        m_socket.close(ec);
+    }
+    m_response.consume(m_response.size());
+}
+
+void EthGetworkClient::socketFailed(const boost::system::error_code& ec, const char* _what)
+{
+    if (ec == boost::asio::error::operation_aborted || !m_socketOpen)
+        return;
+
+    closeSocket();
+
+    // A connection which never got a response is not worth retrying.
+    // Otherwise the node most likely closed an idle connection
+    if (!m_responses)
+    {
+        cwarn << "Error " << _what << " " << m_conn->Host() << ":" << toString(m_conn->Port())
+              << " : " << ec.message();
+        m_endpoints.pop();
+    }
+
+    // Unanswered requests go again on the next connection
+    while (!m_inflight.empty())
+    {
+        m_toWrite.push_front(std::move(m_inflight.back()));
+        m_inflight.pop_back();
+    }
+    if (!m_toWrite.empty())
+        begin_connect();
+}
+
 void EthGetworkClient::handle_resolve(
     const boost::system::error_code& ec, tcp::resolver::iterator i)
 {
@@ -361,7 +559,7 @@ void EthGetworkClient::handle_resolve(
         m_resolver.cancel();
 
         // Resolver has finished so invoke connection asynchronously
-        send(m_jsonGetWork);
+        send(1, m_jsonGetWork);
     }
     else
     {
@@ -370,7 +568,7 @@ void EthGetworkClient::handle_resolve(
     }
 }
 
-void EthGetworkClient::processResponse(Json::Value& JRes) 
+void EthGetworkClient::processResponse(Json::Value& JRes, Request const& _req)
 {
     unsigned _id = 0;  // This SHOULD be the same id as the request it is responding to 
     bool _isSuccess = false;  // Whether or not this is a succesful or failed response
@@ -382,10 +580,10 @@ void EthGetworkClient::processResponse(Json::Value& JRes)
               << toString(m_conn->Port());
         return;
     }
-    // We get the id from pending jrequest
+    // We get the id from the request this responds to
     // It's not guaranteed we get response labelled with same id
     // For instance Dwarfpool always responds with "id":0
-    _id = m_pendingJReq.get("id", unsigned(0)).asUInt();
+    _id = _req.id;
     _isSuccess = JRes.get("error", Json::Value::null).empty();
     _errReason = (_isSuccess ? "" : processError(JRes));
 
@@ -400,7 +598,7 @@ void EthGetworkClient::processResponse(Json::Value& JRes)
         // In such case delay further requests
         // by 30 seconds.
         // Otherwise resubmit another getwork request
-        // with a delay of m_farmRecheckPeriod ms.
+        // with a delay depending on when next block is due.
         if (!_isSuccess)
         {
             cwarn << "Got " << _errReason << " from " << m_conn->Host() << ":"
@@ -420,21 +618,8 @@ void EthGetworkClient::processResponse(Json::Value& JRes)
             else
             {
                 Json::Value JPrm = JRes.get("result", Json::Value::null);
-                WorkPackage newWp;
-                
-                newWp.header = h256(JPrm.get(Json::Value::ArrayIndex(0), "").asString());
-                newWp.seed = h256(JPrm.get(Json::Value::ArrayIndex(1), "").asString());
-                newWp.boundary = h256(JPrm.get(Json::Value::ArrayIndex(2), "").asString());
-                newWp.job = newWp.header.hex();
-                if (m_current.header != newWp.header)
-                {
-                    m_current = newWp;
-                    m_current_tstamp = std::chrono::steady_clock::now();
-
-                    if (m_onWorkReceived)
-                        m_onWorkReceived(m_current);
-                }
-                m_getwork_timer.expires_from_now(boost::posix_time::milliseconds(m_farmRecheckPeriod));
+                processWork(JPrm);
+                m_getwork_timer.expires_from_now(boost::posix_time::milliseconds(pollDelay()));
                 m_getwork_timer.async_wait(
                     m_io_strand.wrap(boost::bind(&EthGetworkClient::getwork_timer_elapsed, this,
                         boost::asio::placeholders::error)));
@@ -453,7 +638,7 @@ void EthGetworkClient::processResponse(Json::Value& JRes)
             _isSuccess = JRes["result"].asBool();
 
         std::chrono::milliseconds _delay = std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::steady_clock::now() - m_pending_tstamp);
+            std::chrono::steady_clock::now() - _req.tstamp);
 
         const unsigned miner_index = _id - 40;
         if (_isSuccess)
@@ -470,6 +655,108 @@ void EthGetworkClient::processResponse(Json::Value& JRes)
 
 }
 
+void EthGetworkClient::processWork(Json::Value& JPrm)
+{
+    WorkPackage newWp;
+
+    newWp.header = h256(JPrm.get(Json::Value::ArrayIndex(0), "").asString());
+    newWp.seed = h256(JPrm.get(Json::Value::ArrayIndex(1), "").asString());
+    newWp.boundary = h256(JPrm.get(Json::Value::ArrayIndex(2), "").asString());
+    newWp.job = newWp.header.hex();
+
+    // Some nodes (eg. geth) also give the block number
+    std::string block = JPrm.get(Json::Value::ArrayIndex(3), "").asString();
+    if (!block.empty())
+        newWp.block = (int)std::strtoul(block.c_str(), nullptr, 16);
+
+    if (m_current.header != newWp.header)
+    {
+        // Without block numbers any new header counts as a new block
+        bool newBlock = (newWp.block == -1 || newWp.block != m_current.block);
+        auto now = std::chrono::steady_clock::now();
+        if (newBlock && m_current)
+        {
+            // Exponential moving average of the block times
+            unsigned elapsed = (unsigned)std::chrono::duration_cast<std::chrono::milliseconds>(
+                now - m_blockTstamp)
+                                   .count();
+            m_blockTime = std::min(
+                c_blockTimeMax, std::max(c_blockTimeMin, (m_blockTime * 4 + elapsed) / 5));
+        }
+        if (newBlock)
+            m_blockTstamp = now;
+
+        m_current = newWp;
+        m_current_tstamp = now;
+        m_current.tstamp = m_current_tstamp;
+
+        if (m_onWorkReceived)
+            m_onWorkReceived(m_current);
+    }
+}
+
+void EthGetworkClient::startNotifier(std::string const& _url)
+{
+    WorkNotifier::Mode mode;
+    std::string host, path;
+    unsigned short port;
+    if (!WorkNotifier::parse(_url, mode, host, port, path))
+    {
+        cwarn << "Can't get work notifications from " << _url << ". Polling for work";
+        return;
+    }
+
+    m_notifier.reset(new WorkNotifier(m_io_strand, mode, host, port, path));
+    m_notifier->onNotify([this](Json::Value& jRes) { notified(jRes); });
+    m_notifier->onFailed([this]() {
+        // Reconnecting the pool tries again
+        cwarn << "No more work notifications from " << m_notifier->str() << ". Polling for work";
+    });
+    if (m_session)
+        m_notifier->start();
+}
+
+void EthGetworkClient::notified(Json::Value& jRes)
+{
+    if (!m_session)
+        return;
+
+    if (m_notifier->mode() == WorkNotifier::Mode::LongPoll)
+    {
+        // The answer to a long poll is work already
+        if (jRes.isMember("result"))
+            processWork(jRes["result"]);
+        return;
+    }
+
+    // A new head. Work is asked for at once and more often till it's
+    // for the next block, as the node may take a while to make it
+    std::string number = jRes.get("number", "").asString();
+    if (!number.empty())
+        m_expectBlock = (int)std::strtoul(number.c_str(), nullptr, 16) + 1;
+    if (m_getworkPending)
+        m_getworkAgain = true;
+    else
+        send(1, m_jsonGetWork);
+}
+
+unsigned EthGetworkClient::pollDelay()
+{
+    bool waiting = (m_expectBlock != -1 && m_current.block != -1 && m_current.block < m_expectBlock);
+    if (m_notifier && m_notifier->isActive() && !waiting)
+        return std::max(m_farmRecheckPeriod, c_pushPoll);
+
+    // Poll at the given interval from three quarters of the average block
+    // time on. Before that, a few times less often
+    unsigned elapsed = (unsigned)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - m_blockTstamp)
+                           .count();
+    unsigned due = m_blockTime / 4 * 3;
+    if (waiting || elapsed >= due)
+        return m_farmRecheckPeriod;
+    return std::max(m_farmRecheckPeriod, std::min(m_farmRecheckPeriod * c_pollRelax, due - elapsed));
+}
+
 std::string EthGetworkClient::processError(Json::Value& JRes)
 {
     std::string retVar;
@@ -506,19 +793,19 @@ std::string EthGetworkClient::processError(Json::Value& JRes)
     return retVar;
 }
 
-void EthGetworkClient::send(Json::Value const& jReq)
+void EthGetworkClient::send(Json::Value const& jReq, std::chrono::steady_clock::time_point _found)
 {
-    send(std::string(Json::writeString(m_jSwBuilder, jReq)));
+    send(jReq.get("id", unsigned(0)).asUInt(), Json::writeString(m_jSwBuilder, jReq), _found);
 }
 
-void EthGetworkClient::send(std::string const& sReq) 
+void EthGetworkClient::send(
+    unsigned _id, std::string const& _body, std::chrono::steady_clock::time_point _found)
 {
-    std::string* line = new std::string(sReq);
-    m_txQueue.push(line);
+    m_txQueue.push(new Request{_id, _body, std::chrono::steady_clock::time_point(), _found});
 
     bool ex = false;
     if (m_txPending.compare_exchange_strong(ex, true, std::memory_order_relaxed))
-        begin_connect();
+        m_io_strand.post(boost::bind(&EthGetworkClient::flush, this));
 }
 
 void EthGetworkClient::submitHashrate(uint64_t const& rate, string const& id)
@@ -555,7 +842,7 @@ void EthGetworkClient::submitSolution(const Solution& solution)
         jReq["params"].append("0x" + nonceHex);
         jReq["params"].append("0x" + solution.work.header.hex());
         jReq["params"].append("0x" + solution.mixHash.hex());
-        send(jReq);
+        send(jReq, solution.tstamp);
     }
 
 }
@@ -576,7 +863,7 @@ void EthGetworkClient::getwork_timer_elapsed(const boost::system::error_code& ec
         }
         else
         {
-            send(m_jsonGetWork);
+            send(1, m_jsonGetWork);
         }
 
     }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <deque>
 #include <iostream>
 #include <string>
 
@@ -11,15 +12,30 @@
 #include <json/json.h>
 
 #include "../PoolClient.h"
+#include "WorkNotifier.h"
 
 using namespace std;
 using namespace dev;
 using namespace eth;
 
+/**
+ * @brief Gets work from a node over JSON-RPC on HTTP
+ *
+ * A single HTTP/1.1 keep-alive connection carries all requests. They're
+ * pipelined: submissions and hashrate reports are written as they come,
+ * without waiting behind the pending eth_getWork. Responses come back in
+ * the order of the requests, which is how they're matched. The connection
+ * is made again only when it fails or the node closes it.
+ *
+ * New work is polled for, more often once a new block is due, judging by
+ * the block times seen so far. When the node can tell about new work, by
+ * a "newHeads" WebSocket subscription or by holding long polls, polls are
+ * just a safety net.
+ */
 class EthGetworkClient : public PoolClient
 {
 public:
-    EthGetworkClient(int worktimeout, unsigned farmRecheckPeriod);
+    EthGetworkClient(int worktimeout, unsigned farmRecheckPeriod, std::string const& push = "");
     ~EthGetworkClient();
 
     void connect() override;
@@ -29,25 +45,46 @@ public:
     void submitSolution(const Solution& solution) override;
 
 private:
+    // A request to the node, from the moment it's sent till it's answered
+    struct Request
+    {
+        unsigned id;
+        std::string body;
+        std::chrono::steady_clock::time_point tstamp;  // When written to the node
+        std::chrono::steady_clock::time_point found;   // Of the solution it submits, if any
+    };
+
     unsigned m_farmRecheckPeriod = 500;  // In milliseconds
 
     void begin_connect();
     void handle_resolve(
         const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::iterator i);
     void handle_connect(const boost::system::error_code& ec);
-    void handle_write(const boost::system::error_code& ec);
-    void handle_read(const boost::system::error_code& ec, std::size_t bytes_transferred);
+    void flush();
+    void handle_write(const boost::system::error_code& ec, size_t _requests);
+    void recvSocketData();
+    void handle_read_headers(const boost::system::error_code& ec);
+    void handle_read_body(const boost::system::error_code& ec);
+    void processHttpResponse(std::string& _body);
+    void closeSocket();
+    void socketFailed(const boost::system::error_code& ec, const char* _what);
     std::string processError(Json::Value& JRes);
-    void processResponse(Json::Value& JRes);
-    void send(Json::Value const& jReq);
-    void send(std::string const& sReq);
+    void processResponse(Json::Value& JRes, Request const& _req);
+    void processWork(Json::Value& JPrm);
+    void notified(Json::Value& jRes);
+    void startNotifier(std::string const& _url);
+    unsigned pollDelay();
+    void send(Json::Value const& jReq,
+        std::chrono::steady_clock::time_point _found = std::chrono::steady_clock::time_point());
+    void send(unsigned _id, std::string const& _body,
+        std::chrono::steady_clock::time_point _found = std::chrono::steady_clock::time_point());
     void getwork_timer_elapsed(const boost::system::error_code& ec);
 
     WorkPackage m_current;
 
     std::atomic<bool> m_connecting = {false};  // Whether or not socket is on first try connect
-    std::atomic<bool> m_txPending = {false};  // Whether or not an async socket operation is pending
-    boost::lockfree::queue<std::string*> m_txQueue;
+    std::atomic<bool> m_txPending = {false};   // Whether or not a flush of the queue is posted
+    boost::lockfree::queue<Request*> m_txQueue;
 
     boost::asio::io_service::strand m_io_strand;
 
@@ -55,12 +92,22 @@ private:
     boost::asio::ip::tcp::resolver m_resolver;
     std::queue<boost::asio::ip::basic_endpoint<boost::asio::ip::tcp>> m_endpoints;
 
-    boost::asio::streambuf m_request;
+    // State of the connection. Only accessed on the strand
+    bool m_socketOpen = false;
+    bool m_socketConnecting = false;
+    bool m_writing = false;
+    bool m_getworkPending = false;  // An eth_getWork is queued or waiting for its response
+    unsigned m_responses = 0;       // Responses got on the current socket
+    std::deque<Request> m_toWrite;  // Waiting for the socket
+    std::deque<Request> m_inflight; // Written, in order, waiting for their responses
+
     boost::asio::streambuf m_response;
+    size_t m_bodyLength = 0;      // Of the response being read
+    bool m_bodyChunked = false;   // Response body is chunked
+    bool m_bodyToEof = false;     // Response body lasts till the node closes the connection
+    bool m_closeAfter = false;    // Node closes the connection after the response
     Json::StreamWriterBuilder m_jSwBuilder;
     std::string m_jsonGetWork;
-    Json::Value m_pendingJReq;
-    std::chrono::time_point<std::chrono::steady_clock> m_pending_tstamp;
 
     boost::asio::deadline_timer m_getwork_timer;  // The timer which triggers getWork requests
 
@@ -68,5 +115,12 @@ private:
     int m_worktimeout;
     std::chrono::time_point<std::chrono::steady_clock> m_current_tstamp;
 
-    unsigned m_solution_submitted_max_id;  // maximum json id we used to send a solution
+    unsigned m_solution_submitted_max_id = 0;  // maximum json id we used to send a solution
+
+    // Tells about new work without polling. Null if the node can't
+    std::unique_ptr<WorkNotifier> m_notifier;
+    bool m_getworkAgain = false;  // Work changed while an eth_getWork was pending
+    int m_expectBlock = -1;       // Block we've been told about but didn't get work for yet
+    std::chrono::steady_clock::time_point m_blockTstamp;  // When the block last changed
+    unsigned m_blockTime = 13000;  // Average milliseconds between blocks
 };
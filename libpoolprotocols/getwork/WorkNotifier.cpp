@@ -0,0 +1,401 @@
+#include <libdevcore/Log.h>
+#include <libdevcore/CommonData.h>
+
+#include <random>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
+
+#include "WorkNotifier.h"
+
+using namespace std;
+using namespace dev;
+
+using boost::asio::ip::tcp;
+
+namespace
+{
+const size_t c_maxMessage = 1024 * 1024;  // Larger WebSocket messages are refused
+const unsigned c_minHold = 1000;  // Milliseconds under which an unchanged answer means the node
+                                  // doesn't hold long polls
+
+std::random_device s_maskEngine;
+
+}  // namespace
+
+WorkNotifier::WorkNotifier(boost::asio::io_service::strand& _strand, Mode _mode,
+    std::string const& _host, unsigned short _port, std::string const& _path)
+  : m_io_strand(_strand),
+    m_mode(_mode),
+    m_host(_host),
+    m_port(_port),
+    m_path(_path.empty() ? "/" : _path),
+    m_socket(g_io_service),
+    m_resolver(g_io_service)
+{
+}
+
+WorkNotifier::~WorkNotifier()
+{
+    stop();
+}
+
+bool WorkNotifier::parse(std::string const& _url, Mode& _mode, std::string& _host,
+    unsigned short& _port, std::string& _path)
+{
+    size_t offset = _url.find("://");
+    if (offset == std::string::npos)
+        return false;
+    std::string scheme = boost::algorithm::to_lower_copy(_url.substr(0, offset));
+    if (scheme == "ws")
+    {
+        _mode = Mode::WebSocket;
+        _port = 8546;
+    }
+    else if (scheme == "http")
+    {
+        _mode = Mode::LongPoll;
+        _port = 8545;
+    }
+    else
+        return false;
+
+    std::string authority = _url.substr(offset + 3);
+    offset = authority.find('/');
+    _path = (offset == std::string::npos ? "/" : authority.substr(offset));
+    authority = authority.substr(0, offset);
+    offset = authority.find(':');
+    _host = authority.substr(0, offset);
+    if (offset != std::string::npos)
+    {
+        unsigned long port = strtoul(authority.c_str() + offset + 1, nullptr, 10);
+        if (!port || port > 65535)
+            return false;
+        _port = (unsigned short)port;
+    }
+    return !_host.empty();
+}
+
+std::string WorkNotifier::str() const
+{
+    return (m_mode == Mode::WebSocket ? "ws://" : "http://") + m_host + ":" + to_string(m_port) +
+           m_path;
+}
+
+void WorkNotifier::start()
+{
+    if (m_running)
+        return;
+    m_running = true;
+    m_active = false;
+    m_toWrite.clear();
+    m_response.consume(m_response.size());
+    m_message.clear();
+
+    tcp::resolver::query q(m_host, to_string(m_port));
+    m_resolver.async_resolve(q, m_io_strand.wrap(boost::bind(&WorkNotifier::handle_resolve, this,
+                                    boost::asio::placeholders::error,
+                                    boost::asio::placeholders::iterator)));
+}
+
+void WorkNotifier::stop()
+{
+    m_running = false;
+    m_active = false;
+    m_resolver.cancel();
+    if (m_socket.is_open())
+    {
+        boost::system::error_code ec;
+        m_socket.shutdown(tcp::socket::shutdown_both, ec);
+        m_socket.close(ec);
+    }
+}
+
+void WorkNotifier::fail(const boost::system::error_code& ec, const char* _what)
+{
+    if (!m_running || ec == boost::asio::error::operation_aborted)
+        return;
+    cwarn << "Error " << _what << " " << str() << " : " << ec.message();
+    stop();
+    if (m_onFailed)
+        m_onFailed();
+}
+
+void WorkNotifier::handle_resolve(const boost::system::error_code& ec, tcp::resolver::iterator i)
+{
+    if (ec)
+    {
+        fail(ec, "resolving");
+        return;
+    }
+    boost::asio::async_connect(m_socket, i,
+        m_io_strand.wrap(
+            boost::bind(&WorkNotifier::handle_connect, this, boost::asio::placeholders::error)));
+}
+
+void WorkNotifier::handle_connect(const boost::system::error_code& ec)
+{
+    if (ec)
+    {
+        fail(ec, "connecting to");
+        return;
+    }
+    boost::system::error_code oec;
+    m_socket.set_option(tcp::no_delay(true), oec);
+
+    if (m_mode == Mode::LongPoll)
+    {
+        sendPoll();
+        async_read_until(m_socket, m_response, "\r\n\r\n",
+            m_io_strand.wrap(boost::bind(
+                &WorkNotifier::handle_read_headers, this, boost::asio::placeholders::error)));
+        return;
+    }
+
+    unsigned char key[16];
+    for (auto& k : key)
+        k = (unsigned char)s_maskEngine();
+    write("GET " + m_path + " HTTP/1.1\r\nHost: " + m_host + ":" + to_string(m_port) +
+          "\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Key: " +
+          toBase64(key, sizeof(key)) + "\r\nSec-WebSocket-Version: 13\r\n\r\n");
+    async_read_until(m_socket, m_response, "\r\n\r\n",
+        m_io_strand.wrap(
+            boost::bind(&WorkNotifier::handle_handshake, this, boost::asio::placeholders::error)));
+}
+
+void WorkNotifier::write(std::string const& _data)
+{
+    m_toWrite.push_back(_data);
+    if (m_toWrite.size() > 1)
+        return;  // Goes after those being written
+    async_write(m_socket, boost::asio::buffer(m_toWrite.front()),
+        m_io_strand.wrap(
+            boost::bind(&WorkNotifier::handle_write, this, boost::asio::placeholders::error)));
+}
+
+void WorkNotifier::handle_write(const boost::system::error_code& ec)
+{
+    if (ec)
+    {
+        fail(ec, "writing to");
+        return;
+    }
+    m_toWrite.pop_front();
+    if (!m_toWrite.empty())
+        async_write(m_socket, boost::asio::buffer(m_toWrite.front()),
+            m_io_strand.wrap(
+                boost::bind(&WorkNotifier::handle_write, this, boost::asio::placeholders::error)));
+}
+
+void WorkNotifier::handle_handshake(const boost::system::error_code& ec)
+{
+    if (ec)
+    {
+        fail(ec, "reading from");
+        return;
+    }
+
+    std::string headers(
+        boost::asio::buffer_cast<const char*>(m_response.data()), m_response.size());
+    size_t headersEnd = headers.find("\r\n\r\n");
+    m_response.consume(headersEnd + 4);
+    if (headers.compare(0, 12, "HTTP/1.1 101") != 0)
+    {
+        cwarn << str() << " refused WebSocket upgrade : " << headers.substr(0, headers.find("\r\n"));
+        fail(boost::asio::error::connection_refused, "upgrading");
+        return;
+    }
+
+    sendFrame(0x1,
+        "{\"id\":1,\"jsonrpc\":\"2.0\",\"method\":\"eth_subscribe\",\"params\":[\"newHeads\"]}");
+    readFrame();
+}
+
+void WorkNotifier::sendFrame(unsigned char _opcode, std::string const& _payload)
+{
+    // Frames from clients are always masked
+    unsigned char mask[4];
+    for (auto& m : mask)
+        m = (unsigned char)s_maskEngine();
+    write(dev::encodeWebSocketFrame(_opcode, _payload, mask));
+}
+
+void WorkNotifier::readFrame()
+{
+    // Process all complete frames already buffered
+    dev::WebSocketFrame frame;
+    for (;;)
+    {
+        size_t size = dev::decodeWebSocketFrame(
+            boost::asio::buffer_cast<const unsigned char*>(m_response.data()),
+            m_response.size(), frame);
+        if (frame.length + m_message.size() > c_maxMessage)
+        {
+            fail(boost::asio::error::message_size, "reading from");
+            return;
+        }
+        if (!size)
+            break;
+        m_response.consume(size);
+
+        std::string& payload = frame.payload;
+        switch (frame.opcode)
+        {
+        case 0x0:  // Continuation
+        case 0x1:  // Text
+        case 0x2:  // Binary
+            m_message += payload;
+            if (frame.fin)
+            {
+                std::string message;
+                message.swap(m_message);
+                processMessage(message);
+            }
+            break;
+        case 0x8:  // Close
+            fail(boost::asio::error::eof, "reading from");
+            return;
+        case 0x9:  // Ping
+            sendFrame(0xA, payload);
+            break;
+        default:  // Pong and anything else
+            break;
+        }
+        if (!m_running)
+            return;
+    }
+
+    async_read(m_socket, m_response, boost::asio::transfer_at_least(1),
+        m_io_strand.wrap(
+            boost::bind(&WorkNotifier::handle_read_frame, this, boost::asio::placeholders::error)));
+}
+
+void WorkNotifier::handle_read_frame(const boost::system::error_code& ec)
+{
+    if (ec)
+    {
+        fail(ec, "reading from");
+        return;
+    }
+    readFrame();
+}
+
+void WorkNotifier::sendPoll()
+{
+    static const std::string c_body =
+        "{\"id\":1,\"jsonrpc\":\"2.0\",\"method\":\"eth_getWork\",\"params\":[]}";
+    write("POST " + m_path + " HTTP/1.1\r\nHost: " + m_host + ":" + to_string(m_port) +
+          "\r\nContent-Type: application/json\r\nContent-Length: " + to_string(c_body.size()) +
+          "\r\nConnection: keep-alive\r\n\r\n" + c_body);
+    m_pollTstamp = std::chrono::steady_clock::now();
+}
+
+void WorkNotifier::handle_read_headers(const boost::system::error_code& ec)
+{
+    if (ec)
+    {
+        fail(ec, "reading from");
+        return;
+    }
+
+    std::string headers(
+        boost::asio::buffer_cast<const char*>(m_response.data()), m_response.size());
+    headers.erase(headers.find("\r\n\r\n"));
+    m_response.consume(headers.size() + 4);
+    boost::algorithm::to_lower(headers);
+
+    size_t lengthoffset = headers.find("\r\ncontent-length:");
+    if (headers.compare(9, 3, "200") != 0 || lengthoffset == std::string::npos)
+    {
+        // Chunked answers are not worth it for a few hundred bytes
+        fail(boost::asio::error::operation_not_supported, "long polling");
+        return;
+    }
+    m_bodyLength = strtoul(headers.c_str() + lengthoffset + 17, nullptr, 10);
+    if (m_bodyLength > c_maxMessage)
+    {
+        fail(boost::asio::error::message_size, "reading from");
+        return;
+    }
+
+    if (m_response.size() >= m_bodyLength)
+        handle_read_body(boost::system::error_code());
+    else
+        async_read(m_socket, m_response,
+            boost::asio::transfer_exactly(m_bodyLength - m_response.size()),
+            m_io_strand.wrap(boost::bind(
+                &WorkNotifier::handle_read_body, this, boost::asio::placeholders::error)));
+}
+
+void WorkNotifier::handle_read_body(const boost::system::error_code& ec)
+{
+    if (ec)
+    {
+        fail(ec, "reading from");
+        return;
+    }
+
+    std::string body(boost::asio::buffer_cast<const char*>(m_response.data()), m_bodyLength);
+    m_response.consume(m_bodyLength);
+    processMessage(body);
+    if (!m_running)
+        return;
+
+    // Next poll waits for the next change
+    sendPoll();
+    async_read_until(m_socket, m_response, "\r\n\r\n",
+        m_io_strand.wrap(boost::bind(
+            &WorkNotifier::handle_read_headers, this, boost::asio::placeholders::error)));
+}
+
+void WorkNotifier::processMessage(std::string const& _message)
+{
+    Json::Value jMsg;
+    Json::Reader jRdr;
+    if (!jRdr.parse(_message, jMsg) || !jMsg.isObject())
+    {
+        fail(boost::asio::error::invalid_argument, "parsing message from");
+        return;
+    }
+    if (!jMsg.get("error", Json::Value::null).empty())
+    {
+        cwarn << str() << " refused request : " << jMsg["error"].toStyledString();
+        fail(boost::asio::error::operation_not_supported, "subscribing to");
+        return;
+    }
+
+    if (m_mode == Mode::LongPoll)
+    {
+        // An unchanged answer right away means the request was not held
+        Json::Value& jResult = jMsg["result"];
+        unsigned held = (unsigned)std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - m_pollTstamp)
+                            .count();
+        if (m_active && held < c_minHold && jResult == m_lastResult)
+        {
+            fail(boost::asio::error::operation_not_supported, "long polling");
+            return;
+        }
+        if (!m_active)
+            cnote << "Long polling " << str();
+        m_active = true;
+        m_lastResult = jResult;
+        if (m_onNotify)
+            m_onNotify(jMsg);
+        return;
+    }
+
+    if (jMsg.isMember("id"))
+    {
+        // Answer to eth_subscribe
+        if (!m_active)
+            cnote << "Subscribed to new heads on " << str();
+        m_active = true;
+    }
+    else if (jMsg.get("method", "").asString() == "eth_subscription")
+    {
+        Json::Value& jHead = jMsg["params"]["result"];
+        if (m_onNotify)
+            m_onNotify(jHead);
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <string>
+
+#include <boost/asio.hpp>
+
+#include <json/json.h>
+
+extern boost::asio::io_service g_io_service;
+
+/**
+ * @brief Tells EthGetworkClient about new work as soon as the node has it
+ *
+ * Two ways of being told, depending on what the node supports:
+ * - WebSocket: subscribes to "newHeads" with eth_subscribe. Each new block
+ *   header is passed on, the work itself still has to be asked for
+ * - LongPoll: keeps an eth_getWork request pending on a dedicated HTTP
+ *   connection, which the node answers only when the work changes. Each
+ *   answer is passed on and a new request is made right away
+ * Runs on the strand of its owner, so no locking is needed on either side.
+ * When the connection fails the failed handler is called and the owner is
+ * expected to go back to polling.
+ */
+class WorkNotifier
+{
+public:
+    enum class Mode
+    {
+        WebSocket,
+        LongPoll
+    };
+
+    using NotifyFn = std::function<void(Json::Value& jRes)>;
+    using FailedFn = std::function<void()>;
+
+    WorkNotifier(boost::asio::io_service::strand& _strand, Mode _mode, std::string const& _host,
+        unsigned short _port, std::string const& _path);
+    ~WorkNotifier();
+
+    // Splits "ws://host[:port][/path]" or "http://host[:port][/path]"
+    static bool parse(std::string const& _url, Mode& _mode, std::string& _host,
+        unsigned short& _port, std::string& _path);
+
+    void start();
+    void stop();
+
+    // Whether the node acknowledged the subscription or the long poll
+    bool isActive() const { return m_active; }
+    Mode mode() const { return m_mode; }
+    std::string str() const;
+
+    void onNotify(NotifyFn const& _handler) { m_onNotify = _handler; }
+    void onFailed(FailedFn const& _handler) { m_onFailed = _handler; }
+
+private:
+    void handle_resolve(
+        const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::iterator i);
+    void handle_connect(const boost::system::error_code& ec);
+    void handle_handshake(const boost::system::error_code& ec);
+    void handle_read_headers(const boost::system::error_code& ec);
+    void handle_read_body(const boost::system::error_code& ec);
+    void handle_read_frame(const boost::system::error_code& ec);
+    void handle_write(const boost::system::error_code& ec);
+    void readFrame();
+    void sendFrame(unsigned char _opcode, std::string const& _payload);
+    void sendPoll();
+    void write(std::string const& _data);
+    void processMessage(std::string const& _message);
+    void fail(const boost::system::error_code& ec, const char* _what);
+
+    boost::asio::io_service::strand& m_io_strand;
+    Mode m_mode;
+    std::string m_host;
+    unsigned short m_port;
+    std::string m_path;
+
+    boost::asio::ip::tcp::socket m_socket;
+    boost::asio::ip::tcp::resolver m_resolver;
+    boost::asio::streambuf m_response;
+    std::deque<std::string> m_toWrite;  // First one is being written
+
+    bool m_running = false;
+    bool m_active = false;
+    size_t m_bodyLength = 0;
+    std::string m_message;  // Fragments of the WebSocket message being read
+    std::chrono::steady_clock::time_point m_pollTstamp;  // When the pending long poll was sent
+    Json::Value m_lastResult;                            // Answer to the previous long poll
+
+    NotifyFn m_onNotify;
+    FailedFn m_onFailed;
+};
@@ -0,0 +1,614 @@
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <libdevcore/Log.h>
+
+#include "StratumProxy.h"
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+using boost::asio::ip::tcp;
+
+namespace
+{
+const unsigned c_maxSlot = 0xffff;       // Fits c_slotChars
+const size_t c_jobsKept = 8;             // Jobs shares can still be submitted for
+const size_t c_maxLine = 16384;          // Longer lines from a miner drop its connection
+const size_t c_maxTxQueue = 256;         // Lines a miner may leave unread
+const double c_diffRounding = 1.000001;  // Never give miners an easier target than upstream's
+
+// First nonce of a slot's share of the upstream nonce space
+uint64_t slotStart(WorkPackage const& _wp, unsigned _slot)
+{
+    unsigned upstreamBits = _wp.exSizeBytes * 4;
+    uint64_t upstream = upstreamBits ? _wp.startNonce & ~(~uint64_t(0) >> upstreamBits) : 0;
+    return upstream |
+           (uint64_t(_slot) << (64 - upstreamBits - StratumProxy::c_slotChars * 4));
+}
+
+}  // namespace
+
+
+ProxySession::ProxySession(StratumProxy& _proxy, unsigned _slot)
+  : m_proxy(_proxy), m_slot(_slot), m_socket(g_io_service)
+{
+    m_jSwBuilder.settings_["indentation"] = "";
+}
+
+void ProxySession::start()
+{
+    boost::system::error_code ec;
+    m_endpoint = boost::lexical_cast<std::string>(m_socket.remote_endpoint(ec));
+    recvSocketData();
+}
+
+void ProxySession::disconnect()
+{
+    if (!m_socket.is_open())
+        return;
+
+    boost::system::error_code ec;
+    m_socket.shutdown(tcp::socket::shutdown_both, ec);
+    m_socket.close(ec);
+
+    if (!m_worker.empty())
+        cnote << "Proxy : " << m_worker << " disconnected";
+    m_subscribed = m_authorized = false;
+    m_submitted.clear();
+    m_txQueue.clear();
+    m_proxy.removeSession(this);
+}
+
+void ProxySession::recvSocketData()
+{
+    boost::asio::async_read(m_socket, m_recvBuffer, boost::asio::transfer_at_least(1),
+        m_proxy.m_io_strand.wrap(boost::bind(&ProxySession::onRecvSocketDataCompleted,
+            shared_from_this(), boost::asio::placeholders::error)));
+}
+
+void ProxySession::onRecvSocketDataCompleted(const boost::system::error_code& ec)
+{
+    if (ec)
+    {
+        disconnect();
+        return;
+    }
+
+    size_t consumed = StratumParser::frame(
+        boost::asio::buffer_cast<const char*>(m_recvBuffer.data()), m_recvBuffer.size(),
+        m_recvScanned, [&](const char* _begin, const char* _end) {
+            Json::Value jReq;
+            std::string what;
+            if (m_parser.parse(_begin, _end, jReq, what) && jReq.isObject())
+            {
+                try
+                {
+                    processRequest(jReq);
+                }
+                catch (const std::exception& _ex)
+                {
+                    cwarn << "Proxy : invalid request from " << m_worker << " " << _ex.what();
+                }
+            }
+            else
+            {
+                replyError(Json::Value::null, -32700, "Json parse error");
+            }
+        });
+    m_recvBuffer.consume(consumed);
+
+    if (m_recvBuffer.size() > c_maxLine)
+    {
+        cwarn << "Proxy : line too long from " << m_endpoint;
+        disconnect();
+        return;
+    }
+
+    if (m_socket.is_open())
+        recvSocketData();
+}
+
+void ProxySession::processRequest(Json::Value& _req)
+{
+    Json::Value id = _req.get("id", Json::Value::null);
+    string method = _req.get("method", "").asString();
+    Json::Value params = _req.get("params", Json::Value(Json::arrayValue));
+    if (!params.isArray())
+        params = Json::Value(Json::arrayValue);
+
+    if (method == "mining.subscribe")
+    {
+        // Other flavours try first when autodetecting: refusing makes the
+        // miner move on to this one
+        if (params.get(Json::Value::ArrayIndex(1), "").asString() != "EthereumStratum/1.0.0")
+        {
+            replyError(id, 20, "Only EthereumStratum/1.0.0 is supported");
+            return;
+        }
+        m_subscribed = true;
+
+        Json::Value jNotify(Json::arrayValue);
+        jNotify.append("mining.notify");
+        jNotify.append(toHex(uint32_t(m_slot)));
+        jNotify.append("EthereumStratum/1.0.0");
+        Json::Value jResult(Json::arrayValue);
+        jResult.append(jNotify);
+        jResult.append(m_proxy.extranonce(m_slot));
+        reply(id, jResult);
+    }
+    else if (method == "mining.extranonce.subscribe")
+    {
+        reply(id, true);
+    }
+    else if (method == "mining.authorize")
+    {
+        if (!m_subscribed)
+        {
+            replyError(id, 25, "Not subscribed");
+            return;
+        }
+        m_worker = params.get(Json::Value::ArrayIndex(0), "").asString();
+        m_authorized = true;
+        reply(id, true);
+        cnote << "Proxy : " << m_worker << " authorized from " << m_endpoint << " on slot "
+              << m_slot;
+        m_proxy.sendWork(*this);
+    }
+    else if (method == "mining.submit")
+    {
+        if (!m_authorized)
+        {
+            replyError(id, 24, "Unauthorized worker");
+            return;
+        }
+        if (params.size() < 3)
+        {
+            replyError(id, 20, "Invalid params");
+            return;
+        }
+        m_proxy.submit(*this, id, params[1].asString(), params[2].asString());
+    }
+    else if (method == "eth_submitHashrate")
+    {
+        try
+        {
+            m_hashrate =
+                stoull(params.get(Json::Value::ArrayIndex(0), "0").asString(), nullptr, 16);
+        }
+        catch (const std::exception&)
+        {
+            m_hashrate = 0;
+        }
+        m_proxy.updateHashRate();
+        reply(id, true);
+    }
+    else if (!id.isNull())
+    {
+        replyError(id, 20, "Method not supported");
+    }
+}
+
+void ProxySession::reply(Json::Value const& _id, Json::Value const& _result)
+{
+    Json::Value jRes;
+    jRes["id"] = _id;
+    jRes["result"] = _result;
+    jRes["error"] = Json::Value::null;
+    send(jRes);
+}
+
+void ProxySession::replyError(Json::Value const& _id, int _code, std::string const& _message)
+{
+    Json::Value jRes;
+    jRes["id"] = _id;
+    jRes["result"] = Json::Value::null;
+    jRes["error"].append(_code);
+    jRes["error"].append(_message);
+    jRes["error"].append(Json::Value::null);
+    send(jRes);
+}
+
+void ProxySession::answer(bool _accepted, std::string const& _reason)
+{
+    if (m_submitted.empty())
+        return;
+
+    Json::Value id = m_submitted.front();
+    m_submitted.pop_front();
+    if (_accepted)
+        reply(id, true);
+    else
+        replyError(id, 23, _reason.empty() ? "Rejected by pool" : _reason);
+}
+
+void ProxySession::send(Json::Value const& _msg)
+{
+    send(make_shared<const std::string>(Json::writeString(m_jSwBuilder, _msg) + "\n"));
+}
+
+void ProxySession::send(std::shared_ptr<const std::string> _line)
+{
+    if (!m_socket.is_open())
+        return;
+
+    if (m_txQueue.size() >= c_maxTxQueue)
+    {
+        // Not in place: we may be called while the proxy walks its sessions
+        cwarn << "Proxy : " << m_worker << " does not read its messages";
+        m_txQueue.clear();
+        m_proxy.m_io_strand.post(boost::bind(&ProxySession::disconnect, shared_from_this()));
+        return;
+    }
+
+    m_txQueue.push_back(std::move(_line));
+    if (!m_txPending)
+        sendSocketData();
+}
+
+void ProxySession::sendSocketData()
+{
+    // Gather all queued lines in a single write
+    m_txLines.assign(m_txQueue.begin(), m_txQueue.end());
+    m_txQueue.clear();
+    m_txBuffers.clear();
+    for (auto const& line : m_txLines)
+        m_txBuffers.push_back(boost::asio::buffer(*line));
+
+    m_txPending = true;
+    boost::asio::async_write(m_socket, m_txBuffers,
+        m_proxy.m_io_strand.wrap(boost::bind(&ProxySession::onSendSocketDataCompleted,
+            shared_from_this(), boost::asio::placeholders::error)));
+}
+
+void ProxySession::onSendSocketDataCompleted(const boost::system::error_code& ec)
+{
+    m_txLines.clear();
+    m_txPending = false;
+
+    if (ec)
+        disconnect();
+    else if (!m_txQueue.empty())
+        sendSocketData();
+}
+
+
+StratumProxy::StratumProxy(std::string _address, unsigned _port, unsigned _batchWindow)
+  : m_address(std::move(_address)),
+    m_port(_port),
+    m_batchWindow(_batchWindow),
+    m_acceptor(g_io_service),
+    m_io_strand(g_io_service),
+    m_batchtimer(g_io_service),
+    m_verifier(1, true, [this](Solution const& _s, bool _valid) {
+        m_io_strand.post(boost::bind(&StratumProxy::shareChecked, this, _s, _valid));
+    })
+{
+    m_jSwBuilder.settings_["indentation"] = "";
+}
+
+void StratumProxy::start()
+{
+    tcp::endpoint endpoint(boost::asio::ip::address::from_string(m_address), m_port);
+
+    // Try to bind to port number
+    try
+    {
+        m_acceptor.open(endpoint.protocol());
+        m_acceptor.set_option(tcp::acceptor::reuse_address(true));
+        m_acceptor.bind(endpoint);
+        m_acceptor.listen(64);
+    }
+    catch (const std::exception&)
+    {
+        cwarn << "Could not start stratum proxy on port: " + to_string(m_port);
+        cwarn << "Ensure port is not in use by another service";
+        return;
+    }
+
+    cnote << "Stratum proxy listening on " << m_address << ":" << m_port;
+    m_running.store(true, std::memory_order_relaxed);
+    g_io_service.post(m_io_strand.wrap(boost::bind(&StratumProxy::begin_accept, this)));
+}
+
+void StratumProxy::stop()
+{
+    // Exit if not started
+    if (!m_running.load(std::memory_order_relaxed))
+        return;
+
+    m_running.store(false, std::memory_order_relaxed);
+    m_io_strand.post([this]() {
+        boost::system::error_code ec;
+        m_acceptor.cancel(ec);
+        m_acceptor.close(ec);
+        m_batchtimer.cancel();
+
+        // Dispose all sessions
+        auto sessions = std::move(m_sessions);
+        m_sessions.clear();
+        for (auto& session : sessions)
+            session.second->disconnect();
+        m_miners.store(0, std::memory_order_relaxed);
+    });
+}
+
+unsigned StratumProxy::freeSlot()
+{
+    // Round robin: a slot whose answers may still be on their way from the
+    // pool is not handed out again right away
+    for (unsigned i = 0; i < c_maxSlot; i++)
+    {
+        unsigned slot = m_nextSlot;
+        m_nextSlot = (m_nextSlot % c_maxSlot) + 1;
+        if (!m_sessions.count(slot))
+            return slot;
+    }
+    return 0;
+}
+
+void StratumProxy::begin_accept()
+{
+    if (!isRunning())
+        return;
+
+    auto session = std::make_shared<ProxySession>(*this, freeSlot());
+    m_acceptor.async_accept(session->socket(),
+        m_io_strand.wrap(boost::bind(
+            &StratumProxy::handle_accept, this, session, boost::asio::placeholders::error)));
+}
+
+void StratumProxy::handle_accept(
+    std::shared_ptr<ProxySession> _session, boost::system::error_code ec)
+{
+    if (!isRunning())
+        return;
+
+    if (!ec)
+    {
+        if (_session->slot())
+        {
+            m_sessions[_session->slot()] = _session;
+            m_miners.store(unsigned(m_sessions.size()), std::memory_order_relaxed);
+            _session->start();
+        }
+        else
+        {
+            cwarn << "Proxy : no slot left for another miner";
+            _session->disconnect();
+        }
+    }
+
+    // Resubmit new accept
+    begin_accept();
+}
+
+void StratumProxy::removeSession(ProxySession* _session)
+{
+    auto it = m_sessions.find(_session->slot());
+    if (it != m_sessions.end() && it->second.get() == _session)
+        m_sessions.erase(it);
+    m_miners.store(unsigned(m_sessions.size()), std::memory_order_relaxed);
+    updateHashRate();
+}
+
+std::string StratumProxy::extranonce(unsigned _slot)
+{
+    if (!m_upstream || m_upstream.exSizeBytes > c_maxUpstream)
+        return "";
+    return toHex(slotStart(m_upstream, _slot)).substr(0, m_upstream.exSizeBytes + c_slotChars);
+}
+
+void StratumProxy::setWork(WorkPackage const& _wp)
+{
+    m_io_strand.post([this, _wp]() {
+        bool newExtranonce = !m_upstream || _wp.startNonce != m_upstream.startNonce ||
+                             _wp.exSizeBytes != m_upstream.exSizeBytes;
+        bool newBoundary = !m_upstream || _wp.boundary != m_upstream.boundary;
+        m_upstream = _wp;
+
+        if (m_upstream.exSizeBytes > c_maxUpstream)
+        {
+            if (newExtranonce)
+                cwarn << "Proxy : upstream nonce space too small to be shared";
+            m_notify.reset();
+            return;
+        }
+
+        m_jobs.push_back(ProxyJob{toCompactHex(++m_jobSeq), _wp});
+        if (m_jobs.size() > c_jobsKept)
+            m_jobs.pop_front();
+
+        Json::Value jMsg;
+        jMsg["id"] = Json::Value::null;
+        if (newBoundary)
+        {
+            // Same relation between difficulty and target as the miners use
+            double diff = getHashesToTarget(_wp.boundary.hex(HexPrefix::Add)) / 4294967296.0;
+            jMsg["method"] = "mining.set_difficulty";
+            jMsg["params"] = Json::Value(Json::arrayValue);
+            jMsg["params"].append(diff * c_diffRounding);
+            m_difficulty =
+                make_shared<const std::string>(Json::writeString(m_jSwBuilder, jMsg) + "\n");
+        }
+        jMsg["method"] = "mining.notify";
+        jMsg["params"] = Json::Value(Json::arrayValue);
+        jMsg["params"].append(m_jobs.back().id);
+        jMsg["params"].append(_wp.seed.hex());
+        jMsg["params"].append(_wp.header.hex());
+        jMsg["params"].append(true);
+        m_notify = make_shared<const std::string>(Json::writeString(m_jSwBuilder, jMsg) + "\n");
+
+        // Fan out. Job lines are formatted once for all miners
+        for (auto& s : m_sessions)
+        {
+            ProxySession& session = *s.second;
+            if (newExtranonce && session.subscribed())
+            {
+                Json::Value jSet;
+                jSet["id"] = Json::Value::null;
+                jSet["method"] = "mining.set_extranonce";
+                jSet["params"].append(extranonce(session.slot()));
+                session.send(jSet);
+            }
+            if (!session.authorized())
+                continue;
+            if (newBoundary)
+                session.send(m_difficulty);
+            session.send(m_notify);
+        }
+    });
+}
+
+void StratumProxy::sendWork(ProxySession& _session)
+{
+    if (!m_notify)
+        return;
+    _session.send(m_difficulty);
+    _session.send(m_notify);
+}
+
+void StratumProxy::submit(ProxySession& _session, Json::Value const& _id,
+    std::string const& _job, std::string const& _nonce)
+{
+    auto job = find_if(m_jobs.rbegin(), m_jobs.rend(),
+        [&](ProxyJob const& _j) { return _j.id == _job; });
+    if (job == m_jobs.rend())
+    {
+        m_rejected.fetch_add(1, std::memory_order_relaxed);
+        _session.replyError(_id, 21, "Job not found");
+        return;
+    }
+    WorkPackage const& wp = job->wp;
+
+    // Miners submit the nonce without their extranonce
+    std::string suffix = (_nonce.compare(0, 2, "0x") == 0 ? _nonce.substr(2) : _nonce);
+    if (suffix.size() != 16 - wp.exSizeBytes - c_slotChars ||
+        suffix.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos)
+    {
+        m_invalid.fetch_add(1, std::memory_order_relaxed);
+        _session.replyError(_id, 20, "Invalid nonce");
+        return;
+    }
+    uint64_t nonce = slotStart(wp, _session.slot()) | stoull(suffix, nullptr, 16);
+
+    // Only shares the pool would accept go upstream. Checking them also gets
+    // us the mix hash some stratum flavours need. Hashing, and building the
+    // light cache of a new epoch, mustn't hold up the strand
+    m_checking.push_back({_session.shared_from_this(), _id});
+    m_verifier.push(
+        Solution{nonce, h256(), wp, std::chrono::steady_clock::now(), _session.slot()});
+}
+
+void StratumProxy::shareChecked(Solution const& _s, bool _valid)
+{
+    // The verifier answers in the order shares were pushed
+    if (m_checking.empty())
+        return;
+    ShareCheck check = std::move(m_checking.front());
+    m_checking.pop_front();
+
+    // Miner gone meanwhile
+    ProxySession& session = *check.session;
+    if (!session.socket().is_open())
+        return;
+
+    if (!_valid)
+    {
+        m_invalid.fetch_add(1, std::memory_order_relaxed);
+        session.replyError(check.id, 23, "Low difficulty share");
+        return;
+    }
+
+    session.m_submitted.push_back(check.id);
+    m_batch.push_back(_s);
+    if (m_flushPending)
+        return;
+
+    m_flushPending = true;
+    if (m_batchWindow)
+    {
+        m_batchtimer.expires_from_now(boost::posix_time::milliseconds(m_batchWindow));
+        m_batchtimer.async_wait(m_io_strand.wrap(boost::bind(
+            &StratumProxy::batchtimer_elapsed, this, boost::asio::placeholders::error)));
+    }
+    else
+    {
+        g_io_service.post(m_io_strand.wrap(boost::bind(&StratumProxy::flush, this)));
+    }
+}
+
+void StratumProxy::batchtimer_elapsed(const boost::system::error_code& ec)
+{
+    if (!ec)
+        flush();
+}
+
+void StratumProxy::flush()
+{
+    m_flushPending = false;
+    if (m_batch.empty())
+        return;
+
+    m_batches.fetch_add(1, std::memory_order_relaxed);
+    if (!m_onSolution || !m_onSolution(m_batch))
+    {
+        for (auto const& s : m_batch)
+        {
+            auto it = m_sessions.find(s.midx);
+            if (it != m_sessions.end())
+                it->second->answer(false, "Upstream not connected");
+        }
+        m_rejected.fetch_add(m_batch.size(), std::memory_order_relaxed);
+    }
+    m_batch.clear();
+}
+
+void StratumProxy::solutionAnswered(unsigned _slot, bool _accepted)
+{
+    if (_accepted)
+        m_accepted.fetch_add(1, std::memory_order_relaxed);
+    else
+        m_rejected.fetch_add(1, std::memory_order_relaxed);
+
+    m_io_strand.post([this, _slot, _accepted]() {
+        auto it = m_sessions.find(_slot);
+        if (it != m_sessions.end())
+            it->second->answer(_accepted);
+    });
+}
+
+void StratumProxy::upstreamDisconnected()
+{
+    m_io_strand.post([this]() {
+        // Jobs are gone with the session and so are the answers we wait for
+        m_upstream = WorkPackage();
+        m_jobs.clear();
+        m_notify.reset();
+        m_batch.clear();
+        for (auto& s : m_sessions)
+            while (s.second->m_submitted.size())
+                s.second->answer(false, "Upstream disconnected");
+    });
+}
+
+void StratumProxy::updateHashRate()
+{
+    uint64_t rate = 0;
+    for (auto const& s : m_sessions)
+        rate += s.second->hashrate();
+    m_hashrate.store(rate, std::memory_order_relaxed);
+}
+
+std::string StratumProxy::str()
+{
+    std::stringstream ss;
+    ss << "Proxy " << m_miners.load(std::memory_order_relaxed) << " miners "
+       << getFormattedHashes(double(m_hashrate.load(std::memory_order_relaxed))) << " A"
+       << m_accepted.load(std::memory_order_relaxed) << " R"
+       << m_rejected.load(std::memory_order_relaxed) << " I"
+       << m_invalid.load(std::memory_order_relaxed) << " in "
+       << m_batches.load(std::memory_order_relaxed) << " batches";
+    return ss.str();
+}
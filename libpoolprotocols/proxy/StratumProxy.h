@@ -0,0 +1,194 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include <json/json.h>
+
+#include <libethcore/EthashAux.h>
+#include <libethcore/SolutionVerifier.h>
+
+#include "../stratum/StratumParser.h"
+
+extern boost::asio::io_service g_io_service;
+
+namespace dev
+{
+namespace eth
+{
+class StratumProxy;
+
+/**
+ * @brief A downstream miner connected to the proxy
+ *
+ * Speaks the EthereumStratum/1.0.0 (NiceHash) flavour ethminer selects with
+ * stratum2+tcp:// and owns a slot of the upstream nonce space. Runs on the
+ * proxy's strand.
+ */
+class ProxySession : public std::enable_shared_from_this<ProxySession>
+{
+public:
+    ProxySession(StratumProxy& _proxy, unsigned _slot);
+
+    void start();
+    void disconnect();
+
+    // Queues a line for the miner. Lines shared by all sessions are not copied
+    void send(std::shared_ptr<const std::string> _line);
+    void send(Json::Value const& _msg);
+
+    // Answers the oldest submission still waiting for the upstream pool
+    void answer(bool _accepted, std::string const& _reason = "");
+
+    boost::asio::ip::tcp::socket& socket() { return m_socket; }
+    unsigned slot() const { return m_slot; }
+    bool subscribed() const { return m_subscribed; }
+    bool authorized() const { return m_authorized; }
+    std::string const& worker() const { return m_worker; }
+    uint64_t hashrate() const { return m_hashrate; }
+
+private:
+    friend class StratumProxy;
+
+    void recvSocketData();
+    void onRecvSocketDataCompleted(const boost::system::error_code& ec);
+    void sendSocketData();
+    void onSendSocketDataCompleted(const boost::system::error_code& ec);
+    void processRequest(Json::Value& _req);
+    void reply(Json::Value const& _id, Json::Value const& _result);
+    void replyError(Json::Value const& _id, int _code, std::string const& _message);
+
+    StratumProxy& m_proxy;
+    unsigned m_slot;
+
+    boost::asio::ip::tcp::socket m_socket;
+    std::string m_endpoint;
+    boost::asio::streambuf m_recvBuffer;
+    size_t m_recvScanned = 0;
+    StratumParser m_parser;
+    Json::StreamWriterBuilder m_jSwBuilder;
+
+    std::deque<std::shared_ptr<const std::string>> m_txQueue;
+    std::vector<std::shared_ptr<const std::string>> m_txLines;  // Lines being written
+    std::vector<boost::asio::const_buffer> m_txBuffers;
+    bool m_txPending = false;
+
+    std::deque<Json::Value> m_submitted;  // Ids of submissions waiting for the pool
+
+    bool m_subscribed = false;
+    bool m_authorized = false;
+    std::string m_worker;
+    uint64_t m_hashrate = 0;  // As reported by the miner
+};
+
+/**
+ * @brief Serves the upstream pool's work to local ethminer instances
+ *
+ * The upstream session is kept by PoolManager (with its failover). Each
+ * downstream miner gets the upstream extranonce extended by a slot of its
+ * own, so miners never search each other's nonces. Shares are checked
+ * against the upstream boundary by a verifier thread, off the strand, and
+ * forwarded upstream in batches: those collected within the batch window
+ * are submitted together, in one write.
+ */
+class StratumProxy
+{
+public:
+    using SolutionForward = std::function<bool(std::vector<Solution> const&)>;
+
+    StratumProxy(std::string _address, unsigned _port, unsigned _batchWindow);
+
+    bool isRunning() { return m_running.load(std::memory_order_relaxed); }
+    void start();
+    void stop();
+
+    // Called with each batch of shares to submit upstream. Returns false if it can't
+    void onSolution(SolutionForward const& _handler) { m_onSolution = _handler; }
+
+    // Interface with PoolManager
+    void setWork(WorkPackage const& _wp);
+    void upstreamDisconnected();
+    void solutionAnswered(unsigned _slot, bool _accepted);
+
+    uint64_t hashRate() { return m_hashrate.load(std::memory_order_relaxed); }
+    std::string str();
+
+    // Downstream miners occupy slots 1 and above of the upstream nonce space
+    static const unsigned c_slotChars = 4;    // Hex chars of extranonce appended per slot
+    static const unsigned c_maxUpstream = 8;  // Max upstream extranonce chars we can split
+
+private:
+    friend class ProxySession;
+
+    struct ProxyJob
+    {
+        std::string id;
+        WorkPackage wp;  // As received from upstream
+    };
+
+    // A share handed to the verifier, waiting for its check
+    struct ShareCheck
+    {
+        std::shared_ptr<ProxySession> session;
+        Json::Value id;
+    };
+
+    void begin_accept();
+    void handle_accept(std::shared_ptr<ProxySession> _session, boost::system::error_code ec);
+    void removeSession(ProxySession* _session);
+    unsigned freeSlot();
+
+    // Called by sessions, on the strand
+    std::string extranonce(unsigned _slot);
+    void sendWork(ProxySession& _session);
+    void submit(ProxySession& _session, Json::Value const& _id, std::string const& _job,
+        std::string const& _nonce);
+    void shareChecked(Solution const& _s, bool _valid);
+    void updateHashRate();
+
+    void batchtimer_elapsed(const boost::system::error_code& ec);
+    void flush();
+
+    std::string m_address;
+    unsigned m_port;
+    unsigned m_batchWindow;  // Milliseconds shares are held to be sent together
+
+    std::atomic<bool> m_running = {false};
+    boost::asio::ip::tcp::acceptor m_acceptor;
+    boost::asio::io_service::strand m_io_strand;
+    boost::asio::deadline_timer m_batchtimer;
+
+    std::map<unsigned, std::shared_ptr<ProxySession>> m_sessions;
+    unsigned m_nextSlot = 1;
+
+    WorkPackage m_upstream;
+    std::deque<ProxyJob> m_jobs;  // Most recent last
+    unsigned m_jobSeq = 0;
+    std::shared_ptr<const std::string> m_notify;      // Current job, shared by all sessions
+    std::shared_ptr<const std::string> m_difficulty;  // Current mining.set_difficulty
+    Json::StreamWriterBuilder m_jSwBuilder;
+
+    std::deque<ShareCheck> m_checking;  // In the order shares were handed to the verifier
+    std::vector<Solution> m_batch;
+    bool m_flushPending = false;
+    SolutionForward m_onSolution;
+
+    std::atomic<unsigned> m_miners = {0};
+    std::atomic<uint64_t> m_hashrate = {0};
+    std::atomic<uint64_t> m_accepted = {0};
+    std::atomic<uint64_t> m_rejected = {0};
+    std::atomic<uint64_t> m_invalid = {0};
+    std::atomic<uint64_t> m_batches = {0};
+
+    SolutionVerifier m_verifier;  // Last: its thread stops before the rest goes
+};
+
+}  // namespace eth
+}  // namespace dev
@@ -1,4 +1,5 @@
 #include <ethminer/buildinfo.h>
+#include <libdevcore/LatencyTrace.h>
 #include <libdevcore/Log.h>
 #include <ethash/ethash.hpp>
 
@@ -11,6 +12,65 @@
 
 using boost::asio::ip::tcp;
 
+namespace
+{
+const size_t c_txLines = 64;         // Lines which can wait for transmission
+const size_t c_txLineReserve = 512;  // Fits any submission
+
+// Allocation free formatting of submissions
+const char c_hexDigits[] = "0123456789abcdef";
+
+void appendHex(std::string& _s, const uint8_t* _data, size_t _size)
+{
+    for (size_t i = 0; i < _size; i++)
+    {
+        _s.push_back(c_hexDigits[_data[i] >> 4]);
+        _s.push_back(c_hexDigits[_data[i] & 0x0f]);
+    }
+}
+
+// 16 digits, as toHex(uint64_t)
+void appendHex(std::string& _s, uint64_t _n, size_t _skip = 0)
+{
+    for (size_t i = _skip; i < 16; i++)
+        _s.push_back(c_hexDigits[(_n >> (60 - i * 4)) & 0x0f]);
+}
+
+void appendUInt(std::string& _s, unsigned _n)
+{
+    char digits[10];
+    size_t count = 0;
+    do
+        digits[count++] = char('0' + _n % 10);
+    while (_n /= 10);
+    while (count)
+        _s.push_back(digits[--count]);
+}
+
+void appendJsonString(std::string& _s, const std::string& _value)
+{
+    _s.push_back('"');
+    for (char c : _value)
+    {
+        if (c == '"' || c == '\\')
+        {
+            _s.push_back('\\');
+            _s.push_back(c);
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            _s.append("\\u00");
+            _s.push_back(c_hexDigits[(c >> 4) & 0x0f]);
+            _s.push_back(c_hexDigits[c & 0x0f]);
+        }
+        else
+            _s.push_back(c);
+    }
+    _s.push_back('"');
+}
+
+}  // namespace
+
 EthStratumClient::EthStratumClient(int worktimeout, int responsetimeout)
   : PoolClient(),
     m_worktimeout(worktimeout),
@@ -20,12 +80,22 @@ EthStratumClient::EthStratumClient(int worktimeout, int responsetimeout)
     m_socket(nullptr),
     m_workloop_timer(g_io_service),
     m_response_plea_times(64),
-    m_txQueue(64),
+    m_txQueue(c_txLines),
+    m_txFree(c_txLines),
     m_resolver(g_io_service),
     m_endpoints()
 {
     m_jSwBuilder.settings_["indentation"] = "";
 
+    m_txLines.reserve(c_txLines);
+    m_txBuffers.reserve(c_txLines);
+    for (size_t i = 0; i < c_txLines / 4; i++)
+    {
+        TxLine* line = new TxLine;
+        line->text.reserve(c_txLineReserve);
+        m_txFree.push(line);
+    }
+
     // Initialize workloop_timer to infinite wait
     m_workloop_timer.expires_at(boost::posix_time::pos_infin);
     m_workloop_timer.async_wait(m_io_strand.wrap(boost::bind(
@@ -34,6 +104,14 @@ EthStratumClient::EthStratumClient(int worktimeout, int responsetimeout)
 }
 
 
+EthStratumClient::~EthStratumClient()
+{
+    for (TxLine* l : m_txLines)
+        delete l;
+    m_txQueue.consume_all([](TxLine* l) { delete l; });
+    m_txFree.consume_all([](TxLine* l) { delete l; });
+}
+
 void EthStratumClient::init_socket()
 {
     // Prepare Socket
@@ -244,9 +322,14 @@ void EthStratumClient::disconnect_finalize()
         m_conn->addDuration(m_session->duration());
     m_session = nullptr;
 
+    if (m_recorder && m_recSession)
+        m_recorder->end(m_recSession);
+    m_recSession = 0;
+
     m_authpending.store(false, std::memory_order_relaxed);
     m_disconnecting.store(false, std::memory_order_relaxed);
     m_txPending.store(false, std::memory_order_relaxed);
+    m_submitMode.store(-1, std::memory_order_relaxed);
 
     if (!m_conn->IsUnrecoverable())
     {
@@ -508,10 +591,11 @@ void EthStratumClient::connect_handler(const boost::system::error_code& ec)
     m_conn->Responds(true);
     m_connected.store(true, memory_order_relaxed);
 
-    m_message.clear();
+    m_recvBuffer.consume(m_recvBuffer.size());
+    m_recvScanned = 0;
 
     // Clear txqueue
-    m_txQueue.consume_all([](std::string* l) { delete l; });
+    m_txQueue.consume_all([this](TxLine* l) { recycleTxLine(l); });
 
 #ifdef DEV_BUILD
     if (g_logOptions & LOG_CONNECT)
@@ -569,8 +653,6 @@ void EthStratumClient::connect_handler(const boost::system::error_code& ec)
         m_nonsecuresocket->set_option(tcp::no_delay(true));
     }
 
-    // Clean buffer from any previous stale data
-    m_sendBuffer.consume(4096);
     clear_response_pleas();
 
     /*
@@ -643,6 +725,9 @@ void EthStratumClient::connect_handler(const boost::system::error_code& ec)
         break;
     }
 
+    if (m_recorder)
+        m_recSession = m_recorder->begin(ProtocolFamily::STRATUM, m_conn->StratumMode());
+
     // Begin receive data
     recvSocketData();
 
@@ -1589,67 +1674,124 @@ void EthStratumClient::submitHashrate(uint64_t const& rate, string const& id)
     send(jReq);
 }
 
+void EthStratumClient::prepareSubmitTemplate()
+{
+    int mode = m_conn->StratumMode();
+    m_submitHead.clear();
+    m_submitTail = "]";
+
+    switch (mode)
+    {
+    case EthStratumClient::STRATUM:
+        m_submitHead = ",\"jsonrpc\":\"2.0\",\"method\":\"mining.submit\",\"params\":[";
+        appendJsonString(m_submitHead, m_conn->User());
+        m_submitHead.push_back(',');
+        break;
+    case EthStratumClient::ETHPROXY:
+        m_submitHead = ",\"method\":\"eth_submitWork\",\"params\":[";
+        break;
+    case EthStratumClient::ETHEREUMSTRATUM:
+        m_submitHead = ",\"method\":\"mining.submit\",\"params\":[";
+        appendJsonString(m_submitHead, m_conn->UserDotWorker());
+        m_submitHead.push_back(',');
+        break;
+    case EthStratumClient::ETHEREUMSTRATUM2:
+        m_submitHead = ",\"method\":\"mining.submit\",\"params\":[";
+        break;
+    }
+
+    if ((mode == EthStratumClient::STRATUM || mode == EthStratumClient::ETHPROXY) &&
+        !m_conn->Workername().empty())
+    {
+        m_submitTail.append(",\"worker\":");
+        appendJsonString(m_submitTail, m_conn->Workername());
+    }
+    m_submitTail.append("}\n");
+
+    m_submitMode.store(mode, std::memory_order_relaxed);
+}
+
 void EthStratumClient::submitSolution(const Solution& solution)
+{
+    TxLine* line = submitLine(solution);
+    if (line)
+        send(line);
+}
+
+void EthStratumClient::submitSolutions(const std::vector<Solution>& solutions)
+{
+    // Queue them all before the write is started so they go out together
+    for (auto const& s : solutions)
+    {
+        TxLine* line = submitLine(s);
+        if (line)
+            m_txQueue.push(line);
+    }
+
+    bool ex = false;
+    if (m_txPending.compare_exchange_strong(ex, true, std::memory_order_relaxed))
+        sendSocketData();
+}
+
+EthStratumClient::TxLine* EthStratumClient::submitLine(const Solution& solution)
 {
     if (!isAuthorized())
     {
         cwarn << "Solution not submitted. Not authorized.";
-        return;
+        return nullptr;
     }
 
-    Json::Value jReq;
+    int mode = m_conn->StratumMode();
+    if (m_submitMode.load(std::memory_order_relaxed) != mode)
+        prepareSubmitTemplate();
 
     unsigned id = 40 + solution.midx;
-    jReq["id"] = id;
     m_solution_submitted_max_id = max(m_solution_submitted_max_id, id);
-    jReq["method"] = "mining.submit";
-    jReq["params"] = Json::Value(Json::arrayValue);
 
-    switch (m_conn->StratumMode())
+    // Fill the session's template. Same message the Json::Value based
+    // formatting would produce
+    TxLine* line = txLine();
+    line->text.append("{\"id\":");
+    appendUInt(line->text, id);
+    line->text.append(m_submitHead);
+
+    size_t exSize = std::min<size_t>(solution.work.exSizeBytes, 16);
+    switch (mode)
     {
     case EthStratumClient::STRATUM:
-
-        jReq["jsonrpc"] = "2.0";
-        jReq["params"].append(m_conn->User());
-        jReq["params"].append(solution.work.job);
-        jReq["params"].append(toHex(solution.nonce, HexPrefix::Add));
-        jReq["params"].append(solution.work.header.hex(HexPrefix::Add));
-        jReq["params"].append(solution.mixHash.hex(HexPrefix::Add));
-        if (!m_conn->Workername().empty())
-            jReq["worker"] = m_conn->Workername();
-
-        break;
-
+        appendJsonString(line->text, solution.work.job);
+        line->text.push_back(',');
+        // Fall through
     case EthStratumClient::ETHPROXY:
-
-        jReq["method"] = "eth_submitWork";
-        jReq["params"].append(toHex(solution.nonce, HexPrefix::Add));
-        jReq["params"].append(solution.work.header.hex(HexPrefix::Add));
-        jReq["params"].append(solution.mixHash.hex(HexPrefix::Add));
-        if (!m_conn->Workername().empty())
-            jReq["worker"] = m_conn->Workername();
-
+        line->text.append("\"0x");
+        appendHex(line->text, solution.nonce);
+        line->text.append("\",\"0x");
+        appendHex(line->text, solution.work.header.data(), solution.work.header.size);
+        line->text.append("\",\"0x");
+        appendHex(line->text, solution.mixHash.data(), solution.mixHash.size);
+        line->text.push_back('"');
         break;
 
     case EthStratumClient::ETHEREUMSTRATUM:
-
-        jReq["params"].append(m_conn->UserDotWorker());
-        jReq["params"].append(solution.work.job);
-        jReq["params"].append(
-            toHex(solution.nonce, HexPrefix::DontAdd).substr(solution.work.exSizeBytes));
+        appendJsonString(line->text, solution.work.job);
+        line->text.append(",\"");
+        appendHex(line->text, solution.nonce, exSize);
+        line->text.push_back('"');
         break;
-        
-    case EthStratumClient::ETHEREUMSTRATUM2:
 
-        jReq["params"].append(solution.work.job);
-        jReq["params"].append(
-            toHex(solution.nonce, HexPrefix::DontAdd).substr(solution.work.exSizeBytes));
-        jReq["params"].append(m_session->workerId);
-        break;        
+    case EthStratumClient::ETHEREUMSTRATUM2:
+        appendJsonString(line->text, solution.work.job);
+        line->text.append(",\"");
+        appendHex(line->text, solution.nonce, exSize);
+        line->text.append("\",");
+        appendJsonString(line->text, m_session->workerId);
+        break;
     }
+    line->text.append(m_submitTail);
 
-    enqueue_response_plea();
-    send(jReq);
+    // Timed once written, see onSendSocketDataCompleted
+    line->found = solution.tstamp;
+    return line;
 }
 
 void EthStratumClient::recvSocketData()
@@ -1678,81 +1820,54 @@ void EthStratumClient::onRecvSocketDataCompleted(
 
     if (!ec)
     {
-        // DO NOT DO THIS !!!!!
-        // std::istream is(&m_recvBuffer);
-        // std::string message;
-        // getline(is, message)
-        /*
-        There are three reasons :
-        1 - Previous async_read_until calls this handler (aside from error codes)
-            with the number of bytes in the buffer's get area up to and including
-            the delimiter. So we know where to split the line
-        2 - Boost's documentation clearly states that after a succesfull
-            async_read_until operation the stream buffer MAY contain additional
-            data which HAVE to be left in the buffer for subsequent read operations.
-            If another delimiter exists in the buffer then it will get caught
-            by the next async_read_until()
-        3 - std::istream is(&m_recvBuffer) will CONSUME ALL data in the buffer
-            thus invalidating the previous point 2
-        */
+        const auto received = std::chrono::steady_clock::now();
+        (void)bytes_transferred;  // Already in m_recvBuffer, partial line included
 
-        // Extract received message and free the buffer
-        std::string rx_message(
-            boost::asio::buffer_cast<const char*>(m_recvBuffer.data()), bytes_transferred);
-        m_recvBuffer.consume(bytes_transferred);
-        m_message.append(rx_message);
-
-        // Process each line in the transmission
+        // Frame lines in place over the receive buffer. A trailing partial
+        // line stays there (and is not scanned again) till the rest arrives
         // NOTE : as multiple jobs may come in with
         // a single transmission only the last will be dispatched
         m_newjobprocessed = false;
-        std::string line;
-        size_t offset = m_message.find("\n");
-        while (offset != string::npos)
-        {
-            if (offset > 0)
-            {
-                line = m_message.substr(0, offset);
-                boost::trim(line);
-
-                if (!line.empty())
+        size_t consumed = StratumParser::frame(
+            boost::asio::buffer_cast<const char*>(m_recvBuffer.data()), m_recvBuffer.size(),
+            m_recvScanned, [&](const char* _begin, const char* _end) {
+                // Out received message only for debug purpouses
+                if (g_logOptions & LOG_JSON)
+                    cnote << " << " << std::string(_begin, _end);
+                if (m_recorder)
+                    m_recorder->received(m_recSession, _begin, _end);
+
+                // Test validity of chunk and process
+                Json::Value jMsg;
+                std::string what;
+                if (m_parser.parse(_begin, _end, jMsg, what))
                 {
-                    // Out received message only for debug purpouses
-                    if (g_logOptions & LOG_JSON)
-                        cnote << " << " << line;
-
-                    // Test validity of chunk and process
-                    Json::Value jMsg;
-                    Json::Reader jRdr;
-                    if (jRdr.parse(line, jMsg))
+                    try
                     {
-                        try
-                        {
-                            // Run in sync so no 2 different async reads may overlap
-                            processResponse(jMsg);
-                        }
-                        catch (const std::exception& _ex)
-                        {
-                            cwarn << "Stratum got invalid Json message : " << _ex.what();
-                        }
+                        // Run in sync so no 2 different async reads may overlap
+                        processResponse(jMsg);
                     }
-                    else
+                    catch (const std::exception& _ex)
                     {
-                        string what = jRdr.getFormattedErrorMessages();
-                        boost::replace_all(what, "\n", " ");
-                        cwarn << "Stratum got invalid Json message : " << what;
+                        cwarn << "Stratum got invalid Json message : " << _ex.what();
                     }
                 }
-            }
-
-            m_message.erase(0, offset + 1);
-            offset = m_message.find("\n");
-        }
+                else
+                {
+                    boost::replace_all(what, "\n", " ");
+                    cwarn << "Stratum got invalid Json message : " << what;
+                }
+            });
+        m_recvBuffer.consume(consumed);
 
         // There is a new job - dispatch it
         if (m_newjobprocessed)
+        {
+            m_current.tstamp = received;
+            LatencyTrace::record(TraceStage::WorkParsed, received);
             if (m_onWorkReceived)
                 m_onWorkReceived(m_current);
+        }
 
         // Eventually keep reading from socket
         if (isConnected())
@@ -1787,10 +1902,35 @@ void EthStratumClient::onRecvSocketDataCompleted(
     }
 }
 
+EthStratumClient::TxLine* EthStratumClient::txLine()
+{
+    TxLine* line;
+    if (!m_txFree.pop(line))
+    {
+        line = new TxLine;
+        line->text.reserve(c_txLineReserve);
+    }
+    return line;
+}
+
+void EthStratumClient::recycleTxLine(TxLine* _line)
+{
+    _line->text.clear();
+    _line->found = std::chrono::steady_clock::time_point();
+    if (!m_txFree.bounded_push(_line))
+        delete _line;
+}
+
 void EthStratumClient::send(Json::Value const& jReq)
 {
-    std::string* line = new std::string(Json::writeString(m_jSwBuilder, jReq));
-    m_txQueue.push(line);
+    TxLine* line = txLine();
+    line->text.append(Json::writeString(m_jSwBuilder, jReq)).push_back('\n');
+    send(line);
+}
+
+void EthStratumClient::send(TxLine* _line)
+{
+    m_txQueue.push(_line);
 
     bool ex = false;
     if (m_txPending.compare_exchange_strong(ex, true, std::memory_order_relaxed))
@@ -1799,35 +1939,44 @@ void EthStratumClient::send(Json::Value const& jReq)
 
 void EthStratumClient::sendSocketData()
 {
+    // Lines of a write which never completed
+    for (TxLine* l : m_txLines)
+        recycleTxLine(l);
+    m_txLines.clear();
+    m_txBuffers.clear();
+
     if (!isConnected() || m_txQueue.empty())
     {
-        m_sendBuffer.consume(m_sendBuffer.capacity());
-        m_txQueue.consume_all([](std::string* l) { delete l; });
+        m_txQueue.consume_all([this](TxLine* l) { recycleTxLine(l); });
         m_txPending.store(false, std::memory_order_relaxed);
         return;
     }
 
-    std::string* line;
-    std::ostream os(&m_sendBuffer);
-    while (m_txQueue.pop(line))
+    // Gather all queued lines in a single write
+    TxLine* line;
+    while (m_txLines.size() < c_txLines && m_txQueue.pop(line))
     {
-        os << *line << std::endl;
+        const std::string& text = line->text;
+
         // Out received message only for debug purpouses
         if (g_logOptions & LOG_JSON)
-            cnote << " >> " << *line;
+            cnote << " >> " << text.substr(0, text.size() - 1);
+        if (m_recorder)
+            m_recorder->sent(m_recSession, text.data(), text.data() + text.size() - 1);
 
-        delete line;
+        m_txLines.push_back(line);
+        m_txBuffers.push_back(boost::asio::buffer(text));
     }
 
     if (m_conn->SecLevel() != SecureLevel::NONE)
     {
-        async_write(*m_securesocket, m_sendBuffer,
+        async_write(*m_securesocket, m_txBuffers,
             m_io_strand.wrap(boost::bind(&EthStratumClient::onSendSocketDataCompleted, this,
                 boost::asio::placeholders::error)));
     }
     else
     {
-        async_write(*m_nonsecuresocket, m_sendBuffer,
+        async_write(*m_nonsecuresocket, m_txBuffers,
             m_io_strand.wrap(boost::bind(&EthStratumClient::onSendSocketDataCompleted, this,
                 boost::asio::placeholders::error)));
     }
@@ -1835,10 +1984,22 @@ void EthStratumClient::sendSocketData()
 
 void EthStratumClient::onSendSocketDataCompleted(const boost::system::error_code& ec)
 {
+    for (TxLine* l : m_txLines)
+    {
+        // Submissions are out: the pool's response is timed from now on
+        if (!ec && l->found != std::chrono::steady_clock::time_point())
+        {
+            LatencyTrace::record(TraceStage::SolutionSent, l->found);
+            enqueue_response_plea();
+        }
+        recycleTxLine(l);
+    }
+    m_txLines.clear();
+    m_txBuffers.clear();
+
     if (ec)
     {
-        m_sendBuffer.consume(m_sendBuffer.capacity());
-        m_txQueue.consume_all([](std::string* l) { delete l; });
+        m_txQueue.consume_all([this](TxLine* l) { recycleTxLine(l); });
         m_txPending.store(false, std::memory_order_relaxed);
 
         if ((ec.category() == boost::asio::error::get_ssl_category()) &&
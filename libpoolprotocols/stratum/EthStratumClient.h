@@ -17,6 +17,7 @@
 #include <libethcore/Miner.h>
 
 #include "../PoolClient.h"
+#include "StratumParser.h"
 
 using namespace std;
 using namespace dev;
@@ -60,6 +61,7 @@ public:
     };
 
     EthStratumClient(int worktimeout, int responsetimeout);
+    ~EthStratumClient();
 
     void init_socket();
     void connect() override;
@@ -79,6 +81,7 @@ public:
 
     void submitHashrate(uint64_t const& rate, string const& id) override;
     void submitSolution(const Solution& solution) override;
+    void submitSolutions(const std::vector<Solution>& solutions) override;
 
     h256 currentHeaderHash() { return m_current.header; }
     bool current() { return static_cast<bool>(m_current); }
@@ -102,7 +105,19 @@ private:
     void recvSocketData();
     void onRecvSocketDataCompleted(
         const boost::system::error_code& ec, std::size_t bytes_transferred);
+    // A line to transmit (newline terminated)
+    struct TxLine
+    {
+        std::string text;
+        std::chrono::steady_clock::time_point found;  // Of the solution it submits, if any
+    };
+
+    TxLine* txLine();
+    void recycleTxLine(TxLine* _line);
+    void prepareSubmitTemplate();
+    TxLine* submitLine(const Solution& solution);
     void send(Json::Value const& jReq);
+    void send(TxLine* _line);
     void sendSocketData();
     void onSendSocketDataCompleted(const boost::system::error_code& ec);
     void onSSLShutdownCompleted(const boost::system::error_code& ec);
@@ -126,7 +141,8 @@ private:
     boost::asio::io_service& m_io_service;  // The IO service reference passed in the constructor
     boost::asio::io_service::strand m_io_strand;
     boost::asio::ip::tcp::socket* m_socket;
-    std::string m_message;  // The internal message string buffer
+    StratumParser m_parser;
+    size_t m_recvScanned = 0;  // Bytes of m_recvBuffer known not to hold a delimiter
     bool m_newjobprocessed = false;
 
     // Use shared ptrs to avoid crashes due to async_writes
@@ -135,7 +151,6 @@ private:
     std::shared_ptr<boost::asio::ssl::stream<boost::asio::ip::tcp::socket>> m_securesocket;
     std::shared_ptr<boost::asio::ip::tcp::socket> m_nonsecuresocket;
 
-    boost::asio::streambuf m_sendBuffer;
     boost::asio::streambuf m_recvBuffer;
     Json::StreamWriterBuilder m_jSwBuilder;
 
@@ -145,8 +160,19 @@ private:
     std::atomic<std::chrono::steady_clock::duration> m_response_plea_older;
     boost::lockfree::queue<std::chrono::steady_clock::time_point> m_response_plea_times;
 
+    // Lines to transmit (newline terminated). They're recycled through m_txFree
+    // once written, so sending costs no allocation once their capacity settled
     std::atomic<bool> m_txPending = {false};
-    boost::lockfree::queue<std::string*> m_txQueue;
+    boost::lockfree::queue<TxLine*> m_txQueue;
+    boost::lockfree::queue<TxLine*> m_txFree;
+    std::vector<TxLine*> m_txLines;                      // Being written
+    std::vector<boost::asio::const_buffer> m_txBuffers;  // Gathered by the write
+
+    // Submission template of the session: what surrounds the values
+    // of each solution. Rebuilt on connection and stratum mode changes
+    std::atomic<int> m_submitMode = {-1};
+    std::string m_submitHead;
+    std::string m_submitTail;
 
     boost::asio::ip::tcp::resolver m_resolver;
     std::queue<boost::asio::ip::basic_endpoint<boost::asio::ip::tcp>> m_endpoints;
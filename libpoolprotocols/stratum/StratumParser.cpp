@@ -0,0 +1,289 @@
+#include <chrono>
+#include <iomanip>
+#include <limits>
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+
+#include "StratumParser.h"
+
+using namespace std;
+
+namespace
+{
+/**
+ * Parses the subset of json pools send on the hot path: an object whose
+ * members are scalars, or arrays / objects of scalars. Strings with escapes,
+ * non integer numbers and deeper nesting are left to jsoncpp
+ */
+class FastReader
+{
+public:
+    FastReader(const char* _begin, const char* _end) : m_p(_begin), m_end(_end) {}
+
+    bool parse(Json::Value& _root)
+    {
+        if (!consume('{') || !members(_root, 1))
+            return false;
+        skipSpaces();
+        return m_p == m_end;
+    }
+
+private:
+    static const unsigned c_maxDepth = 2;  // Root object and its members
+
+    void skipSpaces()
+    {
+        while (m_p < m_end && (*m_p == ' ' || *m_p == '\t' || *m_p == '\r' || *m_p == '\n'))
+            m_p++;
+    }
+
+    bool consume(char _c)
+    {
+        skipSpaces();
+        if (m_p == m_end || *m_p != _c)
+            return false;
+        m_p++;
+        return true;
+    }
+
+    bool string(const char*& _begin, const char*& _end)
+    {
+        if (!consume('"'))
+            return false;
+        _begin = m_p;
+        while (m_p < m_end && *m_p != '"')
+        {
+            if (*m_p == '\\' || static_cast<unsigned char>(*m_p) < 0x20)
+                return false;
+            m_p++;
+        }
+        if (m_p == m_end)
+            return false;
+        _end = m_p++;
+        return true;
+    }
+
+    bool literal(const char* _literal, size_t _length)
+    {
+        if (size_t(m_end - m_p) < _length || memcmp(m_p, _literal, _length) != 0)
+            return false;
+        m_p += _length;
+        return true;
+    }
+
+    bool number(Json::Value& _value)
+    {
+        bool negative = (*m_p == '-');
+        if (negative)
+            m_p++;
+        const char* digits = m_p;
+        uint64_t n = 0;
+        while (m_p < m_end && *m_p >= '0' && *m_p <= '9')
+        {
+            if (n > (numeric_limits<uint64_t>::max() - 9) / 10)
+                return false;
+            n = n * 10 + uint64_t(*m_p++ - '0');
+        }
+        if (m_p == digits || (m_p < m_end && (*m_p == '.' || *m_p == 'e' || *m_p == 'E')))
+            return false;
+
+        // Same types jsoncpp decodes to
+        if (negative)
+        {
+            if (n > uint64_t(numeric_limits<Json::Value::LargestInt>::max()) + 1)
+                return false;
+            _value = n ? Json::Value::LargestInt(-Json::Value::LargestInt(n - 1) - 1) : 0;
+        }
+        else if (n <= Json::Value::LargestUInt(Json::Value::maxInt))
+            _value = Json::Value::LargestInt(n);
+        else
+            _value = Json::Value::LargestUInt(n);
+        return true;
+    }
+
+    bool value(Json::Value& _value, unsigned _depth)
+    {
+        skipSpaces();
+        if (m_p == m_end)
+            return false;
+        switch (*m_p)
+        {
+        case '"':
+        {
+            const char *begin, *end;
+            if (!string(begin, end))
+                return false;
+            _value = Json::Value(begin, end);
+            return true;
+        }
+        case '{':
+            m_p++;
+            _value = Json::Value(Json::objectValue);
+            return _depth < c_maxDepth && members(_value, _depth + 1);
+        case '[':
+            m_p++;
+            _value = Json::Value(Json::arrayValue);
+            return _depth < c_maxDepth && elements(_value, _depth + 1);
+        case 't':
+            _value = true;
+            return literal("true", 4);
+        case 'f':
+            _value = false;
+            return literal("false", 5);
+        case 'n':
+            _value = Json::Value::null;
+            return literal("null", 4);
+        default:
+            return number(_value);
+        }
+    }
+
+    // Members of an object, its opening brace already consumed
+    bool members(Json::Value& _object, unsigned _depth)
+    {
+        if (consume('}'))
+            return true;
+        do
+        {
+            const char *begin, *end;
+            if (!string(begin, end) || !consume(':') ||
+                !value(_object[std::string(begin, end)], _depth))
+                return false;
+        } while (consume(','));
+        return consume('}');
+    }
+
+    // Elements of an array, its opening bracket already consumed
+    bool elements(Json::Value& _array, unsigned _depth)
+    {
+        if (consume(']'))
+            return true;
+        do
+        {
+            if (!value(_array.append(Json::Value()), _depth))
+                return false;
+        } while (consume(','));
+        return consume(']');
+    }
+
+    const char* m_p;
+    const char* m_end;
+};
+
+}  // namespace
+
+
+StratumParser::StratumParser()
+{
+    Json::CharReaderBuilder builder;
+    m_reader.reset(builder.newCharReader());
+}
+
+bool StratumParser::parse(const char* _begin, const char* _end, Json::Value& _msg, string& _error)
+{
+    if (FastReader(_begin, _end).parse(_msg))
+    {
+        m_fastParsed++;
+        return true;
+    }
+
+    m_slowParsed++;
+    _msg = Json::Value();
+    return m_reader->parse(_begin, _end, &_msg, &_error);
+}
+
+void StratumParser::benchmark(istream& _traffic, ostream& _out)
+{
+    // Rebuild the stream of messages as received from the pool
+    string traffic;
+    string line;
+    size_t messages = 0;
+    while (getline(_traffic, line))
+    {
+        size_t pos = line.find(" << ");
+        if (pos != string::npos)
+            line.erase(0, pos + 4);
+        else if (!line.empty() && line[0] == '<')
+        {
+            // Received line of a session recording: "<session us message"
+            pos = line.find(' ', line.find(' ') + 1);
+            line.erase(0, pos == string::npos ? line.size() : pos + 1);
+        }
+        boost::trim(line);
+        if (line.empty() || line[0] != '{')
+            continue;
+        traffic.append(line).append("\n");
+        messages++;
+    }
+    if (!messages)
+    {
+        _out << "No messages found" << endl;
+        return;
+    }
+
+    // Repeat to get meaningful timings
+    const size_t rounds = max<size_t>(1, 200000 / messages);
+    _out << messages << " messages, " << traffic.size() << " bytes, " << rounds << " rounds"
+         << endl;
+
+    // Reads of a single tcp segment, then bursts as after a stall
+    for (size_t readSize : {size_t(1460), size_t(65536)})
+    {
+        size_t legacyParsed = 0;
+        auto start = chrono::steady_clock::now();
+        for (size_t r = 0; r < rounds; r++)
+        {
+            string message;
+            for (size_t offset = 0; offset < traffic.size(); offset += readSize)
+            {
+                string rx(traffic, offset, readSize);
+                message.append(rx);
+                size_t nl = message.find("\n");
+                while (nl != string::npos)
+                {
+                    string msg = message.substr(0, nl);
+                    boost::trim(msg);
+                    Json::Value jMsg;
+                    Json::Reader jRdr;
+                    if (!msg.empty() && jRdr.parse(msg, jMsg))
+                        legacyParsed++;
+                    message.erase(0, nl + 1);
+                    nl = message.find("\n");
+                }
+            }
+        }
+        auto legacy = chrono::steady_clock::now() - start;
+
+        size_t parsed = 0;
+        StratumParser parser;
+        start = chrono::steady_clock::now();
+        for (size_t r = 0; r < rounds; r++)
+        {
+            string buffer;
+            size_t scanned = 0;
+            for (size_t offset = 0; offset < traffic.size(); offset += readSize)
+            {
+                buffer.append(traffic, offset, readSize);
+                size_t consumed = frame(
+                    buffer.data(), buffer.size(), scanned, [&](const char* _b, const char* _e) {
+                        Json::Value jMsg;
+                        string error;
+                        if (parser.parse(_b, _e, jMsg, error))
+                            parsed++;
+                    });
+                buffer.erase(0, consumed);
+            }
+        }
+        auto current = chrono::steady_clock::now() - start;
+
+        double total = double(messages * rounds);
+        double legacyUs = chrono::duration<double, micro>(legacy).count() / total;
+        double currentUs = chrono::duration<double, micro>(current).count() / total;
+        _out << "Reads of " << setw(5) << readSize << " bytes : legacy " << fixed
+             << setprecision(3) << legacyUs << " us/msg (" << legacyParsed << " parsed), framed "
+             << currentUs << " us/msg (" << parsed << " parsed, "
+             << (parser.fastParsed() * 100 / max<uint64_t>(1, parsed)) << "% fast), x"
+             << setprecision(2) << legacyUs / max(currentUs, 1e-9) << endl;
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cctype>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include <json/json.h>
+
+/**
+ * @brief Frames and parses the newline delimited json messages of stratum
+ *
+ * Lines are framed in place over the receive buffer. Messages are parsed by a
+ * specialized parser covering what pools send on the hot path (flat objects
+ * whose members are scalars, or arrays and objects of scalars, as in
+ * mining.notify, mining.set and submission responses). Anything else is
+ * handed to jsoncpp.
+ */
+class StratumParser
+{
+public:
+    StratumParser();
+
+    /**
+     * @brief Calls @p _line with each complete line of @p _data, trimmed and without
+     *  its delimiter. Nothing is copied
+     * @param _scanned Leading bytes of @p _data already known not to hold any
+     *  delimiter. Updated for the next call, once the consumed bytes are dropped
+     * @return Bytes consumed, ie. up to and including the last delimiter
+     */
+    template <typename Handler>
+    static size_t frame(const char* _data, size_t _size, size_t& _scanned, Handler&& _line)
+    {
+        size_t consumed = 0;
+        const char* nl;
+        if (_scanned > _size)
+            _scanned = 0;
+        while ((nl = static_cast<const char*>(
+                    std::memchr(_data + _scanned, '\n', _size - _scanned))) != nullptr)
+        {
+            const char* b = _data + consumed;
+            const char* e = nl;
+            while (b < e && isspace(static_cast<unsigned char>(*b)))
+                b++;
+            while (e > b && isspace(static_cast<unsigned char>(e[-1])))
+                e--;
+            consumed = size_t(nl - _data) + 1;
+            _scanned = consumed;
+            if (b != e)
+                _line(b, e);
+        }
+        _scanned = _size - consumed;
+        return consumed;
+    }
+
+    /**
+     * @brief Parses a single message
+     * @param _error Receives the reason the message is not valid json
+     * @return false if the message is not valid json
+     */
+    bool parse(const char* _begin, const char* _end, Json::Value& _msg, std::string& _error);
+
+    uint64_t fastParsed() const { return m_fastParsed; }
+    uint64_t slowParsed() const { return m_slowParsed; }
+
+    /**
+     * @brief Measures framing and parsing of recorded pool traffic, against
+     *  the former std::string and Json::Reader based path
+     * @param _traffic Messages one per line. Lines logged with -v 1 and session
+     *  recordings are accepted too
+     */
+    static void benchmark(std::istream& _traffic, std::ostream& _out);
+
+private:
+    std::unique_ptr<Json::CharReader> m_reader;  // Fallback
+    uint64_t m_fastParsed = 0;
+    uint64_t m_slowParsed = 0;
+};
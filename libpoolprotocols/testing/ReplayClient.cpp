@@ -0,0 +1,614 @@
+#include <libdevcore/LatencyTrace.h>
+#include <libdevcore/Log.h>
+#include <chrono>
+#include <fstream>
+
+#include "../getwork/EthGetworkClient.h"
+#include "../stratum/EthStratumClient.h"
+#include "../stratum/StratumParser.h"
+#include "ReplayClient.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace dev;
+using namespace eth;
+
+using boost::asio::ip::tcp;
+
+namespace
+{
+bool isSubmission(std::string const& _method)
+{
+    return _method == "mining.submit" || _method == "eth_submitWork";
+}
+
+bool isHashrate(std::string const& _method)
+{
+    return _method == "eth_submitHashrate" || _method == "mining.hashrate";
+}
+
+// Jobs pushed by ethproxy pools and getwork responses are results of 3 hashes at least
+bool isWork(Json::Value const& _msg)
+{
+    Json::Value const& result = _msg["result"];
+    return result.isArray() && result.size() >= 3 && result[0].isString() &&
+           result[0].asString().size() >= 64;
+}
+
+bool parse(std::string const& _line, Json::Value& _msg)
+{
+    Json::Reader jRdr;
+    return jRdr.parse(_line, _msg) && _msg.isObject();
+}
+
+// Whether or not a session ever got work. Failed stratum autodetection
+// attempts did not and are not played
+bool hasWork(RecordedSession const& _session)
+{
+    for (auto const& l : _session.lines)
+    {
+        Json::Value jMsg;
+        if (!l.received || !parse(l.data, jMsg))
+            continue;
+        if (jMsg.get("method", "").asString() == "mining.notify" || isWork(jMsg))
+            return true;
+    }
+    return false;
+}
+
+}  // namespace
+
+ReplayClient::ReplayClient(
+    std::string const& _file, float _speed, int _worktimeout, int _responsetimeout)
+  : PoolClient(),
+    m_file(_file),
+    m_speed(_speed),
+    m_worktimeout(_worktimeout),
+    m_responsetimeout(_responsetimeout),
+    m_io_strand(g_io_service),
+    m_acceptor(g_io_service),
+    m_socket(g_io_service),
+    m_playtimer(g_io_service),
+    m_endtimer(g_io_service)
+{
+    m_jSwBuilder.settings_["indentation"] = "";
+}
+
+ReplayClient::~ReplayClient() = default;
+
+void ReplayClient::connect()
+{
+    if (m_recording.empty())
+    {
+        std::ifstream in(m_file, ios::in | ios::binary);
+        try
+        {
+            if (!in)
+                throw std::runtime_error("Can't read " + m_file);
+            m_recording = SessionRecorder::load(in);
+        }
+        catch (const std::exception& _ex)
+        {
+            cwarn << "Replay : " << _ex.what();
+        }
+
+        boost::system::error_code ec;
+        tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), 0);
+        m_acceptor.open(endpoint.protocol(), ec);
+        if (!ec)
+            m_acceptor.bind(endpoint, ec);
+        if (!ec)
+            m_acceptor.listen(1, ec);
+        if (ec)
+        {
+            cwarn << "Replay : can't listen on loopback " << ec.message();
+            m_recording.clear();
+        }
+    }
+
+    m_stopping.store(false, memory_order_relaxed);
+    m_sessionIdx = 0;
+    m_sessions = 0;
+    m_played = 0;
+    m_recordedUs = 0;
+    m_replayStart = steady_clock::now();
+    m_io_strand.post([this]() {
+        m_sessionIdx = size_t(-1);
+        nextSession();
+    });
+}
+
+void ReplayClient::disconnect()
+{
+    m_stopping.store(true, memory_order_relaxed);
+
+    PoolClient* client;
+    {
+        Guard l(x_client);
+        client = m_client.get();
+    }
+    if (client && client->isConnected())
+    {
+        // Reports back through the client's handler
+        client->disconnect();
+        return;
+    }
+    m_io_strand.post([this]() { finish(); });
+}
+
+void ReplayClient::nextSession()
+{
+    m_playtimer.cancel();
+    m_endtimer.cancel();
+    closeSocket();
+
+    if (m_stopping.load(memory_order_relaxed))
+    {
+        finish();
+        return;
+    }
+
+    // Pick the next session which got work
+    while (++m_sessionIdx < m_recording.size() && !hasWork(m_recording[m_sessionIdx]))
+    {
+    }
+    if (m_sessionIdx >= m_recording.size())
+    {
+        finish();
+        return;
+    }
+
+    RecordedSession const& session = m_recording[m_sessionIdx];
+    m_sessions++;
+    m_recordedUs += session.us;
+
+    // Recorded answers to submissions are dropped: ours are answered as they come
+    std::set<std::string> submissions;
+    m_lines.clear();
+    size_t requests = 0;
+    for (auto const& l : session.lines)
+    {
+        Json::Value jMsg;
+        bool valid = parse(l.data, jMsg);
+        std::string method = valid ? jMsg.get("method", "").asString() : "";
+        std::string id = valid ? Json::writeString(m_jSwBuilder, jMsg["id"]) : "";
+        if (!l.received)
+        {
+            if (isSubmission(method) || isHashrate(method))
+                submissions.insert(id);
+            else
+                requests++;
+            continue;
+        }
+        if (valid && method.empty() && !isWork(jMsg) && submissions.count(id))
+            continue;
+        if (session.family == ProtocolFamily::GETWORK && !(valid && isWork(jMsg)))
+            continue;
+        m_lines.push_back({l.us, requests, l.data});
+    }
+    m_next = 0;
+    m_requests = 0;
+    m_started = false;
+    m_waitedFor = 0;
+    m_waits = 0;
+
+    // The client the session was recorded with, on the loopback endpoint
+    std::string uri;
+    unsigned short port = m_acceptor.local_endpoint().port();
+    if (session.family == ProtocolFamily::GETWORK)
+        uri = "http://127.0.0.1:" + to_string(port);
+    else if (session.mode >= 999)
+        uri = "stratum://replay.worker@127.0.0.1:" + to_string(port);
+    else
+        uri = "stratum" + (session.mode ? to_string(session.mode) : "") +
+              "+tcp://replay.worker@127.0.0.1:" + to_string(port);
+    m_uri = std::make_shared<URI>(uri);
+
+    cnote << "Replay : session " << m_sessionIdx + 1 << " of " << m_recording.size() << ", "
+          << m_lines.size() << " lines over " << session.us / 1000000 << " s";
+
+    {
+        Guard l(x_client);
+        if (m_client)
+            m_retired.push_back(std::move(m_client));
+        if (session.family == ProtocolFamily::GETWORK)
+            m_client = std::unique_ptr<PoolClient>(new EthGetworkClient(m_worktimeout, 500));
+        else
+            m_client =
+                std::unique_ptr<PoolClient>(new EthStratumClient(m_worktimeout, m_responsetimeout));
+        m_client->setConnection(m_uri);
+        setClientHandlers();
+    }
+
+    begin_accept();
+    m_client->connect();
+}
+
+void ReplayClient::finish()
+{
+    m_playtimer.cancel();
+    m_endtimer.cancel();
+    closeSocket();
+    boost::system::error_code ec;
+    m_acceptor.close(ec);
+
+    if (!m_connected.load(memory_order_relaxed))
+    {
+        // Never got to mine
+        m_conn->MarkUnrecoverable();
+        if (m_onDisconnected)
+            m_onDisconnected();
+        return;
+    }
+
+    double replayed = duration_cast<milliseconds>(steady_clock::now() - m_replayStart).count();
+    cnote << "Replay results : " << EthWhiteBold << m_sessions << " sessions, " << m_played
+          << " lines, " << m_jobs.load(memory_order_relaxed) << " jobs, "
+          << m_solutions.load(memory_order_relaxed) << " solutions in "
+          << std::setprecision(3) << replayed / 1000 << " s (recorded "
+          << double(m_recordedUs / 1000) / 1000 << " s)" << EthReset;
+    for (unsigned i = 0; i < unsigned(TraceStage::Max); i++)
+    {
+        TraceStats stats = LatencyTrace::stats(TraceStage(i));
+        if (stats.count)
+            cnote << "Replay latency " << setw(16) << std::left
+                  << LatencyTrace::name(TraceStage(i)) << std::right << " p50 " << setw(6)
+                  << stats.p50 << " us p99 " << setw(6) << stats.p99 << " us max " << setw(6)
+                  << stats.max << " us (" << stats.count << ")";
+    }
+
+    // Recording is over. Nothing to reconnect to
+    if (!m_stopping.load(memory_order_relaxed))
+        m_conn->MarkUnrecoverable();
+    m_conn->addDuration(m_session->duration());
+    m_session = nullptr;
+    m_connected.store(false, memory_order_relaxed);
+    if (m_onDisconnected)
+        m_onDisconnected();
+}
+
+void ReplayClient::setClientHandlers()
+{
+    m_client->onConnected([this]() {
+        if (m_connected.load(memory_order_relaxed))
+            return;
+
+        // Sessions follow one another as a single connection
+        m_session = unique_ptr<Session>(new Session);
+        m_session->subscribed.store(true, memory_order_relaxed);
+        m_session->authorized.store(true, memory_order_relaxed);
+        m_connected.store(true, memory_order_relaxed);
+        if (m_onConnected)
+            m_onConnected();
+    });
+
+    m_client->onDisconnected(
+        [this]() { m_io_strand.post([this]() { nextSession(); }); });
+
+    m_client->onWorkReceived([this](WorkPackage const& wp) {
+        m_jobs.fetch_add(1, memory_order_relaxed);
+        if (m_onWorkReceived)
+            m_onWorkReceived(wp);
+    });
+
+    m_client->onSolutionAccepted(
+        [this](milliseconds const& _delay, unsigned const& _minerIdx, bool _asStale) {
+            if (m_onSolutionAccepted)
+                m_onSolutionAccepted(_delay, _minerIdx, _asStale);
+        });
+
+    m_client->onSolutionRejected([this](milliseconds const& _delay, unsigned const& _minerIdx) {
+        if (m_onSolutionRejected)
+            m_onSolutionRejected(_delay, _minerIdx);
+    });
+}
+
+void ReplayClient::submitHashrate(uint64_t const& rate, string const& id)
+{
+    Guard l(x_client);
+    if (m_client)
+        m_client->submitHashrate(rate, id);
+}
+
+void ReplayClient::submitSolution(const Solution& solution)
+{
+    m_solutions.fetch_add(1, memory_order_relaxed);
+    Guard l(x_client);
+    if (m_client)
+        m_client->submitSolution(solution);
+}
+
+void ReplayClient::submitSolutions(const std::vector<Solution>& solutions)
+{
+    m_solutions.fetch_add(unsigned(solutions.size()), memory_order_relaxed);
+    Guard l(x_client);
+    if (m_client)
+        m_client->submitSolutions(solutions);
+}
+
+void ReplayClient::begin_accept()
+{
+    if (m_socket.is_open())
+        return;
+    m_acceptor.async_accept(m_socket, m_io_strand.wrap(boost::bind(&ReplayClient::handle_accept,
+                                          this, boost::asio::placeholders::error)));
+}
+
+void ReplayClient::handle_accept(const boost::system::error_code& ec)
+{
+    if (ec)
+        return;
+
+    m_recvBuffer.consume(m_recvBuffer.size());
+    m_recvScanned = 0;
+    m_closeAfterWrite = false;
+    if (!m_started)
+    {
+        // Recorded times count from here
+        m_started = true;
+        m_start = steady_clock::now();
+        m_endtimer.expires_from_now(scaled(m_recording[m_sessionIdx].us));
+        m_endtimer.async_wait(m_io_strand.wrap(boost::bind(
+            &ReplayClient::endtimer_elapsed, this, boost::asio::placeholders::error)));
+    }
+    recvSocketData();
+    if (m_recording[m_sessionIdx].family == ProtocolFamily::STRATUM)
+        play();
+}
+
+void ReplayClient::recvSocketData()
+{
+    boost::asio::async_read(m_socket, m_recvBuffer, boost::asio::transfer_at_least(1),
+        m_io_strand.wrap(boost::bind(&ReplayClient::onRecvSocketDataCompleted, this,
+            boost::asio::placeholders::error)));
+}
+
+void ReplayClient::onRecvSocketDataCompleted(const boost::system::error_code& ec)
+{
+    if (ec)
+    {
+        // Getwork clients may use a connection per request
+        closeSocket();
+        if (m_started && m_sessionIdx < m_recording.size() &&
+            m_recording[m_sessionIdx].family == ProtocolFamily::GETWORK)
+            begin_accept();
+        return;
+    }
+
+    if (m_sessionIdx >= m_recording.size())
+        return;
+
+    if (m_recording[m_sessionIdx].family == ProtocolFamily::GETWORK)
+    {
+        processHttpRequests();
+    }
+    else
+    {
+        size_t consumed = StratumParser::frame(
+            boost::asio::buffer_cast<const char*>(m_recvBuffer.data()), m_recvBuffer.size(),
+            m_recvScanned,
+            [this](const char* _begin, const char* _end) { processRequest(_begin, _end); });
+        m_recvBuffer.consume(consumed);
+        play();
+    }
+
+    if (m_socket.is_open())
+        recvSocketData();
+}
+
+void ReplayClient::processRequest(const char* _begin, const char* _end)
+{
+    Json::Value jReq;
+    if (!parse(std::string(_begin, _end), jReq))
+        return;
+
+    std::string method = jReq.get("method", "").asString();
+    if (isSubmission(method) || isHashrate(method))
+        answer(jReq, true);
+    else
+        m_requests++;
+}
+
+void ReplayClient::processHttpRequests()
+{
+    // Requests may be pipelined. Each is headers then a body of Content-Length bytes
+    while (m_recvBuffer.size())
+    {
+        std::string data(
+            boost::asio::buffer_cast<const char*>(m_recvBuffer.data()), m_recvBuffer.size());
+        size_t headersEnd = data.find("\r\n\r\n");
+        if (headersEnd == std::string::npos)
+            return;
+
+        std::string headers = data.substr(0, headersEnd);
+        boost::algorithm::to_lower(headers);
+        size_t length = 0;
+        size_t pos = headers.find("content-length:");
+        if (pos != std::string::npos)
+            length = std::strtoul(headers.c_str() + pos + 15, nullptr, 10);
+        if (data.size() < headersEnd + 4 + length)
+            return;
+        m_recvBuffer.consume(headersEnd + 4 + length);
+
+        bool close = headers.find("connection: close") != std::string::npos ||
+                     (headers.find("http/1.0") != std::string::npos &&
+                         headers.find("connection: keep-alive") == std::string::npos);
+
+        Json::Value jReq;
+        std::string body;
+        if (parse(data.substr(headersEnd + 4, length), jReq))
+        {
+            std::string method = jReq.get("method", "").asString();
+            if (method == "eth_getWork" && !m_lines.empty())
+            {
+                // The node's work at this time of the recording
+                uint64_t elapsed = duration_cast<microseconds>(steady_clock::now() - m_start).count();
+                elapsed = uint64_t(double(elapsed) * m_speed);
+                while (m_speed > 0 && m_next + 1 < m_lines.size() &&
+                       m_lines[m_next + 1].us <= elapsed)
+                    m_next++;
+                Json::Value jRes;
+                parse(m_lines[m_next].data, jRes);
+
+                // Without timing each poll gets the next work
+                if (m_speed <= 0 && m_next + 1 < m_lines.size())
+                    m_next++;
+                jRes["id"] = jReq["id"];
+                body = Json::writeString(m_jSwBuilder, jRes);
+                m_played++;
+            }
+            else
+            {
+                Json::Value jRes;
+                jRes["id"] = jReq["id"];
+                jRes["jsonrpc"] = "2.0";
+                jRes["result"] = true;
+                body = Json::writeString(m_jSwBuilder, jRes);
+            }
+        }
+
+        std::string response = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n";
+        response += "Content-Length: " + to_string(body.size()) + "\r\n";
+        response += (close ? "Connection: close\r\n\r\n" : "Connection: keep-alive\r\n\r\n");
+        write(response + body);
+        if (close)
+        {
+            m_closeAfterWrite = true;
+            return;
+        }
+    }
+}
+
+void ReplayClient::answer(Json::Value const& _req, Json::Value const& _result)
+{
+    Json::Value jRes;
+    jRes["id"] = _req["id"];
+    jRes["jsonrpc"] = "2.0";
+    jRes["result"] = _result;
+    jRes["error"] = Json::Value::null;
+    write(Json::writeString(m_jSwBuilder, jRes) + "\n");
+}
+
+void ReplayClient::write(std::string _data)
+{
+    m_txQueue.push_back(std::move(_data));
+    if (!m_txPending)
+        sendSocketData();
+}
+
+void ReplayClient::sendSocketData()
+{
+    if (m_txQueue.empty() || !m_socket.is_open())
+    {
+        m_txPending = false;
+        return;
+    }
+    m_txPending = true;
+    boost::asio::async_write(m_socket, boost::asio::buffer(m_txQueue.front()),
+        m_io_strand.wrap(boost::bind(
+            &ReplayClient::onSendSocketDataCompleted, this, boost::asio::placeholders::error)));
+}
+
+void ReplayClient::onSendSocketDataCompleted(const boost::system::error_code& ec)
+{
+    if (!m_txQueue.empty())
+        m_txQueue.pop_front();
+    m_txPending = false;
+    if (ec)
+    {
+        closeSocket();
+        return;
+    }
+    if (!m_txQueue.empty())
+        sendSocketData();
+    else if (m_closeAfterWrite)
+        closeSocket();
+}
+
+void ReplayClient::closeSocket()
+{
+    m_txQueue.clear();
+    m_txPending = false;
+    m_closeAfterWrite = false;
+    if (!m_socket.is_open())
+        return;
+    boost::system::error_code ec;
+    m_socket.shutdown(tcp::socket::shutdown_both, ec);
+    m_socket.close(ec);
+}
+
+void ReplayClient::play()
+{
+    while (m_next < m_lines.size() && m_socket.is_open())
+    {
+        PlayLine const& l = m_lines[m_next];
+
+        // Wait for the request this line answers
+        if (m_requests < l.requests)
+            return;
+
+        auto due = m_start + microseconds(m_speed > 0 ? uint64_t(double(l.us) / m_speed) : 0);
+        if (due > steady_clock::now())
+        {
+            m_playtimer.expires_from_now(boost::posix_time::microseconds(
+                duration_cast<microseconds>(due - steady_clock::now()).count()));
+            m_playtimer.async_wait(m_io_strand.wrap(boost::bind(
+                &ReplayClient::playtimer_elapsed, this, boost::asio::placeholders::error)));
+            return;
+        }
+
+        write(l.data + "\n");
+        m_played++;
+        m_next++;
+    }
+}
+
+void ReplayClient::playtimer_elapsed(const boost::system::error_code& ec)
+{
+    if (!ec)
+        play();
+}
+
+void ReplayClient::endtimer_elapsed(const boost::system::error_code& ec)
+{
+    if (ec)
+        return;
+
+    // The session lasted as long as recorded. Still let the client have
+    // what's left to play, unless it's stuck on a line it did not ask for
+    bool getwork = (m_recording[m_sessionIdx].family == ProtocolFamily::GETWORK);
+    bool pending = getwork ? (m_speed <= 0 && m_next + 1 < m_lines.size()) :
+                             (m_next < m_lines.size() && m_socket.is_open());
+    if (pending)
+    {
+        if (m_next != m_waitedFor)
+        {
+            m_waitedFor = m_next;
+            m_waits = 0;
+        }
+        else if (!getwork && ++m_waits >= 10 && m_requests < m_lines[m_next].requests)
+        {
+            cwarn << "Replay : client did not send what the recording answers. Skipping line";
+            m_requests = m_lines[m_next].requests;
+            m_waits = 0;
+            play();
+        }
+        m_endtimer.expires_from_now(boost::posix_time::milliseconds(100));
+        m_endtimer.async_wait(m_io_strand.wrap(boost::bind(
+            &ReplayClient::endtimer_elapsed, this, boost::asio::placeholders::error)));
+        return;
+    }
+
+    PoolClient* client;
+    {
+        Guard l(x_client);
+        client = m_client.get();
+    }
+    closeSocket();
+    client->disconnect();
+}
+
+boost::posix_time::time_duration ReplayClient::scaled(uint64_t _us)
+{
+    return boost::posix_time::microseconds(m_speed > 0 ? int64_t(double(_us) / m_speed) : 0);
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <iostream>
+#include <set>
+
+#include <boost/asio.hpp>
+
+#include <json/json.h>
+
+#include <libdevcore/Guards.h>
+#include <libethcore/Farm.h>
+#include <libethcore/Miner.h>
+
+#include "../PoolClient.h"
+#include "SessionRecorder.h"
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+/**
+ * @brief Plays a recorded pool session back to PoolManager and Farm
+ *
+ * Serves the recording from a loopback endpoint to a regular EthStratumClient
+ * or EthGetworkClient, so the replayed traffic goes through the very same
+ * parsing and dispatching path as it did live. Lines received from the pool
+ * are written at their recorded times, divided by the speed factor (0 means
+ * no wait). A line is held till the client has sent at least as many
+ * requests as it had when the line was recorded. Submissions are answered
+ * as accepted, while the recorded answers to submissions are dropped.
+ * Recorded connections are played one after the other. When the last one
+ * ends results are printed and the connection is given up.
+ */
+class ReplayClient : public PoolClient
+{
+public:
+    ReplayClient(std::string const& _file, float _speed, int _worktimeout, int _responsetimeout);
+    ~ReplayClient() override;
+
+    void connect() override;
+    void disconnect() override;
+
+    bool isPendingState() override { return false; }
+    string ActiveEndPoint() override { return ""; };
+
+    void submitHashrate(uint64_t const& rate, string const& id) override;
+    void submitSolution(const Solution& solution) override;
+    void submitSolutions(const std::vector<Solution>& solutions) override;
+
+private:
+    // A line of the pool to write, once the client sent enough requests
+    struct PlayLine
+    {
+        uint64_t us;
+        size_t requests;  // Requests the client had sent when recorded
+        std::string data;
+    };
+
+    void nextSession();
+    void finish();
+    void setClientHandlers();
+
+    void begin_accept();
+    void handle_accept(const boost::system::error_code& ec);
+    void recvSocketData();
+    void onRecvSocketDataCompleted(const boost::system::error_code& ec);
+    void processRequest(const char* _begin, const char* _end);
+    void processHttpRequests();
+    void answer(Json::Value const& _req, Json::Value const& _result);
+    void write(std::string _data);
+    void sendSocketData();
+    void onSendSocketDataCompleted(const boost::system::error_code& ec);
+    void closeSocket();
+
+    void play();
+    void playtimer_elapsed(const boost::system::error_code& ec);
+    void endtimer_elapsed(const boost::system::error_code& ec);
+    boost::posix_time::time_duration scaled(uint64_t _us);
+
+    std::string m_file;
+    float m_speed;
+    int m_worktimeout;
+    int m_responsetimeout;
+
+    std::vector<RecordedSession> m_recording;
+    size_t m_sessionIdx = 0;
+
+    Mutex x_client;  // Guards the swap of the client of each session
+    std::unique_ptr<PoolClient> m_client;
+    std::vector<std::unique_ptr<PoolClient>> m_retired;  // May still have handlers pending
+    std::shared_ptr<URI> m_uri;
+    std::atomic<bool> m_stopping = {false};
+
+    // The pool side
+    boost::asio::io_service::strand m_io_strand;
+    boost::asio::ip::tcp::acceptor m_acceptor;
+    boost::asio::ip::tcp::socket m_socket;
+    boost::asio::streambuf m_recvBuffer;
+    size_t m_recvScanned = 0;
+    std::deque<std::string> m_txQueue;
+    bool m_txPending = false;
+    bool m_closeAfterWrite = false;
+    Json::StreamWriterBuilder m_jSwBuilder;
+    boost::asio::deadline_timer m_playtimer;
+    boost::asio::deadline_timer m_endtimer;
+
+    // Playback of the current session
+    std::vector<PlayLine> m_lines;  // Stratum lines or getwork responses to eth_getWork
+    size_t m_next = 0;
+    size_t m_requests = 0;
+    bool m_started = false;
+    size_t m_waitedFor = 0;  // Line the client was found stuck on
+    unsigned m_waits = 0;
+    std::chrono::steady_clock::time_point m_start;
+
+    // Results
+    std::chrono::steady_clock::time_point m_replayStart;
+    uint64_t m_recordedUs = 0;
+    unsigned m_sessions = 0;
+    uint64_t m_played = 0;
+    std::atomic<unsigned> m_jobs = {0};
+    std::atomic<unsigned> m_solutions = {0};
+};
@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+#include "SessionRecorder.h"
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+namespace
+{
+const char* c_recordingHeader = "#ethminer session recording 1";
+
+}  // namespace
+
+SessionRecorder::SessionRecorder(std::string const& _file)
+  : m_file(_file, ios::out | ios::trunc | ios::binary)
+{
+    if (!m_file)
+        throw std::runtime_error("Can't write " + _file);
+    m_file << c_recordingHeader << '\n';
+}
+
+SessionRecorder::~SessionRecorder()
+{
+    Guard l(x_file);
+    m_file.flush();
+}
+
+unsigned SessionRecorder::begin(ProtocolFamily _family, unsigned _mode)
+{
+    Guard l(x_file);
+    unsigned session = ++m_sessions;
+    m_started[session] = chrono::steady_clock::now();
+    m_file << 'S' << session << " 0 "
+           << (_family == ProtocolFamily::GETWORK ? "getwork" : "stratum") << ' ' << _mode << '\n';
+    return session;
+}
+
+void SessionRecorder::received(unsigned _session, const char* _begin, const char* _end)
+{
+    write('<', _session, _begin, _end);
+}
+
+void SessionRecorder::sent(unsigned _session, const char* _begin, const char* _end)
+{
+    write('>', _session, _begin, _end);
+}
+
+void SessionRecorder::end(unsigned _session)
+{
+    write('E', _session, nullptr, nullptr);
+
+    // Keep what's recorded so far should we crash later
+    Guard l(x_file);
+    m_started.erase(_session);
+    m_file.flush();
+}
+
+void SessionRecorder::write(char _type, unsigned _session, const char* _begin, const char* _end)
+{
+    auto now = chrono::steady_clock::now();
+    Guard l(x_file);
+    auto started = m_started.find(_session);
+    if (started == m_started.end())
+        return;
+
+    m_file << _type << _session << ' '
+           << chrono::duration_cast<chrono::microseconds>(now - started->second).count();
+    if (_begin != _end)
+    {
+        m_file << ' ';
+        // Lines hold no delimiter but a single message may spread over
+        // several lines (eg. getwork bodies). Keep one record per line
+        for (const char* c = _begin; c < _end; c++)
+            if (*c != '\n' && *c != '\r')
+                m_file.put(*c);
+    }
+    m_file << '\n';
+}
+
+std::vector<RecordedSession> SessionRecorder::load(std::istream& _in)
+{
+    std::vector<RecordedSession> sessions;
+    std::map<unsigned, size_t> index;  // Session id to position in sessions
+
+    string line;
+    if (!getline(_in, line) || line != c_recordingHeader)
+        throw std::runtime_error("Not a session recording");
+
+    while (getline(_in, line))
+    {
+        if (line.size() < 2)
+            continue;
+
+        char type = line[0];
+        istringstream ss(line.substr(1));
+        unsigned session;
+        uint64_t us;
+        if (!(ss >> session >> us))
+            continue;
+        ss.get();  // The separator
+
+        if (type == 'S')
+        {
+            RecordedSession s;
+            string family;
+            ss >> family >> s.mode;
+            s.family = (family == "getwork" ? ProtocolFamily::GETWORK : ProtocolFamily::STRATUM);
+            index[session] = sessions.size();
+            sessions.push_back(std::move(s));
+            continue;
+        }
+
+        auto i = index.find(session);
+        if (i == index.end())
+            continue;
+        RecordedSession& s = sessions[i->second];
+        s.us = max(s.us, us);
+        if (type != '<' && type != '>')
+            continue;
+
+        RecordedLine l;
+        l.received = (type == '<');
+        l.us = us;
+        getline(ss, l.data);
+        s.lines.push_back(std::move(l));
+    }
+    return sessions;
+}
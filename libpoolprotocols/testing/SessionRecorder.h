@@ -0,0 +1,77 @@
+#pragma once
+
+#include <chrono>
+#include <fstream>
+#include <istream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <libdevcore/Guards.h>
+
+#include "../PoolURI.h"
+
+namespace dev
+{
+namespace eth
+{
+/**
+ * @brief A line exchanged with a pool, as recorded
+ */
+struct RecordedLine
+{
+    bool received;    // From the pool, or else sent to it
+    uint64_t us;      // Since the session began
+    std::string data; // Without its delimiter
+};
+
+/**
+ * @brief A connection to a pool, as recorded
+ */
+struct RecordedSession
+{
+    ProtocolFamily family = ProtocolFamily::STRATUM;
+    unsigned mode = 999;  // Stratum mode the connection was made with
+    uint64_t us = 0;      // How long the connection lasted
+    std::vector<RecordedLine> lines;
+};
+
+/**
+ * @brief Records the lines clients exchange with pools, for ReplayClient
+ *
+ * One record per text line. Sessions are numbered as they begin and
+ * timestamps are the microseconds (monotonic) since their session began:
+ *
+ *     S<session> <us> stratum <mode>   connection made (or getwork)
+ *     <<session> <us> <line>           line received from the pool
+ *     ><session> <us> <line>           line sent to the pool
+ *     E<session> <us>                  connection closed
+ *
+ * Clients record from their own strands, so writes are serialized here.
+ */
+class SessionRecorder
+{
+public:
+    explicit SessionRecorder(std::string const& _file);
+    ~SessionRecorder();
+
+    // Returns the id of the new session
+    unsigned begin(ProtocolFamily _family, unsigned _mode);
+    void received(unsigned _session, const char* _begin, const char* _end);
+    void sent(unsigned _session, const char* _begin, const char* _end);
+    void end(unsigned _session);
+
+    // Reads back a recording. Sessions come in the order they began
+    static std::vector<RecordedSession> load(std::istream& _in);
+
+private:
+    void write(char _type, unsigned _session, const char* _begin, const char* _end);
+
+    Mutex x_file;
+    std::ofstream m_file;
+    unsigned m_sessions = 0;
+    std::map<unsigned, std::chrono::steady_clock::time_point> m_started;
+};
+
+}  // namespace eth
+}  // namespace dev
@@ -1,5 +1,10 @@
+#include <libdevcore/LatencyTrace.h>
 #include <libdevcore/Log.h>
 #include <chrono>
+#include <cmath>
+#include <fstream>
+
+#include <json/json.h>
 
 #include "SimulateClient.h"
 
@@ -8,9 +13,17 @@ using namespace std::chrono;
 using namespace dev;
 using namespace eth;
 
-SimulateClient::SimulateClient(unsigned const& block) : PoolClient(), Worker("sim")
+namespace
 {
-    m_block = block;
+const double c_hashesPerDiff = 4294967296.0;  // Hashes to a share at difficulty 1
+const unsigned c_retargetPercent = 25;        // Difficulty drift tolerated before a new job
+
+}  // namespace
+
+SimulateClient::SimulateClient(SimulationSettings const& _settings)
+  : PoolClient(), Worker("sim"), m_settings(_settings)
+{
+    m_settings.jobBurst = max(m_settings.jobBurst, 1U);
 }
 
 SimulateClient::~SimulateClient() = default;
@@ -33,13 +46,17 @@ void SimulateClient::connect()
 
 void SimulateClient::disconnect()
 {
+    // Both the user and the end of the run may get here
+    if (!m_connected.exchange(false, memory_order_relaxed))
+        return;
+
     cnote << "Simulation results : " << EthWhiteBold << "Max "
           << dev::getFormattedHashes((double)hr_max, ScaleSuffix::Add, 6) << " Mean "
           << dev::getFormattedHashes((double)hr_mean, ScaleSuffix::Add, 6) << EthReset;
-    
+    report();
+
     m_conn->addDuration(m_session->duration());
     m_session = nullptr;
-    m_connected.store(false, memory_order_relaxed);
 
     if (m_onDisconnected)
         m_onDisconnected();
@@ -54,26 +71,82 @@ void SimulateClient::submitHashrate(uint64_t const& rate, string const& id)
 void SimulateClient::submitSolution(const Solution& solution)
 {
     // This is a fake submission only evaluated locally
+    m_solutions.fetch_add(1, memory_order_relaxed);
     std::chrono::steady_clock::time_point submit_start = std::chrono::steady_clock::now();
     bool accepted =
         EthashAux::eval(solution.work.epoch, solution.work.header, solution.nonce).value <=
         solution.work.boundary;
+    std::chrono::microseconds verify = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - submit_start);
     std::chrono::milliseconds response_delay_ms =
-        std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::steady_clock::now() - submit_start);
+        std::chrono::duration_cast<std::chrono::milliseconds>(verify);
+
+    uint64_t us = uint64_t(verify.count());
+    m_verifyUs.fetch_add(us, memory_order_relaxed);
+    uint64_t maxUs = m_verifyMaxUs.load(memory_order_relaxed);
+    while (us > maxUs && !m_verifyMaxUs.compare_exchange_weak(maxUs, us, memory_order_relaxed))
+    {
+    }
+
+    // A share for a job already replaced is stale, as it would be for a pool
+    bool stale;
+    {
+        Guard l(x_work);
+        stale = (solution.work.header != m_current.header);
+        if (accepted && !stale)
+            m_hashes += dev::getHashesToTarget(solution.work.boundary.hex(HexPrefix::Add));
+    }
 
     if (accepted)
     {
+        (stale ? m_stale : m_accepted).fetch_add(1, memory_order_relaxed);
         if (m_onSolutionAccepted)
-            m_onSolutionAccepted(response_delay_ms, solution.midx, false);
+            m_onSolutionAccepted(response_delay_ms, solution.midx, stale);
     }
     else
     {
+        m_rejected.fetch_add(1, memory_order_relaxed);
         if (m_onSolutionRejected)
             m_onSolutionRejected(response_delay_ms, solution.midx);
     }
 }
 
+double SimulateClient::targetDifficulty()
+{
+    // Difficulty 1 unless asked for a share rate and the hashrate is known
+    if (m_settings.shareRate <= 0)
+        return 1.0;
+    if (hr_mean <= 0)
+        return m_difficulty;
+    return double(hr_mean) / m_settings.shareRate / c_hashesPerDiff;
+}
+
+void SimulateClient::sendJobs(unsigned _count)
+{
+    // Bursts come as several notifications read at once from a pool
+    for (unsigned i = 0; i < _count && m_session; i++)
+    {
+        WorkPackage wp;
+        {
+            Guard l(x_work);
+            if (!m_current)
+            {
+                m_current.seed = h256::random();  // We don't actually need a real seed as the
+                                                  // epoch is calculated upon block number (see
+                                                  // poolmanager)
+                m_current.block = m_settings.block;
+            }
+            m_current.header = h256::random();
+            m_current.job = m_current.header.hex();
+            m_current.boundary = h256(dev::getTargetFromDiff(m_difficulty));
+            m_current.tstamp = steady_clock::now();
+            m_jobs++;
+            wp = m_current;
+        }
+        m_onWorkReceived(wp);
+    }
+}
+
 // Handles all logic here
 void SimulateClient::workLoop()
 {
@@ -82,21 +155,120 @@ void SimulateClient::workLoop()
     // apply exponential sliding average
     // ref: https://en.wikipedia.org/wiki/Moving_average#Exponential_moving_average
 
+    m_difficulty = 1.0;
+    sendJobs(1);  // submit new fake job
 
-    WorkPackage current;
-    current.seed = h256::random();  // We don't actually need a real seed as the epoch
-                                    // is calculated upon block number (see poolmanager)
-    current.header = h256::random();
-    current.block = m_block;
-    current.boundary = h256(dev::getTargetFromDiff(1));
-    m_onWorkReceived(current);  // submit new fake job
+    auto nextJob = m_start_time + milliseconds(m_settings.jobInterval);
+    auto nextEpoch = m_start_time + seconds(m_settings.epochInterval);
+    auto nextSample = m_start_time;
+    auto end = m_start_time + seconds(m_settings.duration);
 
     while (m_session)
     {
-        float hr = Farm::f().HashRate();
-        hr_max = std::max(hr_max, hr);
-        hr_mean = hr_alpha * hr_mean + (1.0f - hr_alpha) * hr;
+        auto now = steady_clock::now();
+        if (m_settings.duration && now >= end)
+        {
+            // Nothing more to simulate
+            m_conn->MarkUnrecoverable();
+            disconnect();
+            break;
+        }
+
+        if (now >= nextSample)
+        {
+            float hr = Farm::f().HashRate();
+            hr_max = std::max(hr_max, hr);
+            hr_mean = hr_alpha * hr_mean + (1.0f - hr_alpha) * hr;
+            nextSample = now + milliseconds(200);
+        }
+
+        unsigned jobs = 0;
+        if (m_settings.epochInterval && now >= nextEpoch)
+        {
+            // A new seed on the next epoch's block
+            Guard l(x_work);
+            m_current.seed = h256::random();
+            m_current.block += 30000;
+            m_epochs++;
+            jobs = 1;
+            nextEpoch = now + seconds(m_settings.epochInterval);
+        }
+        if (m_settings.jobInterval && now >= nextJob)
+        {
+            jobs = m_settings.jobBurst;
+            nextJob = now + milliseconds(m_settings.jobInterval);
+        }
+
+        // Retarget once the difficulty drifted too far from the share rate
+        double diff = targetDifficulty();
+        if (std::abs(diff - m_difficulty) * 100 > m_difficulty * c_retargetPercent)
+        {
+            m_difficulty = diff;
+            jobs = max(jobs, 1U);
+        }
+
+        if (jobs)
+            sendJobs(jobs);
 
-        this_thread::sleep_for(chrono::milliseconds(200));
+        auto next = nextSample;
+        if (m_settings.jobInterval)
+            next = min(next, nextJob);
+        this_thread::sleep_until(next);
     }
 }
+
+void SimulateClient::report()
+{
+    double elapsed =
+        duration_cast<milliseconds>(steady_clock::now() - m_start_time).count() / 1000.0;
+    unsigned solutions = m_solutions.load(memory_order_relaxed);
+    unsigned stale = m_stale.load(memory_order_relaxed);
+
+    Json::Value jRes;
+    jRes["duration"] = elapsed;
+    {
+        Guard l(x_work);
+        jRes["jobs"] = m_jobs;
+        jRes["epochs"] = m_epochs;
+        jRes["difficulty"] = m_difficulty;
+        jRes["hashrate"]["effective"] = elapsed > 0 ? m_hashes / elapsed : 0.0;
+    }
+    jRes["hashrate"]["mean"] = hr_mean;
+    jRes["hashrate"]["max"] = hr_max;
+
+    jRes["solutions"]["found"] = solutions;
+    jRes["solutions"]["accepted"] = m_accepted.load(memory_order_relaxed);
+    jRes["solutions"]["stale"] = stale;
+    jRes["solutions"]["rejected"] = m_rejected.load(memory_order_relaxed);
+    jRes["solutions"]["staleRate"] = solutions ? double(stale) / solutions : 0.0;
+
+    // Job switches are traced from the moment the job is made
+    for (unsigned i = 0; i < unsigned(TraceStage::Max); i++)
+    {
+        TraceStage stage = TraceStage(i);
+        TraceStats stats = LatencyTrace::stats(stage);
+        Json::Value jStage;
+        jStage["count"] = Json::UInt64(stats.count);
+        jStage["p50"] = stats.p50;
+        jStage["p99"] = stats.p99;
+        jStage["max"] = stats.max;
+        jRes["latency"][LatencyTrace::name(stage)] = jStage;
+    }
+    jRes["latency"]["verify"]["mean"] =
+        solutions ? Json::UInt64(m_verifyUs.load(memory_order_relaxed) / solutions) : 0;
+    jRes["latency"]["verify"]["max"] = Json::UInt64(m_verifyMaxUs.load(memory_order_relaxed));
+
+    Json::StreamWriterBuilder builder;
+    builder.settings_["indentation"] = "";
+    std::string json = Json::writeString(builder, jRes);
+    if (m_settings.reportFile.empty())
+    {
+        cout << json << endl;
+        return;
+    }
+    std::ofstream out(m_settings.reportFile, ios::out | ios::trunc);
+    if (out << json << endl)
+        cnote << "Simulation results written to " << m_settings.reportFile;
+    else
+        cwarn << "Can't write " << m_settings.reportFile;
+}
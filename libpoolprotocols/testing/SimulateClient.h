@@ -2,6 +2,7 @@
 
 #include <iostream>
 
+#include <libdevcore/Guards.h>
 #include <libdevcore/Worker.h>
 #include <libethcore/EthashAux.h>
 #include <libethcore/Farm.h>
@@ -13,10 +14,21 @@ using namespace std;
 using namespace dev;
 using namespace eth;
 
+struct SimulationSettings
+{
+    unsigned block = 0;          // Block number of the first job
+    unsigned jobInterval = 0;    // Milliseconds between job notifications. 0 = a single job
+    unsigned jobBurst = 1;       // Jobs sent back to back on each notification
+    float shareRate = 0.0f;      // Shares per second difficulty is set for. 0 = difficulty 1
+    unsigned epochInterval = 0;  // Seconds between forced epoch switches. 0 = never
+    unsigned duration = 0;       // Seconds the simulation lasts. 0 = till stopped
+    std::string reportFile;      // Where the json results go. Empty = stdout
+};
+
 class SimulateClient : public PoolClient, Worker
 {
 public:
-    SimulateClient(unsigned const& block);
+    SimulateClient(SimulationSettings const& _settings);
     ~SimulateClient() override;
 
     void connect() override;
@@ -31,10 +43,30 @@ public:
 private:
 
     void workLoop() override;
-    unsigned m_block;
+    void sendJobs(unsigned _count);
+    double targetDifficulty();
+    void report();
+
+    SimulationSettings m_settings;
     std::chrono::steady_clock::time_point m_start_time;
 
     float hr_alpha = 0.45f;
     float hr_max = 0.0f;
     float hr_mean = 0.0f;
+
+    // The jobs
+    Mutex x_work;
+    WorkPackage m_current;
+    double m_difficulty = 1.0;
+    unsigned m_jobs = 0;
+    unsigned m_epochs = 0;
+
+    // The shares
+    std::atomic<unsigned> m_solutions = {0};
+    std::atomic<unsigned> m_accepted = {0};
+    std::atomic<unsigned> m_stale = {0};
+    std::atomic<unsigned> m_rejected = {0};
+    std::atomic<uint64_t> m_verifyUs = {0};     // Total time spent verifying
+    std::atomic<uint64_t> m_verifyMaxUs = {0};
+    double m_hashes = 0;  // Worth of the accepted shares. Guarded by x_work
 };